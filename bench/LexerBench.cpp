@@ -0,0 +1,148 @@
+//===----------------------------------------------------------------------===//
+// LexerBench.cpp: Lexer microbenchmark, measures identifiers lexed per second
+// with the keyword table lookup the lexer used to do and with the in place
+// keyword recognition it does now. Also measures the lexing throughput with
+// each set of scanning kernels and with parallel lexing.
+//===----------------------------------------------------------------------===//
+#include "fmt/core.h"
+
+#include "JSLexer.h"
+#include "JSToken.h"
+#include "ParallelLexer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace minijsc;
+
+namespace {
+
+/// Number of times each measurement is repeated.
+constexpr size_t kRounds = 20;
+
+/// Build a source mixing keywords and identifiers, roughly the ratio found
+/// in function bodies.
+auto makeSource(size_t lines) -> std::string {
+    static const std::vector<std::string_view> words = {
+        "var",   "counter", "function", "fib",    "return", "index",
+        "while", "value",   "if",       "result", "else",   "total",
+        "for",   "item",    "true",     "length", "null",   "accumulator",
+    };
+    std::string source;
+    for (size_t line = 0; line < lines; line++) {
+        for (const auto& word : words) {
+            source.append(word);
+            source.push_back(' ');
+        }
+        source.push_back('\n');
+    }
+    return source;
+}
+
+/// Build a source shaped like generated code, indented lines with long
+/// identifiers, long numbers and string literals.
+auto makeGeneratedSource(size_t lines) -> std::string {
+    std::string source;
+    for (size_t line = 0; line < lines; line++) {
+        source.append("                var generated_module_binding_");
+        source.append(std::to_string(line));
+        source.append(" = \"generated string contents for entry ");
+        source.append(std::to_string(line));
+        source.append("\" + 1234567890123.25;\n");
+    }
+    return source;
+}
+
+/// Run `body` kRounds times and return the best time in seconds.
+template <typename Body> auto measure(Body body) -> double {
+    auto best = std::chrono::duration<double>::max();
+    for (size_t round = 0; round < kRounds; round++) {
+        auto begin = std::chrono::steady_clock::now();
+        body();
+        auto elapsed = std::chrono::steady_clock::now() - begin;
+        best         = std::min<std::chrono::duration<double>>(best, elapsed);
+    }
+    return best.count();
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    size_t lines = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    auto source  = makeSource(lines);
+
+    // Split the source into words once so the lookups are measured alone.
+    std::vector<std::string_view> words;
+    auto lexer  = JSLexer(source);
+    auto tokens = lexer.scanTokens();
+    for (const auto& token : tokens) {
+        if (token.getKind() != JSTokenKind::Eof) {
+            words.push_back(token.getLexeme());
+        }
+    }
+
+    size_t keywords = 0;
+    auto table      = measure([&] {
+        for (const auto& word : words) {
+            keywords += jsKeywords.contains(std::string(word));
+        }
+    });
+    auto inPlace    = measure([&] {
+        for (const auto& word : words) {
+            keywords += lookupKeyword(word) != JSTokenKind::Identifier;
+        }
+    });
+
+    auto rate = [&](double seconds) { return words.size() / seconds / 1e6; };
+    fmt::print("{} words ({} bytes)\n", words.size(), source.size());
+    fmt::print("keyword table lookup   {:8.1f} M identifiers/s\n", rate(table));
+    fmt::print("keyword switch lookup  {:8.1f} M identifiers/s\n",
+               rate(inPlace));
+
+    static const std::vector<std::pair<ScanIsa, const char*>> isas = {
+        {ScanIsa::Scalar, "scalar"},
+        {ScanIsa::SSE2, "sse2"},
+        {ScanIsa::AVX2, "avx2"},
+    };
+    for (const auto& [isa, name] : isas) {
+        if (!isScanIsaSupported(isa)) {
+            continue;
+        }
+        auto lexing = measure([&] {
+            auto lexer = JSLexer(source, isa);
+            keywords += lexer.scanTokens().size();
+        });
+        fmt::print("full lexing ({:6})   {:8.1f} M identifiers/s {:8.1f} "
+                   "MB/s\n",
+                   name, rate(lexing), source.size() / lexing / 1e6);
+    }
+
+    auto generated = makeGeneratedSource(lines);
+    fmt::print("generated code ({} bytes)\n", generated.size());
+    for (const auto& [isa, name] : isas) {
+        if (!isScanIsaSupported(isa)) {
+            continue;
+        }
+        auto lexing = measure([&] {
+            auto lexer = JSLexer(generated, isa);
+            keywords += lexer.scanTokens().size();
+        });
+        fmt::print("full lexing ({:6})   {:8.1f} MB/s\n", name,
+                   generated.size() / lexing / 1e6);
+    }
+    auto workers  = std::max(std::thread::hardware_concurrency(), 1U);
+    auto parallel = measure([&] {
+        keywords += lexParallel(generated, workers).size();
+    });
+    fmt::print("parallel lexing ({} threads) {:8.1f} MB/s\n", workers,
+               generated.size() / parallel / 1e6);
+    // Keep the counts observable so the loops aren't optimized away.
+    return keywords == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
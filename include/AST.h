@@ -10,9 +10,14 @@
 #ifndef AST_H
 #define AST_H
 #include <cstddef>
+#include <functional>
 #include <memory>
+#include <span>
+#include <string_view>
 #include <utility>
+#include <vector>
 
+#include "ASTArena.h"
 #include "JSToken.h"
 #include "JSValue.h"
 
@@ -38,6 +43,8 @@ class JSWhileStmt;
 class JSForStmt;
 class JSFuncDecl;
 class JSReturnStmt;
+class JSBreakStmt;
+class JSContinueStmt;
 
 /// ASTVisitor interface provides a way to have encapsulate the AST traversal
 /// by an AST consumer. There are three AST consumers defined currently
@@ -56,10 +63,10 @@ class JSReturnStmt;
 /// bytecode the value returned is practically useless.
 ///
 /// Now since the visitors don't return values how will the interpreter
-/// do expression evaluation ? Well we can use a value stack, every time
-/// we visit an expression we push the value it returns into the value
-/// stack and pop it back in the evaluate function after the call to
-/// `accept`.
+/// do expression evaluation ? Every time we visit an expression the value
+/// it produces is stored in the interpreter's value register and moved out
+/// in the evaluate function after the call to `accept`. Values are returned
+/// by value so evaluation never allocates for primitives.
 class ASTVisitor {
     public:
     virtual ~ASTVisitor()                                        = default;
@@ -72,6 +79,8 @@ class ASTVisitor {
     virtual auto visitAssignExpr(JSAssignExpr* expr) -> void     = 0;
     virtual auto visitCallExpr(JSCallExpr* expr) -> void         = 0;
     virtual auto visitReturnStmt(JSReturnStmt* stmt) -> void     = 0;
+    virtual auto visitBreakStmt(JSBreakStmt* stmt) -> void       = 0;
+    virtual auto visitContinueStmt(JSContinueStmt* stmt) -> void = 0;
     virtual auto visitBlockStmt(JSBlockStmt* stmt) -> void       = 0;
     virtual auto visitExprStmt(JSExprStmt* stmt) -> void         = 0;
     virtual auto visitIfStmt(JSIfStmt* stmt) -> void             = 0;
@@ -113,6 +122,10 @@ enum class ASTNodeKind {
     ForStmt,
     // Return statement.
     ReturnStmt,
+    // Break statement.
+    BreakStmt,
+    // Continue statement.
+    ContinueStmt,
     // Function declaration.
     FuncDecl,
 };
@@ -150,38 +163,52 @@ inline auto astNodeKindToString(ASTNodeKind kind) -> std::string {
         return "ForStmt";
     case ASTNodeKind::ReturnStmt:
         return "ReturnStmt";
+    case ASTNodeKind::BreakStmt:
+        return "BreakStmt";
+    case ASTNodeKind::ContinueStmt:
+        return "ContinueStmt";
     case ASTNodeKind::FuncDecl:
         return "FuncDecl";
     }
 }
 
 /// AST node interface encapsulates both expressions and statements.
+///
+/// Nodes are allocated in an `ASTArena` (see ASTArena.h) and never deleted
+/// through a base pointer, the destructor isn't virtual so that nodes only
+/// holding tokens and children are trivially destructible.
 class ASTNode {
     public:
-    ASTNode()          = default;
-    virtual ~ASTNode() = default;
+    ASTNode() = default;
+
+    protected:
+    ~ASTNode() = default;
 };
 
 /// Expression base interface, the AST is built and evaluated using the visitor
 /// pattern. The base JSExpr type defines all possible JavaScript expressions
 /// each consumer of the AST defines the behavior of how a JSExpr is processed.
-class JSExpr : public ASTNode, public std::enable_shared_from_this<JSExpr> {
+class JSExpr : public ASTNode {
     public:
-    JSExpr()           = default;
-    ~JSExpr() override = default;
+    JSExpr() = default;
 
     virtual auto getKind() -> ASTNodeKind            = 0;
     virtual auto accept(ASTVisitor* visitor) -> void = 0;
+
+    protected:
+    ~JSExpr() = default;
 };
 
 /// Statement base interface that defines all possible JavaScript statements.
-class JSStmt : public ASTNode, public std::enable_shared_from_this<JSStmt> {
+class JSStmt : public ASTNode {
     public:
-    JSStmt()           = default;
-    ~JSStmt() override = default;
+    JSStmt() = default;
 
     virtual auto getKind() -> ASTNodeKind            = 0;
     virtual auto accept(ASTVisitor* visitor) -> void = 0;
+
+    protected:
+    ~JSStmt() = default;
 };
 
 /// Expression statements, are statements that invoke or execute expressions.
@@ -191,21 +218,22 @@ class JSExprStmt : public JSStmt {
     public:
     // Expression statement constructor takes an expression and associates
     // it to a astatement.
-    explicit JSExprStmt(std::shared_ptr<JSExpr> expr) : expr(std::move(expr)) {}
+    explicit JSExprStmt(JSExpr* expr) : expr(expr) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::ExprStmt; }
 
     // Return the internal expression.
-    auto getExpr() -> std::shared_ptr<JSExpr> { return expr; }
+    auto getExpr() -> JSExpr* { return expr; }
+
+    auto setExpr(JSExpr* rewritten) -> void { expr = rewritten; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSExprStmt::accept\n");
         return visitor->visitExprStmt(static_cast<JSExprStmt*>(this));
     }
 
     private:
     // Expression associated to the statement.
-    std::shared_ptr<JSExpr> expr;
+    JSExpr* expr;
 };
 
 /// Return statements return a value to the caller.
@@ -213,23 +241,67 @@ class JSReturnStmt : public JSStmt {
     public:
     // Return statement constructor takes the returned value name
     // and the expression to return.
-    explicit JSReturnStmt(JSToken keyword, std::shared_ptr<JSExpr> value)
-        : keyword(std::move(keyword)), value(std::move(value)) {}
+    explicit JSReturnStmt(JSToken keyword, JSExpr* value)
+        : keyword(std::move(keyword)), value(value) {}
 
     auto getKeyword() -> JSToken { return keyword; }
 
-    auto getValue() -> std::shared_ptr<JSExpr> { return value; }
+    auto getValue() -> JSExpr* { return value; }
+
+    auto setValue(JSExpr* rewritten) -> void { value = rewritten; }
+
+    // Check if the returned value is a call in tail position, such calls
+    // can reuse the frame of the returning function.
+    auto isTailCall() -> bool {
+        return value != nullptr && value->getKind() == ASTNodeKind::CallExpr;
+    }
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::ReturnStmt; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSReturnStmt::accept\n");
         return visitor->visitReturnStmt(static_cast<JSReturnStmt*>(this));
     }
 
     private:
     JSToken keyword;
-    std::shared_ptr<JSExpr> value;
+    JSExpr* value;
+};
+
+/// Break statements exit the innermost enclosing loop.
+class JSBreakStmt : public JSStmt {
+    public:
+    explicit JSBreakStmt(JSToken keyword) : keyword(std::move(keyword)) {}
+
+    auto getKeyword() -> JSToken { return keyword; }
+
+    auto getKind() -> ASTNodeKind override { return ASTNodeKind::BreakStmt; }
+
+    auto accept(ASTVisitor* visitor) -> void override {
+        return visitor->visitBreakStmt(static_cast<JSBreakStmt*>(this));
+    }
+
+    private:
+    JSToken keyword;
+};
+
+/// Continue statements skip to the next iteration of the innermost
+/// enclosing loop.
+class JSContinueStmt : public JSStmt {
+    public:
+    explicit JSContinueStmt(JSToken keyword) : keyword(std::move(keyword)) {}
+
+    auto getKeyword() -> JSToken { return keyword; }
+
+    auto getKind() -> ASTNodeKind override {
+        return ASTNodeKind::ContinueStmt;
+    }
+
+    auto accept(ASTVisitor* visitor) -> void override {
+        return visitor->visitContinueStmt(static_cast<JSContinueStmt*>(this));
+    }
+
+    private:
+    JSToken keyword;
 };
 
 /// Block statements, are blocks of statements to execute. Block statements
@@ -238,21 +310,21 @@ class JSBlockStmt : public JSStmt {
     public:
     // Block statement constructor takes a sequence of statements and associates
     // it to a block.
-    explicit JSBlockStmt(std::vector<std::shared_ptr<JSStmt>> stmts)
-        : stmts(std::move(stmts)) {}
+    explicit JSBlockStmt(std::span<JSStmt*> stmts) : stmts(stmts) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::BlockStmt; }
 
-    auto getStmts() -> std::vector<std::shared_ptr<JSStmt>> { return stmts; }
+    auto getStmts() -> std::span<JSStmt*> { return stmts; }
+
+    auto setStmts(std::span<JSStmt*> rewritten) -> void { stmts = rewritten; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSBlockStmt::accept\n");
         return visitor->visitBlockStmt(static_cast<JSBlockStmt*>(this));
     }
 
     private:
     // Statements associated to the block.
-    std::vector<std::shared_ptr<JSStmt>> stmts;
+    std::span<JSStmt*> stmts;
 };
 
 /// If statements for conditional branching.
@@ -261,34 +333,36 @@ class JSIfStmt : public JSStmt {
     // If statement constructor takes the conditional expression and the branch
     // statements to execute. For `If` statements we only require the block
     // statement for the branch that follows, the else branch will be optional.
-    explicit JSIfStmt(std::shared_ptr<JSExpr> expr,
-                      std::shared_ptr<JSStmt> thenBranch,
-                      std::shared_ptr<JSStmt> elseBranch)
-        : condition(std::move(expr)), thenBranch(std::move(thenBranch)),
-          elseBranch(std::move(elseBranch)) {}
+    explicit JSIfStmt(JSExpr* expr, JSStmt* thenBranch, JSStmt* elseBranch)
+        : condition(expr), thenBranch(thenBranch), elseBranch(elseBranch) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::IfStmt; }
 
-    auto getCondition() -> std::shared_ptr<JSExpr> { return condition; }
+    auto getCondition() -> JSExpr* { return condition; }
+
+    auto setCondition(JSExpr* rewritten) -> void { condition = rewritten; }
+
+    auto getThenBranch() -> JSStmt* { return thenBranch; }
 
-    auto getThenBranch() -> std::shared_ptr<JSStmt> { return thenBranch; }
+    auto getElseBranch() -> JSStmt* { return elseBranch; }
 
-    auto getElseBranch() -> std::shared_ptr<JSStmt> { return elseBranch; }
+    auto setThenBranch(JSStmt* rewritten) -> void { thenBranch = rewritten; }
+
+    auto setElseBranch(JSStmt* rewritten) -> void { elseBranch = rewritten; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSIfStmt::accept\n");
         return visitor->visitIfStmt(static_cast<JSIfStmt*>(this));
     }
 
     private:
     // Expression for the conditional branch.
-    std::shared_ptr<JSExpr> condition;
+    JSExpr* condition;
     // Then branch statement, executed in case the conditional expression
     // evaluates to true.
-    std::shared_ptr<JSStmt> thenBranch;
+    JSStmt* thenBranch;
     // Else branch statement, executed in case the conditional expression
     // evalutes to false.
-    std::shared_ptr<JSStmt> elseBranch;
+    JSStmt* elseBranch;
 };
 
 /// While statements for looping control flow.
@@ -296,26 +370,28 @@ class JSWhileStmt : public JSStmt {
     public:
     // While statement constructor takes the conditional expression and
     // the block to execute if it evaluates to true.
-    explicit JSWhileStmt(std::shared_ptr<JSExpr> expr,
-                         std::shared_ptr<JSStmt> stmt)
-        : condition(std::move(expr)), body(std::move(stmt)) {}
+    explicit JSWhileStmt(JSExpr* expr, JSStmt* stmt)
+        : condition(expr), body(stmt) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::WhileStmt; }
 
-    auto getCondition() -> std::shared_ptr<JSExpr> { return condition; }
+    auto getCondition() -> JSExpr* { return condition; }
+
+    auto setCondition(JSExpr* rewritten) -> void { condition = rewritten; }
+
+    auto getBody() -> JSStmt* { return body; }
 
-    auto getBody() -> std::shared_ptr<JSStmt> { return body; }
+    auto setBody(JSStmt* rewritten) -> void { body = rewritten; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSWhileStmt::accept\n");
         return visitor->visitWhileStmt(static_cast<JSWhileStmt*>(this));
     }
 
     private:
     // Expression for the conditional branch.
-    std::shared_ptr<JSExpr> condition;
+    JSExpr* condition;
     // Block statement to execute in case the expression evaluates to true.
-    std::shared_ptr<JSStmt> body;
+    JSStmt* body;
 };
 
 // For statements for loops.
@@ -323,37 +399,44 @@ class JSForStmt : public JSStmt {
     public:
     // For statement constructor takes the initializer, stopping condition
     // and the step expression. Finally the body of the loop.
-    explicit JSForStmt(std::shared_ptr<JSStmt> initializer,
-                       std::shared_ptr<JSExpr> condition,
-                       std::shared_ptr<JSExpr> step,
-                       std::shared_ptr<JSStmt> body)
-        : initializer(std::move(initializer)), condition(std::move(condition)),
-          step(std::move(step)), body(std::move(body)) {}
+    explicit JSForStmt(JSStmt* initializer, JSExpr* condition, JSExpr* step,
+                       JSStmt* body)
+        : initializer(initializer), condition(condition), step(step),
+          body(body) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::ForStmt; }
 
-    auto getInitializer() -> std::shared_ptr<JSStmt> { return initializer; }
+    auto getInitializer() -> JSStmt* { return initializer; }
+
+    auto setInitializer(JSStmt* rewritten) -> void {
+        initializer = rewritten;
+    }
 
-    auto getCondition() -> std::shared_ptr<JSExpr> { return condition; }
+    auto getCondition() -> JSExpr* { return condition; }
 
-    auto getStep() -> std::shared_ptr<JSExpr> { return step; }
+    auto setCondition(JSExpr* rewritten) -> void { condition = rewritten; }
 
-    auto getBody() -> std::shared_ptr<JSStmt> { return body; }
+    auto getStep() -> JSExpr* { return step; }
+
+    auto setStep(JSExpr* rewritten) -> void { step = rewritten; }
+
+    auto getBody() -> JSStmt* { return body; }
+
+    auto setBody(JSStmt* rewritten) -> void { body = rewritten; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSForStmt::accept\n");
         return visitor->visitForStmt(static_cast<JSForStmt*>(this));
     }
 
     private:
     // Expression for the initializer, which can be null.
-    std::shared_ptr<JSStmt> initializer;
+    JSStmt* initializer;
     // Expression for the stopping condition.
-    std::shared_ptr<JSExpr> condition;
+    JSExpr* condition;
     // Expression for the step.
-    std::shared_ptr<JSExpr> step;
+    JSExpr* step;
     // Body of the loop.
-    std::shared_ptr<JSStmt> body;
+    JSStmt* body;
 };
 
 /// Variable declarations are statements that create runtime bindings
@@ -362,27 +445,31 @@ class JSVarDecl : public JSStmt {
     public:
     // Variable statement constructor takes a variable name and an optional
     // initializer.
-    explicit JSVarDecl(JSToken name) : name(std::move(name)) {}
+    explicit JSVarDecl(JSToken name)
+        : name(std::move(name)), initializer(nullptr) {}
 
-    explicit JSVarDecl(JSToken name, std::shared_ptr<JSExpr> expr)
-        : name(std::move(name)), initializer(std::move(expr)) {}
+    explicit JSVarDecl(JSToken name, JSExpr* expr)
+        : name(std::move(name)), initializer(expr) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::VarDecl; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSVarDecl::accept\n");
         return visitor->visitVarDecl(static_cast<JSVarDecl*>(this));
     }
 
-    auto getName() -> std::string { return name.getLexeme(); }
+    auto getName() -> std::string_view { return name.getLexeme(); }
 
-    auto getInitializer() -> std::shared_ptr<JSExpr> { return initializer; }
+    auto getInitializer() -> JSExpr* { return initializer; }
+
+    auto setInitializer(JSExpr* rewritten) -> void {
+        initializer = rewritten;
+    }
 
     private:
     // Variable name.
     JSToken name;
     // Initializing expression.
-    std::shared_ptr<JSExpr> initializer;
+    JSExpr* initializer;
 };
 
 /// Variable expressions, are expressions which return the value bound to
@@ -397,11 +484,10 @@ class JSVarExpr : public JSExpr {
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::VarExpr; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSVarExpr::accept\n");
         return visitor->visitVarExpr(static_cast<JSVarExpr*>(this));
     }
 
-    auto getName() -> JSToken { return name; }
+    auto getName() -> const JSToken& { return name; }
 
     private:
     JSToken name;
@@ -411,55 +497,112 @@ class JSVarExpr : public JSExpr {
 /// functions.
 class JSFuncDecl : public JSStmt {
     public:
-    /// Constructor takes the function name, parameters and statement for the body.
-    explicit JSFuncDecl(JSToken name, std::vector<JSToken> params,
-                        std::shared_ptr<JSBlockStmt> body)
-        : name(std::move(name)), params(std::move(params)),
-          body(std::move(body)) {}
+    /// Constructor takes the function name, parameters and statement for the
+    /// body. Parameter names are precomputed once, calls bind them directly
+    /// to the argument slots of the function's frame.
+    explicit JSFuncDecl(JSToken name, std::span<JSToken> params,
+                        std::span<std::string_view> paramNames,
+                        JSBlockStmt* body)
+        : name(std::move(name)), params(params), paramNames(paramNames),
+          body(body) {}
+
+    /// Constructor for functions whose body was only pre-parsed, the body
+    /// is the source text from the opening brace to the closing one. It is
+    /// parsed into `arena` the first time it is needed.
+    explicit JSFuncDecl(JSToken name, std::span<JSToken> params,
+                        std::span<std::string_view> paramNames,
+                        std::string_view bodySource, ASTArena* arena)
+        : name(std::move(name)), params(params), paramNames(paramNames),
+          bodySource(bodySource), arena(arena), body(nullptr) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::FuncDecl; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSFuncDecl::accept\n");
         return visitor->visitFuncDecl(static_cast<JSFuncDecl*>(this));
     }
 
-    auto getParams() -> std::vector<JSToken> { return params; }
+    auto getParams() -> std::span<JSToken> { return params; }
+
+    auto getParamNames() -> std::span<std::string_view> { return paramNames; }
+
+    auto getName() -> const JSToken& { return name; }
+
+    // Return the function body, parsing it if it was only pre-parsed.
+    auto getBody() -> JSBlockStmt* {
+        if (body == nullptr) {
+            parseBody();
+        }
+        return body;
+    }
+
+    // Check if the body was parsed, functions that are never called keep
+    // their body unparsed when parsing lazily.
+    [[nodiscard]] auto isBodyParsed() const -> bool { return body != nullptr; }
 
-    auto getName() -> JSToken { return name; }
+    // Return the source text of a pre-parsed body.
+    [[nodiscard]] auto getBodySource() const -> std::string_view {
+        return bodySource;
+    }
+
+    // Set the body of a pre-parsed function parsed elsewhere, the arena
+    // the body was parsed in must outlive the declaration.
+    auto setBody(JSBlockStmt* parsed) -> void { body = parsed; }
+
+    // Check if the function was marked pure by the purity analysis.
+    [[nodiscard]] auto isPure() const -> bool { return pure; }
+
+    auto setPure(bool value) -> void { pure = value; }
+
+    // Check if calls to the function are memoized.
+    [[nodiscard]] auto isMemoized() const -> bool { return memoized; }
 
-    auto getBody() -> std::shared_ptr<JSBlockStmt> { return body; }
+    auto setMemoized(bool value) -> void { memoized = value; }
 
     private:
     /// Function name.
     JSToken name;
+    /// Function parameters.
+    std::span<JSToken> params;
     /// Function parameter names.
-    std::vector<JSToken> params;
-    /// Function body.
-    std::shared_ptr<JSBlockStmt> body;
+    std::span<std::string_view> paramNames;
+    /// Whether the function only depends on its arguments and has no side
+    /// effects (see `PurityAnalyzer`).
+    bool pure = false;
+    /// Whether the results of calls are cached in a memo table.
+    bool memoized = false;
+    /// Source text of the body when it was only pre-parsed.
+    std::string_view bodySource;
+    /// Arena the pre-parsed body is parsed into.
+    ASTArena* arena = nullptr;
+    /// Function body, nullptr until a pre-parsed body is parsed.
+    JSBlockStmt* body;
+
+    /// Parse the pre-parsed body, defined by the parser.
+    auto parseBody() -> void;
 };
 
 /// Assignment expressions, are expressions which after evaluation are bound
 /// to a variable.
 class JSAssignExpr : public JSExpr {
     public:
-    explicit JSAssignExpr(JSToken name, std::shared_ptr<JSExpr> value)
-        : name(std::move(name)), value(std::move(value)) {}
+    explicit JSAssignExpr(JSToken name, JSExpr* value)
+        : name(std::move(name)), value(value) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::AssignExpr; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSAssignExpr::accept\n");
         return visitor->visitAssignExpr(static_cast<JSAssignExpr*>(this));
     }
 
-    auto getName() -> JSToken { return name; }
+    auto getName() -> const JSToken& { return name; }
 
-    auto getValue() -> std::shared_ptr<JSExpr> { return value; }
+    auto getValue() -> JSExpr* { return value; }
+
+    auto setValue(JSExpr* rewritten) -> void { value = rewritten; }
 
     private:
     JSToken name;
-    std::shared_ptr<JSExpr> value;
+    JSExpr* value;
 };
 
 /// Binary expressions, are expressions that encapsulate binary operations.
@@ -467,29 +610,30 @@ class JSBinExpr : public JSExpr {
     public:
     /// Binary expression constructor takes both sides of the expression
     /// and their operand.
-    explicit JSBinExpr(std::shared_ptr<JSExpr> left, JSToken binOp,
-                       std::shared_ptr<JSExpr> right)
-        : left(std::move(left)), right(std::move(right)),
-          binOp(std::move(binOp)) {}
+    explicit JSBinExpr(JSExpr* left, JSToken binOp, JSExpr* right)
+        : left(left), right(right), binOp(std::move(binOp)) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::BinaryExpr; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSBinaryExpr::accept\n");
         return visitor->visitBinaryExpr(static_cast<JSBinExpr*>(this));
     }
 
-    auto getLeft() -> std::shared_ptr<JSExpr> { return left; }
+    auto getLeft() -> JSExpr* { return left; }
+
+    auto getRight() -> JSExpr* { return right; }
+
+    auto setLeft(JSExpr* rewritten) -> void { left = rewritten; }
 
-    auto getRight() -> std::shared_ptr<JSExpr> { return right; }
+    auto setRight(JSExpr* rewritten) -> void { right = rewritten; }
 
-    auto getOperator() -> JSToken { return binOp; }
+    auto getOperator() -> const JSToken& { return binOp; }
 
     private:
     // Left handside of the binary operation.
-    std::shared_ptr<JSExpr> left;
+    JSExpr* left;
     // Right handside of the binary operation.
-    std::shared_ptr<JSExpr> right;
+    JSExpr* right;
     // Binary operator.
     JSToken binOp;
 };
@@ -498,125 +642,198 @@ class JSBinExpr : public JSExpr {
 class JSUnaryExpr : public JSExpr {
     public:
     // Unary expression constructor.
-    explicit JSUnaryExpr(JSToken unaryOp, std::shared_ptr<JSExpr> right)
-        : unaryOp(std::move(unaryOp)), right(std::move(right)) {}
+    explicit JSUnaryExpr(JSToken unaryOp, JSExpr* right)
+        : unaryOp(std::move(unaryOp)), right(right) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::UnaryExpr; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSUnaryExpr::accept\n");
         return visitor->visitUnaryExpr(static_cast<JSUnaryExpr*>(this));
     }
 
-    auto getRight() -> std::shared_ptr<JSExpr> { return right; }
+    auto getRight() -> JSExpr* { return right; }
 
-    auto getOperator() -> JSToken { return unaryOp; }
+    auto setRight(JSExpr* rewritten) -> void { right = rewritten; }
+
+    auto getOperator() -> const JSToken& { return unaryOp; }
 
     private:
     // Unary operator.
     JSToken unaryOp;
     // Right handside of the unary expression.
-    std::shared_ptr<JSExpr> right;
+    JSExpr* right;
 };
 
 //  expressions, are expressions that encapsulate unary operations.
 class JSLogicalExpr : public JSExpr {
     public:
     // Logical expression constructor.
-    explicit JSLogicalExpr(JSToken logicalOp, std::shared_ptr<JSExpr> left,
-                           std::shared_ptr<JSExpr> right)
-        : logicalOp(std::move(logicalOp)), right(std::move(right)),
-          left(std::move(left)) {}
+    explicit JSLogicalExpr(JSToken logicalOp, JSExpr* left, JSExpr* right)
+        : logicalOp(std::move(logicalOp)), right(right), left(left) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::LogicalExpr; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSLogicalExpr::accept\n");
         return visitor->visitLogicalExpr(static_cast<JSLogicalExpr*>(this));
     }
 
-    auto getOperator() -> JSToken { return logicalOp; }
+    auto getOperator() -> const JSToken& { return logicalOp; }
+
+    auto getLeft() -> JSExpr* { return left; }
 
-    auto getLeft() -> std::shared_ptr<JSExpr> { return left; }
+    auto getRight() -> JSExpr* { return right; }
 
-    auto getRight() -> std::shared_ptr<JSExpr> { return right; }
+    auto setLeft(JSExpr* rewritten) -> void { left = rewritten; }
+
+    auto setRight(JSExpr* rewritten) -> void { right = rewritten; }
 
     private:
     // Logical operator.
     JSToken logicalOp;
     // Right handside of the unary expression.
-    std::shared_ptr<JSExpr> right;
+    JSExpr* right;
     // Left handside of the unary expression.
-    std::shared_ptr<JSExpr> left;
+    JSExpr* left;
 };
 
 // Call expressions, are expressions that return a value from a function call.
 class JSCallExpr : public JSExpr {
     public:
     // Call expression constructor.
-    explicit JSCallExpr(std::shared_ptr<JSExpr> callee, JSToken paren,
-                        std::vector<std::shared_ptr<JSExpr>> arguments)
-        : callee(std::move(callee)), paren(std::move(paren)),
-          arguments(std::move(arguments)) {}
+    explicit JSCallExpr(JSExpr* callee, JSToken paren,
+                        std::span<JSExpr*> arguments)
+        : callee(callee), paren(std::move(paren)), arguments(arguments) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::CallExpr; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSCallExpr::accept\n");
         return visitor->visitCallExpr(static_cast<JSCallExpr*>(this));
     }
 
-    auto getCallee() -> std::shared_ptr<JSExpr> { return callee; }
+    auto getCallee() -> JSExpr* { return callee; }
+
+    auto getParen() -> const JSToken& { return paren; }
 
-    auto getArgs() -> std::vector<std::shared_ptr<JSExpr>> { return arguments; }
+    auto getArgs() -> const std::span<JSExpr*>& {
+        return arguments;
+    }
 
     private:
     // Callee expression.
-    std::shared_ptr<JSExpr> callee;
+    JSExpr* callee;
     // Parenthesized token.
     JSToken paren;
     // Arguments list, which is optional.
-    std::vector<std::shared_ptr<JSExpr>> arguments;
+    std::span<JSExpr*> arguments;
 };
 
 // Literal expressions, are expressions that return a value literal.
 class JSLiteralExpr : public JSExpr {
     public:
-    // Constructor takes a JSValue.
-    explicit JSLiteralExpr(std::shared_ptr<JSValue> value)
-        : value(std::move(value)) {}
+    // Constructor takes the literal value.
+    explicit JSLiteralExpr(JSBasicValue value) : value(std::move(value)) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::LiteralExpr; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSLiteralExpr::accept\n");
         return visitor->visitLiteralExpr(static_cast<JSLiteralExpr*>(this));
     }
 
-    auto getValue() -> std::shared_ptr<JSValue> { return value; }
+    auto getValue() -> const JSBasicValue& { return value; }
 
     private:
-    std::shared_ptr<JSValue> value;
+    JSBasicValue value;
 };
 
 // Grouping expressions,are expressions enclosed in parentheses overloading
 // the default precdence rules.
 class JSGroupingExpr : public JSExpr {
     public:
-    explicit JSGroupingExpr(std::shared_ptr<JSExpr> expression)
-        : expr(std::move(expression)) {}
+    explicit JSGroupingExpr(JSExpr* expression) : expr(expression) {}
 
     auto getKind() -> ASTNodeKind override { return ASTNodeKind::GroupingExpr; }
 
     auto accept(ASTVisitor* visitor) -> void override {
-        fmt::print("JSGroupingExpr::accept\n");
         return visitor->visitGroupingExpr(static_cast<JSGroupingExpr*>(this));
     }
 
-    auto getExpr() -> std::shared_ptr<JSExpr> { return expr; }
+    auto getExpr() -> JSExpr* { return expr; }
+
+    auto setExpr(JSExpr* rewritten) -> void { expr = rewritten; }
+
+    private:
+    JSExpr* expr;
+};
+
+/// Check if `text` is a non empty view into `source`, such as the lexeme of
+/// a token scanned from it.
+inline auto isWithin(std::string_view text, std::string_view source)
+    -> bool {
+    std::less_equal<const char*> lessEqual;
+    return !text.empty() && lessEqual(source.data(), text.data()) &&
+           lessEqual(text.data() + text.size(),
+                     source.data() + source.size());
+}
+
+/// JSProgram is the output of the parser, it holds the top level statements
+/// of a program and owns the arena of its syntax tree. Nodes are valid as
+/// long as the program and the source it was parsed from are alive.
+class JSProgram {
+    public:
+    /// Constructor takes the arena the statements were allocated in and
+    /// optionally the source text of each statement.
+    explicit JSProgram(std::unique_ptr<ASTArena> arena,
+                       std::vector<JSStmt*> stmts,
+                       std::vector<std::string_view> sources = {})
+        : arena(std::move(arena)), stmts(std::move(stmts)),
+          sources(std::move(sources)) {}
+
+    /// Return the top level statements.
+    [[nodiscard]] auto getStmts() const -> const std::vector<JSStmt*>& {
+        return stmts;
+    }
+
+    /// Return the source text of each top level statement, from its first
+    /// token to its last one. Empty for programs not parsed from source.
+    [[nodiscard]] auto getSources() const
+        -> const std::vector<std::string_view>& {
+        return sources;
+    }
+
+    /// Replace the top level statements with the ones of a rewritten
+    /// program, the source text of the statements is dropped.
+    auto setStmts(std::vector<JSStmt*> rewritten) -> void {
+        stmts = std::move(rewritten);
+        sources.clear();
+    }
+
+    /// Return the arena owning the syntax tree, passes rewriting the tree
+    /// allocate their nodes in it.
+    auto getArena() -> ASTArena& { return *arena; }
+
+    /// Take ownership of an arena holding parts of the syntax tree, such as
+    /// function bodies parsed on other threads.
+    auto adoptArena(std::unique_ptr<ASTArena> other) -> void {
+        adopted.push_back(std::move(other));
+    }
+
+    /// Programs are ranges of statements.
+    [[nodiscard]] auto begin() const { return stmts.begin(); }
+    [[nodiscard]] auto end() const { return stmts.end(); }
+    [[nodiscard]] auto data() const -> JSStmt* const* { return stmts.data(); }
+    [[nodiscard]] auto size() const -> size_t { return stmts.size(); }
+    [[nodiscard]] auto empty() const -> bool { return stmts.empty(); }
+    auto operator[](size_t idx) const -> JSStmt* { return stmts[idx]; }
 
     private:
-    std::shared_ptr<JSExpr> expr;
+    /// Arena owning the syntax tree.
+    std::unique_ptr<ASTArena> arena;
+    /// Top level statements.
+    std::vector<JSStmt*> stmts;
+    /// Source text of the top level statements.
+    std::vector<std::string_view> sources;
+    /// Arenas owning the parts of the syntax tree parsed separately.
+    std::vector<std::unique_ptr<ASTArena>> adopted;
 };
 
 } // namespace minijsc
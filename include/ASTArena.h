@@ -0,0 +1,104 @@
+//===----------------------------------------------------------------------===//
+// ASTArena.h: This header defines the arena the syntax tree is allocated in.
+//
+// Nodes and the arrays of their children are bump allocated in large chunks
+// and freed all at once when the arena is destroyed. Nodes reference their
+// children with plain pointers, they are laid out in the order the parser
+// creates them so traversals walk mostly contiguous memory. Only nodes that
+// aren't trivially destructible (e.g. literals holding strings) have their
+// destructor registered and run when the arena is freed.
+//===----------------------------------------------------------------------===//
+#ifndef AST_ARENA_H
+#define AST_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace minijsc {
+
+/// Size of the chunks the arena allocates from.
+static constexpr size_t kArenaChunkSize = 64 * 1024;
+
+/// ASTArena owns the nodes of a syntax tree.
+class ASTArena {
+    public:
+    ASTArena() = default;
+    ASTArena(const ASTArena&)                    = delete;
+    auto operator=(const ASTArena&) -> ASTArena& = delete;
+
+    ~ASTArena();
+
+    /// Construct a node in the arena.
+    template <typename Node, typename... Args>
+    auto make(Args&&... args) -> Node* {
+        auto* node = new (allocate(sizeof(Node), alignof(Node)))
+            Node(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<Node>) {
+            destructors.push_back(
+                {node, [](void* ptr) { static_cast<Node*>(ptr)->~Node(); }});
+        }
+        nodes++;
+        return node;
+    }
+
+    /// Copy an array of trivially destructible values (e.g. children
+    /// pointers or tokens) in the arena.
+    template <typename T> auto copy(std::span<const T> values) -> std::span<T> {
+        static_assert(std::is_trivially_destructible_v<T>,
+                      "arena arrays are never destroyed");
+        if (values.empty()) {
+            return {};
+        }
+        auto* data = static_cast<T*>(
+            allocate(values.size_bytes(), alignof(T)));
+        std::uninitialized_copy(values.begin(), values.end(), data);
+        return {data, values.size()};
+    }
+
+    /// Copy a vector in the arena.
+    template <typename T>
+    auto copy(const std::vector<T>& values) -> std::span<T> {
+        return copy(std::span<const T>(values));
+    }
+
+    /// Return the number of nodes allocated.
+    [[nodiscard]] auto getNodeCount() const -> size_t { return nodes; }
+
+    /// Return the number of bytes reserved by the arena.
+    [[nodiscard]] auto getReservedBytes() const -> size_t { return reserved; }
+
+    private:
+    /// Allocate `size` bytes aligned to `align` from the current chunk,
+    /// starting a new chunk when it is exhausted.
+    auto allocate(size_t size, size_t align) -> void*;
+
+    /// A registered destructor.
+    struct Destructor {
+        // Object to destroy.
+        void* object;
+        // Function destroying the object.
+        void (*destroy)(void*);
+    };
+
+    /// Chunks the arena allocates from.
+    std::vector<std::unique_ptr<std::byte[]>> chunks;
+    /// Next free byte of the current chunk.
+    std::byte* cursor = nullptr;
+    /// End of the current chunk.
+    std::byte* limit = nullptr;
+    /// Destructors to run when the arena is freed.
+    std::vector<Destructor> destructors;
+    /// Number of nodes allocated.
+    size_t nodes = 0;
+    /// Number of bytes reserved in chunks.
+    size_t reserved = 0;
+};
+
+} // namespace minijsc
+
+#endif
@@ -4,28 +4,63 @@
 // All optimizers implement the visitor pattern define in the `AST.h`.
 // The currently implemented optimizers are :
 //
-// ASTOptimizer: visits binary and unary expressions and executes
-// constant folding optimizations.
+// ASTOptimizer: rewrites the tree bottom-up folding constant expressions
+// into literals.
+//
+// ConstantPropagator: replaces variables assigned once from a constant by
+// the constant and removes the code it makes dead.
+//
+// FunctionInliner: replaces calls to small functions by their body.
+//
+// LoopInvariantMotion: evaluates the expressions of a loop which don't
+// change between iterations once before the loop.
+//
+// ValueNumbering: evaluates the expressions repeated in a list of
+// statements once and reuses their value.
+//
+// `optimize` runs the optimizers in order on a program.
 //===----------------------------------------------------------------------===//
 #ifndef ASTOPTIMIZER_H
 #define ASTOPTIMIZER_H
 
 #include "AST.h"
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace minijsc {
 
+/// Maximum number of nodes of the returned expression of an inlined
+/// function.
+static constexpr size_t kMaxInlineSize = 32;
+
 /// Constant folding optimizer implements constant folding optimizations
-/// at the AST level on binary and unary expressions.
+/// at the AST level. Expressions are rewritten bottom-up, an operator whose
+/// operands fold to literals is evaluated and replaced by its result.
+/// Statements, blocks and function bodies are rewritten in place.
+///
+/// Operators are only folded when the operand types give the same result
+/// in JavaScript and in every execution tier, e.g. `1 + 2`, `"a" + 1` or
+/// `!null` fold but `true - 1` or `"a" < "b"` are left to the runtime.
+/// Logical operators fold on a constant left operand even if the right one
+/// isn't constant, `false || f()` becomes `f()`.
 class ASTOptimizer : public ASTVisitor {
     public:
-    /// Default constructor with no arguments.
-    explicit ASTOptimizer() = default;
+    /// Construct an optimizer allocating rewritten nodes in `arena`, the
+    /// arena of the tree being optimized.
+    explicit ASTOptimizer(ASTArena& arena) : arena(arena) {}
 
     /// rewriteAST is the core method of all our optimizers, in this case
-    /// the optimizer resolves any constant literals in unary or binary
-    /// expressions and executes a folding pass.
-    auto rewriteAST(std::shared_ptr<JSExpr> expr) -> std::shared_ptr<JSExpr>;
+    /// the optimizer folds the constants of an expression and returns the
+    /// rewritten expression, a literal if the whole expression folded.
+    auto rewriteAST(JSExpr* expr) -> JSExpr*;
+
+    /// Fold the constants of a program, statements are rewritten in place.
+    /// Pre-parsed function bodies are parsed to be folded.
+    auto rewrite(std::span<JSStmt* const> stmts) -> void;
 
     /// Visit a literal expression.
     auto visitLiteralExpr(JSLiteralExpr* expr) -> void override;
@@ -59,12 +94,397 @@ class ASTOptimizer : public ASTVisitor {
     auto visitFuncDecl(JSFuncDecl* stmt) -> void override;
     /// Visit a return statement.
     auto visitReturnStmt(JSReturnStmt* stmt) -> void override;
+    /// Visit a break statement.
+    auto visitBreakStmt(JSBreakStmt* stmt) -> void override;
+    /// Visit a continue statement.
+    auto visitContinueStmt(JSContinueStmt* stmt) -> void override;
+
+    protected:
+    /// Arena rewritten nodes are allocated in.
+    ASTArena& arena;
+    /// Expression stack is used to track down optimized expressions, each
+    /// visited expression pushes its rewritten expression.
+    std::vector<JSExpr*> expressionStack;
+};
+
+/// Constant propagation optimizer replaces the variables of a program that
+/// are bound once to a constant and never assigned by their value, then
+/// removes dead code:
+///
+/// - branches of conditionals whose condition is constant
+/// - loops whose condition is constantly false
+/// - declarations of variables with a constant initializer and functions
+///   whose name is never referenced
+/// - statements following a `return`, `break` or `continue` in a block
+///
+/// Scopes are resolved dynamically so the analysis is done on names over
+/// the whole program. A variable is constant if the program has a single
+/// declaration of its name (including functions and parameters), a top
+/// level one with a literal initializer, and never assigns it. References
+/// are only replaced where they can't run before the declaration: in top
+/// level statements following it and in function bodies if no function is
+/// called before it.
+///
+/// The propagator folds constants while rewriting and runs until the
+/// program stops changing, since removing code can make more variables
+/// constant.
+class ConstantPropagator : public ASTOptimizer {
+    public:
+    /// Uses of a name in the program.
+    struct Binding {
+        // Declarations of the name, variables, functions and parameters.
+        size_t declarations = 0;
+        // Assignments to the name.
+        size_t assignments = 0;
+        // Assignments to the name in function bodies.
+        size_t functionAssignments = 0;
+        // Reads of the name.
+        size_t references = 0;
+        // Top level variable declaration of the name.
+        JSVarDecl* decl = nullptr;
+        // Index of the top level declaration in the program.
+        size_t index = 0;
+    };
+
+    /// Construct an optimizer allocating rewritten nodes in `arena`.
+    explicit ConstantPropagator(ASTArena& arena) : ASTOptimizer(arena) {}
+
+    /// Optimize a program, its top level statements are replaced.
+    auto run(JSProgram& program) -> void;
+
+    /// Visit a variable expression.
+    auto visitVarExpr(JSVarExpr* expr) -> void override;
+    /// Visit a block statement.
+    auto visitBlockStmt(JSBlockStmt* block) -> void override;
+    /// Visit an if statement.
+    auto visitIfStmt(JSIfStmt* stmt) -> void override;
+    /// Visit a while statement.
+    auto visitWhileStmt(JSWhileStmt* stmt) -> void override;
+    /// Visit a for statement.
+    auto visitForStmt(JSForStmt* stmt) -> void override;
+    /// Visit a variable declaration.
+    auto visitVarDecl(JSVarDecl* stmt) -> void override;
+    /// Visit a function declaration.
+    auto visitFuncDecl(JSFuncDecl* stmt) -> void override;
+
+    private:
+    /// Rewrite a statement, returns nullptr if the statement was removed.
+    auto rewriteStmt(JSStmt* stmt) -> JSStmt*;
+    /// Rewrite a statement which can't be removed, such as a loop body.
+    auto rewriteBody(JSStmt* stmt) -> JSStmt*;
+    /// Check if a name is never read nor assigned.
+    auto isUnused(std::string_view name) -> bool;
+    /// Return the constant a variable can be replaced by where it is read,
+    /// nullptr if it isn't constant there.
+    auto getConstant(std::string_view name) -> JSExpr*;
+
+    /// Uses of each name, recomputed before each round.
+    std::unordered_map<std::string_view, Binding> bindings;
+    /// Index of the first top level statement calling a function.
+    size_t firstCall = 0;
+    /// Index of the top level statement being rewritten.
+    size_t topIndex = 0;
+    /// Whether a function body is being rewritten.
+    bool inFunction = false;
+    /// Statement the visited statement was rewritten to.
+    JSStmt* rewritten = nullptr;
+    /// Whether the round changed the program.
+    bool changed = false;
+};
+
+/// Function inliner replaces calls to small functions by the expression
+/// they return. A function is inlined if its body is a single `return` of
+/// an expression of at most `kMaxInlineSize` nodes without calls (so it
+/// isn't recursive) nor assignments, and the program declares its name once
+/// and never assigns it, so the target of a call by that name is known.
+/// Calls which can run before the declaration are kept, with the same rules
+/// as the constants of `ConstantPropagator`.
+///
+/// Literal arguments are substituted for the parameters. Other arguments
+/// are bound to fresh locals declared before the statement making the call,
+/// which preserves their evaluation order, and only calls evaluated first by
+/// their statement (e.g. `var x = f(a + 1);`) are inlined this way. If all
+/// arguments are literals or variables they are substituted directly.
+///
+/// Scopes are resolved dynamically so the expression reads the variables
+/// the caller sees, a function reading a variable declared more than once
+/// or other than at the top level isn't inlined. Inlined expressions are
+/// folded, running `ConstantPropagator` afterwards propagates the
+/// constants they produce and removes the functions no longer called.
+class FunctionInliner : public ASTOptimizer {
+    public:
+    /// Construct an optimizer allocating inlined nodes in `arena`.
+    explicit FunctionInliner(ASTArena& arena) : ASTOptimizer(arena) {}
+
+    /// Inline the calls of a program, its top level statements are replaced.
+    auto run(JSProgram& program) -> void;
+
+    /// Return the number of calls inlined.
+    [[nodiscard]] auto getInlinedCalls() const -> size_t { return inlined; }
+
+    /// Visit a call expression.
+    auto visitCallExpr(JSCallExpr* expr) -> void override;
+    /// Visit a block statement.
+    auto visitBlockStmt(JSBlockStmt* block) -> void override;
+    /// Visit a function declaration.
+    auto visitFuncDecl(JSFuncDecl* stmt) -> void override;
+
+    private:
+    /// A function that can be inlined.
+    struct Candidate {
+        // Function declaration.
+        JSFuncDecl* decl;
+        // Returned expression.
+        JSExpr* body;
+        // Reads of each parameter in the returned expression.
+        std::unordered_map<std::string_view, size_t> uses;
+        // Index of the declaration in the program.
+        size_t index;
+    };
+
+    /// Record a top level function declaration if it can be inlined.
+    auto addCandidate(JSFuncDecl* decl, size_t index) -> void;
+    /// Return the function a call can be replaced by, nullptr if the call
+    /// must be kept.
+    auto getCandidate(JSCallExpr* expr) -> Candidate*;
+    /// Rewrite a statement of a block or of the program and append it to
+    /// `rewritten`, preceded by the fresh locals of its inlined calls.
+    /// Returns whether locals were inserted.
+    auto rewriteStmt(JSStmt* stmt, std::vector<JSStmt*>& rewritten) -> bool;
+
+    /// Uses of each name of the program.
+    std::unordered_map<std::string_view, ConstantPropagator::Binding> bindings;
+    /// Functions that can be inlined by name.
+    std::unordered_map<std::string_view, Candidate> candidates;
+    /// Index of the first top level statement calling a function.
+    size_t firstCall = 0;
+    /// Index of the top level statement being rewritten.
+    size_t topIndex = 0;
+    /// Whether a function body is being rewritten.
+    bool inFunction = false;
+    /// Call evaluated first by the statement being rewritten, its arguments
+    /// can be bound to locals declared before the statement.
+    JSCallExpr* hoistable = nullptr;
+    /// Locals declared for the statement being rewritten.
+    std::vector<JSStmt*> locals;
+    /// Number of calls inlined.
+    size_t inlined = 0;
+};
+
+/// DeclaredNames tracks the variables declared in the scopes enclosing the
+/// statement being rewritten. A name is counted once per declaration since
+/// nested scopes can declare it again.
+class DeclaredNames {
+    public:
+    /// Record a declaration of `name` in the innermost scope.
+    auto declare(std::string_view name) -> void;
+    /// Forget the declarations recorded since `mark`.
+    auto undeclare(size_t mark) -> void;
+    /// Return a mark to undeclare the names declared after this point.
+    [[nodiscard]] auto getMark() const -> size_t { return names.size(); }
+    /// Check if `name` is declared.
+    [[nodiscard]] auto contains(std::string_view name) const -> bool {
+        return counts.contains(name);
+    }
 
     private:
-    /// Expression stack is used to track down optimized expressions.
-    std::vector<std::shared_ptr<JSExpr>> expressionStack;
+    /// Declared names in order.
+    std::vector<std::string_view> names;
+    /// Number of declarations of each name in `names`.
+    std::unordered_map<std::string_view, size_t> counts;
 };
 
+/// Loop invariant code motion hoists the expressions of `while` and `for`
+/// loops whose value doesn't change between iterations. Each maximal
+/// invariant expression of the condition, the step or the body of a loop is
+/// bound to a fresh local declared before the loop and replaced by a read
+/// of the local. Loops nested in a loop are then optimized in turn.
+///
+/// An expression is invariant when the variables it reads are neither
+/// declared nor assigned in the loop, and if the loop calls a function
+/// never assigned by a function body either, scopes are resolved
+/// dynamically so a callee can assign any variable of its caller.
+///
+/// The hoisted expression is evaluated even if the loop doesn't run or
+/// doesn't reach it, so only expressions that can't throw are hoisted:
+/// they read variables declared before the loop (and for loops in function
+/// bodies, parameters or top level variables declared before any call) and
+/// don't use `+`, which throws for some operand types. Function bodies
+/// nested in a loop are left to the loops they contain.
+class LoopInvariantMotion : public ASTOptimizer {
+    public:
+    /// Construct an optimizer allocating hoisted nodes in `arena`.
+    explicit LoopInvariantMotion(ASTArena& arena) : ASTOptimizer(arena) {}
+
+    /// Hoist the loop invariants of a program, its top level statements are
+    /// replaced.
+    auto run(JSProgram& program) -> void;
+
+    /// Return the number of expressions hoisted.
+    [[nodiscard]] auto getHoistedCount() const -> size_t { return hoisted; }
+
+    /// Visit a binary expression.
+    auto visitBinaryExpr(JSBinExpr* expr) -> void override;
+    /// Visit a unary expression.
+    auto visitUnaryExpr(JSUnaryExpr* expr) -> void override;
+    /// Visit a logical expression.
+    auto visitLogicalExpr(JSLogicalExpr* expr) -> void override;
+    /// Visit a grouping expression.
+    auto visitGroupingExpr(JSGroupingExpr* expr) -> void override;
+    /// Visit a block statement.
+    auto visitBlockStmt(JSBlockStmt* block) -> void override;
+    /// Visit a function declaration.
+    auto visitFuncDecl(JSFuncDecl* stmt) -> void override;
+
+    private:
+    /// Rewrite a statement of a block or of the program and append it to
+    /// `rewritten`, preceded by the invariants hoisted out of it if it is a
+    /// loop. Returns whether invariants were hoisted.
+    auto rewriteStmt(JSStmt* stmt, std::vector<JSStmt*>& rewritten) -> bool;
+    /// Hoist the invariants of a loop into `invariants`.
+    auto hoistLoop(JSStmt* loop) -> void;
+    /// Hoist an expression of the loop being optimized if it is invariant,
+    /// pushing the read of its local. Returns whether it was hoisted.
+    auto hoist(JSExpr* expr) -> bool;
+    /// Check if an expression is invariant in the loop being optimized.
+    auto isInvariant(JSExpr* expr) -> bool;
+    /// Check if a variable is invariant in the loop being optimized.
+    auto isInvariant(std::string_view name) -> bool;
+
+    /// Uses of each name of the program.
+    std::unordered_map<std::string_view, ConstantPropagator::Binding> bindings;
+    /// Uses of each name in the loop being optimized.
+    std::unordered_map<std::string_view, ConstantPropagator::Binding>
+        loopBindings;
+    /// Whether the loop being optimized calls a function.
+    bool loopCalls = false;
+    /// Whether the expressions visited belong to the loop being optimized.
+    bool hoisting = false;
+    /// Variables declared before the statement being rewritten.
+    DeclaredNames declared;
+    /// Top level variables and functions declared before any call.
+    std::vector<std::string_view> globals;
+    /// Locals bound to the invariants of the loop being optimized.
+    std::vector<JSStmt*> invariants;
+    /// Number of expressions hoisted.
+    size_t hoisted = 0;
+};
+
+/// Value numbering eliminates the common subexpressions of each list of
+/// statements: the program, the blocks and the function bodies. The
+/// statements are numbered in order, two expressions get the same number
+/// when they apply the same operators to the same literals and variables,
+/// modulo the order of the operands of `*`, `==` and `!=`. An expression
+/// whose number is computed more than once is bound to a fresh local
+/// declared before the statement computing it first, and each computation
+/// is replaced by a read of the local.
+///
+/// A statement declaring or assigning a variable kills the numbers of the
+/// expressions reading it, as does a statement calling a function for the
+/// variables assigned by function bodies, scopes are resolved dynamically.
+/// Expressions reading a variable killed by a statement aren't numbered in
+/// that statement. Expressions are numbered in nested blocks and loops too
+/// and the blocks are then numbered on their own, function bodies are only
+/// numbered on their own.
+///
+/// The local is evaluated even if the statement doesn't reach the first
+/// computation, so like for loop invariants only expressions that can't
+/// throw are numbered: they read variables declared before the statement
+/// and don't use `+`.
+class ValueNumbering : public ASTOptimizer {
+    public:
+    /// Construct an optimizer allocating locals in `arena`.
+    explicit ValueNumbering(ASTArena& arena) : ASTOptimizer(arena) {}
+
+    /// Eliminate the common subexpressions of a program, its top level
+    /// statements are replaced.
+    auto run(JSProgram& program) -> void;
+
+    /// Return the number of computations replaced by a read of a local.
+    [[nodiscard]] auto getEliminatedCount() const -> size_t {
+        return eliminated;
+    }
+
+    /// Visit a binary expression.
+    auto visitBinaryExpr(JSBinExpr* expr) -> void override;
+    /// Visit a unary expression.
+    auto visitUnaryExpr(JSUnaryExpr* expr) -> void override;
+    /// Visit a logical expression.
+    auto visitLogicalExpr(JSLogicalExpr* expr) -> void override;
+    /// Visit a block statement.
+    auto visitBlockStmt(JSBlockStmt* block) -> void override;
+
+    private:
+    /// An expression computed by a list of statements.
+    struct Value {
+        // First computation of the value.
+        JSExpr* expr;
+        // Variables the expression reads.
+        std::vector<std::string_view> reads;
+        // Statement of the list computing the value first.
+        JSStmt* stmt;
+        // Number of computations.
+        size_t uses = 1;
+        // Local bound to the value if it is computed more than once.
+        JSVarDecl* local = nullptr;
+        // Read of the local, variables have no children and are shared.
+        JSVarExpr* read = nullptr;
+    };
+
+    /// Number the expressions of a list of statements then of the lists
+    /// nested in them.
+    auto numberStmts(std::span<JSStmt* const> stmts) -> void;
+    /// Number the lists of statements nested in a statement.
+    auto numberNested(JSStmt* stmt) -> void;
+    /// Number an expression computed by `stmt`, returns whether its operands
+    /// were numbered with it.
+    auto numberExpr(JSExpr* expr, JSStmt* stmt) -> bool;
+    /// Return the key two expressions with the same value share, an empty
+    /// key if the expression can't be numbered. The variables it reads are
+    /// appended to `reads`.
+    auto getKey(JSExpr* expr, std::vector<std::string_view>& reads)
+        -> std::string;
+    /// Check if the statement being numbered may change a variable.
+    auto isKilled(std::string_view name) -> bool;
+    /// Replace a later computation of a value by a read of its local,
+    /// returns whether the expression was replaced.
+    auto reuse(JSExpr* expr) -> bool;
+    /// Bind the rewritten first computation of a value to its local, the
+    /// computation is replaced by a read of the local.
+    auto bind(JSExpr* expr) -> void;
+    /// Rewrite a list of statements, the locals of the values they compute
+    /// first are inserted before them. Returns whether locals were inserted.
+    auto rewriteStmts(std::span<JSStmt* const> stmts,
+                      std::vector<JSStmt*>& rewritten) -> bool;
+
+    /// Uses of each name of the program.
+    std::unordered_map<std::string_view, ConstantPropagator::Binding> bindings;
+    /// Uses of each name in the statement being numbered.
+    std::unordered_map<std::string_view, ConstantPropagator::Binding>
+        stmtBindings;
+    /// Whether the statement being numbered calls a function.
+    bool stmtCalls = false;
+    /// Variables declared before the statement being numbered.
+    DeclaredNames declared;
+    /// Top level variables and functions declared before any call.
+    std::vector<std::string_view> globals;
+    /// Numbered values, in the order their first computation completes.
+    std::vector<Value> values;
+    /// Number of each live value of the list being numbered by key.
+    std::unordered_map<std::string, size_t> numbers;
+    /// Number of each numbered computation.
+    std::unordered_map<JSExpr*, size_t> computations;
+    /// Locals to insert before each statement.
+    std::unordered_map<JSStmt*, std::vector<JSStmt*>> locals;
+    /// Number of computations replaced.
+    size_t eliminated = 0;
+};
+
+/// Run the AST optimizations on a program: constant propagation, inlining,
+/// constant propagation again on the inlined code, loop invariant code
+/// motion and value numbering.
+auto optimize(JSProgram& program) -> void;
+
 } // namespace minijsc
 
 #endif
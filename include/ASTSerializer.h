@@ -0,0 +1,160 @@
+//===----------------------------------------------------------------------===//
+// ASTSerializer.h: This header defines the binary serialization of syntax
+// trees, a parsed (and optionally optimized) program is serialized once and
+// later deserialized without running the lexer and the parser.
+//
+// The format starts with a magic and a version followed by a string table
+// and the top level statements. Nodes are written in pre-order as their
+// kind followed by their operands, integers (kinds, counts and string table
+// indices) are LEB128 varints. Absent children are written as a zero kind.
+// Lexemes and string literals are stored once in the string table, numbers
+// are stored as the 8 little endian bytes of the double.
+//
+// Deserialized tokens point into a copy of the serialized data kept in the
+// program's arena, so the program doesn't depend on any source buffer.
+//===----------------------------------------------------------------------===//
+#ifndef AST_SERIALIZER_H
+#define AST_SERIALIZER_H
+
+#include "AST.h"
+#include "ASTArena.h"
+#include "JSToken.h"
+#include "JSValue.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace minijsc {
+
+/// Magic the serialized syntax trees start with.
+static constexpr std::string_view kASTMagic = "MJSA";
+
+/// Version of the format, bumped whenever the layout of a node changes.
+static constexpr uint32_t kASTFormatVersion = 1;
+
+/// Check if data starts with the magic of serialized syntax trees.
+inline auto isSerializedAST(std::string_view data) -> bool {
+    return data.starts_with(kASTMagic);
+}
+
+/// ASTSerializer implements the visitor pattern writing each node it visits.
+/// Pre-parsed function bodies are parsed before being written.
+class ASTSerializer : public ASTVisitor {
+    public:
+    /// Default constructor.
+    explicit ASTSerializer() = default;
+    /// Default destructor.
+    ~ASTSerializer() override = default;
+
+    /// Serialize a program.
+    auto serialize(std::span<JSStmt* const> stmts) -> std::string;
+
+    /// Visit a literal expression.
+    auto visitLiteralExpr(JSLiteralExpr* expr) -> void override;
+    /// Visit a binary expression.
+    auto visitBinaryExpr(JSBinExpr* expr) -> void override;
+    /// Visit a unary expression.
+    auto visitUnaryExpr(JSUnaryExpr* expr) -> void override;
+    /// Visit a logical expression.
+    auto visitLogicalExpr(JSLogicalExpr* expr) -> void override;
+    /// Visit a grouping expression.
+    auto visitGroupingExpr(JSGroupingExpr* expr) -> void override;
+    /// Visit a variable expression.
+    auto visitVarExpr(JSVarExpr* expr) -> void override;
+    /// Visit an assignment expression.
+    auto visitAssignExpr(JSAssignExpr* expr) -> void override;
+    /// Visit a call expression.
+    auto visitCallExpr(JSCallExpr* expr) -> void override;
+    /// Visit a block statement.
+    auto visitBlockStmt(JSBlockStmt* block) -> void override;
+    /// Visit an expression statement.
+    auto visitExprStmt(JSExprStmt* stmt) -> void override;
+    /// Visit an if statement.
+    auto visitIfStmt(JSIfStmt* stmt) -> void override;
+    /// Visit a while statement.
+    auto visitWhileStmt(JSWhileStmt* stmt) -> void override;
+    /// Visit a for statement.
+    auto visitForStmt(JSForStmt* stmt) -> void override;
+    /// Visit a variable declaration.
+    auto visitVarDecl(JSVarDecl* stmt) -> void override;
+    /// Visit a function declaration.
+    auto visitFuncDecl(JSFuncDecl* stmt) -> void override;
+    /// Visit a return statement.
+    auto visitReturnStmt(JSReturnStmt* stmt) -> void override;
+    /// Visit a break statement.
+    auto visitBreakStmt(JSBreakStmt* stmt) -> void override;
+    /// Visit a continue statement.
+    auto visitContinueStmt(JSContinueStmt* stmt) -> void override;
+
+    private:
+    /// Write an expression, or a zero kind for a missing expression.
+    auto write(JSExpr* expr) -> void;
+    /// Write a statement, or a zero kind for a missing statement.
+    auto write(JSStmt* stmt) -> void;
+    /// Write the kind of a node.
+    auto writeKind(ASTNodeKind kind) -> void;
+    /// Write a token as its kind and the index of its lexeme.
+    auto writeToken(const JSToken& token) -> void;
+    /// Write the index of a string in the string table.
+    auto writeString(std::string_view str) -> void;
+    /// Write a varint.
+    auto writeVarint(uint64_t value) -> void;
+
+    /// Serialized nodes.
+    std::string nodes;
+    /// Strings of the string table in order.
+    std::vector<std::string_view> strings;
+    /// Index of each string in the string table.
+    std::unordered_map<std::string_view, uint64_t> stringIndices;
+};
+
+/// ASTDeserializer rebuilds a program from its serialized syntax tree.
+/// Throws std::runtime_error if the data is malformed.
+class ASTDeserializer {
+    public:
+    /// Constructor takes the serialized data, the data is copied in the
+    /// arena of the deserialized program.
+    explicit ASTDeserializer(std::string_view data) : data(data) {}
+
+    /// Deserialize the program.
+    auto deserialize() -> JSProgram;
+
+    private:
+    /// Read an expression, nullptr for a missing expression.
+    auto readExpr() -> JSExpr*;
+    /// Read a statement, nullptr for a missing statement.
+    auto readStmt() -> JSStmt*;
+    /// Read a statement which must be a block.
+    auto readBlock() -> JSBlockStmt*;
+    /// Read a token.
+    auto readToken() -> JSToken;
+    /// Read a literal value.
+    auto readValue() -> JSBasicValue;
+    /// Read a string table index and return the string.
+    auto readString() -> std::string_view;
+    /// Read a varint.
+    auto readVarint() -> uint64_t;
+    /// Read a count bounded by the remaining bytes.
+    auto readCount() -> size_t;
+    /// Throw an error for malformed data.
+    [[noreturn]] auto fail(const char* what) -> void;
+
+    /// Serialized data, a copy kept in the arena once deserializing.
+    std::string_view data;
+    /// Position of the next byte to read.
+    size_t pos = 0;
+    /// Arena of the deserialized program.
+    std::unique_ptr<ASTArena> arena = std::make_unique<ASTArena>();
+    /// Strings of the string table.
+    std::vector<std::string_view> strings;
+};
+
+} // namespace minijsc
+
+#endif
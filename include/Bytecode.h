@@ -42,8 +42,22 @@ enum class OPCode : uint8_t {
     True,
     False,
     Pop,
+    // Duplicate the value on top of the stack.
+    Dup,
     GetGlobal,
     SetGlobal,
+    // Locals are addressed by a one byte slot relative to the frame base.
+    GetLocal,
+    SetLocal,
+    // Jumps take a two byte (big endian) offset relative to the next
+    // instruction, `Loop` jumps backwards.
+    Jump,
+    JumpIfFalse,
+    Loop,
+    // Calls take a one byte argument count, the callee and the arguments
+    // are on top of the stack.
+    Call,
+    TailCall,
 };
 
 /// Bytecode is a sequence of opcodes.
@@ -9,6 +9,10 @@
 #include "Bytecode.h"
 
 #include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace minijsc {
 
@@ -37,10 +41,52 @@ class BytecodeCompiler : public ASTVisitor {
     /// Emit an instruction with an immediate value to the bytecode buffer.
     auto emit(OPCode instruction, const JSBasicValue& value) -> void {
         auto offset = addValue(value);
+        if (offset > UINT8_MAX) {
+            throw std::runtime_error("Too many constants in one chunk.");
+        }
         bytecodeBuffer.emplace_back(instruction);
         bytecodeBuffer.emplace_back((OPCode)offset);
     }
 
+    /// Emit an instruction with a one byte operand to the bytecode buffer.
+    auto emit(OPCode instruction, size_t operand) -> void {
+        if (operand > UINT8_MAX) {
+            throw std::runtime_error("Instruction operand out of range.");
+        }
+        bytecodeBuffer.emplace_back(instruction);
+        bytecodeBuffer.emplace_back((OPCode)operand);
+    }
+
+    /// Emit a jump instruction with a placeholder offset, returns the
+    /// position of the offset to patch.
+    auto emitJump(OPCode instruction) -> size_t {
+        bytecodeBuffer.emplace_back(instruction);
+        bytecodeBuffer.emplace_back((OPCode)0xff);
+        bytecodeBuffer.emplace_back((OPCode)0xff);
+        return bytecodeBuffer.size() - 2;
+    }
+
+    /// Patch the offset of a jump to target the next emitted instruction.
+    auto patchJump(size_t offset) -> void {
+        auto jump = bytecodeBuffer.size() - offset - 2;
+        if (jump > UINT16_MAX) {
+            throw std::runtime_error("Too much code to jump over.");
+        }
+        bytecodeBuffer[offset]     = (OPCode)((jump >> 8) & 0xff);
+        bytecodeBuffer[offset + 1] = (OPCode)(jump & 0xff);
+    }
+
+    /// Emit a backward jump to the instruction at `start`.
+    auto emitLoop(size_t start) -> void {
+        bytecodeBuffer.emplace_back(OPCode::Loop);
+        auto jump = bytecodeBuffer.size() - start + 2;
+        if (jump > UINT16_MAX) {
+            throw std::runtime_error("Loop body too large.");
+        }
+        bytecodeBuffer.emplace_back((OPCode)((jump >> 8) & 0xff));
+        bytecodeBuffer.emplace_back((OPCode)(jump & 0xff));
+    }
+
     /// Append a constant to the constant pool returning its index.
     auto addValue(JSBasicValue value) -> size_t {
         constantsPool.emplace_back(value);
@@ -50,8 +96,10 @@ class BytecodeCompiler : public ASTVisitor {
     /// Compile an expression.
     auto compile(JSExpr* expr) -> void {
         if (expr != nullptr) {
-            fmt::print("compiling an expression of kind {}\n",
+#ifdef DEBUG_TRACE_EXECUTION
+            fmt::print("compiling a node of kind {}\n",
                        astNodeKindToString(expr->getKind()));
+#endif
             expr->accept(this);
         }
     }
@@ -59,8 +107,10 @@ class BytecodeCompiler : public ASTVisitor {
     /// Compile a statement.
     auto compile(JSStmt* stmt) -> void {
         if (stmt != nullptr) {
-            fmt::print("compiling an expression of kind {}\n",
+#ifdef DEBUG_TRACE_EXECUTION
+            fmt::print("compiling a node of kind {}\n",
                        astNodeKindToString(stmt->getKind()));
+#endif
             stmt->accept(this);
         }
     }
@@ -97,10 +147,65 @@ class BytecodeCompiler : public ASTVisitor {
     auto visitFuncDecl(JSFuncDecl* stmt) -> void override;
     /// Visit a return statement.
     auto visitReturnStmt(JSReturnStmt* stmt) -> void override;
+    /// Visit a break statement.
+    auto visitBreakStmt(JSBreakStmt* stmt) -> void override;
+    /// Visit a continue statement.
+    auto visitContinueStmt(JSContinueStmt* stmt) -> void override;
 
     private:
+    /// Local variables live in stack slots of the function's frame, the slot
+    /// of a local is its index in `locals`.
+    struct Local {
+        // Variable identifier.
+        std::string name;
+        // Depth of the block scope declaring the variable.
+        size_t depth;
+    };
+
+    /// Jumps emitted by `break` and `continue` statements, patched once
+    /// the enclosing loop is compiled.
+    struct LoopState {
+        // Number of locals live when entering the loop.
+        size_t numLocals;
+        // Offsets of the jumps emitted by break statements.
+        std::vector<size_t> breaks;
+        // Offsets of the jumps emitted by continue statements.
+        std::vector<size_t> continues;
+    };
+
+    /// Compilation state of a function, saved while compiling a nested
+    /// function declaration.
+    struct FunctionState {
+        std::vector<OPCode> bytecodeBuffer;
+        std::vector<JSBasicValue> constantsPool;
+        std::vector<Local> locals;
+        std::vector<LoopState> loops;
+        size_t scopeDepth;
+    };
+
+    /// Enter a new block scope.
+    auto beginScope() -> void { scopeDepth++; }
+    /// Exit a block scope popping its locals.
+    auto endScope() -> void;
+    /// Resolve the slot of a local variable.
+    auto resolveLocal(const std::string& name) -> std::optional<size_t>;
+    /// Emit the pops of the locals declared inside the innermost loop.
+    auto popLoopLocals() -> void;
+    /// Compile the callee and the arguments of a call returning the number
+    /// of arguments.
+    auto compileCall(JSCallExpr* expr) -> size_t;
+
     std::vector<OPCode> bytecodeBuffer;
     std::vector<JSBasicValue> constantsPool;
+    /// Locals of the function being compiled.
+    std::vector<Local> locals;
+    /// Loops enclosing the statement being compiled.
+    std::vector<LoopState> loops;
+    /// Depth of the block scope being compiled, top level declarations
+    /// at depth 0 are globals.
+    size_t scopeDepth = 0;
+    /// States of the functions enclosing the function being compiled.
+    std::vector<FunctionState> enclosing;
 };
 
 } // namespace minijsc
@@ -0,0 +1,200 @@
+//===----------------------------------------------------------------------===//
+// ClosureCompiler.h: This header defines the closure compiler, an execution
+// tier that translates the abstract syntax tree once into a tree of pre-bound
+// C++ callables. Each node becomes a lambda holding its compiled children and
+// its resolved variable slots, operators are specialized when the closure is
+// built so evaluation never dispatches on the node kind or the token kind.
+//===----------------------------------------------------------------------===//
+#ifndef CLOSURE_COMPILER_H
+#define CLOSURE_COMPILER_H
+
+#include "AST.h"
+#include "Interpreter.h"
+#include "JSValue.h"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace minijsc {
+
+/// GlobalSlot stores a global binding, globals are resolved to an index
+/// in the global table at compile time.
+struct GlobalSlot {
+    // Bound value.
+    JSBasicValue value;
+    // Whether the binding was defined, reading or assigning an undefined
+    // global is a runtime error.
+    bool defined = false;
+};
+
+/// ClosureContext holds the runtime state of compiled closures, locals of
+/// all active calls live in a single value stack and are addressed relative
+/// to the frame pointer of the running call.
+struct ClosureContext {
+    // Global bindings indexed by their global slot.
+    std::vector<GlobalSlot> globals;
+    // Value stack holding the local slots of active calls.
+    std::vector<JSBasicValue> stack;
+    // Index of the first local slot of the running call.
+    size_t fp = 0;
+    // Number of active calls.
+    size_t depth = 0;
+    // Return register holding the value of the last executed return.
+    JSBasicValue returnReg;
+
+    // Return a reference to a local slot of the running call.
+    auto local(size_t slot) -> JSBasicValue& { return stack[fp + slot]; }
+};
+
+/// ExprClosure is a compiled expression, calling it evaluates the expression.
+using ExprClosure = std::function<JSBasicValue(ClosureContext&)>;
+/// StmtClosure is a compiled statement, calling it executes the statement
+/// and returns its completion.
+using StmtClosure = std::function<Completion(ClosureContext&)>;
+
+/// JSClosure is the function object created by the closure compiler, the body
+/// is compiled once when the declaration is compiled.
+class JSClosure : public JSValue {
+    public:
+    JSClosure(std::string name, size_t arity, size_t numSlots, StmtClosure body)
+        : name(std::move(name)), arity(arity), numSlots(numSlots),
+          body(std::move(body)) {}
+
+    auto getKind() -> JSValueKind override { return JSValueKind::Function; }
+
+    [[nodiscard]] auto getName() const -> const std::string& { return name; }
+
+    /// Return the number of declared parameters.
+    [[nodiscard]] auto getArity() const -> size_t { return arity; }
+
+    /// Return the number of local slots used by the function's frame.
+    [[nodiscard]] auto getNumSlots() const -> size_t { return numSlots; }
+
+    /// Execute the compiled body, the arguments must already be written
+    /// in the first `arity` slots of the frame.
+    auto execute(ClosureContext& ctx) const -> Completion { return body(ctx); }
+
+    private:
+    std::string name;
+    size_t arity;
+    size_t numSlots;
+    StmtClosure body;
+};
+
+/// ClosureCompiler implements the visitor pattern, visiting a node builds the
+/// closure for the node from the closures of its children. Variables are
+/// resolved lexically when compiling, locals are bound to a slot in their
+/// function's frame and everything else to a slot in the global table.
+class ClosureCompiler : public ASTVisitor {
+    public:
+    /// Default constructor.
+    explicit ClosureCompiler() { functions.emplace_back(); }
+    /// Default destructor.
+    ~ClosureCompiler() override = default;
+
+    /// Compile an expression.
+    auto compile(JSExpr* expr) -> ExprClosure;
+    /// Compile a statement.
+    auto compile(JSStmt* stmt) -> StmtClosure;
+
+    /// Compile and run a sequence of statements (a program).
+    auto run(std::span<JSStmt* const> stmts) -> void;
+    /// Compile and evaluate an expression.
+    auto evaluate(JSExpr* expr) -> JSBasicValue;
+
+    /// Call a compiled function with the given arguments.
+    auto call(const JSBasicValue& callee, std::vector<JSBasicValue> args)
+        -> JSBasicValue;
+
+    /// Return the value of a global binding if it is defined.
+    auto getGlobal(const std::string& name) -> std::optional<JSBasicValue>;
+
+    /// Return the runtime state of the compiled closures.
+    auto getContext() -> ClosureContext& { return ctx; }
+
+    /// Visit a literal expression.
+    auto visitLiteralExpr(JSLiteralExpr* expr) -> void override;
+    /// Visit a binary expression.
+    auto visitBinaryExpr(JSBinExpr* expr) -> void override;
+    /// Visit a unary expression.
+    auto visitUnaryExpr(JSUnaryExpr* expr) -> void override;
+    /// Visit a logical expression.
+    auto visitLogicalExpr(JSLogicalExpr* expr) -> void override;
+    /// Visit a grouping expression.
+    auto visitGroupingExpr(JSGroupingExpr* expr) -> void override;
+    /// Visit a variable expression.
+    auto visitVarExpr(JSVarExpr* expr) -> void override;
+    /// Visit an assignment expression.
+    auto visitAssignExpr(JSAssignExpr* expr) -> void override;
+    /// Visit a call expression.
+    auto visitCallExpr(JSCallExpr* expr) -> void override;
+    /// Visit a block statement.
+    auto visitBlockStmt(JSBlockStmt* block) -> void override;
+    /// Visit an expression statement.
+    auto visitExprStmt(JSExprStmt* stmt) -> void override;
+    /// Visit an if statement.
+    auto visitIfStmt(JSIfStmt* stmt) -> void override;
+    /// Visit a while statement.
+    auto visitWhileStmt(JSWhileStmt* stmt) -> void override;
+    /// Visit a for statement.
+    auto visitForStmt(JSForStmt* stmt) -> void override;
+    /// Visit a variable declaration.
+    auto visitVarDecl(JSVarDecl* stmt) -> void override;
+    /// Visit a function declaration.
+    auto visitFuncDecl(JSFuncDecl* stmt) -> void override;
+    /// Visit a return statement.
+    auto visitReturnStmt(JSReturnStmt* stmt) -> void override;
+    /// Visit a break statement.
+    auto visitBreakStmt(JSBreakStmt* stmt) -> void override;
+    /// Visit a continue statement.
+    auto visitContinueStmt(JSContinueStmt* stmt) -> void override;
+
+    private:
+    /// Slot a variable was resolved to.
+    struct Slot {
+        // Whether the slot is in the global table or in the frame.
+        bool global;
+        // Index of the slot.
+        size_t index;
+    };
+
+    /// Compile time scope information of a function being compiled, the
+    /// top level code is compiled as a function whose outermost block
+    /// declares globals.
+    struct FunctionScope {
+        // Stack of block scopes mapping names to local slots.
+        std::vector<std::unordered_map<std::string, size_t>> blocks =
+            std::vector<std::unordered_map<std::string, size_t>>(1);
+        // Number of local slots used by the frame.
+        size_t numSlots = 0;
+    };
+
+    /// Declare a variable in the current block scope.
+    auto declare(const std::string& name) -> Slot;
+    /// Resolve a variable starting from the current block scope.
+    auto resolve(const std::string& name) -> Slot;
+    /// Return the global slot of a name, allocating it on first use.
+    auto globalSlot(const std::string& name) -> size_t;
+
+    /// Stack of functions being compiled, the top level is at index 0.
+    std::vector<FunctionScope> functions;
+    /// Global names mapped to their slot in the global table.
+    std::unordered_map<std::string, size_t> globalSlots;
+    /// Runtime state shared by all the compiled closures.
+    ClosureContext ctx;
+    /// Closure built by the last visited expression.
+    ExprClosure exprResult;
+    /// Closure built by the last visited statement.
+    StmtClosure stmtResult;
+};
+
+} // namespace minijsc
+
+#endif
@@ -0,0 +1,166 @@
+//===----------------------------------------------------------------------===//
+// ExecutionManager.h: This header defines the execution manager, the driver
+// of tiered execution in minijsc.
+//
+// Programs start in the AST interpreter which has no compilation cost. The
+// manager counts the invocations and the loop back edges of each function,
+// a function crossing the bytecode thresholds is compiled to bytecode and
+// runs in the VM from its next call, a function getting hotter is compiled
+// to native code and runs as closures from then on. There is no on-stack
+// replacement, a running call always finishes in the tier it started in.
+//
+// Native code is produced by the closure compiler (see ClosureCompiler.h),
+// the machine code JIT (see Jit.h) only targets aarch64 and has no backend
+// yet.
+//
+// Only pure functions (see PurityAnalyzer.h) are promoted, they only depend
+// on their arguments and on other pure functions so a compiled tier runs
+// them without access to the interpreter's environment. A promoted function
+// is compiled together with the functions it calls.
+//===----------------------------------------------------------------------===//
+#ifndef EXECUTION_MANAGER_H
+#define EXECUTION_MANAGER_H
+
+#include "AST.h"
+#include "ClosureCompiler.h"
+#include "Interpreter.h"
+#include "JSValue.h"
+#include "VM.h"
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace minijsc {
+
+/// Default number of calls before a function is compiled to bytecode.
+static constexpr size_t kBytecodeCallThreshold = 10;
+/// Default number of loop back edges before a function is compiled
+/// to bytecode.
+static constexpr size_t kBytecodeBackEdgeThreshold = 1000;
+/// Default number of calls before a function is compiled to native code.
+static constexpr size_t kNativeCallThreshold = 1000;
+/// Default number of loop back edges before a function is compiled
+/// to native code.
+static constexpr size_t kNativeBackEdgeThreshold = 100000;
+
+/// Tier enumerates the execution tiers from the cheapest to start to the
+/// fastest to run.
+enum class Tier {
+    Interpreter,
+    Bytecode,
+    Native,
+};
+
+/// TierConfig holds the promotion thresholds, a function is promoted once
+/// either its call count or its back edge count reaches the threshold.
+struct TierConfig {
+    // Calls before compiling to bytecode.
+    size_t bytecodeCalls = kBytecodeCallThreshold;
+    // Loop back edges before compiling to bytecode.
+    size_t bytecodeBackEdges = kBytecodeBackEdgeThreshold;
+    // Calls before compiling to native code.
+    size_t nativeCalls = kNativeCallThreshold;
+    // Loop back edges before compiling to native code.
+    size_t nativeBackEdges = kNativeBackEdgeThreshold;
+};
+
+/// TierStats counts the tier transitions and the calls run in each tier.
+struct TierStats {
+    // Functions compiled to bytecode.
+    size_t bytecodePromotions = 0;
+    // Functions compiled to native code.
+    size_t nativePromotions = 0;
+    // Compilations that failed, the function stays in its tier.
+    size_t failedPromotions = 0;
+    // Calls run by the interpreter.
+    size_t interpretedCalls = 0;
+    // Calls run by the bytecode VM.
+    size_t bytecodeCalls = 0;
+    // Calls run as native code.
+    size_t nativeCalls = 0;
+};
+
+/// ExecutionManager owns the interpreter running a program and the compiled
+/// code of its hot functions.
+class ExecutionManager {
+    public:
+    /// Constructor takes the promotion thresholds.
+    explicit ExecutionManager(TierConfig config = {}) : config(config) {
+        interpreter.setExecutionManager(this);
+    }
+
+    /// The interpreter points back to its manager.
+    ExecutionManager(const ExecutionManager&)                    = delete;
+    auto operator=(const ExecutionManager&) -> ExecutionManager& = delete;
+
+    /// Run a sequence of statements (a program).
+    auto run(std::span<JSStmt* const> stmts) -> void;
+
+    /// Count a call to a function whose arguments are the environment slots
+    /// starting at `argBase`. Returns the result if the call ran in a
+    /// compiled tier, otherwise the caller interprets the function.
+    auto dispatch(JSFuncDecl* decl, size_t argBase)
+        -> std::optional<JSBasicValue>;
+
+    /// Count a loop back edge executed by an interpreted function.
+    auto onBackEdge(JSFuncDecl* decl) -> void;
+
+    /// Return the tier a function runs in.
+    [[nodiscard]] auto getTier(JSFuncDecl* decl) const -> Tier;
+
+    /// Check if the runtime state references names or declarations parsed
+    /// from `source`, the source must then outlive the manager.
+    auto references(std::string_view source) -> bool;
+
+    /// Return the tier transition stats.
+    [[nodiscard]] auto getStats() const -> const TierStats& { return stats; }
+
+    /// Return the interpreter running the program.
+    auto getInterpreter() -> Interpreter& { return interpreter; }
+
+    private:
+    /// Profile and compiled code of a function.
+    struct FunctionProfile {
+        // Number of calls.
+        size_t calls = 0;
+        // Number of loop back edges.
+        size_t backEdges = 0;
+        // Tier the function runs in.
+        Tier tier = Tier::Interpreter;
+        // Whether a compilation failed, the function isn't promoted again.
+        bool pinned = false;
+        // Virtual machine running the bytecode tier.
+        std::unique_ptr<VM> vm;
+        // Function compiled to bytecode.
+        JSBasicValue bytecode;
+        // Closure compiler running the native tier.
+        std::unique_ptr<ClosureCompiler> closures;
+        // Function compiled to native code.
+        JSBasicValue native;
+    };
+
+    /// Promote a function to the next tier if it crossed its thresholds.
+    auto promote(JSFuncDecl* decl, FunctionProfile& profile) -> void;
+    /// Compile a function and its callees to bytecode.
+    auto compileBytecode(JSFuncDecl* decl, FunctionProfile& profile) -> void;
+    /// Compile a function and its callees to native code.
+    auto compileNative(JSFuncDecl* decl, FunctionProfile& profile) -> void;
+
+    /// Promotion thresholds.
+    TierConfig config;
+    /// Tier transition stats.
+    TierStats stats;
+    /// Interpreter running the program.
+    Interpreter interpreter;
+    /// Profiles of the pure functions called so far.
+    std::unordered_map<JSFuncDecl*, FunctionProfile> profiles;
+};
+
+} // namespace minijsc
+
+#endif
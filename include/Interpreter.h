@@ -13,76 +13,91 @@
 #include "AST.h"
 #include "JSRuntime.h"
 #include "JSValue.h"
+#include "PurityAnalyzer.h"
 
 #include <memory>
+#include <span>
 #include <mutex>
 #include <utility>
 
 namespace minijsc {
 
-/// Max possiblee number of scopes.
-static constexpr int kMaxNestedScopes = 65535;
+class ExecutionManager;
+
+/// Completion records how the execution of a statement ended. Abrupt
+/// completions (return, break and continue) propagate up through `execute`
+/// and `executeBlock` until a loop or a function call consumes them, this
+/// replaces unwinding the native stack with exceptions.
+enum class Completion {
+    // Execution continues with the next statement.
+    Normal,
+    // A return statement was executed, the value is in the return register.
+    Return,
+    // A break statement was executed.
+    Break,
+    // A continue statement was executed.
+    Continue,
+};
 
 /// Interpreter implements runtime evaluation of the abstract syntax tree.
 class Interpreter : public ASTVisitor {
     public:
     /// Default constructor.
-    explicit Interpreter() {
-        // Allocate for enough scopes.
-        symTables.reserve(kMaxNestedScopes);
-        // Set the index of the current environment to 0.
-        currIdx = 0;
-        // Append a new environment and set it's parent to -1.
-        auto topLevel = Environment();
-        topLevel.setParentPtr(-1);
-        symTables.emplace_back(topLevel);
-    }
+    explicit Interpreter() = default;
 
     ~Interpreter() override = default;
 
     /// Return the interpeter's current scope pointer.
-    [[nodiscard]] auto getCurrIdx() const -> EnvPtr { return currIdx; }
+    [[nodiscard]] auto getCurrIdx() const -> EnvPtr {
+        return env.getCurrent();
+    }
+
+    /// Enter a new scope nested in the current scope.
+    auto pushScope() -> void { env.pushFrame(); }
+
+    /// Exit the current scope, destroying its bindings. Scopes exited by
+    /// a return deferring a tail call that may read them are kept live.
+    auto popScope() -> void {
+        if (!keepScopes) {
+            env.popFrame();
+        }
+    }
+
+    /// Return the runtime environment.
+    auto getEnvironment() -> Environment& { return env; }
 
-    /// Set the current scope's index to a new value.
-    auto setCurrIdx(EnvPtr idx) -> void { currIdx = idx; }
+    /// Return the purity analysis of the programs run so far.
+    auto getPurityAnalyzer() -> const PurityAnalyzer& { return purity; }
 
-    // Add a new scope to the global scopes table.
-    auto appendSymbolTable(const Environment& env) -> void {
-        symTables.emplace_back(env);
-        currIdx += 1;
+    /// Attach an execution manager, function calls and loop iterations
+    /// are reported to it so hot functions run in a faster tier.
+    auto setExecutionManager(ExecutionManager* executionManager) -> void {
+        manager = executionManager;
     }
 
-    // Pop a scope from the symbol tables.
-    auto popSymbolTable() -> void {
-        symTables.pop_back();
-        currIdx -= 1;
+    /// Return the attached execution manager or nullptr.
+    auto getExecutionManager() -> ExecutionManager* { return manager; }
+
+    /// Set the function whose body is being executed, returns the previously
+    /// executing function.
+    auto enterFunction(JSFuncDecl* func) -> JSFuncDecl* {
+        return std::exchange(activeFunction, func);
     }
 
     /// Define a binding, definitions of new bindings always go into
     /// the current scope.
-    auto define(const std::string& name, std::shared_ptr<JSValue> value)
-        -> void {
-        symTables[currIdx].defineBinding(name, std::move(value));
+    auto define(std::string_view name, JSBasicValue value) -> void {
+        env.defineBinding(name, std::move(value));
     }
 
     /// Assign abinding.
-    auto assign(const std::string& name, const std::shared_ptr<JSValue>& value)
-        -> void {
+    auto assign(std::string_view name, const JSBasicValue& value) -> void {
         // In order to create an assignment we need to check scopes
         // in the reverse order they were created in.
         // Starting from the current scope and iterating until we reach
         // the global scope at index 0.
-        auto idx = currIdx;
-        while (idx != -1) {
-            // If the variable exists this scope, try and create an assignment.
-            if (symTables[idx].resolveBinding(name) != nullptr) {
-                if (symTables[idx].assign(name, value)) {
-                    // If the assignment is successful return.
-                    return;
-                }
-            }
-            // If the variable wasn't found in the current scope, move to its parent.
-            idx = symTables[idx].getParentPtr();
+        if (env.assign(name, value)) {
+            return;
         }
         // If the variable isn't found in all the scopes throw a runtime error
         throw std::runtime_error(
@@ -90,20 +105,12 @@ class Interpreter : public ASTVisitor {
     }
 
     // Resolve a binding
-    auto resolve(const std::string& name) -> std::shared_ptr<JSValue> {
+    auto resolve(std::string_view name) -> const JSBasicValue& {
         // Similar to assignment the runtime starts by checking the current scope
         // if the binding is found we return the value. Otherwise we move to the
         // parent scope.
-        auto idx = currIdx;
-        while (idx != -1) {
-            // If the variable existis within this scope we return it.
-            auto value = symTables[idx].resolveBinding(name);
-            if (value != nullptr) {
-                return value;
-            }
-            // If the variable wasn't found in the current scope we move to it
-            // parent.
-            idx = symTables[idx].getParentPtr();
+        if (auto* value = env.resolveBinding(name)) {
+            return *value;
         }
         // If the variable isn't found in the existing scopes we throw a runtime
         // error.
@@ -112,25 +119,33 @@ class Interpreter : public ASTVisitor {
     }
 
     /// Run a sequence of statements (a program).
-    auto run(const std::vector<std::shared_ptr<JSStmt>>& stmts) -> void;
+    auto run(std::span<JSStmt* const> stmts) -> void;
 
     /// Evaluate expression.
-    auto evaluate(JSExpr* expr) -> std::shared_ptr<JSValue>;
+    auto evaluate(JSExpr* expr) -> JSBasicValue;
     /// Execute a single statement.
-    auto execute(JSStmt* stmt) -> void;
-    /// Execute a block (sequence of statements)
-    auto executeBlock(JSBlockStmt* block, Environment env) -> void;
+    auto execute(JSStmt* stmt) -> Completion;
+    /// Execute a block (sequence of statements) in the current scope.
+    auto executeBlock(JSBlockStmt* block) -> Completion;
+
+    /// Store an evaluated value in the value register.
+    auto setResult(JSBasicValue value) -> void { valueReg = std::move(value); }
+
+    /// Take the value of the last executed return statement.
+    auto takeReturnValue() -> JSBasicValue { return std::move(returnReg); }
 
-    /// Push an evaluated value into the value stack.
-    auto pushValue(std::shared_ptr<JSValue> value) -> void {
-        valueStack.emplace_back(value);
+    /// Check if the last executed return statement deferred a tail call.
+    [[nodiscard]] auto hasTailCall() const -> bool {
+        return tailCallee != nullptr;
     }
 
-    // Pop a value from the value stack.
-    auto popValue() -> std::shared_ptr<JSValue> {
-        auto value = valueStack.back();
-        valueStack.pop_back();
-        return value;
+    /// Check if the deferred tail call runs in the scopes of its caller.
+    [[nodiscard]] auto isTailCallScoped() const -> bool { return keepScopes; }
+
+    /// Take the callee and the arguments of the deferred tail call.
+    auto takeTailCall() -> std::pair<JSObjectRef, std::vector<JSBasicValue>> {
+        keepScopes = false;
+        return {std::move(tailCallee), std::move(tailCallArgs)};
     }
 
     /// Visit a literal expression.
@@ -165,42 +180,42 @@ class Interpreter : public ASTVisitor {
     auto visitFuncDecl(JSFuncDecl* stmt) -> void override;
     /// Visit a return statement.
     auto visitReturnStmt(JSReturnStmt* stmt) -> void override;
+    /// Visit a break statement.
+    auto visitBreakStmt(JSBreakStmt* stmt) -> void override;
+    /// Visit a continue statement.
+    auto visitContinueStmt(JSContinueStmt* stmt) -> void override;
 
 #ifdef DEBUG_INTERPRETER_ENV
 
-    auto getEnv(const JSToken& name) -> std::shared_ptr<JSValue> {
-        auto value = symTables[currIdx].resolveBinding(name.getLexeme());
+    auto getEnv(const JSToken& name) -> std::optional<JSBasicValue> {
+        auto* value = env.resolveLocal(name.getLexeme());
         if (value != nullptr) {
-            return value;
+            return *value;
         }
 
         fmt::print("Value undefined .\n");
-        return {nullptr};
+        return std::nullopt;
     }
 
     auto getValue(const JSToken& name) -> JSBasicValue {
-        auto value = getEnv(name);
-
-        auto result = std::static_pointer_cast<JSBasicValue>(value);
-        return *result;
+        return getEnv(name).value_or(JSBasicValue());
     }
 
 #endif
     /// Check truthiness of a value.
-    static auto isTruthy(const std::shared_ptr<JSValue>& value) -> bool {
-        auto basicValue = std::static_pointer_cast<JSBasicValue>(value);
-        switch (basicValue->getKind()) {
+    static auto isTruthy(const JSBasicValue& value) -> bool {
+        switch (value.getKind()) {
         case JSValueKind::Boolean: {
-            return basicValue->getValue<JSBoolean>();
+            return value.getValue<JSBoolean>();
         }
         case JSValueKind::Number: {
-            return basicValue->getValue<JSNumber>() != 0 &&
-                   basicValue->getValue<JSNumber>() != 0.0;
+            return value.getValue<JSNumber>() != 0 &&
+                   value.getValue<JSNumber>() != 0.0;
         }
         case JSValueKind::Undefined:
             return false;
         case JSValueKind::String:
-            if (basicValue->getValue<JSString>().empty()) {
+            if (value.getValue<JSString>().empty()) {
                 return false;
             }
         case JSValueKind::Null:
@@ -214,29 +229,60 @@ class Interpreter : public ASTVisitor {
     }
 
     /// Runtime environment is designed following the same ideas of spaghetti
-    /// stack. We have a stack of environments, the stack is always populated
-    /// with at least one top level environment (the global environment).
+    /// stack. We have a stack of scopes, the stack is always populated
+    /// with at least one top level scope (the global scope).
     ///
-    /// Upon entering a block statement, we push a new environment to the stack
-    /// this environment is for defining bindings in the new inner scope.
-    /// Upon exiting a block statement we pop the inner environment from
-    /// the stack and restore the runtime's pointer (`currIdx`).
+    /// Upon entering a block statement, we push a new scope to the stack
+    /// this scope is for defining bindings in the new inner scope.
+    /// Upon exiting a block statement we pop the inner scope from
+    /// the stack, the bindings it defined are released with it.
     ///
-    /// When assigning a variable you first check if its defined in the global
+    /// When assigning a variable you first check if its defined in the current
     /// scope, if it isn't defined we move the outer scope using the parent
     /// pointer and assign it there.
     /// If we reach the top level scope without making an assignment it means
     /// the variable is undefined, the same process is used for resolving
     /// bindings.
     ///
-    /// Runtime environment is a stack of symbol tables.
-    std::vector<Environment> symTables;
-    /// Value stack to keep track of evaluated expressions.
-    std::vector<std::shared_ptr<JSValue>> valueStack;
-    /// Pointer to the current environment.
-    EnvPtr currIdx;
+    /// Runtime environment is a frame arena (see `Environment`).
+    Environment env;
+    /// Value register holding the result of the last visited expression,
+    /// expression visitors write to it and `evaluate` moves it out.
+    JSBasicValue valueReg;
+    /// Return register holding the value of the last executed return.
+    JSBasicValue returnReg;
+    /// Completion of the statement being executed.
+    Completion completion = Completion::Normal;
+    /// Callee of a tail call deferred by a return statement, the call is
+    /// executed by the returning function in place of its own frame.
+    JSObjectRef tailCallee;
+    /// Arguments of the deferred tail call.
+    std::vector<JSBasicValue> tailCallArgs;
+    /// Whether the scopes exited by the deferred tail call's return are
+    /// kept live, variables resolve through the caller's scopes so only
+    /// pure callees can run without them.
+    bool keepScopes = false;
+    /// Number of active function calls.
+    size_t callDepth = 0;
+    /// Purity analysis, kept across runs so functions declared by earlier
+    /// programs are known to later ones.
+    PurityAnalyzer purity;
+    /// Execution manager profiling the program, nullptr when the program
+    /// only runs in the interpreter.
+    ExecutionManager* manager = nullptr;
+    /// Function whose body is being executed, nullptr at the top level.
+    JSFuncDecl* activeFunction = nullptr;
 
     private:
+    /// Report a loop back edge to the execution manager.
+    auto profileBackEdge() -> void;
+
+    /// Evaluate the callee of a call expression.
+    auto evaluateCallee(JSCallExpr* expr) -> JSBasicValue;
+
+    /// Evaluate the arguments of a call expression and call the callee.
+    auto callFunction(const JSBasicValue& callee, JSCallExpr* expr)
+        -> JSBasicValue;
 };
 
 } // namespace minijsc
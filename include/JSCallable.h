@@ -2,28 +2,18 @@
 #define JSCALLABLE_H
 
 #include "AST.h"
+#include "ExecutionManager.h"
 #include "Interpreter.h"
+#include "JSRuntime.h"
 #include "JSValue.h"
 
+#include <optional>
+#include <tuple>
 #include <utility>
 #include <vector>
 
 namespace minijsc {
 
-/// JSReturn inherits from runtime exception to unwind the stack after the return
-/// back to a function call.
-class JSReturn : public std::exception {
-    public:
-    JSReturn(std::shared_ptr<JSValue> value) : value(std::move(value)) {}
-
-    auto getValue() -> std::shared_ptr<JSValue> { return value; }
-
-    const char* what() const throw() override { return "Return"; }
-
-    private:
-    std::shared_ptr<JSValue> value;
-};
-
 /// JSCallable interface defines JavaScript callable objects such as functions
 /// and methods.
 class JSCallable {
@@ -31,9 +21,11 @@ class JSCallable {
     /// Default destructor.
     virtual ~JSCallable() = default;
 
-    /// The JSCallable interface defines a single method, `call`.
-    virtual auto call(Interpreter* interpreter,
-                      std::vector<JSBasicValue> arguments) -> JSBasicValue = 0;
+    /// The JSCallable interface defines a single method, `call`. Arguments
+    /// are passed in place, they are the environment slots starting at
+    /// `argBase` and become the slots of the callee's frame.
+    virtual auto call(Interpreter* interpreter, size_t argBase)
+        -> JSBasicValue = 0;
 };
 
 /// JSFunction is a concrete implementation of JSCallable and represents
@@ -41,57 +33,143 @@ class JSCallable {
 class JSFunction : public JSCallable, public JSValue {
     public:
     /// Default constructor takes the function declaration as argument.
-    explicit JSFunction(std::shared_ptr<JSFuncDecl> funcDecl)
-        : funcDecl(std::move(funcDecl)) {}
+    /// Functions marked as memoized by the purity analysis own a memo table.
+    /// The declaration is owned by the arena of its program, which must
+    /// outlive the function.
+    explicit JSFunction(JSFuncDecl* funcDecl) : funcDecl(funcDecl) {
+        if (funcDecl->isMemoized()) {
+            memo = std::make_unique<MemoTable>();
+        }
+    }
 
     auto getKind() -> JSValueKind override { return JSValueKind::Function; }
 
-    auto getName() -> std::string { return funcDecl->getName().getLexeme(); }
+    auto getName() -> std::string {
+        return std::string(funcDecl->getName().getLexeme());
+    }
 
-    /// Function calls are dispatched by the runtime after creating the new
-    /// function scope.
-    auto call(Interpreter* interpreter, std::vector<JSBasicValue> arguments)
+    /// Function calls are dispatched by the runtime after evaluating the
+    /// arguments into the environment. Tail calls deferred by the body's
+    /// return statement run in a loop after the function's body returned,
+    /// so a chain of tail calls doesn't grow the native stack. Scopes the
+    /// tail calls keep live are exited once the chain returns.
+    auto call(Interpreter* interpreter, size_t argBase)
         -> JSBasicValue override {
-        // Get the top level scope pointer.
-        auto currentScopeIdx = interpreter->getCurrIdx();
-        // Create the function scope.
-        auto funcScope = Environment();
-        // Set the function scope pointer to the top level environment.
-        funcScope.setParentPtr(currentScopeIdx);
-        // Define the parameters as part of the function scope.
-        auto params = funcDecl->getParams();
-        for (size_t i = 0; i < params.size(); i++) {
-            auto paramName  = params[i].getLexeme();
-            auto paramValue = arguments[i];
-            fmt::print("Argument : {} has Value : {}\n", paramName,
-                       paramValue.toString());
-            funcScope.defineBinding(paramName,
-                                    std::make_shared<JSBasicValue>(paramValue));
+        auto& env  = interpreter->getEnvironment();
+        auto depth = env.getDepth();
+        ScopeExit exitCall([&env, depth] { env.popFramesTo(depth); });
+        return invoke(interpreter, argBase, depth);
+    }
+
+    /// Return the declaration of the function.
+    [[nodiscard]] auto getDecl() const -> JSFuncDecl* { return funcDecl; }
+
+    /// Return the memo table or nullptr if the function isn't memoized.
+    [[nodiscard]] auto getMemoTable() const -> const MemoTable* {
+        return memo.get();
+    }
+
+    private:
+    /// Memo tables that missed a call of a chain of tail calls, with the
+    /// key of the call.
+    using MemoMisses = std::vector<std::pair<MemoTable*, MemoKey>>;
+
+    /// Run the function and the tail calls it defers. Calls to memoized
+    /// functions with primitive arguments, tail calls included, are looked
+    /// up in the memo table first. The result of the chain is the result
+    /// of each of its calls and is cached by the ones that missed.
+    auto invoke(Interpreter* interpreter, size_t argBase, size_t depth)
+        -> JSBasicValue {
+        MemoMisses misses;
+        auto result = runChain(interpreter, argBase, depth, misses);
+        for (auto& [table, key] : misses) {
+            table->insert(std::move(key), result);
         }
-        // Append the new environment to the global env stack.
-        interpreter->appendSymbolTable(funcScope);
-        // Increment the env scope index.
-        // interpreter->setCurrIdx(currentScopeIdx++);
-        try {
-            // Execute the statements in a new block.
-            interpreter->executeBlock(funcDecl->getBody().get(),
-                                      std::move(funcScope));
-        } catch (JSReturn& ret) {
-            auto res = (std::static_pointer_cast<JSBasicValue>(ret.getValue()));
-            fmt::print("call => Got return value {}\n", res->toString());
-            interpreter->pushValue(res);
-            // Pop function scope
-            //  interpreter->setCurrIdx(currentScopeIdx--);
-            interpreter->popSymbolTable();
-            return *res;
+        return result;
+    }
+
+    /// Run the calls of a chain of tail calls, each call is first offered
+    /// to the execution manager which runs it if the function was promoted
+    /// to a compiled tier. A memo hit discards the arguments without
+    /// entering the function.
+    auto runChain(Interpreter* interpreter, size_t argBase, size_t depth,
+                  MemoMisses& misses) -> JSBasicValue {
+        auto& env     = interpreter->getEnvironment();
+        auto* func    = this;
+        auto* manager = interpreter->getExecutionManager();
+        // Keeps the function of the current tail call alive.
+        JSObjectRef tailCallee;
+        while (true) {
+            if (auto key = func->getMemoKey(env, argBase)) {
+                if (const auto* cached = func->memo->lookup(*key)) {
+                    env.truncate(argBase);
+                    return *cached;
+                }
+                misses.emplace_back(func->memo.get(), std::move(*key));
+            }
+            if (manager != nullptr) {
+                if (auto result = manager->dispatch(func->funcDecl, argBase)) {
+                    return std::move(*result);
+                }
+            }
+            auto completion = func->execute(interpreter, argBase);
+            if (completion != Completion::Return) {
+                return {};
+            }
+            if (!interpreter->hasTailCall()) {
+                return interpreter->takeReturnValue();
+            }
+            // Pure callees don't read the scopes of their callers.
+            if (!interpreter->isTailCallScoped()) {
+                env.popFramesTo(depth);
+            }
+            std::vector<JSBasicValue> arguments;
+            std::tie(tailCallee, arguments) = interpreter->takeTailCall();
+            func    = static_cast<JSFunction*>(tailCallee.get());
+            argBase = env.getTop();
+            for (auto& arg : arguments) {
+                env.pushArg(std::move(arg));
+            }
         }
-        interpreter->popSymbolTable();
-        // interpreter->setCurrIdx(currentScopeIdx--);
-        return {};
     }
 
-    private:
-    std::shared_ptr<JSFuncDecl> funcDecl;
+    /// Return the memo key of a call to the function, or nothing if the
+    /// function isn't memoized or an argument is an object.
+    auto getMemoKey(const Environment& env, size_t argBase)
+        -> std::optional<MemoKey> {
+        if (memo == nullptr) {
+            return std::nullopt;
+        }
+        MemoKey key;
+        key.reserve(env.getTop() - argBase);
+        for (auto idx = argBase; idx < env.getTop(); idx++) {
+            if (env.getSlot(idx).isObject()) {
+                return std::nullopt;
+            }
+            key.push_back(env.getSlot(idx));
+        }
+        return key;
+    }
+
+    /// Execute the function's body in a new function scope owning the
+    /// argument slots, the scope is exited on runtime errors too.
+    auto execute(Interpreter* interpreter, size_t argBase) -> Completion {
+        auto& env = interpreter->getEnvironment();
+        // Enter the function scope and name the argument slots.
+        env.pushFrameAt(argBase);
+        auto* caller = interpreter->enterFunction(funcDecl);
+        ScopeExit exitFunction([&] {
+            interpreter->enterFunction(caller);
+            interpreter->popScope();
+        });
+        env.bindParams(funcDecl->getParamNames());
+        // Execute the body in the function scope.
+        return interpreter->executeBlock(funcDecl->getBody());
+    }
+
+    JSFuncDecl* funcDecl;
+    /// Results of previous calls, only allocated for memoized functions.
+    std::unique_ptr<MemoTable> memo;
 };
 
 } // namespace minijsc
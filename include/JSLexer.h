@@ -7,8 +7,11 @@
 #define JSLEXER_H
 
 #include "JSToken.h"
+#include "LexerKernels.h"
+#include "SourceBuffer.h"
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -22,7 +25,14 @@ auto isDigit(char chr) -> bool;
 // Check if charcter is alphanumeric.
 auto isAlphaNumeric(char chr) -> bool;
 
-// JavaScript keywords.
+// Average number of source bytes per token, used to size the token vector.
+static constexpr size_t kSourceBytesPerToken = 6;
+
+// Return the kind of the keyword spelled by `text`, or `Identifier` when
+// it isn't a keyword. The lookup doesn't allocate.
+auto lookupKeyword(std::string_view text) -> JSTokenKind;
+
+// JavaScript keywords, the lexer recognizes them with `lookupKeyword`.
 static std::unordered_map<std::string, JSTokenKind> jsKeywords = {
     {"break", JSTokenKind::Break},
     {"case", JSTokenKind::Case},
@@ -67,28 +77,37 @@ static std::unordered_map<std::string, JSTokenKind> jsKeywords = {
 // and transforms it to a list of tokens.
 class JSLexer {
     public:
-    // Default constructor
-    explicit JSLexer(std::string source) : source(std::move(source)) {}
+    // Default constructor, the lexer doesn't copy the source which must
+    // outlive the tokens. Runs of characters are scanned with the kernels
+    // of the given instruction set.
+    explicit JSLexer(std::string_view source,
+                     ScanIsa isa = getNativeScanIsa())
+        : source(source), kernels(&getScanKernels(isa)) {}
+
+    // Lex the text of a source buffer in place, the buffer must outlive the
+    // tokens.
+    explicit JSLexer(const SourceBuffer& buffer,
+                     ScanIsa isa = getNativeScanIsa())
+        : JSLexer(buffer.getText(), isa) {}
 
     // Run the lexical analysis pass, populating the vector of tokens.
     auto lex() -> void;
 
     // Return the internal vector of tokens.
-    auto getTokens() -> std::vector<JSToken> { return tokens; }
+    auto getTokens() const -> const std::vector<JSToken>& { return tokens; }
 
     // Scan the source code and populate the the vector of tokens, the function
     // acts as a proxy for `lex`.
     auto scanTokens() -> std::vector<JSToken>;
+    // Scan and return the next token, returns `Eof` once the source is
+    // exhausted. Pulling tokens one at a time doesn't accumulate them.
+    auto next() -> JSToken;
     // Single token lexical pass
     auto scanToken() -> void;
     // Advance the lexer's cursor position.
     auto advance() -> char;
-    // Add a token to the list (for single lexeme tokens).
+    // Add a token spanning the current lexeme to the list.
     auto addToken(JSTokenKind kind) -> void;
-    // Add a token with a literal value.
-    auto addToken(JSTokenKind kind, const std::string& literal);
-    // Add a token with a numeric value.
-    auto addToken(JSTokenKind kind, double literal);
     // Check if we reached the end of file.
     auto isAtEnd() -> bool;
     // Match checks if the next token matches the argument.
@@ -107,13 +126,19 @@ class JSLexer {
     auto peekNext() -> char;
 
     private:
+    // Move the cursor past the run of characters skipped by the kernel.
+    auto skip(ScanKernel kernel) -> void;
+
     // Index of starting current token.
     size_t start = 0;
     // Index of the cursor in the source.
     size_t current = 0;
-    // Source code we want to lex as an std::string.
-    std::string source;
-    // List of processed tokens.
+    // Source code we want to lex.
+    std::string_view source;
+    // Kernels scanning runs of characters.
+    const ScanKernels* kernels;
+    // List of processed tokens, when pulling tokens with `next` it holds
+    // the token being scanned.
     std::vector<JSToken> tokens;
     // Line in the file or source code we're processing.
     int line = 0;
@@ -1,27 +1,94 @@
 //===----------------------------------------------------------------------===//
 // JSParser.h: This header defines the class and interface for the minijsc
-// parser. The parser we implement is a handwritten recursive descent parser.
+// parser. The parser we implement is a handwritten recursive descent parser,
+// expressions are parsed by precedence climbing (a Pratt parser) driven by a
+// table of binding powers indexed by token kind.
 //===----------------------------------------------------------------------===//
 #ifndef JSPARSER_H
 #define JSPARSER_H
 
 #include "AST.h"
+#include "ASTArena.h"
+#include "JSLexer.h"
 #include "JSToken.h"
+#include "JSTokenStream.h"
 #include "JSValue.h"
 #include "fmt/core.h"
 
 #include <algorithm>
+#include <array>
 #include <cstddef>
-#include <list>
+#include <cstdint>
+#include <initializer_list>
 #include <memory>
-#include <ranges>
 #include <stdexcept>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
 namespace minijsc {
 
+/// Binding power of the infix operators, from the loosest to the tightest.
+/// An operator binds the operands of every operator with a higher binding
+/// power.
+enum class Precedence : uint8_t {
+    // Tokens that aren't infix operators.
+    None,
+    // Assignment `=`, right associative.
+    Assignment,
+    // Logical or `||`.
+    Or,
+    // Logical and `&&`.
+    And,
+    // Equality `==` and `!=`.
+    Equality,
+    // Comparison `<`, `<=`, `>` and `>=`.
+    Comparison,
+    // Additive `+` and `-`.
+    Term,
+    // Multiplicative `*` and `/`.
+    Factor,
+    // Prefix `!` and `-`.
+    Unary,
+    // Call `f(...)`.
+    Call,
+};
+
+/// Table of the binding power of each token kind when it follows an operand.
+static constexpr auto kInfixPrecedence = [] {
+    std::array<Precedence, kTokenKindCount> table{};
+    auto set = [&table](JSTokenKind kind, Precedence prec) {
+        table[static_cast<size_t>(kind)] = prec;
+    };
+    set(JSTokenKind::Equal, Precedence::Assignment);
+    set(JSTokenKind::Or, Precedence::Or);
+    set(JSTokenKind::And, Precedence::And);
+    set(JSTokenKind::EqualEqual, Precedence::Equality);
+    set(JSTokenKind::BangEqual, Precedence::Equality);
+    set(JSTokenKind::Less, Precedence::Comparison);
+    set(JSTokenKind::LessEqual, Precedence::Comparison);
+    set(JSTokenKind::Greater, Precedence::Comparison);
+    set(JSTokenKind::GreaterEqual, Precedence::Comparison);
+    set(JSTokenKind::Plus, Precedence::Term);
+    set(JSTokenKind::Minus, Precedence::Term);
+    set(JSTokenKind::Star, Precedence::Factor);
+    set(JSTokenKind::Slash, Precedence::Factor);
+    set(JSTokenKind::LParen, Precedence::Call);
+    return table;
+}();
+
+/// Return the binding power of a token following an operand.
+constexpr auto getInfixPrecedence(JSTokenKind kind) -> Precedence {
+    return kInfixPrecedence[static_cast<size_t>(kind)];
+}
+
+/// Return the binding power just tighter than `prec`, the right operand of
+/// a left associative operator binds at least this tightly.
+constexpr auto nextPrecedence(Precedence prec) -> Precedence {
+    return static_cast<Precedence>(static_cast<uint8_t>(prec) + 1);
+}
+
 /// JSParser is a recursive descent parser that builds the abstract syntax
 /// tree for the JavaScript source.
 class JSParser {
@@ -30,9 +97,24 @@ class JSParser {
     explicit JSParser(std::vector<JSToken> tokens)
         : tokens(std::move(tokens)) {}
 
+    /// Constructor takes a lexer the parser pulls tokens from as it parses,
+    /// the lexer must outlive the parser.
+    explicit JSParser(JSLexer& lexer) : tokens(lexer) {}
+
+    /// Constructor takes a lexer and an arena owned elsewhere the nodes are
+    /// allocated in, used to parse pre-parsed function bodies into the arena
+    /// of their program. Such a parser doesn't own a program to `parse`.
+    explicit JSParser(JSLexer& lexer, ASTArena& arena)
+        : tokens(lexer), ownedArena(nullptr), arena(&arena) {}
+
+    /// Pre-parse the bodies of function declarations instead of parsing
+    /// them, a pre-parsed body is only checked for balanced brackets and is
+    /// parsed the first time it is needed (see `JSFuncDecl::getBody`).
+    auto setLazyFunctions(bool lazy) -> void { lazyFunctions = lazy; }
+
     // Match the next token against what we expect.
     auto match(const JSTokenKind& expected) -> bool {
-        if (tokens.at(current).getKind() == expected) {
+        if (peek().getKind() == expected) {
             advance();
             return true;
         }
@@ -40,21 +122,19 @@ class JSParser {
     }
 
     // Match one of many of the expected tokens.
-    auto match(const std::list<JSTokenKind>& expected) -> bool {
-        return std::ranges::any_of(expected.begin(), expected.end(),
-                                   [this](JSTokenKind tok) {
-                                       if (check(tok)) {
-                                           advance();
-                                           return true;
-                                       }
-                                       return false;
-                                   });
+    auto match(std::initializer_list<JSTokenKind> expected) -> bool {
+        if (std::ranges::find(expected, peek().getKind()) == expected.end() ||
+            isAtEnd()) {
+            return false;
+        }
+        advance();
+        return true;
     }
 
     // Advance consumes the current token and returns it.
-    auto advance() -> JSToken {
+    auto advance() -> const JSToken& {
         if (!isAtEnd()) {
-            current++;
+            tokens.advance();
         }
         return previous();
     }
@@ -69,12 +149,14 @@ class JSParser {
 
     // Consume checks if the passed token matches, if it does
     // it advances to the next token.
-    auto consume(const JSTokenKind& kind, std::string message) -> JSToken {
+    auto consume(const JSTokenKind& kind, std::string message)
+        -> const JSToken& {
         if (check(kind)) {
-            fmt::print("consume => {}", JSToken(kind, "", 0.0).toString());
+#ifdef DEBUG_TRACE_EXECUTION
+            fmt::print("consume => {}", JSToken(kind, {}).toString());
+#endif
             return advance();
         }
-        fmt::print("{}", message);
         throw std::invalid_argument(message);
     }
 
@@ -82,82 +164,100 @@ class JSParser {
     auto isAtEnd() -> bool { return peek().getKind() == JSTokenKind::Eof; }
 
     // Peek the current token we're at currently.
-    auto peek() -> JSToken { return tokens.at(current); }
+    auto peek() -> const JSToken& { return tokens.peek(); }
 
     // Return the most recently consumed token.
-    auto previous() -> JSToken { return tokens.at(current - 1); }
+    auto previous() -> const JSToken& { return tokens.previous(); }
+
+    // Parse is the core parsing function, the returned program owns the
+    // nodes of its syntax tree.
+    auto parse() -> JSProgram;
 
-    // Parse is the core parsing function.
-    auto parse() -> std::vector<std::shared_ptr<JSStmt>>;
+    // Return the arena nodes are allocated in until the next call to
+    // `parse`, nodes built by the other parsing functions live in it.
+    auto getArena() -> ASTArena& { return *arena; }
 
     // Parse a statement.
-    auto parseStmt() -> std::shared_ptr<JSStmt>;
+    auto parseStmt() -> JSStmt*;
 
     // Parse a declaration.
-    auto parseDecl() -> std::shared_ptr<JSStmt>;
+    auto parseDecl() -> JSStmt*;
 
     // Parse a variable declaration.
-    auto parseVarDecl() -> std::shared_ptr<JSStmt>;
+    auto parseVarDecl() -> JSStmt*;
 
     // Parse a function declaration.
-    auto parseFuncDecl() -> std::shared_ptr<JSStmt>;
+    auto parseFuncDecl() -> JSStmt*;
 
     // Parse a block statement.
-    auto parseBlockStmt() -> std::shared_ptr<JSBlockStmt>;
+    auto parseBlockStmt() -> JSBlockStmt*;
+
+    // Parse the source text of a pre-parsed function body into `arena`,
+    // functions nested in the body are pre-parsed if `lazy` is set.
+    static auto parseFunctionBody(std::string_view bodySource,
+                                  ASTArena& arena, bool lazy)
+        -> JSBlockStmt*;
+
+    // Pre-parse a function body, the opening brace was just consumed.
+    // Returns the source text of the body including its braces.
+    auto preParseBody() -> std::string_view;
 
     // Parse an if statement.
-    auto parseIfStmt() -> std::shared_ptr<JSIfStmt>;
+    auto parseIfStmt() -> JSIfStmt*;
 
     // Parse a while statement.
-    auto parseWhileStmt() -> std::shared_ptr<JSWhileStmt>;
+    auto parseWhileStmt() -> JSWhileStmt*;
 
     // Parse a for statement.
-    auto parseForStmt() -> std::shared_ptr<JSForStmt>;
+    auto parseForStmt() -> JSForStmt*;
 
     // Parse a return statement.
-    auto parseReturnStmt() -> std::shared_ptr<JSReturnStmt>;
+    auto parseReturnStmt() -> JSReturnStmt*;
+
+    // Parse a break statement.
+    auto parseBreakStmt() -> JSBreakStmt*;
+
+    // Parse a continue statement.
+    auto parseContinueStmt() -> JSContinueStmt*;
 
     // Parse an expression statement.
-    auto parseExprStmt() -> std::shared_ptr<JSStmt>;
+    auto parseExprStmt() -> JSStmt*;
 
     // Parse an expression.
-    auto parseExpr() -> std::shared_ptr<JSExpr>;
+    auto parseExpr() -> JSExpr*;
 
-    // Parse an assignment expression.
-    auto parseAssignmentExpr() -> std::shared_ptr<JSExpr>;
+    // Parse an expression whose infix operators bind at least as tightly
+    // as `minPrec`.
+    auto parsePrecedenceExpr(Precedence minPrec) -> JSExpr*;
 
-    // Parse equality expressions.
-    auto parseEqualityExpr() -> std::shared_ptr<JSExpr>;
+    // Parse a prefix expression, a unary expression or a primary one.
+    auto parsePrefixExpr() -> JSExpr*;
 
     // Parse a primary expression.
-    auto parsePrimaryExpr() -> std::shared_ptr<JSExpr>;
-
-    // Parse a unary expression.
-    auto parseUnaryExpr() -> std::shared_ptr<JSExpr>;
-
-    // Parse an Or logical expression.
-    auto parseOrExpr() -> std::shared_ptr<JSExpr>;
-
-    // Parse an And logical expression.
-    auto parseAndExpr() -> std::shared_ptr<JSExpr>;
-
-    // Parse a call expression.
-    auto parseCallExpr() -> std::shared_ptr<JSExpr>;
-
-    // Parse a factor expression.
-    auto parseFactorExpr() -> std::shared_ptr<JSExpr>;
+    auto parsePrimaryExpr() -> JSExpr*;
 
-    // Parse a term expression.
-    auto parseTermExpr() -> std::shared_ptr<JSExpr>;
+    // Parse the expression an infix operator forms with its left operand,
+    // the operator was just consumed.
+    auto parseInfixExpr(JSExpr* left, Precedence prec) -> JSExpr*;
 
-    // Parse comparison expression.
-    auto parseComparisonExpr() -> std::shared_ptr<JSExpr>;
+    // Parse the arguments of a call, the opening parenthesis was just
+    // consumed.
+    auto parseCallArgs(JSExpr* callee) -> JSExpr*;
 
     private:
     // Tokens the parser is processing.
-    std::vector<JSToken> tokens;
-    // Current token the parser is point to.
-    std::size_t current = 0;
+    JSTokenStream tokens;
+    // Arena owned by the parser until `parse` hands it to the program.
+    std::unique_ptr<ASTArena> ownedArena = std::make_unique<ASTArena>();
+    // Arena the syntax tree is allocated in.
+    ASTArena* arena = ownedArena.get();
+    // Whether function bodies are pre-parsed.
+    bool lazyFunctions = false;
+    // Brackets opened in the function body being pre-parsed.
+    std::vector<JSTokenKind> openBrackets;
+    // Depth of the loops enclosing the statement being parsed, used to
+    // reject `break` and `continue` outside of loops.
+    std::size_t loopDepth = 0;
 };
 
 } // namespace minijsc
@@ -4,18 +4,45 @@
 #include "AST.h"
 #include "JSValue.h"
 
+#include <bit>
+#include <cstdint>
 #include <exception>
+#include <functional>
+#include <list>
 #include <memory>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace minijsc {
 
 /// EnvPtr is an index in a heap allocated vector.
 using EnvPtr = int64_t;
 
+/// Max possiblee number of scopes.
+static constexpr size_t kMaxNestedScopes = 65535;
+
+/// Max number of results cached by a memoized function.
+static constexpr size_t kMemoCapacity = 4096;
+
+/// ScopeExit runs a function when it goes out of scope. Runtime errors are
+/// exceptions unwinding through the scopes and calls being executed, state
+/// restored by a ScopeExit is restored when an error unwinds it too.
+template <typename Exit> class ScopeExit {
+    public:
+    explicit ScopeExit(Exit exit) : exit(std::move(exit)) {}
+    ScopeExit(const ScopeExit&)                    = delete;
+    auto operator=(const ScopeExit&) -> ScopeExit& = delete;
+    ~ScopeExit() { exit(); }
+
+    private:
+    Exit exit;
+};
+
 /// JSValueRef is an index to a JSValue in the global state heap.
 using JSValueRef = size_t;
 
@@ -52,64 +79,328 @@ struct JSGlobalState {
     size_t occSize;
 };
 
+/// Binding associates a variable identifier to its value, bindings are
+/// stored in the environment's slot arena. Identifiers are not copied, they
+/// reference the identifiers owned by the AST which must outlive the bindings.
+/// Argument slots of a pending call have an empty name until the callee's
+/// frame is entered.
+struct Binding {
+    // Variable identifier.
+    std::string_view name;
+    // Bound value.
+    JSBasicValue value;
+};
+
+/// Frame describes a single scope as a contiguous range of slots in the
+/// environment's arena, the range starts at `base` and ends at the base
+/// of the next frame (or the end of the arena for the innermost frame).
+struct Frame {
+    // Index of the first slot owned by the frame.
+    size_t base;
+    // Index of the parent frame, -1 for the global scope.
+    EnvPtr parent;
+};
+
 // Each runtime environment is scoped to a block, blocks are enclosed within
 // curly braces and each block can have one or more inner blocks.
 // In order to be able to resolve variables in an outer scope we assign each
-// environment a pointer denoted by an index in the global runtime environment
-// the interpreter's core assign and resolve methods will walk the runtime.
+// scope a pointer denoted by an index in the frame stack, the interpreter's
+// core assign and resolve methods will walk the frames using that pointer.
 //
-// Each environment is protected by a guard, when entering a new scope the top
-// EnvPtr is updated to the new scope's environment and keeps track of the old
-// parent by saving the old value in PrevEnvPtr.
+// Scopes don't own their bindings, all bindings live in a single arena of
+// slots and each frame owns the range of slots defined while it was the
+// innermost frame. Entering a scope bump allocates a frame and exiting it
+// truncates the arena back to the frame's base, so block entry and exit
+// never allocate once the arena has grown to the program's working set.
+// Function and block scopes hold a handful of bindings and are searched
+// linearly, the global scope holds every top level declaration and indexes
+// its slots by name.
 // At first the design used a pointer oriented approach but this ended up to be
 // very bug prone especially since the ownership of the runtime changes and old
 // values must be destroyed.
 class Environment {
     public:
-    // Default constructor.
-    explicit Environment() = default;
+    // Default constructor creates the global scope.
+    explicit Environment() { frames.push_back(Frame{0, -1}); }
+
+    // Push a new scope whose parent is the current innermost scope.
+    auto pushFrame() -> void { pushFrameAt(slots.size()); }
 
-    // Set a reference to the parent environment.
-    auto setParentPtr(EnvPtr ptr) -> void { parent = ptr; }
+    // Push a new scope owning the slots starting at `base`, the slots past
+    // `base` are the arguments of a call pushed with `pushArg`.
+    auto pushFrameAt(size_t base) -> void {
+        if (frames.size() >= kMaxNestedScopes) {
+            throw std::runtime_error("Maximum call stack size exceeded.");
+        }
+        frames.push_back(Frame{base, getCurrent()});
+    }
 
-    // Get a reference to the parent environment.
-    [[nodiscard]] auto getParentPtr() const -> EnvPtr { return parent; }
+    // Return the index of the next free slot.
+    [[nodiscard]] auto getTop() const -> size_t { return slots.size(); }
+
+    // Push an unnamed argument slot, arguments are written directly to
+    // the slots that become the callee's parameters.
+    auto pushArg(JSBasicValue value) -> void {
+        slots.push_back(Binding{{}, std::move(value)});
+    }
+
+    // Bind the parameter names to the argument slots of the innermost scope,
+    // extra arguments are dropped and missing ones are undefined.
+    auto bindParams(std::span<const std::string_view> names) -> void {
+        auto base = frames.back().base;
+        slots.resize(base + names.size());
+        for (size_t i = 0; i < names.size(); i++) {
+            slots[base + i].name = names[i];
+        }
+    }
+
+    // Return the value stored in the slot at `idx`.
+    [[nodiscard]] auto getSlot(size_t idx) const -> const JSBasicValue& {
+        return slots[idx].value;
+    }
+
+    // Drop the slots past `top`, used to discard the arguments of a call
+    // that completed without entering the callee's frame.
+    auto truncate(size_t top) -> void { slots.resize(top); }
+
+    // Pop the innermost scope destroying its bindings.
+    auto popFrame() -> void {
+        slots.resize(frames.back().base);
+        frames.pop_back();
+    }
+
+    // Pop the scopes entered after the environment had `depth` scopes.
+    auto popFramesTo(size_t depth) -> void {
+        if (depth < frames.size()) {
+            slots.resize(frames[depth].base);
+            frames.resize(depth);
+        }
+    }
+
+    // Get a reference to the innermost scope.
+    [[nodiscard]] auto getCurrent() const -> EnvPtr {
+        return static_cast<EnvPtr>(frames.size()) - 1;
+    }
+
+    // Return the number of live scopes.
+    [[nodiscard]] auto getDepth() const -> size_t { return frames.size(); }
+
+    // Return the bindings of the live scopes.
+    [[nodiscard]] auto getBindings() const -> std::span<const Binding> {
+        return slots;
+    }
 
-    // Define a new binding from a variable identifier to a value.
-    auto defineBinding(const std::string& name, std::shared_ptr<JSValue> value)
-        -> void {
-        values[name] = std::move(value);
+    // Define a new binding from a variable identifier to a value in the
+    // innermost scope, redefinitions overwrite the existing binding.
+    auto defineBinding(std::string_view name, JSBasicValue value) -> void {
+        if (auto* slot = lookup(getCurrent(), name)) {
+            *slot = std::move(value);
+            return;
+        }
+        if (getCurrent() == 0) {
+            globals[name] = slots.size();
+        }
+        slots.push_back(Binding{name, std::move(value)});
     }
 
-    // Resolve a binding.
-    auto resolveBinding(const std::string& name) -> std::shared_ptr<JSValue> {
-        fmt::print("Checking inner scope of : {} for variable : {}\n", parent,
-                   name);
-        if (values.contains(name)) {
-            return values[name];
+    // Resolve a binding walking from the innermost scope to the global scope,
+    // returns a pointer to the bound value or nullptr if the binding doesn't
+    // exist.
+    auto resolveBinding(std::string_view name) -> JSBasicValue* {
+        for (auto idx = getCurrent(); idx != -1; idx = frames[idx].parent) {
+            if (auto* slot = lookup(idx, name)) {
+                return slot;
+            }
         }
         return nullptr;
     }
 
+    // Resolve a binding in the innermost scope only.
+    auto resolveLocal(std::string_view name) -> JSBasicValue* {
+        return lookup(getCurrent(), name);
+    }
+
     // Assign a new value to an existing binding, returns a boolean value
     // to signal success or failure.
     // Failure of an assignment means the binding doesn't existing in JS
     // terms the variable is undefined.
-    auto assign(const std::string& name, std::shared_ptr<JSValue> value)
-        -> bool {
-        if (values.contains(name)) {
-            values[name] = std::move(value);
+    auto assign(std::string_view name, JSBasicValue value) -> bool {
+        if (auto* slot = resolveBinding(name)) {
+            *slot = std::move(value);
             return true;
         }
         return false;
     }
 
     private:
-    /// Values map stores variable declarations by their variable name mapping
-    /// them to the variable values.
-    std::unordered_map<std::string, std::shared_ptr<JSValue>> values;
-    /// Parent scope's environment.
-    EnvPtr parent;
+    // Lookup a binding in the slot range owned by the frame at `idx`.
+    auto lookup(EnvPtr idx, std::string_view name) -> JSBasicValue* {
+        auto begin = frames[idx].base;
+        auto end   = static_cast<size_t>(idx + 1) < frames.size()
+                         ? frames[idx + 1].base
+                         : slots.size();
+        if (idx == 0) {
+            auto found = globals.find(name);
+            if (found == globals.end()) {
+                return nullptr;
+            }
+            // Global slots are only dropped if the arena is truncated below
+            // them, the index entry is stale then.
+            if (found->second >= end || slots[found->second].name != name) {
+                globals.erase(found);
+                return nullptr;
+            }
+            return &slots[found->second].value;
+        }
+        for (auto i = end; i > begin; i--) {
+            if (slots[i - 1].name == name) {
+                return &slots[i - 1].value;
+            }
+        }
+        return nullptr;
+    }
+
+    /// Slot arena holding the bindings of all live scopes, grows on demand
+    /// and is truncated when scopes exit.
+    std::vector<Binding> slots;
+    /// Stack of live scopes, the global scope is always at index 0.
+    std::vector<Frame> frames;
+    /// Slots of the global scope's bindings by name.
+    std::unordered_map<std::string_view, size_t> globals;
+};
+
+/// MemoKey is the list of argument values of a memoized call, memoized
+/// calls only take primitive arguments.
+using MemoKey = std::vector<JSBasicValue>;
+
+/// MemoTable caches the results of a pure function keyed by its arguments,
+/// the table is bounded and evicts the least recently used result.
+///
+/// Numbers are compared by their bit pattern so `0` and `-0` are distinct
+/// keys and a NaN argument hits the cached NaN result.
+class MemoTable {
+    public:
+    explicit MemoTable(size_t capacity = kMemoCapacity) : capacity(capacity) {}
+
+    // Return the cached result of a call or nullptr on a miss, a hit marks
+    // the result as the most recently used.
+    auto lookup(const MemoKey& key) -> const JSBasicValue* {
+        auto iter = index.find(&key);
+        if (iter == index.end()) {
+            misses++;
+            return nullptr;
+        }
+        hits++;
+        entries.splice(entries.begin(), entries, iter->second);
+        return &iter->second->second;
+    }
+
+    // Cache the result of a call evicting the least recently used result
+    // when the table is full.
+    auto insert(MemoKey key, JSBasicValue value) -> void {
+        if (index.contains(&key)) {
+            return;
+        }
+        if (entries.size() >= capacity) {
+            index.erase(&entries.back().first);
+            entries.pop_back();
+        }
+        entries.emplace_front(std::move(key), std::move(value));
+        index.emplace(&entries.front().first, entries.begin());
+    }
+
+    // Return the number of cached results.
+    [[nodiscard]] auto size() const -> size_t { return entries.size(); }
+
+    // Return the number of lookups that found a cached result.
+    [[nodiscard]] auto getHits() const -> size_t { return hits; }
+
+    // Return the number of lookups that didn't find a cached result.
+    [[nodiscard]] auto getMisses() const -> size_t { return misses; }
+
+    private:
+    /// Entry is a cached result, entries own their key.
+    using Entry = std::pair<MemoKey, JSBasicValue>;
+
+    /// Hash a key by the kinds and values of its arguments.
+    struct KeyHash {
+        auto operator()(const MemoKey* key) const -> size_t {
+            size_t hash = key->size();
+            for (const auto& arg : *key) {
+                hash = hash * 31 + static_cast<size_t>(arg.getKind());
+                switch (arg.getKind()) {
+                case JSValueKind::Number:
+                    hash = hash * 31 + std::hash<uint64_t>{}(
+                                           std::bit_cast<uint64_t>(
+                                               arg.getValue<JSNumber>()));
+                    break;
+                case JSValueKind::Boolean:
+                    hash = hash * 31 +
+                           static_cast<size_t>(arg.getValue<JSBoolean>());
+                    break;
+                case JSValueKind::String:
+                    hash = hash * 31 +
+                           std::hash<JSString>{}(arg.getValue<JSString>());
+                    break;
+                default:
+                    break;
+                }
+            }
+            return hash;
+        }
+    };
+
+    /// Compare two keys argument by argument.
+    struct KeyEqual {
+        auto operator()(const MemoKey* lhs, const MemoKey* rhs) const -> bool {
+            if (lhs->size() != rhs->size()) {
+                return false;
+            }
+            for (size_t i = 0; i < lhs->size(); i++) {
+                const auto& left  = (*lhs)[i];
+                const auto& right = (*rhs)[i];
+                if (left.getKind() != right.getKind()) {
+                    return false;
+                }
+                switch (left.getKind()) {
+                case JSValueKind::Number:
+                    if (std::bit_cast<uint64_t>(left.getValue<JSNumber>()) !=
+                        std::bit_cast<uint64_t>(right.getValue<JSNumber>())) {
+                        return false;
+                    }
+                    break;
+                case JSValueKind::Boolean:
+                    if (left.getValue<JSBoolean>() !=
+                        right.getValue<JSBoolean>()) {
+                        return false;
+                    }
+                    break;
+                case JSValueKind::String:
+                    if (left.getValue<JSString>() !=
+                        right.getValue<JSString>()) {
+                        return false;
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+            return true;
+        }
+    };
+
+    /// Maximum number of cached results.
+    size_t capacity;
+    /// Cached results ordered from the most to the least recently used.
+    std::list<Entry> entries;
+    /// Index of the cached results, keys point into the entries.
+    std::unordered_map<const MemoKey*, std::list<Entry>::iterator, KeyHash,
+                       KeyEqual>
+        index;
+    /// Number of lookups that found a cached result.
+    size_t hits = 0;
+    /// Number of lookups that didn't find a cached result.
+    size_t misses = 0;
 };
 } // namespace minijsc
 
@@ -7,13 +7,16 @@
 
 #include "JSValue.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
 
 namespace minijsc {
 // JavaScript token types.
-enum class JSTokenKind {
+enum class JSTokenKind : uint8_t {
     // Single character tokens
     LParen,
     RParen,
@@ -98,20 +101,24 @@ enum class JSTokenKind {
     Eof,
 };
 
+// Number of token kinds, tables indexed by token kind have this size.
+static constexpr size_t kTokenKindCount =
+    static_cast<size_t>(JSTokenKind::Eof) + 1;
+
 // Token class represents the outputs of our lexer, a token has an associated
-// kind, encoded as an enum, a lexeme that holds the textual representation
-// of the token and a literal (for numerics, strings and identifiers).
+// kind, encoded as an enum, and a lexeme that holds the textual representation
+// of the token.
+//
+// Tokens don't own their lexeme, the lexeme is a span of the source which
+// must outlive the tokens and the syntax tree built from them. Literal values
+// (for numerics and strings) are decoded from the lexeme on demand, so lexing
+// never allocates per token and a token fits in 16 bytes.
 class JSToken {
     public:
     // Default constructor.
-    explicit JSToken(JSTokenKind typ, std::string lexeme,
-                     JSBasicValue literal)                          // NOLINT
-        : kind(typ), lexeme(std::move(lexeme)), literal(literal) {} // NOLINT
-
-    // Default constructo for numeric values.
-    JSToken(JSTokenKind typ, std::string lexeme,
-            double literal)                                         // NOLINT
-        : kind(typ), lexeme(std::move(lexeme)), literal(literal) {} // NOLINT
+    JSToken(JSTokenKind typ, std::string_view lexeme)
+        : start(lexeme.data()), length(static_cast<uint32_t>(lexeme.size())),
+          kind(typ) {}
 
     // Return a textual representation of the token.
     [[nodiscard]] auto toString() const -> std::string;
@@ -119,22 +126,26 @@ class JSToken {
     // Return the token kind.
     [[nodiscard]] auto getKind() const -> JSTokenKind { return kind; }
 
-    // Return the value literal.
-    [[nodiscard]] auto getLiteral() const -> JSBasicValue { return literal; }
+    // Return the value literal, numerics are parsed, strings are unquoted and
+    // the lexeme of every other token is returned as a string.
+    [[nodiscard]] auto getLiteral() const -> JSBasicValue;
 
     // Return the lexeme.
-    [[nodiscard]] auto getLexeme() const -> std::string { return lexeme; }
+    [[nodiscard]] auto getLexeme() const -> std::string_view {
+        return {start, length};
+    }
 
     private:
+    // First character of the lexeme in the source.
+    const char* start;
+    // Length of the lexeme.
+    uint32_t length;
     // Token kind
     JSTokenKind kind;
-    // Lexeme is the string representation of the token.
-    std::string lexeme;
-    // Literal is the literal value associated with some token types
-    // such as numeric values, strings or identifiers.
-    JSBasicValue literal;
 };
 
+static_assert(sizeof(JSToken) == 16, "tokens should stay 16 bytes");
+
 }; // namespace minijsc
 
 #endif
@@ -0,0 +1,75 @@
+//===----------------------------------------------------------------------===//
+// JSTokenStream.h: This header defines the token stream the parser reads
+// from, the stream either pulls tokens from a lexer on demand or reads them
+// from a vector of tokens lexed beforehand.
+//
+// The stream keeps a small window of tokens in a ring buffer: the most
+// recently consumed token, the current token and a bounded lookahead. When
+// pulling from a lexer the memory used for tokens doesn't depend on the size
+// of the source and each token is parsed right after being lexed.
+//===----------------------------------------------------------------------===//
+#ifndef JSTOKEN_STREAM_H
+#define JSTOKEN_STREAM_H
+
+#include "JSLexer.h"
+#include "JSToken.h"
+
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace minijsc {
+
+/// Number of tokens kept in the stream window, the previous token, the
+/// current token and the lookahead.
+static constexpr size_t kTokenWindow = 4;
+
+/// Number of tokens past the current one the parser can peek at.
+static constexpr size_t kMaxLookahead = kTokenWindow - 2;
+
+/// JSTokenStream feeds tokens to the parser through a ring buffer.
+class JSTokenStream {
+    public:
+    /// Pull tokens from the lexer as the parser consumes them, the lexer
+    /// must outlive the stream.
+    explicit JSTokenStream(JSLexer& lexer) : lexer(&lexer) {}
+
+    /// Read tokens from a vector, the vector is expected to end with an
+    /// `Eof` token.
+    explicit JSTokenStream(std::vector<JSToken> tokens)
+        : tokens(std::move(tokens)) {}
+
+    /// Return the token `ahead` tokens past the current one, `ahead` is at
+    /// most kMaxLookahead. Tokens are valid until the stream advances.
+    auto peek(size_t ahead = 0) -> const JSToken&;
+
+    /// Return the most recently consumed token.
+    auto previous() -> const JSToken&;
+
+    /// Consume the current token.
+    auto advance() -> void;
+
+    private:
+    /// Fetch the next token into the window.
+    auto fetch() -> void;
+
+    /// Lexer the tokens are pulled from, nullptr when reading a vector.
+    JSLexer* lexer = nullptr;
+    /// Tokens lexed beforehand.
+    std::vector<JSToken> tokens;
+    /// Index of the next token to read from `tokens`.
+    size_t next = 0;
+    /// Ring buffer of the tokens in the window.
+    std::array<JSToken, kTokenWindow> window = {
+        JSToken(JSTokenKind::Eof, {}), JSToken(JSTokenKind::Eof, {}),
+        JSToken(JSTokenKind::Eof, {}), JSToken(JSTokenKind::Eof, {})};
+    /// Position of the current token in the stream.
+    size_t current = 0;
+    /// Number of tokens fetched so far.
+    size_t fetched = 0;
+};
+
+} // namespace minijsc
+
+#endif
@@ -9,6 +9,7 @@
 #include "fmt/core.h"
 
 #include <cstddef>
+#include <memory>
 #include <optional>
 #include <string>
 #include <utility>
@@ -27,10 +28,15 @@ using JSBoolean = bool;
 // JSString aliases the string types (includes std::string & char*).
 using JSString = std::string;
 
+class JSValue;
+// JSObjectRef is a reference to a heap allocated runtime object such as
+// a function, primitives are never boxed behind a JSObjectRef.
+using JSObjectRef = std::shared_ptr<JSValue>;
+
 // JSPrimitiveValue is a type that can hold all possible variants of JavaScript's
-// primitive values.
+// primitive values and references to heap objects.
 using JSPrimitiveValue =
-    std::variant<JSNumber, JSBoolean, JSString, JSUndefined, JSNull>;
+    std::variant<JSNumber, JSBoolean, JSString, JSUndefined, JSNull, JSObjectRef>;
 
 // JSType enumerates the possible Javascript primitive types.
 enum class JSValueKind {
@@ -44,8 +50,8 @@ enum class JSValueKind {
     Array,
 };
 
-/// JSValue defines a virtual interface for representing all JavaScript values
-/// including primitives and compound literals and types.
+/// JSValue defines a virtual interface for representing heap allocated
+/// JavaScript values such as functions, objects and arrays.
 class JSValue {
     public:
     virtual ~JSValue() = default;
@@ -56,7 +62,9 @@ class JSValue {
 /// JSBasicValue class represents a JavaScript primitive value, primitives
 /// include numbers, booleans, strings and the undefined and null types.
 /// JSBasicValue is implemented using a variant around C++ primitive types
-class JSBasicValue : public JSValue {
+/// and is passed around by value, only heap objects (see `JSValue`) live
+/// behind a reference counted pointer.
+class JSBasicValue {
     public:
     // Default constructor sets the type to undefined, the variant is in monostate.
     JSBasicValue() : type(JSValueKind::Undefined) {}
@@ -79,6 +87,11 @@ class JSBasicValue : public JSValue {
     JSBasicValue(const char* str)
         : value(std::string(str)), type(JSValueKind::String) {}
 
+    // Constructor for references to heap objects, the kind is the one
+    // reported by the referenced object.
+    JSBasicValue(JSObjectRef object)
+        : value(object), type(object->getKind()) {}
+
     // Check if two values are equal, this is a strict equality implementation
     // that is used to compare values in the VM and interpreter.
     auto isEqual(JSBasicValue& other) -> bool {
@@ -102,6 +115,11 @@ class JSBasicValue : public JSValue {
             auto rhs = other.getValue<JSBoolean>();
             return (lhs == rhs);
         }
+        // Heap objects are equal only if they are the same object.
+        case JSValueKind::Function:
+        case JSValueKind::Object:
+        case JSValueKind::Array:
+            return getObject() == other.getObject();
         default:
             return false;
         }
@@ -162,7 +180,7 @@ class JSBasicValue : public JSValue {
     }
 
     // Return the `JSValueKind` of this value.
-    [[nodiscard]] auto getKind() -> JSValueKind override { return type; }
+    [[nodiscard]] auto getKind() const -> JSValueKind { return type; }
 
     // Check if the value is undefined.
     [[nodiscard]] auto isUndefined() const -> bool {
@@ -184,6 +202,19 @@ class JSBasicValue : public JSValue {
         return type == JSValueKind::String;
     }
 
+    // Check if the value is a reference to a heap object.
+    [[nodiscard]] auto isObject() const -> bool {
+        return std::holds_alternative<JSObjectRef>(value);
+    }
+
+    // Return the referenced heap object or nullptr for primitives.
+    [[nodiscard]] auto getObject() const -> JSValue* {
+        if (const auto* obj = std::get_if<JSObjectRef>(&value)) {
+            return obj->get();
+        }
+        return nullptr;
+    }
+
     // Return a string representation of the value.
     [[nodiscard]] auto toString() const -> std::string {
         switch (type) {
@@ -0,0 +1,54 @@
+//===----------------------------------------------------------------------===//
+// LexerKernels.h: This header defines the scanning kernels of the lexer, the
+// routines skipping over runs of characters of the same class (blanks,
+// identifier characters, digits and string contents).
+//
+// Each kernel has a scalar version and, on x86-64, versions using SSE2 and
+// AVX2 which test 16 or 32 characters at a time. The kernels are picked at
+// runtime depending on the instruction sets the CPU supports.
+//===----------------------------------------------------------------------===//
+#ifndef LEXER_KERNELS_H
+#define LEXER_KERNELS_H
+
+#include <cstdint>
+
+namespace minijsc {
+
+/// ScanIsa enumerates the instruction sets the scanning kernels target.
+enum class ScanIsa : uint8_t {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+/// Kernel skipping a run of characters in [first, last), returns a pointer
+/// to the first character ending the run or `last`.
+using ScanKernel = auto (*)(const char* first, const char* last)
+    -> const char*;
+
+/// ScanKernels holds the kernels for one instruction set.
+struct ScanKernels {
+    // Skip spaces, tabs and carriage returns, newlines end the run since the
+    // lexer counts lines.
+    ScanKernel skipBlanks;
+    // Skip letters, digits and underscores.
+    ScanKernel skipIdentifier;
+    // Skip decimal digits.
+    ScanKernel skipDigits;
+    // Skip string contents up to a double quote or a newline.
+    ScanKernel skipString;
+};
+
+/// Check if the CPU supports the instruction set.
+auto isScanIsaSupported(ScanIsa isa) -> bool;
+
+/// Return the fastest instruction set supported by the CPU.
+auto getNativeScanIsa() -> ScanIsa;
+
+/// Return the kernels for an instruction set, falls back to the scalar
+/// kernels if the instruction set isn't supported.
+auto getScanKernels(ScanIsa isa) -> const ScanKernels&;
+
+} // namespace minijsc
+
+#endif
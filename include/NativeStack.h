@@ -0,0 +1,31 @@
+//===----------------------------------------------------------------------===//
+// NativeStack.h: This header defines the native stack guard of the tiers
+// whose calls recurse on the native stack.
+//
+// Interpreted and closure compiled calls run the callee's body in a nested
+// native call, how many of them fit depends on the build type, the size of
+// the function bodies and the stack size of the thread. Instead of bounding
+// the number of calls the guard checks how much of the thread's stack is
+// left, runaway recursion is reported as an error instead of crashing.
+//===----------------------------------------------------------------------===//
+#ifndef NATIVE_STACK_H
+#define NATIVE_STACK_H
+
+#include <cstddef>
+
+namespace minijsc {
+
+/// Bytes of native stack kept free when entering a call, room for the
+/// expressions evaluated between two calls and for unwinding the error.
+static constexpr size_t kNativeStackReserve = 512 * 1024;
+
+/// Stack size assumed for threads whose stack bounds can't be queried.
+static constexpr size_t kDefaultNativeStackSize = 1024 * 1024;
+
+/// Throw a "Maximum call stack size exceeded." runtime error if less than
+/// `kNativeStackReserve` bytes of the current thread's stack are left.
+auto checkNativeStack() -> void;
+
+} // namespace minijsc
+
+#endif
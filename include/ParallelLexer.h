@@ -0,0 +1,40 @@
+//===----------------------------------------------------------------------===//
+// ParallelLexer.h: This header defines parallel lexing of large sources.
+//
+// The source is split in chunks at newlines outside of string literals,
+// found by counting the quotes preceding each candidate newline. No token
+// spans such a newline so each chunk is lexed by its own JSLexer on a worker
+// thread and the token vectors are concatenated. Tokens point into the
+// source so they need no fixups.
+//===----------------------------------------------------------------------===//
+#ifndef PARALLEL_LEXER_H
+#define PARALLEL_LEXER_H
+
+#include "JSToken.h"
+#include "LexerKernels.h"
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace minijsc {
+
+/// Minimum size of a chunk, smaller sources are lexed on the calling thread.
+static constexpr size_t kMinLexChunk = 1 << 20;
+
+/// Split a source in at most `chunks` chunks of at least `minChunk` bytes
+/// each ending after a newline outside of string literals, the last chunk
+/// ends with the source.
+auto splitSource(std::string_view source, size_t chunks,
+                 size_t minChunk = kMinLexChunk)
+    -> std::vector<std::string_view>;
+
+/// Lex a source using up to `workers` threads, returns the same tokens as
+/// `JSLexer(source).scanTokens()`. The source must outlive the tokens.
+auto lexParallel(std::string_view source, size_t workers,
+                 size_t minChunk = kMinLexChunk,
+                 ScanIsa isa = getNativeScanIsa()) -> std::vector<JSToken>;
+
+} // namespace minijsc
+
+#endif
@@ -0,0 +1,33 @@
+//===----------------------------------------------------------------------===//
+// ParallelParser.h: This header defines parallel parsing of large programs.
+//
+// The program is first parsed with function bodies pre-parsed, a fast scan
+// matching brackets which finds where each top level function body starts
+// and ends. The bodies are then split in contiguous groups of roughly equal
+// size and each group is parsed on a worker thread into an arena of its own.
+// The parsed bodies are attached to their declarations, which are already in
+// source order in the program, and the program adopts the workers' arenas.
+//===----------------------------------------------------------------------===//
+#ifndef PARALLEL_PARSER_H
+#define PARALLEL_PARSER_H
+
+#include "AST.h"
+
+#include <cstddef>
+#include <string_view>
+
+namespace minijsc {
+
+/// Minimum size of the function bodies parsed by a worker, smaller programs
+/// are parsed on the calling thread.
+static constexpr size_t kMinParseChunk = 64 * 1024;
+
+/// Parse a program using up to `workers` threads, returns the same program
+/// as `JSParser(tokens).parse()` with every top level function body parsed.
+/// The source must outlive the program.
+auto parseParallel(std::string_view source, size_t workers,
+                   size_t minChunk = kMinParseChunk) -> JSProgram;
+
+} // namespace minijsc
+
+#endif
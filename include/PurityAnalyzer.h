@@ -0,0 +1,134 @@
+//===----------------------------------------------------------------------===//
+// PurityAnalyzer.h: This file defines the purity analysis, a pass over
+// a program that marks the top level function declarations which only depend
+// on their arguments and have no side effects.
+//
+// A function is pure when it doesn't write or read any non-local binding
+// except for calling other pure functions (including itself). Since scopes
+// are resolved dynamically, a function name that is ever assigned or shadowed
+// by a parameter or a variable declaration is never considered pure.
+//
+// Pure functions whose body starts with the `"use memo";` directive have
+// their calls memoized by the interpreter.
+//
+// Top level functions whose body was only pre-parsed are analyzed once the
+// analyzed code references them, a function nothing references can't run
+// so its body is never parsed.
+//===----------------------------------------------------------------------===//
+#ifndef PURITY_ANALYZER_H
+#define PURITY_ANALYZER_H
+
+#include "AST.h"
+
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace minijsc {
+
+/// Directive opting a pure function into call memoization.
+static constexpr const char* kMemoDirective = "use memo";
+
+/// Purity analyzer implements the visitor pattern collecting for each top
+/// level function the non-local bindings it depends on.
+class PurityAnalyzer : public ASTVisitor {
+    public:
+    /// Default constructor.
+    explicit PurityAnalyzer() = default;
+    /// Default destructor.
+    ~PurityAnalyzer() override = default;
+
+    /// Analyze a program, marking its pure and memoized functions.
+    auto analyze(std::span<JSStmt* const> stmts) -> void;
+
+    /// Return a pure function followed by the functions it transitively
+    /// calls, returns an empty list if the function isn't pure.
+    [[nodiscard]] auto getDependencies(JSFuncDecl* decl) const
+        -> std::vector<JSFuncDecl*>;
+
+    /// Check if the analysis references names or declarations parsed from
+    /// `source`.
+    [[nodiscard]] auto references(std::string_view source) const -> bool;
+
+    /// Visit a literal expression.
+    auto visitLiteralExpr(JSLiteralExpr* expr) -> void override;
+    /// Visit a binary expression.
+    auto visitBinaryExpr(JSBinExpr* expr) -> void override;
+    /// Visit a unary expression.
+    auto visitUnaryExpr(JSUnaryExpr* expr) -> void override;
+    /// Visit a logical expression.
+    auto visitLogicalExpr(JSLogicalExpr* expr) -> void override;
+    /// Visit a grouping expression.
+    auto visitGroupingExpr(JSGroupingExpr* expr) -> void override;
+    /// Visit a variable expression.
+    auto visitVarExpr(JSVarExpr* expr) -> void override;
+    /// Visit an assignment expression.
+    auto visitAssignExpr(JSAssignExpr* expr) -> void override;
+    /// Visit a call expression.
+    auto visitCallExpr(JSCallExpr* expr) -> void override;
+    /// Visit a block statement.
+    auto visitBlockStmt(JSBlockStmt* block) -> void override;
+    /// Visit an expression statement.
+    auto visitExprStmt(JSExprStmt* stmt) -> void override;
+    /// Visit an if statement.
+    auto visitIfStmt(JSIfStmt* stmt) -> void override;
+    /// Visit a while statement.
+    auto visitWhileStmt(JSWhileStmt* stmt) -> void override;
+    /// Visit a for statement.
+    auto visitForStmt(JSForStmt* stmt) -> void override;
+    /// Visit a variable declaration.
+    auto visitVarDecl(JSVarDecl* stmt) -> void override;
+    /// Visit a function declaration.
+    auto visitFuncDecl(JSFuncDecl* stmt) -> void override;
+    /// Visit a return statement.
+    auto visitReturnStmt(JSReturnStmt* stmt) -> void override;
+    /// Visit a break statement.
+    auto visitBreakStmt(JSBreakStmt* stmt) -> void override;
+    /// Visit a continue statement.
+    auto visitContinueStmt(JSContinueStmt* stmt) -> void override;
+
+    private:
+    /// Facts collected for a top level function.
+    struct FunctionInfo {
+        // Function declaration.
+        JSFuncDecl* decl = nullptr;
+        // Whether the function is pure so far.
+        bool pure = true;
+        // Names of the functions the function depends on.
+        std::unordered_set<std::string_view> callees = {};
+    };
+
+    /// Visit an expression.
+    auto analyze(JSExpr* expr) -> void;
+    /// Visit a statement.
+    auto analyze(JSStmt* stmt) -> void;
+    /// Check if a name is bound in the scopes of the analyzed function.
+    auto isLocal(std::string_view name) -> bool;
+    /// Declare a local in the innermost scope of the analyzed function.
+    auto declare(std::string_view name) -> void;
+    /// Mark the analyzed function as impure.
+    auto markImpure() -> void;
+    /// Queue the pre-parsed top level functions named `name` for analysis.
+    auto reference(std::string_view name) -> void;
+
+    /// Top level functions that are candidates for purity.
+    std::unordered_map<std::string_view, FunctionInfo> functions;
+    /// Names declared as variables or parameters or assigned anywhere.
+    std::unordered_set<std::string_view> shadowed;
+    /// Function being analyzed, nullptr at the top level.
+    FunctionInfo* current = nullptr;
+    /// Local scopes of the function being analyzed.
+    std::vector<std::unordered_set<std::string_view>> scopes;
+    /// Pre-parsed top level functions that weren't referenced yet.
+    std::unordered_map<std::string_view, std::vector<JSFuncDecl*>> deferred;
+    /// Pre-parsed top level functions referenced but not analyzed yet.
+    std::vector<JSFuncDecl*> pending;
+};
+
+} // namespace minijsc
+
+#endif
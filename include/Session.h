@@ -0,0 +1,117 @@
+//===----------------------------------------------------------------------===//
+// Session.h: This header defines sessions, long lived programs evaluated
+// piece by piece such as a REPL or a script edited in an editor.
+//
+// A session keeps a single execution manager, and so the interpreter's
+// environment and the compiled code of hot functions, for its whole
+// lifetime. Bindings reference their names in the source text and functions
+// reference their declarations, so a source and the program parsed from it
+// are kept as long as the document or the runtime state references them.
+// Editing a statement over and over keeps at most its first version, which
+// defined the names of its bindings, and its latest one.
+//
+// The session tracks its document, the concatenation of the evaluated
+// sources, as a list of top level statements with their range in the text.
+// Appending source only parses the new text. Replacing the document finds
+// the edited range as the longest common prefix and suffix of the old and
+// new text. Statements entirely before or after the edited range are reused
+// along with the compiled code of their functions, only the text between
+// them is parsed and only the statements parsed from it are run. The effects
+// of statements removed by an edit are not undone.
+//===----------------------------------------------------------------------===//
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "AST.h"
+#include "ExecutionManager.h"
+
+#include <cstddef>
+#include <list>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace minijsc {
+
+/// EditStats counts the top level statements reused and parsed by the last
+/// evaluation.
+struct EditStats {
+    // Statements kept from the previous document.
+    size_t reused = 0;
+    // Statements parsed and run.
+    size_t parsed = 0;
+};
+
+/// Session evaluates a program incrementally.
+class Session {
+    public:
+    /// Constructor takes the promotion thresholds of the execution manager.
+    explicit Session(TierConfig config = {}) : manager(config) {}
+
+    /// Append source to the document and run it, only the appended source
+    /// is parsed.
+    auto eval(std::string source) -> EditStats;
+
+    /// Replace the document and run the statements parsed from the edited
+    /// range.
+    auto update(std::string source) -> EditStats;
+
+    /// Return the top level statements of the document.
+    [[nodiscard]] auto getStmts() const -> std::vector<JSStmt*>;
+
+    /// Return the number of sources the session keeps alive.
+    [[nodiscard]] auto getSourceCount() const -> size_t {
+        return sources.size();
+    }
+
+    /// Return the execution manager running the session.
+    auto getManager() -> ExecutionManager& { return manager; }
+
+    private:
+    /// A text parsed by the session and the program parsed from it.
+    struct Source {
+        // Copy of the parsed range of the document, the tokens point into it.
+        std::string text;
+        // Program parsed from the text.
+        std::optional<JSProgram> program;
+    };
+
+    /// A top level statement of the document.
+    struct Unit {
+        // Statement.
+        JSStmt* stmt;
+        // Source the statement was parsed from.
+        const Source* source;
+        // Offset of the statement's first character in the document.
+        size_t begin;
+        // Offset past the statement's last character in the document.
+        size_t end;
+    };
+
+    /// Parse the document text in [begin, end), the session keeps the
+    /// text and the program. Returns the parsed statements.
+    auto parse(size_t begin, size_t end) -> std::vector<Unit>;
+
+    /// Run statements of the document.
+    auto run(std::span<const Unit> parsed) -> void;
+
+    /// Release the sources no statement of the document was parsed from and
+    /// the runtime state doesn't reference.
+    auto release() -> void;
+
+    /// Execution manager running the session.
+    ExecutionManager manager;
+    /// Sources the statements were parsed from, a list never moves its
+    /// elements so the tokens pointing into them stay valid.
+    std::list<Source> sources;
+    /// Text of the document.
+    std::string document;
+    /// Top level statements of the document in order.
+    std::vector<Unit> units;
+};
+
+} // namespace minijsc
+
+#endif
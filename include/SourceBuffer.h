@@ -0,0 +1,64 @@
+//===----------------------------------------------------------------------===//
+// SourceBuffer.h: This header defines the source buffer, the text of a
+// program the lexer reads from.
+//
+// A buffer either maps a file in memory, owns a string or borrows a view of
+// text owned elsewhere. Tokens and syntax trees point into the buffer's text
+// so the buffer must outlive them.
+//===----------------------------------------------------------------------===//
+#ifndef SOURCE_BUFFER_H
+#define SOURCE_BUFFER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace minijsc {
+
+/// SourceBuffer holds the text of a program, buffers are movable but not
+/// copyable since a mapped buffer owns its mapping.
+class SourceBuffer {
+    public:
+    /// Map a file in memory, the mapping is advised for sequential access.
+    /// Throws std::runtime_error if the file can't be opened or mapped.
+    static auto mapFile(const std::string& path) -> SourceBuffer;
+
+    /// Take ownership of a string.
+    static auto fromString(std::string text) -> SourceBuffer;
+
+    /// Borrow text owned elsewhere, the text must outlive the buffer.
+    static auto borrow(std::string_view text) -> SourceBuffer;
+
+    SourceBuffer(SourceBuffer&& other) noexcept;
+    auto operator=(SourceBuffer&& other) noexcept -> SourceBuffer&;
+    SourceBuffer(const SourceBuffer&)                    = delete;
+    auto operator=(const SourceBuffer&) -> SourceBuffer& = delete;
+
+    ~SourceBuffer();
+
+    /// Return the text of the buffer.
+    [[nodiscard]] auto getText() const -> std::string_view { return text; }
+
+    /// Check if the buffer maps a file.
+    [[nodiscard]] auto isMapped() const -> bool { return mapping != nullptr; }
+
+    private:
+    SourceBuffer() = default;
+
+    /// Unmap the file if the buffer maps one.
+    auto release() -> void;
+
+    /// Text of the buffer, a view of the mapping, of `owned` or of borrowed
+    /// text.
+    std::string_view text;
+    /// String owned by the buffer.
+    std::string owned;
+    /// Start of the mapping, nullptr if the buffer doesn't map a file.
+    void* mapping = nullptr;
+    /// Length of the mapping.
+    size_t mappingLength = 0;
+};
+
+} // namespace minijsc
+
+#endif
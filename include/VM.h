@@ -13,7 +13,7 @@
 #include "Bytecode.h"
 #include "JSValue.h"
 
-#define DEBUG_TRACE_EXECUTION
+// Build with -DDEBUG_TRACE_EXECUTION to trace the executed instructions.
 
 namespace minijsc {
 
@@ -37,7 +37,9 @@ struct VMContext {
 
     /// Load a value from the constants pool.
     auto loadConstant(uint32_t offset) -> JSBasicValue {
+#ifdef DEBUG_TRACE_EXECUTION
         fmt::print("Loading constant @ {}\n", offset);
+#endif
         return constantsPool[offset];
     }
 
@@ -49,6 +51,49 @@ struct VMContext {
 /// Virtual machine stack.
 using VMStack = std::vector<JSBasicValue>;
 
+/// JSBytecodeFunction is a function compiled to bytecode, each function
+/// owns its code and its constants pool.
+class JSBytecodeFunction : public JSValue {
+    public:
+    JSBytecodeFunction(std::string name, size_t arity, Bytecode code,
+                       std::vector<JSBasicValue> pool)
+        : name(std::move(name)), arity(arity), code(std::move(code)),
+          ctx(std::move(pool)) {}
+
+    auto getKind() -> JSValueKind override { return JSValueKind::Function; }
+
+    [[nodiscard]] auto getName() const -> const std::string& { return name; }
+
+    /// Return the number of declared parameters.
+    [[nodiscard]] auto getArity() const -> size_t { return arity; }
+
+    /// Return the function's bytecode.
+    auto getCode() -> const Bytecode& { return code; }
+
+    /// Return the function's constants pool.
+    auto getContext() -> VMContext* { return &ctx; }
+
+    private:
+    std::string name;
+    size_t arity;
+    Bytecode code;
+    VMContext ctx;
+};
+
+/// Call frames save the state of the caller while a function executes.
+struct CallFrame {
+    // Function being executed, keeps the function alive during the call.
+    JSObjectRef func;
+    // Caller's code.
+    const Bytecode* code;
+    // Caller's constants pool.
+    VMContext* ctx;
+    // Caller's instruction pointer.
+    uint32_t ip;
+    // Caller's frame base.
+    size_t base;
+};
+
 /// Virtual machine class implements a stack based virtual machine.
 class VM {
     /// Virtual machine interpretation results.
@@ -61,13 +106,20 @@ class VM {
     public:
     /// VM construct with pool and bytecode parameters.
     explicit VM(std::vector<OPCode> bytecode, std::vector<JSBasicValue> pool)
-        : code(std::move(bytecode)), ctx(std::make_shared<VMContext>(pool)),
-          disas(Disassembler(bytecode, "vm-trace")) {}
+        : code(std::move(bytecode)), ctx(std::make_shared<VMContext>(pool)) {
+        activeCode = &code;
+        activeCtx  = ctx.get();
+#ifdef DEBUG_TRACE_EXECUTION
+        disas = Disassembler(code, "vm-trace");
+#endif
+    }
 
     /// VM constructor that we use to load bytecode for execution.
     explicit VM(const Bytecode& bcode) {
-        code = bcode;
-        ctx  = std::make_shared<VMContext>();
+        code       = bcode;
+        ctx        = std::make_shared<VMContext>();
+        activeCode = &code;
+        activeCtx  = ctx.get();
 #ifdef DEBUG_TRACE_EXECUTION
         disas = Disassembler(bcode, "vm-trace");
 #endif
@@ -75,15 +127,43 @@ class VM {
 
     // Return next instruction to execute, incrementing the instruction pointer.
     inline auto fetch() -> OPCode {
-        auto nextIp = ip;
-        ip++;
-        fmt::print("Fetching instruction @ {}\n", nextIp);
-        return code.at(nextIp);
+#ifdef DEBUG_TRACE_EXECUTION
+        fmt::print("Fetching instruction @ {}\n", ip);
+#endif
+        return activeCode->at(ip++);
+    }
+
+    // Return the two byte operand of jump instructions.
+    inline auto fetchOffset() -> uint16_t {
+        auto high = static_cast<uint16_t>(fetch());
+        auto low  = static_cast<uint16_t>(fetch());
+        return static_cast<uint16_t>((high << 8) | low);
     }
 
     // Run the execution loop.
     auto run() -> VMResult;
 
+    // Call the function at `argc` slots below the top of the stack.
+    auto call(size_t argc) -> void;
+
+    // Replace the executing function's frame with a call to the function
+    // at `argc` slots below the top of the stack.
+    auto tailCall(size_t argc) -> void;
+
+    // Call a function from the host after the top level code ran, returns
+    // the function's result.
+    auto invoke(const JSBasicValue& callee,
+                const std::vector<JSBasicValue>& args) -> JSBasicValue;
+
+    // Return the number of active calls.
+    [[nodiscard]] auto getCallDepth() const -> size_t { return frames.size(); }
+
+    // Return the number of call instructions executed so far.
+    [[nodiscard]] auto getCalls() const -> size_t { return calls; }
+
+    // Return the number of backward jumps executed so far.
+    [[nodiscard]] auto getBackEdges() const -> size_t { return backEdges; }
+
     // Display the stack contents.
     auto displayStack() -> void;
 
@@ -94,9 +174,10 @@ class VM {
 
     /// Load a value from the constants pool.
     auto loadConstant(uint32_t offset) -> JSBasicValue {
-        fmt::print("Fetching constant @ {}\n", offset);
-        auto cnst = ctx->loadConstant(offset);
-        fmt::print("Fetched constant {}\n", cnst.toString());
+        auto cnst = activeCtx->loadConstant(offset);
+#ifdef DEBUG_TRACE_EXECUTION
+        fmt::print("Fetched constant {} @ {}\n", cnst.toString(), offset);
+#endif
         return cnst;
     }
 
@@ -158,6 +239,19 @@ class VM {
     Bytecode code;
     // Virtual machine's stack.
     VMStack stack;
+    // Code being executed, either the top level code or a function's code.
+    const Bytecode* activeCode = nullptr;
+    // Constants pool of the code being executed.
+    VMContext* activeCtx = nullptr;
+    // Stack index of the first local slot of the executing function.
+    size_t base = 0;
+    // Frames of the active calls.
+    std::vector<CallFrame> frames;
+    // Number of executed `Call` and `TailCall` instructions, used to profile
+    // hot functions.
+    size_t calls = 0;
+    // Number of executed `Loop` instructions, used to profile hot loops.
+    size_t backEdges = 0;
     // Execution context.
     std::shared_ptr<VMContext> ctx;
     // Storage for global variables.
@@ -1,48 +1,83 @@
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 #include <cstdlib>
 
+#include "ASTOptimizer.h"
+#include "ASTSerializer.h"
 #include "Bytecode.h"
+#include "ExecutionManager.h"
 #include "Interpreter.h"
 #include "JSLexer.h"
 #include "JSParser.h"
 #include "JSToken.h"
+#include "Session.h"
+#include "SourceBuffer.h"
 using namespace minijsc;
 
-/// Read a JavaScript file into an std::string.
-auto readJSFile(const std::string& filePath) -> std::string {
-    std::string buffer;
-    std::ifstream file(filePath);
-
-    file.seekg(0, std::ios::end);
-    buffer.resize(file.tellg());
-    file.seekg(0);
-
-    file.read(buffer.data(), buffer.size()); // NOLINT
+/// Load a program, either a serialized syntax tree or source code whose
+/// function bodies are parsed when first needed. The optimizations need
+/// every body, optimized programs are parsed eagerly instead. Serialized
+/// trees are loaded as they were emitted.
+auto load(const SourceBuffer& source, bool optimized) -> JSProgram {
+    if (isSerializedAST(source.getText())) {
+        return ASTDeserializer(source.getText()).deserialize();
+    }
+    auto lexer  = JSLexer(source);
+    auto parser = JSParser(lexer);
+    parser.setLazyFunctions(!optimized);
+    auto program = parser.parse();
+    if (optimized) {
+        optimize(program);
+    }
+    return program;
+}
 
-    return buffer;
+/// Write the serialized syntax tree of a program to `path`.
+auto emitAST(const SourceBuffer& source, const std::string& path,
+             bool optimized) -> void {
+    auto code = load(source, optimized);
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("cannot open '" + path + "'");
+    }
+    out << ASTSerializer().serialize(code);
 }
 
-/// Run a given chunk of code.
-auto run(std::string source) -> void {
-    auto lexer       = JSLexer(source);
-    auto tokens      = lexer.scanTokens();
-    auto parser      = JSParser(std::move(tokens));
-    auto code        = parser.parse();
-    auto interpreter = Interpreter();
-    interpreter.run(code);
+/// Run a given chunk of code, hot functions are promoted to the faster
+/// execution tiers.
+auto run(const SourceBuffer& source, bool optimized, bool showStats = false)
+    -> void {
+    auto code    = load(source, optimized);
+    auto manager = ExecutionManager();
+    manager.run(code);
+    if (showStats) {
+        const auto& stats = manager.getStats();
+        fmt::print("Promotions : {} bytecode, {} native, {} failed\n",
+                   stats.bytecodePromotions, stats.nativePromotions,
+                   stats.failedPromotions);
+        fmt::print("Calls : {} interpreted, {} bytecode, {} native\n",
+                   stats.interpretedCalls, stats.bytecodeCalls,
+                   stats.nativeCalls);
+    }
 }
 
-/// Run the REPL prompt.
+/// Run the REPL prompt, lines are evaluated in a single session so the
+/// bindings and compiled functions of a line are kept for the next ones.
 auto runPrompt() -> void {
+    auto session = Session();
     std::string source;
     while (true) {
         fmt::print("> ");
         if (std::getline(std::cin, source)) {
-            run(source);
+            try {
+                session.eval(source + "\n");
+            } catch (const std::exception& error) {
+                fmt::print("{}\n", error.what());
+            }
         } else {
             fmt::print("\n");
             break;
@@ -51,13 +86,41 @@ auto runPrompt() -> void {
 }
 
 auto main(int argc, char** argv) -> int {
-    if (argc > 2) {
-        fmt::print("Usage : minijsc [file]\n");
+    // Print the tier transition stats after running a file.
+    auto showStats = argc > 1 && std::string(argv[1]) == "--stats";
+    if (showStats) {
+        argc--;
+        argv++;
+    }
+    // Optimize the syntax tree before running or serializing it.
+    auto optimized = argc > 1 && std::string(argv[1]) == "--optimize";
+    if (optimized) {
+        argc--;
+        argv++;
+    }
+    // Serialize the syntax tree of a file instead of running it.
+    std::string astPath;
+    if (argc > 2 && std::string(argv[1]) == "--emit-ast") {
+        astPath = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc > 2 || (!astPath.empty() && argc != 2)) {
+        fmt::print("Usage : minijsc [--stats] [--optimize] [--emit-ast out] "
+                   "[file]\n");
         exit(1);
     } else if (argc == 2) {
-        auto filePath = argv[1];
-        auto source   = readJSFile(filePath);
-        run(source);
+        try {
+            auto source = SourceBuffer::mapFile(argv[1]);
+            if (!astPath.empty()) {
+                emitAST(source, astPath, optimized);
+            } else {
+                run(source, optimized, showStats);
+            }
+        } catch (const std::runtime_error& error) {
+            fmt::print("{}\n", error.what());
+            exit(1);
+        }
     } else {
         runPrompt();
     }
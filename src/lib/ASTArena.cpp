@@ -0,0 +1,41 @@
+//===----------------------------------------------------------------------===//
+// ASTArena.cpp: This file implements the arena the syntax tree is allocated
+// in.
+//===----------------------------------------------------------------------===//
+#include "ASTArena.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace minijsc {
+
+// Nodes are destroyed in reverse allocation order, like automatic objects.
+ASTArena::~ASTArena() {
+    for (auto dtor = destructors.rbegin(); dtor != destructors.rend();
+         dtor++) {
+        dtor->destroy(dtor->object);
+    }
+}
+
+// Allocations larger than a chunk get a chunk of their own.
+auto ASTArena::allocate(size_t size, size_t align) -> void* {
+    auto addr    = reinterpret_cast<uintptr_t>(cursor);
+    auto aligned = (addr + align - 1) & ~(uintptr_t(align) - 1);
+    if (cursor == nullptr ||
+        aligned + size > reinterpret_cast<uintptr_t>(limit)) {
+        auto chunkSize = std::max(kArenaChunkSize, size + align);
+        chunks.push_back(
+            std::make_unique_for_overwrite<std::byte[]>(chunkSize));
+        reserved += chunkSize;
+        cursor  = chunks.back().get();
+        limit   = cursor + chunkSize;
+        addr    = reinterpret_cast<uintptr_t>(cursor);
+        aligned = (addr + align - 1) & ~(uintptr_t(align) - 1);
+    }
+    cursor += (aligned - addr) + size;
+    return reinterpret_cast<void*>(aligned);
+}
+
+} // namespace minijsc
@@ -4,111 +4,1577 @@
 // All optimizers implement the visitor pattern define in the `AST.h`.
 // The currently implemented optimizers are :
 //
-// ASTOptimizer : visits binary and unary expressions and executes
-// constant folding optimizations.
+// ASTOptimizer : rewrites the tree bottom-up folding constant expressions
+// into literals.
+//
+// ConstantPropagator : replaces variables assigned once from a constant by
+// the constant and removes the code it makes dead.
+//
+// FunctionInliner : replaces calls to small functions by their body.
+//
+// LoopInvariantMotion : evaluates the expressions of a loop which don't
+// change between iterations once before the loop.
+//
+// ValueNumbering : evaluates the expressions repeated in a list of
+// statements once and reuses their value.
 //===----------------------------------------------------------------------===//
 #include "AST.h"
 #include "ASTOptimizer.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace minijsc {
 
-auto ASTOptimizer::rewriteAST(std::shared_ptr<JSExpr> expr)
-    -> std::shared_ptr<JSExpr> {
-    auto kind = expr->getKind();
-    fmt::print("Node kind: {}\n", astNodeKindToString(kind));
-    /// Visit left and right nodes to fold them.
-    auto binExpr = (JSBinExpr*)(expr.get());
-    // Visiting binary expressions will either push the folded value into
-    // the stack or unfolded.
-    visitBinaryExpr(binExpr);
-    fmt::print("Visited binary expression");
-    auto folded = expressionStack.back();
+namespace {
+
+/// Return the literal an expression folded to, nullptr if it isn't constant.
+auto asLiteral(JSExpr* expr) -> JSLiteralExpr* {
+    if (expr == nullptr || expr->getKind() != ASTNodeKind::LiteralExpr) {
+        return nullptr;
+    }
+    return static_cast<JSLiteralExpr*>(expr);
+}
+
+/// Return the truth value of a constant, strings and NaN are left to the
+/// runtime whose truthiness doesn't follow JavaScript for them.
+auto truthiness(const JSBasicValue& value) -> std::optional<bool> {
+    switch (value.getKind()) {
+    case JSValueKind::Boolean:
+        return value.getValue<JSBoolean>();
+    case JSValueKind::Number:
+        if (std::isnan(value.getValue<JSNumber>())) {
+            return std::nullopt;
+        }
+        return value.getValue<JSNumber>() != 0;
+    case JSValueKind::Undefined:
+    case JSValueKind::Null:
+        return false;
+    default:
+        return std::nullopt;
+    }
+}
+
+/// Evaluate a binary operator on constants, only numbers and string
+/// concatenations are folded.
+auto foldBinary(JSTokenKind op, const JSBasicValue& lhs,
+                const JSBasicValue& rhs) -> std::optional<JSBasicValue> {
+    if (op == JSTokenKind::Plus && (lhs.isString() || rhs.isString())) {
+        // Numbers are concatenated with the runtime's formatting.
+        return JSBasicValue(lhs.toString() + rhs.toString());
+    }
+    if (!lhs.isNumber() || !rhs.isNumber()) {
+        return std::nullopt;
+    }
+    auto left  = lhs.getValue<JSNumber>();
+    auto right = rhs.getValue<JSNumber>();
+    switch (op) {
+    case JSTokenKind::Plus:
+        return JSBasicValue(left + right);
+    case JSTokenKind::Minus:
+        return JSBasicValue(left - right);
+    case JSTokenKind::Star:
+        return JSBasicValue(left * right);
+    case JSTokenKind::Slash:
+        return JSBasicValue(left / right);
+    case JSTokenKind::Greater:
+        return JSBasicValue(JSBoolean(left > right));
+    case JSTokenKind::GreaterEqual:
+        return JSBasicValue(JSBoolean(left >= right));
+    case JSTokenKind::Less:
+        return JSBasicValue(JSBoolean(left < right));
+    case JSTokenKind::LessEqual:
+        return JSBasicValue(JSBoolean(left <= right));
+    case JSTokenKind::EqualEqual:
+        return JSBasicValue(JSBoolean(left == right));
+    case JSTokenKind::BangEqual:
+        return JSBasicValue(JSBoolean(left != right));
+    default:
+        return std::nullopt;
+    }
+}
+
+/// Evaluate a unary operator on a constant.
+auto foldUnary(JSTokenKind op, const JSBasicValue& rhs)
+    -> std::optional<JSBasicValue> {
+    if (op == JSTokenKind::Minus && rhs.isNumber()) {
+        return JSBasicValue(-rhs.getValue<JSNumber>());
+    }
+    if (op == JSTokenKind::Bang) {
+        if (auto truth = truthiness(rhs)) {
+            return JSBasicValue(JSBoolean(!*truth));
+        }
+    }
+    return std::nullopt;
+}
+
+/// Check if a statement transfers control, the statements following it in
+/// a block never run.
+auto isJump(JSStmt* stmt) -> bool {
+    auto kind = stmt->getKind();
+    return kind == ASTNodeKind::ReturnStmt || kind == ASTNodeKind::BreakStmt ||
+           kind == ASTNodeKind::ContinueStmt;
+}
+
+/// Check if an operator can't throw nor have effects whatever its operands,
+/// `+` throws for some operand types.
+auto isSafeOperator(JSTokenKind op) -> bool {
+    switch (op) {
+    case JSTokenKind::Minus:
+    case JSTokenKind::Star:
+    case JSTokenKind::Slash:
+    case JSTokenKind::Bang:
+    case JSTokenKind::Greater:
+    case JSTokenKind::GreaterEqual:
+    case JSTokenKind::Less:
+    case JSTokenKind::LessEqual:
+    case JSTokenKind::EqualEqual:
+    case JSTokenKind::BangEqual:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// Return the name a variable or function declaration declares, an empty
+/// name for other statements.
+auto getDeclaredName(JSStmt* stmt) -> std::string_view {
+    if (stmt->getKind() == ASTNodeKind::VarDecl) {
+        return static_cast<JSVarDecl*>(stmt)->getName();
+    }
+    if (stmt->getKind() == ASTNodeKind::FuncDecl) {
+        return static_cast<JSFuncDecl*>(stmt)->getName().getLexeme();
+    }
+    return {};
+}
+
+/// Return the names declared by the top level statements of a program
+/// preceding its first call.
+auto getGlobals(JSProgram& program, size_t firstCall)
+    -> std::vector<std::string_view> {
+    std::vector<std::string_view> globals;
+    for (size_t idx = 0; idx < std::min(firstCall, program.size()); idx++) {
+        if (auto name = getDeclaredName(program[idx]); !name.empty()) {
+            globals.push_back(name);
+        }
+    }
+    return globals;
+}
+
+/// ASTWalker is the base of the visitors walking a tree without rewriting
+/// it. The parser leaves missing operands null, they aren't visited.
+class ASTWalker : public ASTVisitor {
+    protected:
+    /// Visit a child expression.
+    auto walk(JSExpr* expr) -> void {
+        if (expr != nullptr) {
+            expr->accept(this);
+        }
+    }
+    /// Visit a child statement.
+    auto walk(JSStmt* stmt) -> void {
+        if (stmt != nullptr) {
+            stmt->accept(this);
+        }
+    }
+};
+
+/// BindingCounter counts the declarations, assignments and reads of every
+/// name of a program.
+class BindingCounter : public ASTWalker {
+    public:
+    using Bindings =
+        std::unordered_map<std::string_view, ConstantPropagator::Binding>;
+
+    explicit BindingCounter(Bindings& bindings) : bindings(bindings) {}
+
+    /// Count the uses of the names of a program, returns the index of the
+    /// first top level statement calling a function.
+    auto count(std::span<JSStmt* const> stmts) -> size_t {
+        for (topIndex = 0; topIndex < stmts.size(); topIndex++) {
+            auto* stmt = stmts[topIndex];
+            stmt->accept(this);
+            if (stmt->getKind() == ASTNodeKind::VarDecl) {
+                auto* decl    = static_cast<JSVarDecl*>(stmt);
+                auto& binding = bindings[decl->getName()];
+                binding.decl  = decl;
+                binding.index = topIndex;
+            }
+        }
+        return firstCall;
+    }
+
+    auto visitLiteralExpr(JSLiteralExpr* /*expr*/) -> void override {}
+    auto visitBinaryExpr(JSBinExpr* expr) -> void override {
+        walk(expr->getLeft());
+        walk(expr->getRight());
+    }
+    auto visitUnaryExpr(JSUnaryExpr* expr) -> void override {
+        walk(expr->getRight());
+    }
+    auto visitLogicalExpr(JSLogicalExpr* expr) -> void override {
+        walk(expr->getLeft());
+        walk(expr->getRight());
+    }
+    auto visitGroupingExpr(JSGroupingExpr* expr) -> void override {
+        walk(expr->getExpr());
+    }
+    auto visitVarExpr(JSVarExpr* expr) -> void override {
+        bindings[expr->getName().getLexeme()].references++;
+    }
+    auto visitAssignExpr(JSAssignExpr* expr) -> void override {
+        auto& binding = bindings[expr->getName().getLexeme()];
+        binding.assignments++;
+        if (inFunction) {
+            binding.functionAssignments++;
+        }
+        walk(expr->getValue());
+    }
+    auto visitCallExpr(JSCallExpr* expr) -> void override {
+        // Calls in function bodies only run once the function is called.
+        if (!inFunction) {
+            firstCall = std::min(firstCall, topIndex);
+        }
+        walk(expr->getCallee());
+        for (auto* arg : expr->getArgs()) {
+            walk(arg);
+        }
+    }
+    auto visitBlockStmt(JSBlockStmt* block) -> void override {
+        for (auto* stmt : block->getStmts()) {
+            stmt->accept(this);
+        }
+    }
+    auto visitExprStmt(JSExprStmt* stmt) -> void override {
+        walk(stmt->getExpr());
+    }
+    auto visitIfStmt(JSIfStmt* stmt) -> void override {
+        walk(stmt->getCondition());
+        walk(stmt->getThenBranch());
+        walk(stmt->getElseBranch());
+    }
+    auto visitWhileStmt(JSWhileStmt* stmt) -> void override {
+        walk(stmt->getCondition());
+        walk(stmt->getBody());
+    }
+    auto visitForStmt(JSForStmt* stmt) -> void override {
+        walk(stmt->getInitializer());
+        walk(stmt->getCondition());
+        walk(stmt->getStep());
+        walk(stmt->getBody());
+    }
+    auto visitVarDecl(JSVarDecl* stmt) -> void override {
+        bindings[stmt->getName()].declarations++;
+        walk(stmt->getInitializer());
+    }
+    auto visitFuncDecl(JSFuncDecl* stmt) -> void override {
+        bindings[stmt->getName().getLexeme()].declarations++;
+        for (auto param : stmt->getParamNames()) {
+            bindings[param].declarations++;
+        }
+        auto enclosing = inFunction;
+        inFunction     = true;
+        walk(stmt->getBody());
+        inFunction = enclosing;
+    }
+    auto visitReturnStmt(JSReturnStmt* stmt) -> void override {
+        walk(stmt->getValue());
+    }
+    auto visitBreakStmt(JSBreakStmt* /*stmt*/) -> void override {}
+    auto visitContinueStmt(JSContinueStmt* /*stmt*/) -> void override {}
+
+    private:
+    /// Uses of each name.
+    Bindings& bindings;
+    /// Index of the top level statement being counted.
+    size_t topIndex = 0;
+    /// Index of the first top level statement calling a function.
+    size_t firstCall = std::numeric_limits<size_t>::max();
+    /// Whether a function body is being counted.
+    bool inFunction = false;
+};
+
+/// ExprScanner measures an expression and collects the variables it reads.
+class ExprScanner : public ASTWalker {
+    public:
+    /// Number of nodes of the expression.
+    size_t size = 0;
+    /// Whether the expression calls a function or assigns a variable.
+    bool hasEffects = false;
+    /// Reads of each variable.
+    std::unordered_map<std::string_view, size_t> reads;
+
+    auto visitLiteralExpr(JSLiteralExpr* /*expr*/) -> void override { size++; }
+    auto visitBinaryExpr(JSBinExpr* expr) -> void override {
+        size++;
+        walk(expr->getLeft());
+        walk(expr->getRight());
+    }
+    auto visitUnaryExpr(JSUnaryExpr* expr) -> void override {
+        size++;
+        walk(expr->getRight());
+    }
+    auto visitLogicalExpr(JSLogicalExpr* expr) -> void override {
+        size++;
+        walk(expr->getLeft());
+        walk(expr->getRight());
+    }
+    auto visitGroupingExpr(JSGroupingExpr* expr) -> void override {
+        size++;
+        walk(expr->getExpr());
+    }
+    auto visitVarExpr(JSVarExpr* expr) -> void override {
+        size++;
+        reads[expr->getName().getLexeme()]++;
+    }
+    auto visitAssignExpr(JSAssignExpr* /*expr*/) -> void override {
+        hasEffects = true;
+    }
+    auto visitCallExpr(JSCallExpr* /*expr*/) -> void override {
+        hasEffects = true;
+    }
+    // Expressions don't contain statements.
+    auto visitBlockStmt(JSBlockStmt* /*block*/) -> void override {}
+    auto visitExprStmt(JSExprStmt* /*stmt*/) -> void override {}
+    auto visitIfStmt(JSIfStmt* /*stmt*/) -> void override {}
+    auto visitWhileStmt(JSWhileStmt* /*stmt*/) -> void override {}
+    auto visitForStmt(JSForStmt* /*stmt*/) -> void override {}
+    auto visitVarDecl(JSVarDecl* /*stmt*/) -> void override {}
+    auto visitFuncDecl(JSFuncDecl* /*stmt*/) -> void override {}
+    auto visitReturnStmt(JSReturnStmt* /*stmt*/) -> void override {}
+    auto visitBreakStmt(JSBreakStmt* /*stmt*/) -> void override {}
+    auto visitContinueStmt(JSContinueStmt* /*stmt*/) -> void override {}
+};
+
+/// ExprCloner copies an expression without calls nor assignments in an
+/// arena, replacing variables by the expressions they are bound to.
+/// Literals and variables have no children and are shared.
+class ExprCloner : public ASTVisitor {
+    public:
+    using Substitutions = std::unordered_map<std::string_view, JSExpr*>;
+
+    explicit ExprCloner(ASTArena& arena, const Substitutions& substitutions)
+        : arena(arena), substitutions(substitutions) {}
+
+    /// Return the copy of an expression, missing operands stay null.
+    auto clone(JSExpr* expr) -> JSExpr* {
+        if (expr == nullptr) {
+            return nullptr;
+        }
+        expr->accept(this);
+        return result;
+    }
+
+    auto visitLiteralExpr(JSLiteralExpr* expr) -> void override {
+        result = expr;
+    }
+    auto visitBinaryExpr(JSBinExpr* expr) -> void override {
+        auto* left  = clone(expr->getLeft());
+        auto* right = clone(expr->getRight());
+        result = arena.make<JSBinExpr>(left, expr->getOperator(), right);
+    }
+    auto visitUnaryExpr(JSUnaryExpr* expr) -> void override {
+        auto* right = clone(expr->getRight());
+        result      = arena.make<JSUnaryExpr>(expr->getOperator(), right);
+    }
+    auto visitLogicalExpr(JSLogicalExpr* expr) -> void override {
+        auto* left  = clone(expr->getLeft());
+        auto* right = clone(expr->getRight());
+        result = arena.make<JSLogicalExpr>(expr->getOperator(), left, right);
+    }
+    auto visitGroupingExpr(JSGroupingExpr* expr) -> void override {
+        result = arena.make<JSGroupingExpr>(clone(expr->getExpr()));
+    }
+    auto visitVarExpr(JSVarExpr* expr) -> void override {
+        auto found = substitutions.find(expr->getName().getLexeme());
+        result     = found != substitutions.end() ? found->second : expr;
+    }
+    // Inlined expressions don't contain calls, assignments nor statements.
+    auto visitAssignExpr(JSAssignExpr* /*expr*/) -> void override {
+        assert(false && "inlined expressions don't assign");
+    }
+    auto visitCallExpr(JSCallExpr* /*expr*/) -> void override {
+        assert(false && "inlined expressions don't call");
+    }
+    auto visitBlockStmt(JSBlockStmt* /*block*/) -> void override {}
+    auto visitExprStmt(JSExprStmt* /*stmt*/) -> void override {}
+    auto visitIfStmt(JSIfStmt* /*stmt*/) -> void override {}
+    auto visitWhileStmt(JSWhileStmt* /*stmt*/) -> void override {}
+    auto visitForStmt(JSForStmt* /*stmt*/) -> void override {}
+    auto visitVarDecl(JSVarDecl* /*stmt*/) -> void override {}
+    auto visitFuncDecl(JSFuncDecl* /*stmt*/) -> void override {}
+    auto visitReturnStmt(JSReturnStmt* /*stmt*/) -> void override {}
+    auto visitBreakStmt(JSBreakStmt* /*stmt*/) -> void override {}
+    auto visitContinueStmt(JSContinueStmt* /*stmt*/) -> void override {}
+
+    private:
+    /// Arena the copy is allocated in.
+    ASTArena& arena;
+    /// Expressions replacing variables.
+    const Substitutions& substitutions;
+    /// Copy of the last visited expression.
+    JSExpr* result = nullptr;
+};
+
+/// Create a name no identifier of the program can be equal to, `$` and `.`
+/// aren't identifier characters. The name is suffixed with the number of
+/// nodes of the arena, which differs between names as long as a node using
+/// the name is allocated before the next one is created.
+auto makeFreshName(ASTArena& arena, std::string_view base) -> JSToken {
+    auto name = fmt::format("${}.{}", base, arena.getNodeCount());
+    auto text = arena.copy(std::span<const char>(name.data(), name.size()));
+    return {JSTokenKind::Identifier,
+            std::string_view(text.data(), text.size())};
+}
+
+/// Return the call a statement evaluates first, the call of an expression
+/// statement, of an assignment statement, of a declaration or of a return.
+auto getLeadingCall(JSStmt* stmt) -> JSCallExpr* {
+    JSExpr* expr = nullptr;
+    switch (stmt->getKind()) {
+    case ASTNodeKind::ExprStmt:
+        expr = static_cast<JSExprStmt*>(stmt)->getExpr();
+        if (expr != nullptr && expr->getKind() == ASTNodeKind::AssignExpr) {
+            expr = static_cast<JSAssignExpr*>(expr)->getValue();
+        }
+        break;
+    case ASTNodeKind::VarDecl:
+        expr = static_cast<JSVarDecl*>(stmt)->getInitializer();
+        break;
+    case ASTNodeKind::ReturnStmt:
+        expr = static_cast<JSReturnStmt*>(stmt)->getValue();
+        break;
+    default:
+        break;
+    }
+    if (expr == nullptr || expr->getKind() != ASTNodeKind::CallExpr) {
+        return nullptr;
+    }
+    return static_cast<JSCallExpr*>(expr);
+}
+
+/// ComputationScanner walks the expressions of a statement, outside of
+/// function bodies, and calls `visit` on each operator. The operands of an
+/// operator are walked unless `visit` returns true.
+class ComputationScanner : public ASTWalker {
+    public:
+    using Callback = std::function<bool(JSExpr*)>;
+
+    explicit ComputationScanner(Callback visit) : visit(std::move(visit)) {}
+
+    /// Walk a statement.
+    auto scan(JSStmt* stmt) -> void { stmt->accept(this); }
+
+    auto visitLiteralExpr(JSLiteralExpr* /*expr*/) -> void override {}
+    auto visitBinaryExpr(JSBinExpr* expr) -> void override {
+        if (!visit(expr)) {
+            walk(expr->getLeft());
+            walk(expr->getRight());
+        }
+    }
+    auto visitUnaryExpr(JSUnaryExpr* expr) -> void override {
+        if (!visit(expr)) {
+            walk(expr->getRight());
+        }
+    }
+    auto visitLogicalExpr(JSLogicalExpr* expr) -> void override {
+        if (!visit(expr)) {
+            walk(expr->getLeft());
+            walk(expr->getRight());
+        }
+    }
+    auto visitGroupingExpr(JSGroupingExpr* expr) -> void override {
+        walk(expr->getExpr());
+    }
+    auto visitVarExpr(JSVarExpr* /*expr*/) -> void override {}
+    auto visitAssignExpr(JSAssignExpr* expr) -> void override {
+        walk(expr->getValue());
+    }
+    auto visitCallExpr(JSCallExpr* expr) -> void override {
+        walk(expr->getCallee());
+        for (auto* arg : expr->getArgs()) {
+            walk(arg);
+        }
+    }
+    auto visitBlockStmt(JSBlockStmt* block) -> void override {
+        for (auto* stmt : block->getStmts()) {
+            stmt->accept(this);
+        }
+    }
+    auto visitExprStmt(JSExprStmt* stmt) -> void override {
+        walk(stmt->getExpr());
+    }
+    auto visitIfStmt(JSIfStmt* stmt) -> void override {
+        walk(stmt->getCondition());
+        walk(stmt->getThenBranch());
+        walk(stmt->getElseBranch());
+    }
+    auto visitWhileStmt(JSWhileStmt* stmt) -> void override {
+        walk(stmt->getCondition());
+        walk(stmt->getBody());
+    }
+    auto visitForStmt(JSForStmt* stmt) -> void override {
+        walk(stmt->getInitializer());
+        walk(stmt->getCondition());
+        walk(stmt->getStep());
+        walk(stmt->getBody());
+    }
+    auto visitVarDecl(JSVarDecl* stmt) -> void override {
+        walk(stmt->getInitializer());
+    }
+    // Function bodies only run once the function is called.
+    auto visitFuncDecl(JSFuncDecl* /*stmt*/) -> void override {}
+    auto visitReturnStmt(JSReturnStmt* stmt) -> void override {
+        walk(stmt->getValue());
+    }
+    auto visitBreakStmt(JSBreakStmt* /*stmt*/) -> void override {}
+    auto visitContinueStmt(JSContinueStmt* /*stmt*/) -> void override {}
+
+    private:
+    /// Called on each operator.
+    Callback visit;
+};
+
+} // namespace
+
+auto ASTOptimizer::rewriteAST(JSExpr* expr) -> JSExpr* {
+    if (expr == nullptr) {
+        return nullptr;
+    }
+    // Visiting an expression pushes the rewritten expression into the stack.
+    expr->accept(this);
+    auto* folded = expressionStack.back();
     assert(folded != nullptr);
     expressionStack.pop_back();
     return folded;
 }
 
-auto ASTOptimizer::visitLiteralExpr(JSLiteralExpr* expr) -> void {}
+auto ASTOptimizer::rewrite(std::span<JSStmt* const> stmts) -> void {
+    for (auto* stmt : stmts) {
+        stmt->accept(this);
+    }
+}
+
+/// Visit a literal expression.
+auto ASTOptimizer::visitLiteralExpr(JSLiteralExpr* expr) -> void {
+    expressionStack.push_back(expr);
+}
 
 /// Visit a binary expression.
 auto ASTOptimizer::visitBinaryExpr(JSBinExpr* expr) -> void {
+    // Fold both sides first so that nested constants fold all the way up.
+    expr->setLeft(rewriteAST(expr->getLeft()));
+    expr->setRight(rewriteAST(expr->getRight()));
 
-    /// Visit left and right nodes to fold them.
-    auto left  = expr->getLeft();
-    auto right = expr->getRight();
-
-    // Check if the children are literals
-    if (auto leftRef = dynamic_cast<JSLiteralExpr*>(left.get()))
-        if (auto rightRef = dynamic_cast<JSLiteralExpr*>(right.get())) {
-            // If the operation is addition, do a fold on the addition expression.
-            auto op = expr->getOperator();
-            if (op.getKind() == JSTokenKind::Plus) {
-                auto leftVal =
-                    std::static_pointer_cast<JSBasicValue>(leftRef->getValue());
-                auto rightVal = std::static_pointer_cast<JSBasicValue>(
-                    rightRef->getValue());
-                auto litVal = leftVal->getValue<JSNumber>() +
-                              rightVal->getValue<JSNumber>();
-                fmt::print("Folded value : {}\n", litVal);
-                // push folded expression into the stack.
-                expressionStack.emplace_back(std::make_shared<JSLiteralExpr>(
-                    std::make_shared<JSBasicValue>(litVal)));
-                return;
-            }
+    auto* left  = asLiteral(expr->getLeft());
+    auto* right = asLiteral(expr->getRight());
+    if (left != nullptr && right != nullptr) {
+        if (auto value = foldBinary(expr->getOperator().getKind(),
+                                    left->getValue(), right->getValue())) {
+            expressionStack.push_back(
+                arena.make<JSLiteralExpr>(std::move(*value)));
+            return;
         }
-    // If no optimization was made push the original value into the expression stack.
-    expressionStack.emplace_back(std::make_shared<JSBinExpr>(*expr));
-    return;
+    }
+    // If no optimization was made push the original expression.
+    expressionStack.push_back(expr);
 }
 
 /// Visit a unary expression.
-auto ASTOptimizer::visitUnaryExpr(JSUnaryExpr* /*expr*/) -> void {}
+auto ASTOptimizer::visitUnaryExpr(JSUnaryExpr* expr) -> void {
+    expr->setRight(rewriteAST(expr->getRight()));
 
-/// Visit a logical expression.
-auto ASTOptimizer::visitLogicalExpr(JSLogicalExpr* /*expr*/) -> void {}
+    if (auto* right = asLiteral(expr->getRight())) {
+        if (auto value =
+                foldUnary(expr->getOperator().getKind(), right->getValue())) {
+            expressionStack.push_back(
+                arena.make<JSLiteralExpr>(std::move(*value)));
+            return;
+        }
+    }
+    expressionStack.push_back(expr);
+}
 
-/// Visit a grouping expression.
-auto ASTOptimizer::visitGroupingExpr(JSGroupingExpr* /*expr*/) -> void {}
+/// Visit a logical expression, a constant left operand decides which
+/// operand the expression evaluates to.
+auto ASTOptimizer::visitLogicalExpr(JSLogicalExpr* expr) -> void {
+    expr->setLeft(rewriteAST(expr->getLeft()));
+    expr->setRight(rewriteAST(expr->getRight()));
+
+    auto* left = asLiteral(expr->getLeft());
+    if (left != nullptr && expr->getRight() != nullptr) {
+        if (auto truth = truthiness(left->getValue())) {
+            auto isOr = expr->getOperator().getKind() == JSTokenKind::Or;
+            expressionStack.push_back(*truth == isOr ? expr->getLeft()
+                                                     : expr->getRight());
+            return;
+        }
+    }
+    expressionStack.push_back(expr);
+}
+
+/// Visit a grouping expression, parentheses around a constant are dropped.
+auto ASTOptimizer::visitGroupingExpr(JSGroupingExpr* expr) -> void {
+    expr->setExpr(rewriteAST(expr->getExpr()));
+
+    if (asLiteral(expr->getExpr()) != nullptr) {
+        expressionStack.push_back(expr->getExpr());
+        return;
+    }
+    expressionStack.push_back(expr);
+}
 
 /// Visit a variable expression.
-auto ASTOptimizer::visitVarExpr(JSVarExpr* /*expr*/) -> void {}
+auto ASTOptimizer::visitVarExpr(JSVarExpr* expr) -> void {
+    expressionStack.push_back(expr);
+}
 
-/// Visit an assignment expression.
-auto ASTOptimizer::visitAssignExpr(JSAssignExpr* /*expr*/) -> void {
-    /// When visiting assignment expressions we can call visitBinExpr
-    /// to try and fold the right hand side of the assignment.
-    /// var x = !true
-    /// We should be able to call rewriteAST recursively on
-    /// expr->getValue()
+/// Visit an assignment expression, the right hand side is folded.
+auto ASTOptimizer::visitAssignExpr(JSAssignExpr* expr) -> void {
+    expr->setValue(rewriteAST(expr->getValue()));
+    expressionStack.push_back(expr);
 }
 
-/// Visit a call expression.
-auto ASTOptimizer::visitCallExpr(JSCallExpr* /*expr*/) -> void {}
+/// Visit a call expression, the arguments are folded.
+auto ASTOptimizer::visitCallExpr(JSCallExpr* expr) -> void {
+    for (auto& arg : expr->getArgs()) {
+        arg = rewriteAST(arg);
+    }
+    expressionStack.push_back(expr);
+}
 
 /// Visit a block statement.
-auto ASTOptimizer::visitBlockStmt(JSBlockStmt* block) -> void {}
+auto ASTOptimizer::visitBlockStmt(JSBlockStmt* block) -> void {
+    rewrite(block->getStmts());
+}
 
 /// Visit an expression statement.
-auto ASTOptimizer::visitExprStmt(JSExprStmt* stmt) -> void {}
+auto ASTOptimizer::visitExprStmt(JSExprStmt* stmt) -> void {
+    stmt->setExpr(rewriteAST(stmt->getExpr()));
+}
 
 /// Visit an if statement.
-auto ASTOptimizer::visitIfStmt(JSIfStmt* stmt) -> void {}
+auto ASTOptimizer::visitIfStmt(JSIfStmt* stmt) -> void {
+    stmt->setCondition(rewriteAST(stmt->getCondition()));
+    stmt->getThenBranch()->accept(this);
+    if (stmt->getElseBranch() != nullptr) {
+        stmt->getElseBranch()->accept(this);
+    }
+}
 
 /// Visit a while statement.
-auto ASTOptimizer::visitWhileStmt(JSWhileStmt* stmt) -> void {}
+auto ASTOptimizer::visitWhileStmt(JSWhileStmt* stmt) -> void {
+    stmt->setCondition(rewriteAST(stmt->getCondition()));
+    stmt->getBody()->accept(this);
+}
 
 /// Visit a for statement.
-auto ASTOptimizer::visitForStmt(JSForStmt* stmt) -> void {}
+auto ASTOptimizer::visitForStmt(JSForStmt* stmt) -> void {
+    if (stmt->getInitializer() != nullptr) {
+        stmt->getInitializer()->accept(this);
+    }
+    stmt->setCondition(rewriteAST(stmt->getCondition()));
+    stmt->setStep(rewriteAST(stmt->getStep()));
+    stmt->getBody()->accept(this);
+}
 
 /// Visit a variable declaration.
-auto ASTOptimizer::visitVarDecl(JSVarDecl* stmt) -> void {}
+auto ASTOptimizer::visitVarDecl(JSVarDecl* stmt) -> void {
+    stmt->setInitializer(rewriteAST(stmt->getInitializer()));
+}
 
 /// Visit a function declaration.
-auto ASTOptimizer::visitFuncDecl(JSFuncDecl* stmt) -> void {}
+auto ASTOptimizer::visitFuncDecl(JSFuncDecl* stmt) -> void {
+    stmt->getBody()->accept(this);
+}
 
 /// Visit a return statement.
-auto ASTOptimizer::visitReturnStmt(JSReturnStmt* stmt) -> void {}
+auto ASTOptimizer::visitReturnStmt(JSReturnStmt* stmt) -> void {
+    stmt->setValue(rewriteAST(stmt->getValue()));
+}
+
+/// Visit a break statement.
+auto ASTOptimizer::visitBreakStmt(JSBreakStmt* /*stmt*/) -> void {}
+
+/// Visit a continue statement.
+auto ASTOptimizer::visitContinueStmt(JSContinueStmt* /*stmt*/) -> void {}
+
+// Each round starts from fresh counts since removing code removes uses,
+// the tree is folded first so top level initializers are literals.
+auto ConstantPropagator::run(JSProgram& program) -> void {
+    ASTOptimizer(arena).rewrite(program);
+    do {
+        changed = false;
+        bindings.clear();
+        firstCall = BindingCounter(bindings).count(program);
+        std::vector<JSStmt*> stmts;
+        for (topIndex = 0; topIndex < program.size(); topIndex++) {
+            if (auto* stmt = rewriteStmt(program[topIndex])) {
+                stmts.push_back(stmt);
+            }
+        }
+        if (changed) {
+            program.setStmts(std::move(stmts));
+        }
+    } while (changed);
+}
+
+auto ConstantPropagator::rewriteStmt(JSStmt* stmt) -> JSStmt* {
+    if (stmt == nullptr) {
+        return nullptr;
+    }
+    // Statement visits replace `rewritten` once their children are done.
+    rewritten = stmt;
+    stmt->accept(this);
+    return rewritten;
+}
+
+auto ConstantPropagator::rewriteBody(JSStmt* stmt) -> JSStmt* {
+    if (auto* body = rewriteStmt(stmt)) {
+        return body;
+    }
+    return arena.make<JSBlockStmt>(std::span<JSStmt*>());
+}
+
+auto ConstantPropagator::isUnused(std::string_view name) -> bool {
+    auto binding = bindings.find(name);
+    return binding == bindings.end() || (binding->second.references == 0 &&
+                                         binding->second.assignments == 0);
+}
+
+auto ConstantPropagator::getConstant(std::string_view name) -> JSExpr* {
+    auto found = bindings.find(name);
+    if (found == bindings.end()) {
+        return nullptr;
+    }
+    const auto& binding = found->second;
+    if (binding.decl == nullptr || binding.declarations != 1 ||
+        binding.assignments != 0) {
+        return nullptr;
+    }
+    auto* value = asLiteral(binding.decl->getInitializer());
+    if (value == nullptr) {
+        return nullptr;
+    }
+    // Function bodies run when called, so after the declaration only if
+    // nothing is called before it.
+    auto declared =
+        inFunction ? binding.index < firstCall : binding.index < topIndex;
+    return declared ? value : nullptr;
+}
+
+/// Visit a variable expression, constants are replaced by their value.
+auto ConstantPropagator::visitVarExpr(JSVarExpr* expr) -> void {
+    if (auto* value = getConstant(expr->getName().getLexeme())) {
+        changed = true;
+        expressionStack.push_back(value);
+        return;
+    }
+    expressionStack.push_back(expr);
+}
+
+/// Visit a block statement, removed statements and statements following
+/// a jump are dropped. Empty blocks are removed.
+auto ConstantPropagator::visitBlockStmt(JSBlockStmt* block) -> void {
+    auto stmts    = block->getStmts();
+    auto modified = false;
+    std::vector<JSStmt*> kept;
+    for (size_t idx = 0; idx < stmts.size(); idx++) {
+        auto* stmt = rewriteStmt(stmts[idx]);
+        modified |= stmt != stmts[idx];
+        if (stmt == nullptr) {
+            continue;
+        }
+        kept.push_back(stmt);
+        if (isJump(stmt)) {
+            modified |= idx + 1 < stmts.size();
+            break;
+        }
+    }
+    if (modified) {
+        changed = true;
+        block->setStmts(arena.copy(kept));
+    }
+    if (kept.empty()) {
+        rewritten = nullptr;
+        return;
+    }
+    rewritten = block;
+}
+
+/// Visit an if statement, a constant condition selects a branch.
+auto ConstantPropagator::visitIfStmt(JSIfStmt* stmt) -> void {
+    stmt->setCondition(rewriteAST(stmt->getCondition()));
+    auto* thenBranch = rewriteStmt(stmt->getThenBranch());
+    auto* elseBranch = rewriteStmt(stmt->getElseBranch());
+
+    if (auto* condition = asLiteral(stmt->getCondition())) {
+        if (auto truth = truthiness(condition->getValue())) {
+            changed   = true;
+            rewritten = *truth ? thenBranch : elseBranch;
+            return;
+        }
+    }
+    if (thenBranch == nullptr) {
+        thenBranch = arena.make<JSBlockStmt>(std::span<JSStmt*>());
+    }
+    stmt->setThenBranch(thenBranch);
+    stmt->setElseBranch(elseBranch);
+    rewritten = stmt;
+}
+
+/// Visit a while statement, a loop whose condition is false is removed.
+auto ConstantPropagator::visitWhileStmt(JSWhileStmt* stmt) -> void {
+    stmt->setCondition(rewriteAST(stmt->getCondition()));
+    if (auto* condition = asLiteral(stmt->getCondition())) {
+        if (truthiness(condition->getValue()) == false) {
+            changed   = true;
+            rewritten = nullptr;
+            return;
+        }
+    }
+    stmt->setBody(rewriteBody(stmt->getBody()));
+    rewritten = stmt;
+}
+
+/// Visit a for statement, a loop whose condition is false is replaced by
+/// its initializer. The initializer doesn't have a scope of its own.
+auto ConstantPropagator::visitForStmt(JSForStmt* stmt) -> void {
+    auto* initializer = rewriteStmt(stmt->getInitializer());
+    stmt->setCondition(rewriteAST(stmt->getCondition()));
+    stmt->setStep(rewriteAST(stmt->getStep()));
+    if (auto* condition = asLiteral(stmt->getCondition())) {
+        if (truthiness(condition->getValue()) == false) {
+            changed   = true;
+            rewritten = initializer;
+            return;
+        }
+    }
+    stmt->setInitializer(initializer);
+    stmt->setBody(rewriteBody(stmt->getBody()));
+    rewritten = stmt;
+}
+
+/// Visit a variable declaration, unused variables with a constant value
+/// are removed.
+auto ConstantPropagator::visitVarDecl(JSVarDecl* stmt) -> void {
+    stmt->setInitializer(rewriteAST(stmt->getInitializer()));
+    auto* initializer = stmt->getInitializer();
+    if (isUnused(stmt->getName()) &&
+        (initializer == nullptr || asLiteral(initializer) != nullptr)) {
+        changed   = true;
+        rewritten = nullptr;
+        return;
+    }
+    rewritten = stmt;
+}
+
+/// Visit a function declaration, unused functions are removed.
+auto ConstantPropagator::visitFuncDecl(JSFuncDecl* stmt) -> void {
+    if (isUnused(stmt->getName().getLexeme())) {
+        changed   = true;
+        rewritten = nullptr;
+        return;
+    }
+    // The body block is rewritten in place, even when it becomes empty.
+    auto enclosing = inFunction;
+    inFunction     = true;
+    stmt->getBody()->accept(this);
+    inFunction = enclosing;
+    rewritten  = stmt;
+}
+
+// Calls are counted once, inlined expressions don't call so a single pass
+// inlines every call that can be.
+auto FunctionInliner::run(JSProgram& program) -> void {
+    bindings.clear();
+    candidates.clear();
+    firstCall = BindingCounter(bindings).count(program);
+    for (size_t idx = 0; idx < program.size(); idx++) {
+        if (program[idx]->getKind() == ASTNodeKind::FuncDecl) {
+            addCandidate(static_cast<JSFuncDecl*>(program[idx]), idx);
+        }
+    }
+    if (candidates.empty()) {
+        return;
+    }
+    std::vector<JSStmt*> stmts;
+    auto inserted = false;
+    for (topIndex = 0; topIndex < program.size(); topIndex++) {
+        inserted |= rewriteStmt(program[topIndex], stmts);
+    }
+    if (inserted) {
+        program.setStmts(std::move(stmts));
+    }
+}
+
+auto FunctionInliner::addCandidate(JSFuncDecl* decl, size_t index) -> void {
+    auto name    = decl->getName().getLexeme();
+    auto binding = bindings.find(name);
+    if (binding == bindings.end() || binding->second.declarations != 1 ||
+        binding->second.assignments != 0) {
+        return;
+    }
+    auto body = decl->getBody()->getStmts();
+    if (body.size() != 1 || body[0]->getKind() != ASTNodeKind::ReturnStmt) {
+        return;
+    }
+    auto* value = static_cast<JSReturnStmt*>(body[0])->getValue();
+    if (value == nullptr) {
+        return;
+    }
+    auto scanner = ExprScanner();
+    value->accept(&scanner);
+    if (scanner.hasEffects || scanner.size > kMaxInlineSize) {
+        return;
+    }
+    auto candidate = Candidate{decl, value, {}, index};
+    auto params    = decl->getParamNames();
+    for (auto [read, count] : scanner.reads) {
+        if (std::find(params.begin(), params.end(), read) != params.end()) {
+            candidate.uses[read] = count;
+            continue;
+        }
+        // Other variables must resolve to the same binding from any caller.
+        const auto& other = bindings[read];
+        if (other.declarations > 1 ||
+            (other.declarations == 1 && other.decl == nullptr)) {
+            return;
+        }
+    }
+    candidates.emplace(name, std::move(candidate));
+}
+
+auto FunctionInliner::getCandidate(JSCallExpr* expr) -> Candidate* {
+    if (expr->getCallee()->getKind() != ASTNodeKind::VarExpr) {
+        return nullptr;
+    }
+    auto* callee = static_cast<JSVarExpr*>(expr->getCallee());
+    auto found   = candidates.find(callee->getName().getLexeme());
+    if (found == candidates.end()) {
+        return nullptr;
+    }
+    auto& candidate = found->second;
+    if (expr->getArgs().size() != candidate.decl->getParamNames().size()) {
+        return nullptr;
+    }
+    // Function bodies run when called, so after the declaration only if
+    // nothing is called before it.
+    auto declared = inFunction ? candidate.index < firstCall
+                               : candidate.index < topIndex;
+    return declared ? &candidate : nullptr;
+}
+
+auto FunctionInliner::rewriteStmt(JSStmt* stmt,
+                                  std::vector<JSStmt*>& rewritten) -> bool {
+    hoistable = getLeadingCall(stmt);
+    stmt->accept(this);
+    hoistable     = nullptr;
+    auto inserted = !locals.empty();
+    rewritten.insert(rewritten.end(), locals.begin(), locals.end());
+    rewritten.push_back(stmt);
+    locals.clear();
+    return inserted;
+}
+
+/// Visit a call expression, calls to small functions are replaced by the
+/// expression they return.
+auto FunctionInliner::visitCallExpr(JSCallExpr* expr) -> void {
+    auto canHoist = expr == hoistable;
+    hoistable     = nullptr;
+    for (auto& arg : expr->getArgs()) {
+        arg = rewriteAST(arg);
+    }
+    auto* candidate = getCandidate(expr);
+    if (candidate == nullptr) {
+        expressionStack.push_back(expr);
+        return;
+    }
+
+    auto args   = expr->getArgs();
+    auto params = candidate->decl->getParamNames();
+    // Missing arguments are left to fail where the call evaluates them.
+    if (std::find(args.begin(), args.end(), nullptr) != args.end()) {
+        expressionStack.push_back(expr);
+        return;
+    }
+    auto simple = std::all_of(args.begin(), args.end(), [](JSExpr* arg) {
+        auto kind = arg->getKind();
+        return kind == ASTNodeKind::LiteralExpr || kind == ASTNodeKind::VarExpr;
+    });
+    if (!simple && !canHoist) {
+        expressionStack.push_back(expr);
+        return;
+    }
+    auto substitutions = ExprCloner::Substitutions();
+    auto bound         = std::vector<JSStmt*>();
+    for (size_t idx = 0; idx < args.size(); idx++) {
+        auto* arg = args[idx];
+        if (arg->getKind() == ASTNodeKind::LiteralExpr) {
+            substitutions[params[idx]] = arg;
+        } else if (simple) {
+            // Reading an undefined variable throws, the read must be kept.
+            if (candidate->uses[params[idx]] == 0) {
+                expressionStack.push_back(expr);
+                return;
+            }
+            substitutions[params[idx]] = arg;
+        } else {
+            auto local = makeFreshName(arena, params[idx]);
+            bound.push_back(arena.make<JSVarDecl>(local, arg));
+            substitutions[params[idx]] = arena.make<JSVarExpr>(local);
+        }
+    }
+    locals.insert(locals.end(), bound.begin(), bound.end());
+    inlined++;
+    auto* body = ExprCloner(arena, substitutions).clone(candidate->body);
+    expressionStack.push_back(rewriteAST(body));
+}
+
+/// Visit a block statement.
+auto FunctionInliner::visitBlockStmt(JSBlockStmt* block) -> void {
+    std::vector<JSStmt*> stmts;
+    auto inserted = false;
+    for (auto* stmt : block->getStmts()) {
+        inserted |= rewriteStmt(stmt, stmts);
+    }
+    if (inserted) {
+        block->setStmts(arena.copy(stmts));
+    }
+}
+
+/// Visit a function declaration.
+auto FunctionInliner::visitFuncDecl(JSFuncDecl* stmt) -> void {
+    auto enclosing = inFunction;
+    inFunction     = true;
+    stmt->getBody()->accept(this);
+    inFunction = enclosing;
+}
+
+auto DeclaredNames::declare(std::string_view name) -> void {
+    names.push_back(name);
+    counts[name]++;
+}
+
+auto DeclaredNames::undeclare(size_t mark) -> void {
+    while (names.size() > mark) {
+        auto found = counts.find(names.back());
+        if (--found->second == 0) {
+            counts.erase(found);
+        }
+        names.pop_back();
+    }
+}
+
+auto LoopInvariantMotion::run(JSProgram& program) -> void {
+    bindings.clear();
+    auto firstCall = BindingCounter(bindings).count(program);
+    globals        = getGlobals(program, firstCall);
+    std::vector<JSStmt*> stmts;
+    auto inserted = false;
+    for (auto* stmt : program) {
+        inserted |= rewriteStmt(stmt, stmts);
+    }
+    declared.undeclare(0);
+    if (inserted) {
+        program.setStmts(std::move(stmts));
+    }
+}
+
+auto LoopInvariantMotion::rewriteStmt(JSStmt* stmt,
+                                      std::vector<JSStmt*>& rewritten)
+    -> bool {
+    auto kind = stmt->getKind();
+    if (kind == ASTNodeKind::WhileStmt || kind == ASTNodeKind::ForStmt) {
+        hoistLoop(stmt);
+    }
+    auto inserted = !invariants.empty();
+    for (auto* local : invariants) {
+        declared.declare(getDeclaredName(local));
+    }
+    rewritten.insert(rewritten.end(), invariants.begin(), invariants.end());
+    invariants.clear();
+    // Loops nested in the statement are optimized on their own.
+    stmt->accept(this);
+    rewritten.push_back(stmt);
+    if (auto name = getDeclaredName(stmt); !name.empty()) {
+        declared.declare(name);
+    }
+    return inserted;
+}
+
+auto LoopInvariantMotion::hoistLoop(JSStmt* loop) -> void {
+    loopBindings.clear();
+    auto firstCall = BindingCounter(loopBindings)
+                         .count(std::span<JSStmt* const>(&loop, 1));
+    loopCalls = firstCall != std::numeric_limits<size_t>::max();
+    // The initializer of a for loop runs once.
+    hoisting = true;
+    if (loop->getKind() == ASTNodeKind::WhileStmt) {
+        auto* stmt = static_cast<JSWhileStmt*>(loop);
+        stmt->setCondition(rewriteAST(stmt->getCondition()));
+        stmt->getBody()->accept(this);
+    } else {
+        auto* stmt = static_cast<JSForStmt*>(loop);
+        stmt->setCondition(rewriteAST(stmt->getCondition()));
+        stmt->setStep(rewriteAST(stmt->getStep()));
+        stmt->getBody()->accept(this);
+    }
+    hoisting = false;
+}
+
+auto LoopInvariantMotion::hoist(JSExpr* expr) -> bool {
+    if (!hoisting || !isInvariant(expr)) {
+        return false;
+    }
+    auto name = makeFreshName(arena, "inv");
+    invariants.push_back(arena.make<JSVarDecl>(name, expr));
+    expressionStack.push_back(arena.make<JSVarExpr>(name));
+    hoisted++;
+    return true;
+}
+
+auto LoopInvariantMotion::isInvariant(JSExpr* expr) -> bool {
+    if (expr == nullptr) {
+        return false;
+    }
+    switch (expr->getKind()) {
+    case ASTNodeKind::LiteralExpr:
+        return true;
+    case ASTNodeKind::VarExpr:
+        return isInvariant(
+            static_cast<JSVarExpr*>(expr)->getName().getLexeme());
+    case ASTNodeKind::GroupingExpr:
+        return isInvariant(static_cast<JSGroupingExpr*>(expr)->getExpr());
+    case ASTNodeKind::UnaryExpr: {
+        auto* unary = static_cast<JSUnaryExpr*>(expr);
+        return isSafeOperator(unary->getOperator().getKind()) &&
+               isInvariant(unary->getRight());
+    }
+    case ASTNodeKind::LogicalExpr: {
+        auto* logical = static_cast<JSLogicalExpr*>(expr);
+        return isInvariant(logical->getLeft()) &&
+               isInvariant(logical->getRight());
+    }
+    case ASTNodeKind::BinaryExpr: {
+        auto* binary = static_cast<JSBinExpr*>(expr);
+        return isSafeOperator(binary->getOperator().getKind()) &&
+               isInvariant(binary->getLeft()) &&
+               isInvariant(binary->getRight());
+    }
+    default:
+        return false;
+    }
+}
+
+auto LoopInvariantMotion::isInvariant(std::string_view name) -> bool {
+    // Reading a variable that isn't declared throws.
+    if (!declared.contains(name)) {
+        return false;
+    }
+    if (auto used = loopBindings.find(name); used != loopBindings.end()) {
+        if (used->second.declarations != 0 || used->second.assignments != 0) {
+            return false;
+        }
+    }
+    return !loopCalls || bindings[name].functionAssignments == 0;
+}
+
+/// Visit a binary expression.
+auto LoopInvariantMotion::visitBinaryExpr(JSBinExpr* expr) -> void {
+    if (!hoist(expr)) {
+        ASTOptimizer::visitBinaryExpr(expr);
+    }
+}
+
+/// Visit a unary expression.
+auto LoopInvariantMotion::visitUnaryExpr(JSUnaryExpr* expr) -> void {
+    if (!hoist(expr)) {
+        ASTOptimizer::visitUnaryExpr(expr);
+    }
+}
+
+/// Visit a logical expression.
+auto LoopInvariantMotion::visitLogicalExpr(JSLogicalExpr* expr) -> void {
+    if (!hoist(expr)) {
+        ASTOptimizer::visitLogicalExpr(expr);
+    }
+}
+
+/// Visit a grouping expression.
+auto LoopInvariantMotion::visitGroupingExpr(JSGroupingExpr* expr) -> void {
+    if (!hoist(expr)) {
+        ASTOptimizer::visitGroupingExpr(expr);
+    }
+}
+
+/// Visit a block statement, inside the loop being optimized its statements
+/// are rewritten in place. Otherwise the loops it contains are optimized
+/// and the block scope ends with it.
+auto LoopInvariantMotion::visitBlockStmt(JSBlockStmt* block) -> void {
+    if (hoisting) {
+        ASTOptimizer::visitBlockStmt(block);
+        return;
+    }
+    auto mark = declared.getMark();
+    std::vector<JSStmt*> stmts;
+    auto inserted = false;
+    for (auto* stmt : block->getStmts()) {
+        inserted |= rewriteStmt(stmt, stmts);
+    }
+    declared.undeclare(mark);
+    if (inserted) {
+        block->setStmts(arena.copy(stmts));
+    }
+}
+
+/// Visit a function declaration, the body runs with the caller's scopes so
+/// only its parameters and the globals declared before any call are known
+/// to be declared.
+auto LoopInvariantMotion::visitFuncDecl(JSFuncDecl* stmt) -> void {
+    if (hoisting) {
+        return;
+    }
+    auto enclosing = std::exchange(declared, DeclaredNames());
+    for (auto name : globals) {
+        declared.declare(name);
+    }
+    for (auto param : stmt->getParamNames()) {
+        declared.declare(param);
+    }
+    stmt->getBody()->accept(this);
+    declared = std::move(enclosing);
+}
+
+auto ValueNumbering::run(JSProgram& program) -> void {
+    bindings.clear();
+    auto firstCall = BindingCounter(bindings).count(program);
+    globals        = getGlobals(program, firstCall);
+    values.clear();
+    computations.clear();
+    locals.clear();
+    numberStmts(program.getStmts());
+    // Values are in the order their first computation completes, so the
+    // locals of the values a computation reuses precede its own.
+    for (auto& value : values) {
+        if (value.uses > 1) {
+            auto name   = makeFreshName(arena, "cse");
+            value.local = arena.make<JSVarDecl>(name, value.expr);
+            value.read  = arena.make<JSVarExpr>(name);
+            locals[value.stmt].push_back(value.local);
+        }
+    }
+    std::vector<JSStmt*> stmts;
+    if (rewriteStmts(program.getStmts(), stmts)) {
+        program.setStmts(std::move(stmts));
+    }
+}
+
+auto ValueNumbering::numberStmts(std::span<JSStmt* const> stmts) -> void {
+    auto mark = declared.getMark();
+    numbers.clear();
+    for (auto* stmt : stmts) {
+        stmtBindings.clear();
+        auto firstCall = BindingCounter(stmtBindings)
+                             .count(std::span<JSStmt* const>(&stmt, 1));
+        stmtCalls = firstCall != std::numeric_limits<size_t>::max();
+        std::erase_if(numbers, [&](const auto& entry) {
+            return std::ranges::any_of(
+                values[entry.second].reads,
+                [&](std::string_view name) { return isKilled(name); });
+        });
+        ComputationScanner([&](JSExpr* expr) {
+            return numberExpr(expr, stmt);
+        }).scan(stmt);
+        if (auto name = getDeclaredName(stmt); !name.empty()) {
+            declared.declare(name);
+        }
+    }
+    declared.undeclare(mark);
+    // The values of the enclosing list are final once it is numbered.
+    numbers.clear();
+    for (auto* stmt : stmts) {
+        numberNested(stmt);
+        if (auto name = getDeclaredName(stmt); !name.empty()) {
+            declared.declare(name);
+        }
+    }
+    declared.undeclare(mark);
+}
+
+auto ValueNumbering::numberNested(JSStmt* stmt) -> void {
+    switch (stmt->getKind()) {
+    case ASTNodeKind::BlockStmt:
+        numberStmts(static_cast<JSBlockStmt*>(stmt)->getStmts());
+        break;
+    case ASTNodeKind::IfStmt: {
+        auto* branch = static_cast<JSIfStmt*>(stmt);
+        numberNested(branch->getThenBranch());
+        if (branch->getElseBranch() != nullptr) {
+            numberNested(branch->getElseBranch());
+        }
+        break;
+    }
+    case ASTNodeKind::WhileStmt:
+        numberNested(static_cast<JSWhileStmt*>(stmt)->getBody());
+        break;
+    case ASTNodeKind::ForStmt: {
+        // The initializer declares its variable in the enclosing scope.
+        auto* loop = static_cast<JSForStmt*>(stmt);
+        auto mark  = declared.getMark();
+        if (loop->getInitializer() != nullptr) {
+            if (auto name = getDeclaredName(loop->getInitializer());
+                !name.empty()) {
+                declared.declare(name);
+            }
+        }
+        numberNested(loop->getBody());
+        declared.undeclare(mark);
+        break;
+    }
+    case ASTNodeKind::FuncDecl: {
+        // The body runs with the caller's scopes, only its parameters and
+        // the globals declared before any call are known to be declared.
+        auto* decl     = static_cast<JSFuncDecl*>(stmt);
+        auto enclosing = std::exchange(declared, DeclaredNames());
+        for (auto name : globals) {
+            declared.declare(name);
+        }
+        for (auto param : decl->getParamNames()) {
+            declared.declare(param);
+        }
+        numberNested(decl->getBody());
+        declared = std::move(enclosing);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+auto ValueNumbering::numberExpr(JSExpr* expr, JSStmt* stmt) -> bool {
+    // Computations of a value reused in an enclosing list are replaced as a
+    // whole.
+    if (auto found = computations.find(expr);
+        found != computations.end() && values[found->second].uses > 1) {
+        return true;
+    }
+    std::vector<std::string_view> reads;
+    auto key = getKey(expr, reads);
+    if (key.empty()) {
+        return false;
+    }
+    if (auto found = numbers.find(key); found != numbers.end()) {
+        values[found->second].uses++;
+        computations[expr] = found->second;
+        return true;
+    }
+    auto numberOperand = [&](JSExpr* operand) {
+        while (operand != nullptr &&
+               operand->getKind() == ASTNodeKind::GroupingExpr) {
+            operand = static_cast<JSGroupingExpr*>(operand)->getExpr();
+        }
+        if (operand == nullptr) {
+            return;
+        }
+        auto kind = operand->getKind();
+        if (kind == ASTNodeKind::BinaryExpr ||
+            kind == ASTNodeKind::UnaryExpr ||
+            kind == ASTNodeKind::LogicalExpr) {
+            numberExpr(operand, stmt);
+        }
+    };
+    if (expr->getKind() == ASTNodeKind::BinaryExpr) {
+        numberOperand(static_cast<JSBinExpr*>(expr)->getLeft());
+        numberOperand(static_cast<JSBinExpr*>(expr)->getRight());
+    } else if (expr->getKind() == ASTNodeKind::LogicalExpr) {
+        numberOperand(static_cast<JSLogicalExpr*>(expr)->getLeft());
+        numberOperand(static_cast<JSLogicalExpr*>(expr)->getRight());
+    } else {
+        numberOperand(static_cast<JSUnaryExpr*>(expr)->getRight());
+    }
+    computations[expr] = values.size();
+    numbers.emplace(std::move(key), values.size());
+    values.push_back({expr, std::move(reads), stmt});
+    return true;
+}
+
+auto ValueNumbering::getKey(JSExpr* expr,
+                            std::vector<std::string_view>& reads)
+    -> std::string {
+    if (expr == nullptr) {
+        return {};
+    }
+    switch (expr->getKind()) {
+    case ASTNodeKind::LiteralExpr: {
+        const auto& value = static_cast<JSLiteralExpr*>(expr)->getValue();
+        if (value.getKind() == JSValueKind::Number) {
+            return fmt::format("#{}", value.getValue<JSNumber>());
+        }
+        if (value.getKind() == JSValueKind::String) {
+            auto str = value.getValue<JSString>();
+            return fmt::format("\"{}:{}", str.size(), str);
+        }
+        return fmt::format("'{}", value.toString());
+    }
+    case ASTNodeKind::VarExpr: {
+        // Reading a variable that isn't declared throws.
+        auto name = static_cast<JSVarExpr*>(expr)->getName().getLexeme();
+        if (!declared.contains(name) || isKilled(name)) {
+            return {};
+        }
+        reads.push_back(name);
+        return std::string(name);
+    }
+    case ASTNodeKind::GroupingExpr:
+        return getKey(static_cast<JSGroupingExpr*>(expr)->getExpr(), reads);
+    case ASTNodeKind::UnaryExpr: {
+        auto* unary = static_cast<JSUnaryExpr*>(expr);
+        if (!isSafeOperator(unary->getOperator().getKind())) {
+            return {};
+        }
+        auto right = getKey(unary->getRight(), reads);
+        if (right.empty()) {
+            return {};
+        }
+        return fmt::format("({} {})", unary->getOperator().getLexeme(),
+                           right);
+    }
+    case ASTNodeKind::LogicalExpr: {
+        auto* logical = static_cast<JSLogicalExpr*>(expr);
+        auto left     = getKey(logical->getLeft(), reads);
+        auto right    = getKey(logical->getRight(), reads);
+        if (left.empty() || right.empty()) {
+            return {};
+        }
+        return fmt::format("({} {} {})", logical->getOperator().getLexeme(),
+                           left, right);
+    }
+    case ASTNodeKind::BinaryExpr: {
+        auto* binary = static_cast<JSBinExpr*>(expr);
+        auto op      = binary->getOperator().getKind();
+        if (!isSafeOperator(op)) {
+            return {};
+        }
+        auto left  = getKey(binary->getLeft(), reads);
+        auto right = getKey(binary->getRight(), reads);
+        if (left.empty() || right.empty()) {
+            return {};
+        }
+        auto commutes = op == JSTokenKind::Star ||
+                        op == JSTokenKind::EqualEqual ||
+                        op == JSTokenKind::BangEqual;
+        if (commutes && right < left) {
+            std::swap(left, right);
+        }
+        return fmt::format("({} {} {})", binary->getOperator().getLexeme(),
+                           left, right);
+    }
+    default:
+        return {};
+    }
+}
+
+auto ValueNumbering::isKilled(std::string_view name) -> bool {
+    if (auto used = stmtBindings.find(name); used != stmtBindings.end()) {
+        if (used->second.declarations != 0 || used->second.assignments != 0) {
+            return true;
+        }
+    }
+    return stmtCalls && bindings[name].functionAssignments != 0;
+}
+
+auto ValueNumbering::reuse(JSExpr* expr) -> bool {
+    auto found = computations.find(expr);
+    if (found == computations.end()) {
+        return false;
+    }
+    auto& value = values[found->second];
+    if (value.local == nullptr || value.expr == expr) {
+        return false;
+    }
+    expressionStack.push_back(value.read);
+    eliminated++;
+    return true;
+}
+
+auto ValueNumbering::bind(JSExpr* expr) -> void {
+    auto found = computations.find(expr);
+    if (found == computations.end()) {
+        return;
+    }
+    auto& value = values[found->second];
+    if (value.local == nullptr) {
+        return;
+    }
+    value.local->setInitializer(expressionStack.back());
+    expressionStack.back() = value.read;
+}
+
+auto ValueNumbering::rewriteStmts(std::span<JSStmt* const> stmts,
+                                  std::vector<JSStmt*>& rewritten) -> bool {
+    auto inserted = false;
+    for (auto* stmt : stmts) {
+        if (auto found = locals.find(stmt); found != locals.end()) {
+            rewritten.insert(rewritten.end(), found->second.begin(),
+                             found->second.end());
+            inserted = true;
+        }
+        stmt->accept(this);
+        rewritten.push_back(stmt);
+    }
+    return inserted;
+}
+
+/// Visit a binary expression.
+auto ValueNumbering::visitBinaryExpr(JSBinExpr* expr) -> void {
+    if (!reuse(expr)) {
+        ASTOptimizer::visitBinaryExpr(expr);
+        bind(expr);
+    }
+}
+
+/// Visit a unary expression.
+auto ValueNumbering::visitUnaryExpr(JSUnaryExpr* expr) -> void {
+    if (!reuse(expr)) {
+        ASTOptimizer::visitUnaryExpr(expr);
+        bind(expr);
+    }
+}
+
+/// Visit a logical expression.
+auto ValueNumbering::visitLogicalExpr(JSLogicalExpr* expr) -> void {
+    if (!reuse(expr)) {
+        ASTOptimizer::visitLogicalExpr(expr);
+        bind(expr);
+    }
+}
+
+/// Visit a block statement, the locals of the values its statements compute
+/// are inserted in the block.
+auto ValueNumbering::visitBlockStmt(JSBlockStmt* block) -> void {
+    std::vector<JSStmt*> stmts;
+    if (rewriteStmts(block->getStmts(), stmts)) {
+        block->setStmts(arena.copy(stmts));
+    }
+}
+
+auto optimize(JSProgram& program) -> void {
+    ConstantPropagator(program.getArena()).run(program);
+    FunctionInliner(program.getArena()).run(program);
+    ConstantPropagator(program.getArena()).run(program);
+    LoopInvariantMotion(program.getArena()).run(program);
+    ValueNumbering(program.getArena()).run(program);
+}
 
 } // namespace minijsc
@@ -0,0 +1,466 @@
+//===----------------------------------------------------------------------===//
+// ASTSerializer.cpp: This file implements the binary serialization of syntax
+// trees, the serializer visits the tree writing nodes in pre-order and the
+// deserializer reads them back recursively.
+//===----------------------------------------------------------------------===//
+#include "ASTSerializer.h"
+#include "AST.h"
+#include "ASTArena.h"
+#include "JSToken.h"
+#include "JSValue.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace minijsc {
+
+namespace {
+
+/// Append a LEB128 varint, 7 bits per byte with the high bit set on every
+/// byte but the last.
+auto appendVarint(std::string& out, uint64_t value) -> void {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/// Number of bytes of a serialized number.
+constexpr size_t kNumberBytes = sizeof(uint64_t);
+
+} // namespace
+
+// The string table is only known once every node is written, it is emitted
+// before the nodes so the deserializer can resolve indices as it reads.
+auto ASTSerializer::serialize(std::span<JSStmt* const> stmts) -> std::string {
+    nodes.clear();
+    strings.clear();
+    stringIndices.clear();
+    writeVarint(stmts.size());
+    for (auto* stmt : stmts) {
+        write(stmt);
+    }
+
+    std::string out(kASTMagic);
+    appendVarint(out, kASTFormatVersion);
+    appendVarint(out, strings.size());
+    for (const auto& str : strings) {
+        appendVarint(out, str.size());
+        out.append(str);
+    }
+    out.append(nodes);
+    return out;
+}
+
+auto ASTSerializer::write(JSExpr* expr) -> void {
+    if (expr == nullptr) {
+        writeVarint(0);
+        return;
+    }
+    expr->accept(this);
+}
+
+auto ASTSerializer::write(JSStmt* stmt) -> void {
+    if (stmt == nullptr) {
+        writeVarint(0);
+        return;
+    }
+    stmt->accept(this);
+}
+
+auto ASTSerializer::writeKind(ASTNodeKind kind) -> void {
+    writeVarint(static_cast<uint64_t>(kind) + 1);
+}
+
+auto ASTSerializer::writeToken(const JSToken& token) -> void {
+    writeVarint(static_cast<uint64_t>(token.getKind()));
+    writeString(token.getLexeme());
+}
+
+auto ASTSerializer::writeString(std::string_view str) -> void {
+    auto [iter, inserted] = stringIndices.try_emplace(str, strings.size());
+    if (inserted) {
+        strings.push_back(str);
+    }
+    writeVarint(iter->second);
+}
+
+auto ASTSerializer::writeVarint(uint64_t value) -> void {
+    appendVarint(nodes, value);
+}
+
+auto ASTSerializer::visitLiteralExpr(JSLiteralExpr* expr) -> void {
+    writeKind(ASTNodeKind::LiteralExpr);
+    const auto& value = expr->getValue();
+    writeVarint(static_cast<uint64_t>(value.getKind()));
+    switch (value.getKind()) {
+    case JSValueKind::Number: {
+        auto bits = std::bit_cast<uint64_t>(value.getValue<JSNumber>());
+        for (size_t idx = 0; idx < kNumberBytes; idx++) {
+            nodes.push_back(static_cast<char>(bits >> (8 * idx)));
+        }
+        break;
+    }
+    case JSValueKind::Boolean:
+        writeVarint(value.getValue<JSBoolean>() ? 1 : 0);
+        break;
+    case JSValueKind::String:
+        writeString(value.getValue<JSString>());
+        break;
+    case JSValueKind::Undefined:
+    case JSValueKind::Null:
+        break;
+    default:
+        throw std::runtime_error("Cannot serialize a literal heap object.");
+    }
+}
+
+auto ASTSerializer::visitBinaryExpr(JSBinExpr* expr) -> void {
+    writeKind(ASTNodeKind::BinaryExpr);
+    write(expr->getLeft());
+    writeToken(expr->getOperator());
+    write(expr->getRight());
+}
+
+auto ASTSerializer::visitUnaryExpr(JSUnaryExpr* expr) -> void {
+    writeKind(ASTNodeKind::UnaryExpr);
+    writeToken(expr->getOperator());
+    write(expr->getRight());
+}
+
+auto ASTSerializer::visitLogicalExpr(JSLogicalExpr* expr) -> void {
+    writeKind(ASTNodeKind::LogicalExpr);
+    writeToken(expr->getOperator());
+    write(expr->getLeft());
+    write(expr->getRight());
+}
+
+auto ASTSerializer::visitGroupingExpr(JSGroupingExpr* expr) -> void {
+    writeKind(ASTNodeKind::GroupingExpr);
+    write(expr->getExpr());
+}
+
+auto ASTSerializer::visitVarExpr(JSVarExpr* expr) -> void {
+    writeKind(ASTNodeKind::VarExpr);
+    writeToken(expr->getName());
+}
+
+auto ASTSerializer::visitAssignExpr(JSAssignExpr* expr) -> void {
+    writeKind(ASTNodeKind::AssignExpr);
+    writeToken(expr->getName());
+    write(expr->getValue());
+}
+
+auto ASTSerializer::visitCallExpr(JSCallExpr* expr) -> void {
+    writeKind(ASTNodeKind::CallExpr);
+    write(expr->getCallee());
+    writeToken(expr->getParen());
+    writeVarint(expr->getArgs().size());
+    for (auto* arg : expr->getArgs()) {
+        write(arg);
+    }
+}
+
+auto ASTSerializer::visitBlockStmt(JSBlockStmt* block) -> void {
+    writeKind(ASTNodeKind::BlockStmt);
+    writeVarint(block->getStmts().size());
+    for (auto* stmt : block->getStmts()) {
+        write(stmt);
+    }
+}
+
+auto ASTSerializer::visitExprStmt(JSExprStmt* stmt) -> void {
+    writeKind(ASTNodeKind::ExprStmt);
+    write(stmt->getExpr());
+}
+
+auto ASTSerializer::visitIfStmt(JSIfStmt* stmt) -> void {
+    writeKind(ASTNodeKind::IfStmt);
+    write(stmt->getCondition());
+    write(stmt->getThenBranch());
+    write(stmt->getElseBranch());
+}
+
+auto ASTSerializer::visitWhileStmt(JSWhileStmt* stmt) -> void {
+    writeKind(ASTNodeKind::WhileStmt);
+    write(stmt->getCondition());
+    write(stmt->getBody());
+}
+
+auto ASTSerializer::visitForStmt(JSForStmt* stmt) -> void {
+    writeKind(ASTNodeKind::ForStmt);
+    write(stmt->getInitializer());
+    write(stmt->getCondition());
+    write(stmt->getStep());
+    write(stmt->getBody());
+}
+
+auto ASTSerializer::visitVarDecl(JSVarDecl* stmt) -> void {
+    writeKind(ASTNodeKind::VarDecl);
+    writeToken(JSToken(JSTokenKind::Identifier, stmt->getName()));
+    write(stmt->getInitializer());
+}
+
+auto ASTSerializer::visitFuncDecl(JSFuncDecl* stmt) -> void {
+    writeKind(ASTNodeKind::FuncDecl);
+    writeToken(stmt->getName());
+    writeVarint(stmt->getParams().size());
+    for (const auto& param : stmt->getParams()) {
+        writeToken(param);
+    }
+    write(stmt->getBody());
+}
+
+auto ASTSerializer::visitReturnStmt(JSReturnStmt* stmt) -> void {
+    writeKind(ASTNodeKind::ReturnStmt);
+    writeToken(stmt->getKeyword());
+    write(stmt->getValue());
+}
+
+auto ASTSerializer::visitBreakStmt(JSBreakStmt* stmt) -> void {
+    writeKind(ASTNodeKind::BreakStmt);
+    writeToken(stmt->getKeyword());
+}
+
+auto ASTSerializer::visitContinueStmt(JSContinueStmt* stmt) -> void {
+    writeKind(ASTNodeKind::ContinueStmt);
+    writeToken(stmt->getKeyword());
+}
+
+// The data is copied once in the arena, the string table entries are views
+// of the copy and so are the lexemes of the deserialized tokens.
+auto ASTDeserializer::deserialize() -> JSProgram {
+    auto copy = arena->copy(std::span<const char>(data));
+    data      = {copy.data(), copy.size()};
+    if (!isSerializedAST(data)) {
+        fail("missing magic");
+    }
+    pos = kASTMagic.size();
+    if (readVarint() != kASTFormatVersion) {
+        fail("unsupported version");
+    }
+    auto count = readCount();
+    strings.reserve(count);
+    for (size_t idx = 0; idx < count; idx++) {
+        auto length = readCount();
+        strings.push_back(data.substr(pos, length));
+        pos += length;
+    }
+
+    std::vector<JSStmt*> stmts(readCount());
+    for (auto& stmt : stmts) {
+        stmt = readStmt();
+        if (stmt == nullptr) {
+            fail("missing top level statement");
+        }
+    }
+    if (pos != data.size()) {
+        fail("trailing bytes");
+    }
+    return JSProgram(std::move(arena), std::move(stmts));
+}
+
+// Operands are read into locals, in the order they were written, before the
+// node is built since the evaluation order of arguments is unspecified.
+auto ASTDeserializer::readExpr() -> JSExpr* {
+    auto kind = readVarint();
+    if (kind == 0) {
+        return nullptr;
+    }
+    switch (static_cast<ASTNodeKind>(kind - 1)) {
+    case ASTNodeKind::LiteralExpr:
+        return arena->make<JSLiteralExpr>(readValue());
+    case ASTNodeKind::BinaryExpr: {
+        auto* left  = readExpr();
+        auto binOp  = readToken();
+        auto* right = readExpr();
+        return arena->make<JSBinExpr>(left, binOp, right);
+    }
+    case ASTNodeKind::UnaryExpr: {
+        auto unaryOp = readToken();
+        auto* right  = readExpr();
+        return arena->make<JSUnaryExpr>(unaryOp, right);
+    }
+    case ASTNodeKind::LogicalExpr: {
+        auto logicalOp = readToken();
+        auto* left     = readExpr();
+        auto* right    = readExpr();
+        return arena->make<JSLogicalExpr>(logicalOp, left, right);
+    }
+    case ASTNodeKind::GroupingExpr:
+        return arena->make<JSGroupingExpr>(readExpr());
+    case ASTNodeKind::VarExpr:
+        return arena->make<JSVarExpr>(readToken());
+    case ASTNodeKind::AssignExpr: {
+        auto name   = readToken();
+        auto* value = readExpr();
+        return arena->make<JSAssignExpr>(name, value);
+    }
+    case ASTNodeKind::CallExpr: {
+        auto* callee = readExpr();
+        auto paren   = readToken();
+        std::vector<JSExpr*> args(readCount());
+        for (auto& arg : args) {
+            arg = readExpr();
+        }
+        return arena->make<JSCallExpr>(callee, paren, arena->copy(args));
+    }
+    default:
+        fail("expected an expression");
+    }
+}
+
+auto ASTDeserializer::readStmt() -> JSStmt* {
+    auto kind = readVarint();
+    if (kind == 0) {
+        return nullptr;
+    }
+    switch (static_cast<ASTNodeKind>(kind - 1)) {
+    case ASTNodeKind::BlockStmt: {
+        std::vector<JSStmt*> stmts(readCount());
+        for (auto& stmt : stmts) {
+            stmt = readStmt();
+        }
+        return arena->make<JSBlockStmt>(arena->copy(stmts));
+    }
+    case ASTNodeKind::ExprStmt:
+        return arena->make<JSExprStmt>(readExpr());
+    case ASTNodeKind::IfStmt: {
+        auto* condition  = readExpr();
+        auto* thenBranch = readStmt();
+        auto* elseBranch = readStmt();
+        return arena->make<JSIfStmt>(condition, thenBranch, elseBranch);
+    }
+    case ASTNodeKind::WhileStmt: {
+        auto* condition = readExpr();
+        auto* body      = readStmt();
+        return arena->make<JSWhileStmt>(condition, body);
+    }
+    case ASTNodeKind::ForStmt: {
+        auto* initializer = readStmt();
+        auto* condition   = readExpr();
+        auto* step        = readExpr();
+        auto* body        = readStmt();
+        return arena->make<JSForStmt>(initializer, condition, step, body);
+    }
+    case ASTNodeKind::VarDecl: {
+        auto name         = readToken();
+        auto* initializer = readExpr();
+        return arena->make<JSVarDecl>(name, initializer);
+    }
+    case ASTNodeKind::FuncDecl: {
+        auto name = readToken();
+        std::vector<JSToken> params;
+        std::vector<std::string_view> paramNames;
+        auto count = readCount();
+        params.reserve(count);
+        paramNames.reserve(count);
+        for (size_t idx = 0; idx < count; idx++) {
+            params.push_back(readToken());
+            paramNames.push_back(params.back().getLexeme());
+        }
+        auto* body = readBlock();
+        return arena->make<JSFuncDecl>(name, arena->copy(params),
+                                       arena->copy(paramNames), body);
+    }
+    case ASTNodeKind::ReturnStmt: {
+        auto keyword = readToken();
+        auto* value  = readExpr();
+        return arena->make<JSReturnStmt>(keyword, value);
+    }
+    case ASTNodeKind::BreakStmt:
+        return arena->make<JSBreakStmt>(readToken());
+    case ASTNodeKind::ContinueStmt:
+        return arena->make<JSContinueStmt>(readToken());
+    default:
+        fail("expected a statement");
+    }
+}
+
+auto ASTDeserializer::readBlock() -> JSBlockStmt* {
+    auto* stmt = readStmt();
+    if (stmt == nullptr || stmt->getKind() != ASTNodeKind::BlockStmt) {
+        fail("expected a block");
+    }
+    return static_cast<JSBlockStmt*>(stmt);
+}
+
+auto ASTDeserializer::readToken() -> JSToken {
+    auto kind = readVarint();
+    if (kind >= kTokenKindCount) {
+        fail("invalid token kind");
+    }
+    return {static_cast<JSTokenKind>(kind), readString()};
+}
+
+auto ASTDeserializer::readValue() -> JSBasicValue {
+    switch (static_cast<JSValueKind>(readVarint())) {
+    case JSValueKind::Number: {
+        if (data.size() - pos < kNumberBytes) {
+            fail("truncated number");
+        }
+        uint64_t bits = 0;
+        for (size_t idx = 0; idx < kNumberBytes; idx++) {
+            bits |= uint64_t(static_cast<uint8_t>(data[pos++])) << (8 * idx);
+        }
+        return {std::bit_cast<JSNumber>(bits)};
+    }
+    case JSValueKind::Boolean:
+        return {readVarint() != 0};
+    case JSValueKind::String:
+        return {JSString(readString())};
+    case JSValueKind::Undefined:
+        return {};
+    case JSValueKind::Null:
+        return {nullptr};
+    default:
+        fail("invalid literal");
+    }
+}
+
+auto ASTDeserializer::readString() -> std::string_view {
+    auto index = readVarint();
+    if (index >= strings.size()) {
+        fail("invalid string index");
+    }
+    return strings[index];
+}
+
+auto ASTDeserializer::readVarint() -> uint64_t {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (pos >= data.size()) {
+            fail("truncated varint");
+        }
+        auto byte = static_cast<uint8_t>(data[pos++]);
+        value |= uint64_t(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    fail("varint too long");
+}
+
+// Every element takes at least a byte, larger counts can only come from
+// malformed data and would otherwise allocate unbounded vectors.
+auto ASTDeserializer::readCount() -> size_t {
+    auto count = readVarint();
+    if (count > data.size() - pos) {
+        fail("count out of range");
+    }
+    return static_cast<size_t>(count);
+}
+
+auto ASTDeserializer::fail(const char* what) -> void {
+    throw std::runtime_error(std::string("Malformed serialized AST: ") + what);
+}
+
+} // namespace minijsc
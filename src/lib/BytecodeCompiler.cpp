@@ -8,10 +8,14 @@
 #include "AST.h"
 #include "BytecodeCompiler.h"
 #include "JSValue.h"
+#include "VM.h"
 #include "fmt/core.h"
 
 #include <cassert>
 #include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
 
 namespace minijsc {
 
@@ -20,18 +24,19 @@ auto BytecodeCompiler::visitLiteralExpr(JSLiteralExpr* expr) -> void {
         emit(OPCode::Constant, JSBasicValue());
         return;
     }
-    auto value = std::static_pointer_cast<JSBasicValue>(expr->getValue());
-    emit(OPCode::Constant, *value);
+    const auto& value = expr->getValue();
+    emit(OPCode::Constant, value);
     // emit(OPCode::Return);
-    fmt::print("Emitting constant literal {}\n", value->toString());
-    fmt::print("OpConstant\n");
+#ifdef DEBUG_TRACE_EXECUTION
+    fmt::print("Emitting constant literal {}\n", value.toString());
+#endif
 }
 
 /// Visit a binary expression.
 auto BytecodeCompiler::visitBinaryExpr(JSBinExpr* expr) -> void {
     auto binOp = expr->getOperator();
-    compile(expr->getLeft().get());
-    compile(expr->getRight().get());
+    compile(expr->getLeft());
+    compile(expr->getRight());
     switch (binOp.getKind()) {
     case JSTokenKind::Plus: {
         emit(OPCode::Add);
@@ -82,7 +87,7 @@ auto BytecodeCompiler::visitBinaryExpr(JSBinExpr* expr) -> void {
 /// Visit a unary expression.
 auto BytecodeCompiler::visitUnaryExpr(JSUnaryExpr* expr) -> void {
     auto unaryOp = expr->getOperator();
-    compile(expr->getRight().get());
+    compile(expr->getRight());
     switch (unaryOp.getKind()) {
     case JSTokenKind::Minus:
         emit(OPCode::Negate);
@@ -96,18 +101,27 @@ auto BytecodeCompiler::visitUnaryExpr(JSUnaryExpr* expr) -> void {
     }
 }
 
-/// Visit a logical expression.
+/// Logical expressions short circuit, the left operand is kept on the stack
+/// as the result when it decides the expression.
 auto BytecodeCompiler::visitLogicalExpr(JSLogicalExpr* expr) -> void {
     auto binOp = expr->getOperator();
-    compile(expr->getLeft().get());
-    compile(expr->getRight().get());
+    compile(expr->getLeft());
+    emit(OPCode::Dup);
     switch (binOp.getKind()) {
     case JSTokenKind::Or: {
-        emit(OPCode::Or);
+        auto elseJump = emitJump(OPCode::JumpIfFalse);
+        auto endJump  = emitJump(OPCode::Jump);
+        patchJump(elseJump);
+        emit(OPCode::Pop);
+        compile(expr->getRight());
+        patchJump(endJump);
         break;
     }
     case JSTokenKind::And: {
-        emit(OPCode::And);
+        auto endJump = emitJump(OPCode::JumpIfFalse);
+        emit(OPCode::Pop);
+        compile(expr->getRight());
+        patchJump(endJump);
         break;
     }
     default:
@@ -118,54 +132,270 @@ auto BytecodeCompiler::visitLogicalExpr(JSLogicalExpr* expr) -> void {
 
 /// Visit a grouping expression.
 auto BytecodeCompiler::visitGroupingExpr(JSGroupingExpr* expr) -> void {
-    compile(expr->getExpr().get());
+    compile(expr->getExpr());
 }
 
 /// Visit a variable expression.
 auto BytecodeCompiler::visitVarExpr(JSVarExpr* expr) -> void {
-    auto ident = expr->getName().getLexeme();
+    auto ident = std::string(expr->getName().getLexeme());
+    if (auto slot = resolveLocal(ident)) {
+        emit(OPCode::GetLocal, *slot);
+        return;
+    }
     emit(OPCode::GetGlobal, ident);
 }
 
 /// Visit an assignment expression.
-auto BytecodeCompiler::visitAssignExpr(JSAssignExpr* exor) -> void {}
+auto BytecodeCompiler::visitAssignExpr(JSAssignExpr* expr) -> void {
+    auto ident = std::string(expr->getName().getLexeme());
+    compile(expr->getValue());
+    if (auto slot = resolveLocal(ident)) {
+        emit(OPCode::SetLocal, *slot);
+        return;
+    }
+    // Setting a global pops the value, load it back since assignments
+    // are expressions.
+    emit(OPCode::SetGlobal, ident);
+    emit(OPCode::GetGlobal, ident);
+}
 
 /// Visit a call expression.
-auto BytecodeCompiler::visitCallExpr(JSCallExpr* /*expr*/) -> void {}
+auto BytecodeCompiler::visitCallExpr(JSCallExpr* expr) -> void {
+    emit(OPCode::Call, compileCall(expr));
+}
 
 /// Visit a block statement.
-auto BytecodeCompiler::visitBlockStmt(JSBlockStmt* block) -> void {}
+auto BytecodeCompiler::visitBlockStmt(JSBlockStmt* block) -> void {
+    beginScope();
+    for (auto& stmt : block->getStmts()) {
+        compile(stmt);
+    }
+    endScope();
+}
 
 /// Visit an expression statement.
-auto BytecodeCompiler::visitExprStmt(JSExprStmt* stmt) -> void {}
+auto BytecodeCompiler::visitExprStmt(JSExprStmt* stmt) -> void {
+    compile(stmt->getExpr());
+    emit(OPCode::Pop);
+}
 
 /// Visit an if statement.
-auto BytecodeCompiler::visitIfStmt(JSIfStmt* stmt) -> void {}
+auto BytecodeCompiler::visitIfStmt(JSIfStmt* stmt) -> void {
+    compile(stmt->getCondition());
+    auto thenJump = emitJump(OPCode::JumpIfFalse);
+    compile(stmt->getThenBranch());
+    auto elseJump = emitJump(OPCode::Jump);
+    patchJump(thenJump);
+    compile(stmt->getElseBranch());
+    patchJump(elseJump);
+}
 
 /// Visit a while statement.
-auto BytecodeCompiler::visitWhileStmt(JSWhileStmt* stmt) -> void {}
+auto BytecodeCompiler::visitWhileStmt(JSWhileStmt* stmt) -> void {
+    auto start = bytecodeBuffer.size();
+    compile(stmt->getCondition());
+    auto exitJump = emitJump(OPCode::JumpIfFalse);
+    loops.push_back(LoopState{locals.size(), {}, {}});
+    compile(stmt->getBody());
+    for (auto jump : loops.back().continues) {
+        patchJump(jump);
+    }
+    emitLoop(start);
+    patchJump(exitJump);
+    for (auto jump : loops.back().breaks) {
+        patchJump(jump);
+    }
+    loops.pop_back();
+}
 
-/// Visit a for statement.
-auto BytecodeCompiler::visitForStmt(JSForStmt* stmt) -> void {}
+/// Visit a for statement, the initializer runs in the enclosing scope like
+/// in the interpreter.
+auto BytecodeCompiler::visitForStmt(JSForStmt* stmt) -> void {
+    compile(stmt->getInitializer());
+    auto start = bytecodeBuffer.size();
+    if (stmt->getCondition() != nullptr) {
+        compile(stmt->getCondition());
+    } else {
+        emit(OPCode::Constant, JSBasicValue());
+    }
+    auto exitJump = emitJump(OPCode::JumpIfFalse);
+    loops.push_back(LoopState{locals.size(), {}, {}});
+    compile(stmt->getBody());
+    // Continue statements jump to the step.
+    for (auto jump : loops.back().continues) {
+        patchJump(jump);
+    }
+    if (stmt->getStep() != nullptr) {
+        compile(stmt->getStep());
+        emit(OPCode::Pop);
+    }
+    emitLoop(start);
+    patchJump(exitJump);
+    for (auto jump : loops.back().breaks) {
+        patchJump(jump);
+    }
+    loops.pop_back();
+}
 
 /// Visit a variable declaration.
 auto BytecodeCompiler::visitVarDecl(JSVarDecl* stmt) -> void {
-    auto ident = stmt->getName();
-    if (stmt->getInitializer().get() != nullptr) {
-        compile(stmt->getInitializer().get());
+    auto ident = std::string(stmt->getName());
+    if (stmt->getInitializer() != nullptr) {
+        compile(stmt->getInitializer());
     } else {
         // If no assignment then set it as undefined.
         emit(OPCode::Constant, JSBasicValue());
     }
-    emit(OPCode::SetGlobal, ident);
+    if (scopeDepth == 0) {
+        emit(OPCode::SetGlobal, ident);
+        return;
+    }
+    // Redeclarations in the same scope assign the existing local.
+    for (size_t i = locals.size(); i > 0; i--) {
+        if (locals[i - 1].depth < scopeDepth) {
+            break;
+        }
+        if (locals[i - 1].name == ident) {
+            emit(OPCode::SetLocal, i - 1);
+            emit(OPCode::Pop);
+            return;
+        }
+    }
+    // The initial value stays on the stack as the local's slot.
+    locals.push_back(Local{ident, scopeDepth});
 }
 
-/// Visit a function declaration.
-auto BytecodeCompiler::visitFuncDecl(JSFuncDecl* stmt) -> void {}
+/// Visit a function declaration, the body is compiled into its own code
+/// and constants pool and the function object is stored as a constant.
+/// Functions don't capture the locals of enclosing functions, so nested
+/// declarations whose body could reach them, including through the nested
+/// function's own name, are rejected.
+auto BytecodeCompiler::visitFuncDecl(JSFuncDecl* stmt) -> void {
+    auto name = std::string(stmt->getName().getLexeme());
+    if (!enclosing.empty()) {
+        throw std::runtime_error(fmt::format(
+            "Nested function {} is not supported.\n", name));
+    }
+    auto params = stmt->getParams();
+
+    enclosing.push_back(FunctionState{
+        std::move(bytecodeBuffer), std::move(constantsPool), std::move(locals),
+        std::move(loops), scopeDepth});
+    bytecodeBuffer = {};
+    constantsPool  = {};
+    locals         = {};
+    loops          = {};
+    // The parameters are the first locals of the function's frame and the
+    // body runs in the same scope.
+    scopeDepth = 1;
+    for (const auto& param : params) {
+        locals.push_back(Local{std::string(param.getLexeme()), scopeDepth});
+    }
+    for (auto& bodyStmt : stmt->getBody()->getStmts()) {
+        compile(bodyStmt);
+    }
+    // Functions without a return statement return undefined.
+    emit(OPCode::Constant, JSBasicValue());
+    emit(OPCode::Return);
+
+    auto func = std::make_shared<JSBytecodeFunction>(
+        name, params.size(), std::move(bytecodeBuffer),
+        std::move(constantsPool));
+    auto& state    = enclosing.back();
+    bytecodeBuffer = std::move(state.bytecodeBuffer);
+    constantsPool  = std::move(state.constantsPool);
+    locals         = std::move(state.locals);
+    loops          = std::move(state.loops);
+    scopeDepth     = state.scopeDepth;
+    enclosing.pop_back();
+
+    emit(OPCode::Constant, JSBasicValue(std::move(func)));
+    if (scopeDepth == 0) {
+        emit(OPCode::SetGlobal, name);
+        return;
+    }
+    locals.push_back(Local{name, scopeDepth});
+}
 
-/// Visit a return statement.
+/// Visit a return statement, returns of a call in tail position reuse
+/// the returning function's frame.
 auto BytecodeCompiler::visitReturnStmt(JSReturnStmt* stmt) -> void {
+    // Returning from the top level code stops the execution.
+    if (enclosing.empty()) {
+        emit(OPCode::Return);
+        return;
+    }
+    if (stmt->isTailCall()) {
+        auto* call = static_cast<JSCallExpr*>(stmt->getValue());
+        emit(OPCode::TailCall, compileCall(call));
+        return;
+    }
+    if (stmt->getValue() != nullptr) {
+        compile(stmt->getValue());
+    } else {
+        emit(OPCode::Constant, JSBasicValue());
+    }
     emit(OPCode::Return);
 }
 
+/// Visit a break statement.
+auto BytecodeCompiler::visitBreakStmt(JSBreakStmt* /*stmt*/) -> void {
+    popLoopLocals();
+    loops.back().breaks.push_back(emitJump(OPCode::Jump));
+}
+
+/// Visit a continue statement.
+auto BytecodeCompiler::visitContinueStmt(JSContinueStmt* /*stmt*/) -> void {
+    popLoopLocals();
+    loops.back().continues.push_back(emitJump(OPCode::Jump));
+}
+
+/// Exiting a scope pops the locals it declared from the stack.
+auto BytecodeCompiler::endScope() -> void {
+    scopeDepth--;
+    while (!locals.empty() && locals.back().depth > scopeDepth) {
+        emit(OPCode::Pop);
+        locals.pop_back();
+    }
+}
+
+/// Locals are resolved from the innermost scope of the function being
+/// compiled, functions don't capture the locals of enclosing functions.
+auto BytecodeCompiler::resolveLocal(const std::string& name)
+    -> std::optional<size_t> {
+    for (size_t i = locals.size(); i > 0; i--) {
+        if (locals[i - 1].name == name) {
+            return i - 1;
+        }
+    }
+    for (const auto& state : enclosing) {
+        for (const auto& local : state.locals) {
+            if (local.name == name) {
+                throw std::runtime_error(fmt::format(
+                    "Capturing variable {} is not supported.\n", name));
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+/// Jumping out of a loop body pops the locals declared inside the loop, the
+/// compiler keeps tracking them since the code after the jump still runs
+/// with those locals in scope.
+auto BytecodeCompiler::popLoopLocals() -> void {
+    for (auto i = locals.size(); i > loops.back().numLocals; i--) {
+        emit(OPCode::Pop);
+    }
+}
+
+/// Compile the callee followed by the arguments.
+auto BytecodeCompiler::compileCall(JSCallExpr* expr) -> size_t {
+    compile(expr->getCallee());
+    auto args = expr->getArgs();
+    for (auto& arg : args) {
+        compile(arg);
+    }
+    return args.size();
+}
+
 } // namespace minijsc
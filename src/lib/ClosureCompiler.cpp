@@ -0,0 +1,549 @@
+//===----------------------------------------------------------------------===//
+// ClosureCompiler.cpp: This file implements the closure compiler, each visit
+// method builds the closure of the visited node. Closures follow the same
+// evaluation rules as the tree-walking interpreter (see Interpreter.cpp).
+//===----------------------------------------------------------------------===//
+#include "ClosureCompiler.h"
+#include "AST.h"
+#include "Interpreter.h"
+#include "JSToken.h"
+#include "JSValue.h"
+#include "NativeStack.h"
+#include "fmt/core.h"
+
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+namespace minijsc {
+
+namespace {
+
+/// Build the closure of a binary operation on numbers, the operator is
+/// a template parameter so each operator gets its own specialized closure.
+template <typename Op>
+auto numericOp(ExprClosure lhs, ExprClosure rhs) -> ExprClosure {
+    return [lhs = std::move(lhs),
+            rhs = std::move(rhs)](ClosureContext& ctx) -> JSBasicValue {
+        auto left  = lhs(ctx);
+        auto right = rhs(ctx);
+        return Op{}(left.getValue<JSNumber>(), right.getValue<JSNumber>());
+    };
+}
+
+/// Run a closure whose arguments were pushed starting at `base`, the frame
+/// of the call starts at the first argument.
+auto invokeClosure(ClosureContext& ctx, JSClosure* func, size_t base)
+    -> JSBasicValue {
+    // Extra arguments are dropped and missing ones are undefined.
+    ctx.stack.resize(base + func->getArity());
+    ctx.stack.resize(base + func->getNumSlots());
+    auto savedFp = ctx.fp;
+    ctx.fp       = base;
+    ctx.depth++;
+    // The caller's frame is restored on runtime errors too.
+    ScopeExit exitCall([&] {
+        ctx.depth--;
+        ctx.fp = savedFp;
+        ctx.stack.resize(base);
+    });
+    auto completion = func->execute(ctx);
+    if (completion == Completion::Return) {
+        return std::move(ctx.returnReg);
+    }
+    return JSBasicValue();
+}
+
+/// Build the closure of the plus operator, see `visitBinaryExpr` in the
+/// interpreter for the overloading rules.
+auto plusOp(ExprClosure lhs, ExprClosure rhs) -> ExprClosure {
+    return [lhs = std::move(lhs),
+            rhs = std::move(rhs)](ClosureContext& ctx) -> JSBasicValue {
+        auto left  = lhs(ctx);
+        auto right = rhs(ctx);
+        if (left.isNumber() && right.isNumber()) {
+            return left.getValue<JSNumber>() + right.getValue<JSNumber>();
+        }
+        if (left.isString() && right.isString()) {
+            return left.getValue<JSString>() + right.getValue<JSString>();
+        }
+        if (left.isString()) {
+            return left.getValue<JSString>() + right.toString();
+        }
+        if (right.isString()) {
+            return left.toString() + right.getValue<JSString>();
+        }
+        throw std::runtime_error(
+            "Uncaught type error '+' unsupported for types : " +
+            left.toString() + " and " + right.toString());
+    };
+}
+
+} // namespace
+
+/// Compiling an expression visits it and takes the built closure, empty
+/// expressions compile to a closure returning `undefined`.
+auto ClosureCompiler::compile(JSExpr* expr) -> ExprClosure {
+    if (expr == nullptr) {
+        return [](ClosureContext& /*ctx*/) -> JSBasicValue { return {}; };
+    }
+    expr->accept(this);
+    return std::move(exprResult);
+}
+
+/// Compiling a statement visits it and takes the built closure, empty
+/// statements compile to a closure that completes normally.
+auto ClosureCompiler::compile(JSStmt* stmt) -> StmtClosure {
+    if (stmt == nullptr) {
+        return [](ClosureContext& /*ctx*/) { return Completion::Normal; };
+    }
+    stmt->accept(this);
+    return std::move(stmtResult);
+}
+
+/// Running a program compiles all of its statements first, then executes
+/// them in the top level frame.
+auto ClosureCompiler::run(std::span<JSStmt* const> stmts)
+    -> void {
+    std::vector<StmtClosure> program;
+    program.reserve(stmts.size());
+    for (const auto& stmt : stmts) {
+        program.emplace_back(compile(stmt));
+    }
+    ctx.stack.resize(functions.front().numSlots);
+    for (auto& stmt : program) {
+        stmt(ctx);
+    }
+}
+
+/// Evaluating an expression compiles it and runs it in the top level frame.
+auto ClosureCompiler::evaluate(JSExpr* expr) -> JSBasicValue {
+    auto closure = compile(expr);
+    ctx.stack.resize(functions.front().numSlots);
+    return closure(ctx);
+}
+
+/// Host calls push the arguments on top of the value stack like compiled
+/// calls do.
+auto ClosureCompiler::call(const JSBasicValue& callee,
+                           std::vector<JSBasicValue> args) -> JSBasicValue {
+    if (callee.getKind() != JSValueKind::Function) {
+        throw std::runtime_error(fmt::format(
+            "Uncaught type error {} is not a function", callee.toString()));
+    }
+    auto base = ctx.stack.size();
+    for (auto& arg : args) {
+        ctx.stack.emplace_back(std::move(arg));
+    }
+    return invokeClosure(ctx, static_cast<JSClosure*>(callee.getObject()),
+                         base);
+}
+
+/// Globals are looked up by name, only used outside of compiled code.
+auto ClosureCompiler::getGlobal(const std::string& name)
+    -> std::optional<JSBasicValue> {
+    auto iter = globalSlots.find(name);
+    if (iter == globalSlots.end() || !ctx.globals[iter->second].defined) {
+        return std::nullopt;
+    }
+    return ctx.globals[iter->second].value;
+}
+
+/// Declarations in the outermost block of the top level define globals,
+/// every other declaration gets a local slot in the frame of the function
+/// being compiled. Redeclarations in the same block reuse the same slot.
+auto ClosureCompiler::declare(const std::string& name) -> Slot {
+    auto& func = functions.back();
+    if (functions.size() == 1 && func.blocks.size() == 1) {
+        return Slot{true, globalSlot(name)};
+    }
+    auto& block = func.blocks.back();
+    if (auto iter = block.find(name); iter != block.end()) {
+        return Slot{false, iter->second};
+    }
+    auto slot = func.numSlots++;
+    block[name] = slot;
+    return Slot{false, slot};
+}
+
+/// Variables resolve to the innermost block declaring them in the function
+/// being compiled, otherwise they are globals. Closures don't capture their
+/// environment so referencing a local of an enclosing function is an error.
+auto ClosureCompiler::resolve(const std::string& name) -> Slot {
+    auto& func = functions.back();
+    for (auto block = func.blocks.rbegin(); block != func.blocks.rend();
+         block++) {
+        if (auto iter = block->find(name); iter != block->end()) {
+            return Slot{false, iter->second};
+        }
+    }
+    for (auto outer = functions.rbegin() + 1; outer != functions.rend();
+         outer++) {
+        for (const auto& block : outer->blocks) {
+            if (block.find(name) != block.end()) {
+                throw std::runtime_error(fmt::format(
+                    "Capturing variable {} is not supported.\n", name));
+            }
+        }
+    }
+    return Slot{true, globalSlot(name)};
+}
+
+/// Global slots are allocated the first time a name is declared or referenced.
+auto ClosureCompiler::globalSlot(const std::string& name) -> size_t {
+    if (auto iter = globalSlots.find(name); iter != globalSlots.end()) {
+        return iter->second;
+    }
+    auto slot = ctx.globals.size();
+    ctx.globals.emplace_back();
+    globalSlots[name] = slot;
+    return slot;
+}
+
+/// Literal expressions capture the literal value.
+auto ClosureCompiler::visitLiteralExpr(JSLiteralExpr* expr) -> void {
+    exprResult = [value = expr->getValue()](ClosureContext& /*ctx*/) {
+        return value;
+    };
+}
+
+/// Binary expressions are specialized on the operator when compiled.
+auto ClosureCompiler::visitBinaryExpr(JSBinExpr* expr) -> void {
+    auto lhs = compile(expr->getLeft());
+    auto rhs = compile(expr->getRight());
+
+    switch (expr->getOperator().getKind()) {
+    case JSTokenKind::Plus:
+        exprResult = plusOp(std::move(lhs), std::move(rhs));
+        break;
+    case JSTokenKind::Minus:
+        exprResult = numericOp<std::minus<>>(std::move(lhs), std::move(rhs));
+        break;
+    case JSTokenKind::Star:
+        exprResult =
+            numericOp<std::multiplies<>>(std::move(lhs), std::move(rhs));
+        break;
+    case JSTokenKind::Slash:
+        exprResult = numericOp<std::divides<>>(std::move(lhs), std::move(rhs));
+        break;
+    case JSTokenKind::Greater:
+        exprResult = numericOp<std::greater<>>(std::move(lhs), std::move(rhs));
+        break;
+    case JSTokenKind::GreaterEqual:
+        exprResult =
+            numericOp<std::greater_equal<>>(std::move(lhs), std::move(rhs));
+        break;
+    case JSTokenKind::Less:
+        exprResult = numericOp<std::less<>>(std::move(lhs), std::move(rhs));
+        break;
+    case JSTokenKind::LessEqual:
+        exprResult =
+            numericOp<std::less_equal<>>(std::move(lhs), std::move(rhs));
+        break;
+    case JSTokenKind::BangEqual:
+        exprResult =
+            numericOp<std::not_equal_to<>>(std::move(lhs), std::move(rhs));
+        break;
+    case JSTokenKind::EqualEqual:
+        exprResult =
+            numericOp<std::equal_to<>>(std::move(lhs), std::move(rhs));
+        break;
+    default:
+        throw std::invalid_argument("Unknown operator");
+    }
+}
+
+/// Unary expressions are specialized on the operator when compiled.
+auto ClosureCompiler::visitUnaryExpr(JSUnaryExpr* expr) -> void {
+    auto rhs = compile(expr->getRight());
+    switch (expr->getOperator().getKind()) {
+    case JSTokenKind::Minus:
+        exprResult = [rhs = std::move(rhs)](ClosureContext& ctx) {
+            return JSBasicValue(-rhs(ctx).getValue<JSNumber>());
+        };
+        break;
+    case JSTokenKind::Bang:
+        exprResult = [rhs = std::move(rhs)](ClosureContext& ctx) {
+            return JSBasicValue(!Interpreter::isTruthy(rhs(ctx)));
+        };
+        break;
+    default:
+        exprResult = [rhs = std::move(rhs)](ClosureContext& ctx) {
+            rhs(ctx);
+            return JSBasicValue(nullptr);
+        };
+        break;
+    }
+}
+
+/// Logical expressions short circuit on the left hand side.
+auto ClosureCompiler::visitLogicalExpr(JSLogicalExpr* expr) -> void {
+    auto lhs = compile(expr->getLeft());
+    auto rhs = compile(expr->getRight());
+    if (expr->getOperator().getKind() == JSTokenKind::Or) {
+        exprResult = [lhs = std::move(lhs),
+                      rhs = std::move(rhs)](ClosureContext& ctx) {
+            auto left = lhs(ctx);
+            return Interpreter::isTruthy(left) ? left : rhs(ctx);
+        };
+        return;
+    }
+    exprResult = [lhs = std::move(lhs),
+                  rhs = std::move(rhs)](ClosureContext& ctx) {
+        auto left = lhs(ctx);
+        return !Interpreter::isTruthy(left) ? left : rhs(ctx);
+    };
+}
+
+/// Grouping expressions compile to the closure of the grouped expression.
+auto ClosureCompiler::visitGroupingExpr(JSGroupingExpr* expr) -> void {
+    exprResult = compile(expr->getExpr());
+}
+
+/// Variable expressions read the slot resolved at compile time.
+auto ClosureCompiler::visitVarExpr(JSVarExpr* expr) -> void {
+    auto name = std::string(expr->getName().getLexeme());
+    auto slot = resolve(name);
+    if (!slot.global) {
+        exprResult = [index = slot.index](ClosureContext& ctx) {
+            return ctx.local(index);
+        };
+        return;
+    }
+    exprResult = [index = slot.index, name](ClosureContext& ctx) {
+        auto& global = ctx.globals[index];
+        if (!global.defined) {
+            throw std::runtime_error(
+                fmt::format("Variable {} is undefined.\n", name));
+        }
+        return global.value;
+    };
+}
+
+/// Assignment expressions write the slot resolved at compile time.
+auto ClosureCompiler::visitAssignExpr(JSAssignExpr* expr) -> void {
+    auto name  = std::string(expr->getName().getLexeme());
+    auto value = compile(expr->getValue());
+    auto slot  = resolve(name);
+    if (!slot.global) {
+        exprResult = [index = slot.index,
+                      value = std::move(value)](ClosureContext& ctx) {
+            auto result      = value(ctx);
+            ctx.local(index) = result;
+            return result;
+        };
+        return;
+    }
+    exprResult = [index = slot.index, name,
+                  value = std::move(value)](ClosureContext& ctx) {
+        auto result  = value(ctx);
+        auto& global = ctx.globals[index];
+        if (!global.defined) {
+            throw std::runtime_error(
+                fmt::format("Variable {} is undefined.\n", name));
+        }
+        global.value = result;
+        return result;
+    };
+}
+
+/// Call expressions evaluate the arguments directly into the callee's frame
+/// which is pushed on top of the value stack.
+auto ClosureCompiler::visitCallExpr(JSCallExpr* expr) -> void {
+    auto callee = compile(expr->getCallee());
+    std::vector<ExprClosure> args;
+    for (auto& arg : expr->getArgs()) {
+        args.emplace_back(compile(arg));
+    }
+    exprResult = [callee = std::move(callee),
+                  args   = std::move(args)](ClosureContext& ctx) {
+        auto value = callee(ctx);
+        if (value.getKind() != JSValueKind::Function) {
+            throw std::runtime_error(fmt::format(
+                "Uncaught type error {} is not a function", value.toString()));
+        }
+        checkNativeStack();
+        auto base = ctx.stack.size();
+        for (const auto& arg : args) {
+            ctx.stack.emplace_back(arg(ctx));
+        }
+        return invokeClosure(ctx, static_cast<JSClosure*>(value.getObject()),
+                             base);
+    };
+}
+
+/// Block statements open a compile time scope, their locals are allocated
+/// in the enclosing function's frame so entering a block is free at runtime.
+auto ClosureCompiler::visitBlockStmt(JSBlockStmt* block) -> void {
+    functions.back().blocks.emplace_back();
+    std::vector<StmtClosure> stmts;
+    for (auto& stmt : block->getStmts()) {
+        stmts.emplace_back(compile(stmt));
+    }
+    functions.back().blocks.pop_back();
+    stmtResult = [stmts = std::move(stmts)](ClosureContext& ctx) {
+        for (const auto& stmt : stmts) {
+            auto completion = stmt(ctx);
+            if (completion != Completion::Normal) {
+                return completion;
+            }
+        }
+        return Completion::Normal;
+    };
+}
+
+/// Expression statements evaluate the expression and discard its value.
+auto ClosureCompiler::visitExprStmt(JSExprStmt* stmt) -> void {
+    stmtResult = [expr = compile(stmt->getExpr())](ClosureContext& ctx) {
+        expr(ctx);
+        return Completion::Normal;
+    };
+}
+
+/// If statements dispatch to the branch selected by the condition.
+auto ClosureCompiler::visitIfStmt(JSIfStmt* stmt) -> void {
+    auto condition  = compile(stmt->getCondition());
+    auto thenBranch = compile(stmt->getThenBranch());
+    auto elseBranch = compile(stmt->getElseBranch());
+    stmtResult      = [condition  = std::move(condition),
+                  thenBranch = std::move(thenBranch),
+                  elseBranch = std::move(elseBranch)](ClosureContext& ctx) {
+        if (Interpreter::isTruthy(condition(ctx))) {
+            return thenBranch(ctx);
+        }
+        return elseBranch(ctx);
+    };
+}
+
+/// While statements loop as long as the condition holds, handling `break`
+/// and `continue` completions and propagating `return` completions.
+auto ClosureCompiler::visitWhileStmt(JSWhileStmt* stmt) -> void {
+    auto condition = compile(stmt->getCondition());
+    auto body      = compile(stmt->getBody());
+    stmtResult     = [condition = std::move(condition),
+                  body      = std::move(body)](ClosureContext& ctx) {
+        while (Interpreter::isTruthy(condition(ctx))) {
+            auto completion = body(ctx);
+            if (completion == Completion::Break) {
+                break;
+            }
+            if (completion == Completion::Return) {
+                return completion;
+            }
+        }
+        return Completion::Normal;
+    };
+}
+
+/// For statements run the initializer in the enclosing scope then loop
+/// like while statements, the step still runs after a `continue`.
+auto ClosureCompiler::visitForStmt(JSForStmt* stmt) -> void {
+    auto initializer = compile(stmt->getInitializer());
+    auto condition   = compile(stmt->getCondition());
+    auto step        = compile(stmt->getStep());
+    auto body        = compile(stmt->getBody());
+    stmtResult       = [initializer = std::move(initializer),
+                  condition   = std::move(condition), step = std::move(step),
+                  body = std::move(body)](ClosureContext& ctx) {
+        initializer(ctx);
+        while (Interpreter::isTruthy(condition(ctx))) {
+            auto completion = body(ctx);
+            if (completion == Completion::Break) {
+                break;
+            }
+            if (completion == Completion::Return) {
+                return completion;
+            }
+            step(ctx);
+        }
+        return Completion::Normal;
+    };
+}
+
+/// Variable declarations write the initial value to the declared slot.
+auto ClosureCompiler::visitVarDecl(JSVarDecl* stmt) -> void {
+    auto initializer = compile(stmt->getInitializer());
+    auto slot        = declare(std::string(stmt->getName()));
+    if (!slot.global) {
+        stmtResult = [index       = slot.index,
+                      initializer = std::move(initializer)](ClosureContext& ctx) {
+            auto value       = initializer(ctx);
+            ctx.local(index) = std::move(value);
+            return Completion::Normal;
+        };
+        return;
+    }
+    stmtResult = [index       = slot.index,
+                  initializer = std::move(initializer)](ClosureContext& ctx) {
+        auto value               = initializer(ctx);
+        ctx.globals[index].value = std::move(value);
+        ctx.globals[index].defined = true;
+        return Completion::Normal;
+    };
+}
+
+/// Function declarations compile the body once in a new function scope, the
+/// parameters occupy the first slots of the function's frame. Executing the
+/// declaration binds the function object to the declared name.
+auto ClosureCompiler::visitFuncDecl(JSFuncDecl* stmt) -> void {
+    auto name = std::string(stmt->getName().getLexeme());
+    // Declare the name first so the body can call the function recursively.
+    auto slot = declare(name);
+
+    functions.emplace_back();
+    auto params = stmt->getParams();
+    for (const auto& param : params) {
+        declare(std::string(param.getLexeme()));
+    }
+    // The body runs in the same scope as the parameters.
+    std::vector<StmtClosure> stmts;
+    for (auto& bodyStmt : stmt->getBody()->getStmts()) {
+        stmts.emplace_back(compile(bodyStmt));
+    }
+    auto numSlots = functions.back().numSlots;
+    functions.pop_back();
+
+    auto body = [stmts = std::move(stmts)](ClosureContext& ctx) {
+        for (const auto& bodyStmt : stmts) {
+            auto completion = bodyStmt(ctx);
+            if (completion != Completion::Normal) {
+                return completion;
+            }
+        }
+        return Completion::Normal;
+    };
+    auto func = std::make_shared<JSClosure>(name, params.size(), numSlots,
+                                            std::move(body));
+    if (!slot.global) {
+        stmtResult = [index = slot.index, func](ClosureContext& ctx) {
+            ctx.local(index) = JSBasicValue(func);
+            return Completion::Normal;
+        };
+        return;
+    }
+    stmtResult = [index = slot.index, func](ClosureContext& ctx) {
+        ctx.globals[index].value   = JSBasicValue(func);
+        ctx.globals[index].defined = true;
+        return Completion::Normal;
+    };
+}
+
+/// Return statements write the return register and signal a `return`.
+auto ClosureCompiler::visitReturnStmt(JSReturnStmt* stmt) -> void {
+    stmtResult = [value = compile(stmt->getValue())](ClosureContext& ctx) {
+        ctx.returnReg = value(ctx);
+        return Completion::Return;
+    };
+}
+
+/// Break statements signal a `break` completion.
+auto ClosureCompiler::visitBreakStmt(JSBreakStmt* /*stmt*/) -> void {
+    stmtResult = [](ClosureContext& /*ctx*/) { return Completion::Break; };
+}
+
+/// Continue statements signal a `continue` completion.
+auto ClosureCompiler::visitContinueStmt(JSContinueStmt* /*stmt*/) -> void {
+    stmtResult = [](ClosureContext& /*ctx*/) { return Completion::Continue; };
+}
+
+} // namespace minijsc
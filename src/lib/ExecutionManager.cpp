@@ -0,0 +1,168 @@
+//===----------------------------------------------------------------------===//
+// ExecutionManager.cpp: This file implements the execution manager, calls
+// are profiled when the interpreter dispatches them and hot functions are
+// compiled on their next call.
+//===----------------------------------------------------------------------===//
+#include "ExecutionManager.h"
+#include "AST.h"
+#include "BytecodeCompiler.h"
+#include "ClosureCompiler.h"
+#include "Interpreter.h"
+#include "JSCallable.h"
+#include "JSRuntime.h"
+#include "JSValue.h"
+#include "VM.h"
+
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace minijsc {
+
+auto ExecutionManager::run(std::span<JSStmt* const> stmts)
+    -> void {
+    interpreter.run(stmts);
+}
+
+/// Impure functions always run in the interpreter and aren't profiled, pure
+/// functions are promoted before running once they crossed a threshold.
+/// Compiled tiers take the arguments out of the environment since the call
+/// never enters the callee's frame.
+auto ExecutionManager::dispatch(JSFuncDecl* decl, size_t argBase)
+    -> std::optional<JSBasicValue> {
+    if (!decl->isPure()) {
+        stats.interpretedCalls++;
+        return std::nullopt;
+    }
+    auto& profile = profiles[decl];
+    profile.calls++;
+    if (!profile.pinned) {
+        promote(decl, profile);
+    }
+    if (profile.tier == Tier::Interpreter) {
+        stats.interpretedCalls++;
+        return std::nullopt;
+    }
+
+    auto& env = interpreter.getEnvironment();
+    std::vector<JSBasicValue> args;
+    args.reserve(env.getTop() - argBase);
+    for (auto idx = argBase; idx < env.getTop(); idx++) {
+        args.push_back(env.getSlot(idx));
+    }
+    env.truncate(argBase);
+
+    if (profile.tier == Tier::Bytecode) {
+        stats.bytecodeCalls++;
+        // Calls and loops run by the VM count towards the native thresholds.
+        auto calls     = profile.vm->getCalls();
+        auto backEdges = profile.vm->getBackEdges();
+        auto result    = profile.vm->invoke(profile.bytecode, args);
+        profile.calls += profile.vm->getCalls() - calls;
+        profile.backEdges += profile.vm->getBackEdges() - backEdges;
+        return result;
+    }
+    stats.nativeCalls++;
+    return profile.closures->call(profile.native, std::move(args));
+}
+
+auto ExecutionManager::onBackEdge(JSFuncDecl* decl) -> void {
+    if (decl->isPure()) {
+        profiles[decl].backEdges++;
+    }
+}
+
+auto ExecutionManager::getTier(JSFuncDecl* decl) const -> Tier {
+    auto iter = profiles.find(decl);
+    return iter == profiles.end() ? Tier::Interpreter : iter->second.tier;
+}
+
+/// Bindings reference their names and functions their declaration, the
+/// declarations of compiled functions are the keys of their profile. The
+/// compiled code copies what it needs from the syntax tree.
+auto ExecutionManager::references(std::string_view source) -> bool {
+    for (const auto& binding : interpreter.getEnvironment().getBindings()) {
+        if (isWithin(binding.name, source)) {
+            return true;
+        }
+        auto* object = binding.value.getObject();
+        if (object == nullptr || object->getKind() != JSValueKind::Function) {
+            continue;
+        }
+        auto* decl = static_cast<JSFunction*>(object)->getDecl();
+        if (isWithin(decl->getName().getLexeme(), source)) {
+            return true;
+        }
+    }
+    for (const auto& [decl, profile] : profiles) {
+        if (isWithin(decl->getName().getLexeme(), source)) {
+            return true;
+        }
+    }
+    return interpreter.getPurityAnalyzer().references(source);
+}
+
+/// Functions move up one tier at a time, a compilation error pins the
+/// function in the tier it runs in.
+auto ExecutionManager::promote(JSFuncDecl* decl, FunctionProfile& profile)
+    -> void {
+    try {
+        switch (profile.tier) {
+        case Tier::Interpreter:
+            if (profile.calls >= config.bytecodeCalls ||
+                profile.backEdges >= config.bytecodeBackEdges) {
+                compileBytecode(decl, profile);
+                profile.tier = Tier::Bytecode;
+                stats.bytecodePromotions++;
+            }
+            break;
+        case Tier::Bytecode:
+            if (profile.calls >= config.nativeCalls ||
+                profile.backEdges >= config.nativeBackEdges) {
+                compileNative(decl, profile);
+                profile.tier = Tier::Native;
+                stats.nativePromotions++;
+            }
+            break;
+        case Tier::Native:
+            break;
+        }
+    } catch (const std::exception& /*error*/) {
+        profile.pinned = true;
+        stats.failedPromotions++;
+    }
+}
+
+/// The function and its callees are compiled as top level declarations,
+/// running the compiled code defines them as globals of the VM.
+auto ExecutionManager::compileBytecode(JSFuncDecl* decl,
+                                       FunctionProfile& profile) -> void {
+    BytecodeCompiler compiler;
+    for (auto* dep : interpreter.getPurityAnalyzer().getDependencies(decl)) {
+        compiler.compile(dep);
+    }
+    auto vm = std::make_unique<VM>(compiler.getBytecode(),
+                                   compiler.getConstantsPool());
+    vm->run();
+    profile.bytecode =
+        vm->resolveGlobal(std::string(decl->getName().getLexeme()));
+    profile.vm = std::move(vm);
+}
+
+/// Native code is compiled the same way, the declarations define globals
+/// of the closure compiler's context.
+auto ExecutionManager::compileNative(JSFuncDecl* decl, FunctionProfile& profile)
+    -> void {
+    std::vector<JSStmt*> program;
+    for (auto* dep : interpreter.getPurityAnalyzer().getDependencies(decl)) {
+        program.push_back(dep);
+    }
+    auto closures = std::make_unique<ClosureCompiler>();
+    closures->run(program);
+    profile.native   = *closures->getGlobal(
+        std::string(decl->getName().getLexeme()));
+    profile.closures = std::move(closures);
+}
+
+} // namespace minijsc
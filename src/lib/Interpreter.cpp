@@ -4,11 +4,14 @@
 // method implements an evaluation pattern depending on the visited node kind.
 //===----------------------------------------------------------------------===//
 #include "AST.h"
+#include "ExecutionManager.h"
 #include "Interpreter.h"
 #include "JSCallable.h"
 #include "JSRuntime.h"
 #include "JSToken.h"
 #include "JSValue.h"
+#include "NativeStack.h"
+#include "PurityAnalyzer.h"
 #include "fmt/core.h"
 #include <cassert>
 #include <iterator>
@@ -19,7 +22,7 @@ namespace minijsc {
 
 /// Expression statement nodes are evaluated when visited.
 auto Interpreter::visitExprStmt(JSExprStmt* stmt) -> void {
-    evaluate(stmt->getExpr().get());
+    evaluate(stmt->getExpr());
 }
 
 /// Processing If statement nodes start by evaluating the conditional expression
@@ -27,12 +30,13 @@ auto Interpreter::visitExprStmt(JSExprStmt* stmt) -> void {
 /// the branch after the if statement or the branch after the else statement.
 /// If no else statement is provided we simply return.
 auto Interpreter::visitIfStmt(JSIfStmt* stmt) -> void {
-    auto expr = evaluate(stmt->getCondition().get());
+    auto expr = evaluate(stmt->getCondition());
     if (isTruthy(expr) && (stmt->getThenBranch() != nullptr)) {
-        return execute(stmt->getThenBranch().get());
+        completion = execute(stmt->getThenBranch());
+        return;
     }
     if (!isTruthy(expr) && (stmt->getElseBranch() != nullptr)) {
-        return execute(stmt->getElseBranch().get());
+        completion = execute(stmt->getElseBranch());
     }
 }
 
@@ -41,10 +45,21 @@ auto Interpreter::visitIfStmt(JSIfStmt* stmt) -> void {
 /// be optimized away. Once the conditional expression is evaluated we check
 /// its truth value. As long as the condition evaluates to `true` we execute
 /// the statements in the loop body.
+/// A `break` completion exits the loop, a `continue` completion moves on to
+/// the next iteration and a `return` completion is propagated to the caller.
 auto Interpreter::visitWhileStmt(JSWhileStmt* stmt) -> void {
-    while (isTruthy(evaluate(stmt->getCondition().get()))) {
-        execute(stmt->getBody().get());
+    while (isTruthy(evaluate(stmt->getCondition()))) {
+        auto result = execute(stmt->getBody());
+        if (result == Completion::Break) {
+            break;
+        }
+        if (result == Completion::Return) {
+            completion = result;
+            return;
+        }
+        profileBackEdge();
     }
+    completion = Completion::Normal;
 }
 
 /// For statements are evaluated similarly to while loops, we first execute
@@ -55,13 +70,30 @@ auto Interpreter::visitWhileStmt(JSWhileStmt* stmt) -> void {
 auto Interpreter::visitForStmt(JSForStmt* stmt) -> void {
     // Execute the initializer statement, which will either create the variable
     // or the assignment.
-    execute(stmt->getInitializer().get());
+    execute(stmt->getInitializer());
     // Evaluate the condition.
-    while (isTruthy(evaluate(stmt->getCondition().get()))) {
+    while (isTruthy(evaluate(stmt->getCondition()))) {
         // Execute the statement block.
-        execute(stmt->getBody().get());
-        // Execute the step.
-        evaluate(stmt->getStep().get());
+        auto result = execute(stmt->getBody());
+        if (result == Completion::Break) {
+            break;
+        }
+        if (result == Completion::Return) {
+            completion = result;
+            return;
+        }
+        // Execute the step, `continue` still runs the step.
+        evaluate(stmt->getStep());
+        profileBackEdge();
+    }
+    completion = Completion::Normal;
+}
+
+/// Loop iterations inside a function count towards the function's promotion
+/// to a faster tier.
+auto Interpreter::profileBackEdge() -> void {
+    if (manager != nullptr && activeFunction != nullptr) {
+        manager->onBackEdge(activeFunction);
     }
 }
 
@@ -69,56 +101,75 @@ auto Interpreter::visitForStmt(JSForStmt* stmt) -> void {
 /// braces. On each entry to a block statement we create a new environment
 /// for the inner scope that references the top level environment scope.
 /// After exiting the block statement the inner scope environment is cleaned
-/// up and the pointer to the current environment is restored.
+/// up and the pointer to the current environment is restored, on runtime
+/// errors too.
 auto Interpreter::visitBlockStmt(JSBlockStmt* block) -> void {
-    fmt::print("visitBlockStmt\n");
-    fmt::print("All pointers are good\n");
-    auto env = Environment();
-    executeBlock(block, std::move(env));
-    fmt::print("Done processing block\n");
+    pushScope();
+    ScopeExit exitScope([this] { popScope(); });
+    completion = executeBlock(block);
 }
 
 /// Variable declarations can either have an initial value or are assigned
-/// the `null` value. Once the assignment expression is evaluated a new
+/// the `undefined` value. Once the assignment expression is evaluated a new
 /// binding is defined in the current environment.
 auto Interpreter::visitVarDecl(JSVarDecl* stmt) -> void {
-    std::shared_ptr<JSBasicValue> value;
+    JSBasicValue value;
     if (stmt->getInitializer()) {
-        value = static_pointer_cast<JSBasicValue>(
-            evaluate(stmt->getInitializer().get()));
-        fmt::print("Has initializer : {}\n", value->toString());
+        value = evaluate(stmt->getInitializer());
     }
-    fmt::print("Defining binding : {} -> {}\n", stmt->getName(),
-               value->toString());
-    define(stmt->getName(), value);
+    define(stmt->getName(), std::move(value));
 }
 
-/// Function declarations create a binding to a function.
+/// Function declarations create a binding to a function, functions are
+/// heap objects and are the only values bound by reference.
 auto Interpreter::visitFuncDecl(JSFuncDecl* stmt) -> void {
-    auto decl = std::make_shared<JSFuncDecl>(*stmt);
-    auto func = std::make_shared<JSFunction>(decl);
-    define(stmt->getName().getLexeme(), func);
+    auto func = std::make_shared<JSFunction>(stmt);
+    define(stmt->getName().getLexeme(), JSBasicValue(std::move(func)));
 }
 
 /// Variable expressions return the value of the variable we do that by
 /// resolving the binding in starting from the current environment, walking
 /// bottom up to the top level environment.
 auto Interpreter::visitVarExpr(JSVarExpr* expr) -> void {
-    fmt::print("Resolving variable expression: {}\n",
-               expr->getName().getLexeme());
-    // TODO: handle nullopt
-    auto resolvedValue = resolve(expr->getName().getLexeme());
-    pushValue(resolvedValue);
+    setResult(resolve(expr->getName().getLexeme()));
 }
 
-/// Return statements evaluate the return value and unwind the stack back
-/// to the call expression.
+/// Return statements evaluate the return value into the return register
+/// and signal a `return` completion, enclosing blocks and loops stop
+/// executing and propagate the completion back to the call expression.
+/// Calls in tail position are not executed, the callee and arguments are
+/// deferred to the returning function which runs the call once its body
+/// returned, keeping the native stack depth constant. Pure callees run in
+/// place of the caller's frame. Other callees may read the caller's
+/// variables through the scope chain, the scopes exited by the return are
+/// kept live until the chain of tail calls returns.
 auto Interpreter::visitReturnStmt(JSReturnStmt* stmt) -> void {
-    std::shared_ptr<JSValue> value = nullptr;
-    if (stmt->getValue() != nullptr) {
-        value = evaluate(stmt->getValue().get());
+    if (callDepth > 0 && stmt->isTailCall()) {
+        auto* call   = static_cast<JSCallExpr*>(stmt->getValue());
+        auto  callee = evaluateCallee(call);
+        std::vector<JSBasicValue> args;
+        for (const auto& arg : call->getArgs()) {
+            args.emplace_back(evaluate(arg));
+        }
+        auto* func   = static_cast<JSFunction*>(callee.getObject());
+        keepScopes   = !func->getDecl()->isPure();
+        tailCallee   = callee.getValue<JSObjectRef>();
+        tailCallArgs = std::move(args);
+        completion   = Completion::Return;
+        return;
     }
-    throw JSReturn(value);
+    returnReg  = evaluate(stmt->getValue());
+    completion = Completion::Return;
+}
+
+/// Break statements signal a `break` completion to the enclosing loop.
+auto Interpreter::visitBreakStmt(JSBreakStmt* /*stmt*/) -> void {
+    completion = Completion::Break;
+}
+
+/// Continue statements signal a `continue` completion to the enclosing loop.
+auto Interpreter::visitContinueStmt(JSContinueStmt* /*stmt*/) -> void {
+    completion = Completion::Continue;
 }
 
 /// Assignment expressions will assign an expression's value to the variable
@@ -126,144 +177,121 @@ auto Interpreter::visitReturnStmt(JSReturnStmt* stmt) -> void {
 /// bottom up through the environment scopes. If the variable isn't found
 /// a runtime error is thrown.
 auto Interpreter::visitAssignExpr(JSAssignExpr* expr) -> void {
-    auto value = std::static_pointer_cast<JSBasicValue>(
-        evaluate(expr->getValue().get()));
-    fmt::print("Visit assign expr: {}\n", value->toString());
+    auto value = evaluate(expr->getValue());
     assign(expr->getName().getLexeme(), value);
-    pushValue(value);
+    setResult(std::move(value));
 }
 
-/// Call expressions
+/// Call expressions evaluate the callee and the arguments then dispatch
+/// the call to the function object.
 auto Interpreter::visitCallExpr(JSCallExpr* expr) -> void {
-    // Evaluate should return std::shared_ptr<JSValue>
-    auto callee = evaluate(expr->getCallee().get());
-    // Casting shouldn't be required here.
-    assert(callee != nullptr);
-    std::vector<JSBasicValue> args;
-    for (auto& arg : expr->getArgs()) {
-        auto value =
-            std::static_pointer_cast<JSBasicValue>(evaluate(arg.get()));
-        args.emplace_back(*value);
+    auto callee = evaluateCallee(expr);
+    setResult(callFunction(callee, expr));
+    // The completion of the callee's body doesn't leak into the caller.
+    completion = Completion::Normal;
+}
+
+/// Evaluate the callee of a call expression, checking it is a function.
+auto Interpreter::evaluateCallee(JSCallExpr* expr) -> JSBasicValue {
+    auto callee = evaluate(expr->getCallee());
+    if (callee.getKind() != JSValueKind::Function) {
+        throw std::runtime_error(fmt::format(
+            "Uncaught type error {} is not a function", callee.toString()));
     }
-    auto func = std::static_pointer_cast<JSFunction>(callee);
-    assert(func != nullptr);
-    auto result = func->call(this, args);
-    auto ret    = std::make_shared<JSBasicValue>(result);
-    fmt::print("Pushing return value {} from function {}\n", ret->toString(),
-               func->getName());
-    pushValue(ret);
+    return callee;
+}
+
+/// Evaluate the arguments of a call expression into the environment and call
+/// the function. A runtime error unwinding the call drops the arguments the
+/// callee didn't consume.
+auto Interpreter::callFunction(const JSBasicValue& callee, JSCallExpr* expr)
+    -> JSBasicValue {
+    checkNativeStack();
+    // Arguments are evaluated directly into the slots of the callee's frame.
+    auto argBase = env.getTop();
+    ScopeExit exitCall([this, argBase] { env.truncate(argBase); });
+    for (const auto& arg : expr->getArgs()) {
+        env.pushArg(evaluate(arg));
+    }
+    auto* func = static_cast<JSFunction*>(callee.getObject());
+    callDepth++;
+    ScopeExit exitDepth([this] { callDepth--; });
+    return func->call(this, argBase);
 }
 
 /// Literal expressions will simply return the literal value.
 auto Interpreter::visitLiteralExpr(JSLiteralExpr* expr) -> void {
-    fmt::print("Value : {}\n",
-               ((JSBasicValue*)expr->getValue().get())->toString());
-    auto value = expr->getValue();
-    pushValue(value);
+    setResult(expr->getValue());
 }
 
 /// Binary expressions are processed by evaluating the left and right hand
 /// sides of the expression. The rules used for evaluation follow JavaScript's
 /// rules, we upcast depending on the values of either sides of the expression.
 auto Interpreter::visitBinaryExpr(JSBinExpr* expr) -> void {
-    auto lhs =
-        std::static_pointer_cast<JSBasicValue>(evaluate(expr->getLeft().get()));
-    auto rhs = std::static_pointer_cast<JSBasicValue>(
-        evaluate(expr->getRight().get()));
-
-    auto binOp = expr->getOperator();
+    auto lhs = evaluate(expr->getLeft());
+    auto rhs = evaluate(expr->getRight());
 
-    switch (binOp.getKind()) {
+    switch (expr->getOperator().getKind()) {
     case JSTokenKind::Plus: {
         // Overloading for the plus operator:
-        // 1. If both sides are strings concatenate them.
-        if (lhs->isString() && rhs->isString()) {
-            auto res = std::make_shared<JSBasicValue>(
-                lhs->getValue<JSString>() + rhs->getValue<JSString>());
-            pushValue(res);
+        // 1. If both sides are numbers sum them.
+        if (lhs.isNumber() && rhs.isNumber()) {
+            setResult(lhs.getValue<JSNumber>() + rhs.getValue<JSNumber>());
             break;
         }
-        // 2. If both sides are numbers sum them.
-        if (lhs->isNumber() && rhs->isNumber()) {
-            auto res = std::make_shared<JSBasicValue>(
-                lhs->getValue<JSNumber>() + rhs->getValue<JSNumber>());
-            pushValue(res);
+        // 2. If both sides are strings concatenate them.
+        if (lhs.isString() && rhs.isString()) {
+            setResult(lhs.getValue<JSString>() + rhs.getValue<JSString>());
             break;
         }
         // If one side is a string, cast the other side to a string.
-        if (lhs->isString()) {
-            auto res = std::make_shared<JSBasicValue>(
-                lhs->getValue<JSString>() + rhs->toString());
-            pushValue(res);
+        if (lhs.isString()) {
+            setResult(lhs.getValue<JSString>() + rhs.toString());
             break;
         }
-        if (rhs->isString()) {
-            auto res = std::make_shared<JSBasicValue>(
-                lhs->toString() + rhs->getValue<JSString>());
-            pushValue(res);
+        if (rhs.isString()) {
+            setResult(lhs.toString() + rhs.getValue<JSString>());
             break;
         }
         // Throw a type error if none of the above.
         throw std::runtime_error(
             "Uncaught type error '+' unsupported for types : " +
-            lhs->toString() + " and " + rhs->toString());
+            lhs.toString() + " and " + rhs.toString());
     }
-    case JSTokenKind::Minus: {
-        auto res = std::make_shared<JSBasicValue>(lhs->getValue<JSNumber>() -
-                                                  rhs->getValue<JSNumber>());
-        pushValue(res);
+    case JSTokenKind::Minus:
+        setResult(lhs.getValue<JSNumber>() - rhs.getValue<JSNumber>());
         break;
-    }
-    case JSTokenKind::Star: {
-        auto res = std::make_shared<JSBasicValue>(lhs->getValue<JSNumber>() *
-                                                  rhs->getValue<JSNumber>());
-        pushValue(res);
+    case JSTokenKind::Star:
+        setResult(lhs.getValue<JSNumber>() * rhs.getValue<JSNumber>());
         break;
-    }
-    case JSTokenKind::Slash: {
-        auto res = std::make_shared<JSBasicValue>(lhs->getValue<JSNumber>() /
-                                                  rhs->getValue<JSNumber>());
-        pushValue(res);
+    case JSTokenKind::Slash:
+        setResult(lhs.getValue<JSNumber>() / rhs.getValue<JSNumber>());
         break;
-    }
     // Comparison operations.
-    case JSTokenKind::Greater: {
-        auto res = std::make_shared<JSBasicValue>(
-            JSBoolean(lhs->getValue<JSNumber>() > rhs->getValue<JSNumber>()));
-        pushValue(res);
+    case JSTokenKind::Greater:
+        setResult(
+            JSBoolean(lhs.getValue<JSNumber>() > rhs.getValue<JSNumber>()));
         break;
-    }
-    case JSTokenKind::GreaterEqual: {
-        auto res = std::make_shared<JSBasicValue>(
-            JSBoolean(lhs->getValue<JSNumber>() >= rhs->getValue<JSNumber>()));
-        pushValue(res);
+    case JSTokenKind::GreaterEqual:
+        setResult(
+            JSBoolean(lhs.getValue<JSNumber>() >= rhs.getValue<JSNumber>()));
         break;
-    }
-    case JSTokenKind::Less: {
-        auto res = std::make_shared<JSBasicValue>(
-            JSBoolean(lhs->getValue<JSNumber>() < rhs->getValue<JSNumber>()));
-        pushValue(res);
+    case JSTokenKind::Less:
+        setResult(
+            JSBoolean(lhs.getValue<JSNumber>() < rhs.getValue<JSNumber>()));
         break;
-    }
-    case JSTokenKind::LessEqual: {
-        auto res = std::make_shared<JSBasicValue>(
-            JSBoolean(lhs->getValue<JSNumber>() <= rhs->getValue<JSNumber>()));
-        pushValue(res);
+    case JSTokenKind::LessEqual:
+        setResult(
+            JSBoolean(lhs.getValue<JSNumber>() <= rhs.getValue<JSNumber>()));
         break;
-    }
-    case JSTokenKind::BangEqual: {
-        auto res = std::make_shared<JSBasicValue>(
-            JSBoolean(lhs->getValue<JSNumber>() != rhs->getValue<JSNumber>()));
-        pushValue(res);
-
+    case JSTokenKind::BangEqual:
+        setResult(
+            JSBoolean(lhs.getValue<JSNumber>() != rhs.getValue<JSNumber>()));
         break;
-    }
-    case JSTokenKind::EqualEqual: {
-        auto res = std::make_shared<JSBasicValue>(
-            JSBoolean(lhs->getValue<JSNumber>() == rhs->getValue<JSNumber>()));
-        pushValue(res);
+    case JSTokenKind::EqualEqual:
+        setResult(
+            JSBoolean(lhs.getValue<JSNumber>() == rhs.getValue<JSNumber>()));
         break;
-    }
     default:
         throw std::invalid_argument("Unknown operator");
     }
@@ -273,68 +301,55 @@ auto Interpreter::visitBinaryExpr(JSBinExpr* expr) -> void {
 /// of the expression and executing the operator on the left hand side.
 auto Interpreter::visitUnaryExpr(JSUnaryExpr* expr) -> void {
     // Type check before cast since -[1,2,3] might be passed.
-    auto rhs = std::static_pointer_cast<JSBasicValue>(
-        evaluate(expr->getRight().get()));
-    auto unaryOp = expr->getOperator();
-    switch (unaryOp.getKind()) {
-    case JSTokenKind::Minus: {
-        auto res = std::make_shared<JSBasicValue>(-rhs->getValue<JSNumber>());
-        pushValue(res);
+    auto rhs = evaluate(expr->getRight());
+    switch (expr->getOperator().getKind()) {
+    case JSTokenKind::Minus:
+        setResult(-rhs.getValue<JSNumber>());
         break;
-    }
-    case JSTokenKind::Bang: {
-        fmt::print("Unary/!/");
-        auto res = std::make_shared<JSBasicValue>(!isTruthy(rhs));
-        pushValue(res);
+    case JSTokenKind::Bang:
+        setResult(!isTruthy(rhs));
         break;
-    }
-    default: {
-        fmt::print("visitUnaryExpr::nullPtr");
-        auto res = std::make_shared<JSBasicValue>(nullptr);
-        pushValue(res);
+    default:
+        setResult(nullptr);
         break;
     }
-    }
 }
 
 /// Logical expressions are processed by evaluating the left hand side
 /// short circuiting execution for Or condtionals.
 auto Interpreter::visitLogicalExpr(JSLogicalExpr* expr) -> void {
-    auto left = evaluate(expr->getLeft().get());
+    auto left = evaluate(expr->getLeft());
 
     if (expr->getOperator().getKind() == JSTokenKind::Or) {
-        fmt::print("visitLogical::kind => {}\n",
-                   expr->getOperator().toString());
         if (isTruthy(left)) {
-            fmt::print("Left is true\n");
-            pushValue(left);
+            setResult(std::move(left));
             return;
         }
     } else {
         if (!isTruthy(left)) {
-            pushValue(left);
+            setResult(std::move(left));
             return;
         }
     }
 
-    auto value = evaluate(expr->getRight().get());
-    pushValue(value);
+    setResult(evaluate(expr->getRight()));
 }
 
 /// Grouping expressions are processed recursively by evaluating the expression
 /// in the grouping.
 auto Interpreter::visitGroupingExpr(JSGroupingExpr* expr) -> void {
-    auto value = evaluate(expr->getExpr().get());
-    pushValue(value);
+    setResult(evaluate(expr->getExpr()));
 }
 
 /// Interpreter core loop, takes a program which is a sequence of statements
-/// executing them one by one.
-auto Interpreter::run(const std::vector<std::shared_ptr<JSStmt>>& stmts)
+/// executing them one by one. The program is analyzed first to mark its pure
+/// functions so the ones opting into memoization are memoized.
+auto Interpreter::run(std::span<JSStmt* const> stmts)
     -> void {
+    purity.analyze(stmts);
     try {
         for (const auto& stmt : stmts) {
-            execute(stmt.get());
+            execute(stmt);
         }
     } catch (const std::runtime_error& e) {
         fmt::print("Runtime error : {}", e.what());
@@ -344,53 +359,40 @@ auto Interpreter::run(const std::vector<std::shared_ptr<JSStmt>>& stmts)
 }
 
 /// Evaluating expressions calls the accept method on the passed expressions.
-auto Interpreter::evaluate(JSExpr* expr) -> std::shared_ptr<JSValue> {
+auto Interpreter::evaluate(JSExpr* expr) -> JSBasicValue {
     if (expr != nullptr) {
-        fmt::print("Expr of kind {} is not null\n",
-                   astNodeKindToString(expr->getKind()));
-        /// When we call accept all expressions we visit will push
-        /// a value to the internal value stack, when returning from
-        /// the visitor we pop the value back from the stack.
+        /// When we call accept all expressions we visit will store
+        /// their value in the value register, when returning from
+        /// the visitor we move the value out of the register.
         expr->accept(this);
-        return popValue();
+        return std::move(valueReg);
     }
     return {};
 }
 
-/// Executing statements calls the accept method on the passed statement type.
-auto Interpreter::execute(JSStmt* stmt) -> void {
+/// Executing statements calls the accept method on the passed statement type
+/// and returns the completion signaled by the statement.
+auto Interpreter::execute(JSStmt* stmt) -> Completion {
+    completion = Completion::Normal;
     if (stmt != nullptr) {
         stmt->accept(this);
     }
+    return completion;
 }
 
-/// Executing block statements creates a scopped environment that points at
-/// the top level environment cleaning up the stack after execution is finished
-/// and restoring the pointer to the current environment.
-auto Interpreter::executeBlock(JSBlockStmt* block, Environment env) -> void {
-    // Get the current scope.
-    auto currentScopeIdx = this->currIdx;
-    // Create a new scope, with the current scope as its parent.
-    // auto newScopedEnv = Environment(Parent = currentScopeIdx);
-    // Set the parent pointer on the `env` scope to the current scope index.
-    env.setParentPtr(currentScopeIdx);
-    // Append the new environment to the nested envs and increment the currIdx.
-    this->symTables.emplace_back(std::move(env));
-    // Substract one since we started from a current scope ptr of 0 because
-    // vectors are 0-indexed.
-    currIdx += 1;
-    fmt::print("Scope index: {}\n", currIdx);
+/// Executing block statements runs the statements in the current scope, the
+/// caller is responsible for entering and exiting the block's scope. This lets
+/// function calls bind their parameters in the same scope as the body.
+auto Interpreter::executeBlock(JSBlockStmt* block) -> Completion {
     for (auto& stmt : block->getStmts()) {
-        // If execute fails we unwind the new environment and restore
-        // back the previous index
-        execute(stmt.get());
+        // Abrupt completions stop the execution of the block and are
+        // propagated to the caller.
+        auto result = execute(stmt);
+        if (result != Completion::Normal) {
+            return result;
+        }
     }
-    // saveguard parent scope ptr before destroying the current scope
-    auto parent = this->symTables[currIdx].getParentPtr();
-    // pop the env from the stack
-    this->symTables.pop_back();
-    // restore old stack pointer
-    this->currIdx = parent;
+    return Completion::Normal;
 }
 
 } // namespace minijsc
@@ -11,6 +11,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -18,40 +19,46 @@ namespace minijsc {
 
 // Advance to the next character.
 auto JSLexer::advance() -> char {
-    auto curr = current;
-    current++;
-    return source.at(curr);
+    return source[current++];
 }
 
-// Append a token without a lexeme to the vector of tokens.
-auto JSLexer::addToken(JSTokenKind kind) -> void {
-    tokens.emplace_back(kind, "", "");
+// Skip a run of characters, the kernel scans the source past the cursor.
+auto JSLexer::skip(ScanKernel kernel) -> void {
+    const auto* first = source.data() + current;
+    current += kernel(first, source.data() + source.length()) - first;
 }
 
-// Append the token with its literal value (String).
-auto JSLexer::addToken(JSTokenKind kind, const std::string& literal) {
-    auto len  = current - start;
-    auto text = source.substr(start, len);
-    tokens.emplace_back(kind, text, literal);
-}
-
-// Append the token with its literal value (Numeric).
-auto JSLexer::addToken(JSTokenKind kind, double literal) {
-    auto len  = current - start;
-    auto text = source.substr(start, len);
-    tokens.emplace_back(kind, text, literal);
+// Append a token spanning the current lexeme to the vector of tokens.
+auto JSLexer::addToken(JSTokenKind kind) -> void {
+    tokens.emplace_back(kind, source.substr(start, current - start));
 }
 
 // Core lexer scanning function.
 auto JSLexer::scanTokens() -> std::vector<JSToken> {
+    // Reserve for the typical token density so large sources don't spend
+    // their time growing the vector.
+    tokens.reserve(tokens.size() + source.length() / kSourceBytesPerToken + 1);
     while (!isAtEnd()) {
         start = current;
         scanToken();
     }
-    tokens.emplace_back(JSTokenKind::Eof, "", "");
+    tokens.emplace_back(JSTokenKind::Eof, source.substr(current, 0));
     return tokens;
 }
 
+// Scan characters until a token is produced, whitespace produces none.
+auto JSLexer::next() -> JSToken {
+    tokens.clear();
+    while (tokens.empty() && !isAtEnd()) {
+        start = current;
+        scanToken();
+    }
+    if (tokens.empty()) {
+        return {JSTokenKind::Eof, source.substr(current, 0)};
+    }
+    return tokens.back();
+}
+
 // Scan the current character and process its token.
 auto JSLexer::scanToken() -> void {
     // Advance the cursor position.
@@ -146,6 +153,7 @@ auto JSLexer::scanToken() -> void {
     case ' ':
     case '\r':
     case '\t':
+        skip(kernels->skipBlanks);
         break;
     case '\n':
         line++;
@@ -169,53 +177,36 @@ auto JSLexer::scanToken() -> void {
 
 // Scan an identifier.
 auto JSLexer::scanIdentifier() -> void {
-    while (isAlphaNumeric(peek())) {
-        advance();
-    }
-    // Get current lexeme length.
-    auto len = current - start;
-    // Extract the lexeme.
-    auto text = source.substr(start, len);
-    // Check if the lexeme is a keyword, if so process it as a keyword.
-    if (auto iter = jsKeywords.find(text); iter != jsKeywords.end()) {
-        addToken(iter->second, text);
-        return;
-    }
-    // Lexeme isn't a keyword, must be an identifier.
-    addToken(JSTokenKind::Identifier, text);
+    skip(kernels->skipIdentifier);
+    // Keywords are recognized in place, lexemes that aren't keywords are
+    // identifiers.
+    addToken(lookupKeyword(source.substr(start, current - start)));
 }
 
 // Scan a numeric.
 auto JSLexer::scanNumeric() -> void {
-    // While processing digits, consume the character lexemes one by one.
-    while (isDigit(peek())) {
-        advance();
-    }
+    // Consume the integral section digits.
+    skip(kernels->skipDigits);
     // If we find a dot lexeme we consume it then move to consume
     // the decimal section.
     if (peek() == '.' && isDigit(peekNext())) {
         advance();
     }
     // Consume decimal section digits.
-    while (isDigit(peek())) {
-        advance();
-    }
-    // Get the numeric lexeme length.
-    auto len = current - start;
-    // Extract the numeric lexeme from source and cast it as a double value.
-    auto value = std::atof(source.substr(start, len).c_str());
-    // Append the numeric token to the tokens vector.
-    addToken(JSTokenKind::Numeric, value);
+    skip(kernels->skipDigits);
+    // Append the numeric token to the tokens vector, the value is parsed
+    // from the lexeme when the parser builds the literal.
+    addToken(JSTokenKind::Numeric);
 }
 
 // Scan a literal string.
 auto JSLexer::scanString() -> void {
-    while (peek() != '"' && !isAtEnd()) {
-        // Some strings may span multiple lines.
-        if (peek() == '\n') {
-            line++;
-        }
+    skip(kernels->skipString);
+    // Some strings may span multiple lines.
+    while (peek() == '\n') {
+        line++;
         advance();
+        skip(kernels->skipString);
     }
     if (isAtEnd()) {
         std::cout << "Unterminated string\n";
@@ -223,14 +214,9 @@ auto JSLexer::scanString() -> void {
     }
     advance();
 
-    // Build literal.
-    // For a string literal such as "hello"
-    // after consume the characters in the lexeme
-    // current would point to the closing quote
-    // start would point to the starting quote
-    auto len   = (current - 1) - (start + 1);
-    auto value = source.substr(start + 1, len);
-    addToken(JSTokenKind::String, value);
+    // The lexeme spans the quotes, they are stripped when the parser builds
+    // the literal.
+    addToken(JSTokenKind::String);
 }
 
 // Match if the current character is the one we expect.
@@ -238,7 +224,7 @@ auto JSLexer::match(char expected) -> bool {
     if (isAtEnd()) {
         return false;
     }
-    if (source.at(current) != expected) {
+    if (source[current] != expected) {
         return false;
     }
     current++;
@@ -251,7 +237,7 @@ auto JSLexer::peek() -> char {
     if (isAtEnd()) {
         return '\0';
     }
-    return source.at(current);
+    return source[current];
 }
 
 // Peek the next character.
@@ -259,7 +245,7 @@ auto JSLexer::peekNext() -> char {
     if (current + 1 >= source.length()) {
         return '\0';
     }
-    return source.at(current + 1);
+    return source[current + 1];
 }
 
 // Check if we reached EOF.
@@ -268,6 +254,112 @@ auto JSLexer::isAtEnd() -> bool { return current >= source.length(); }
 // Process source code and build a list of processed tokens.
 auto JSLexer::lex() -> void { scanTokens(); }
 
+// Keywords are dispatched on their length then on their first character,
+// leaving at most two candidates that are compared against the lexeme.
+auto lookupKeyword(std::string_view text) -> JSTokenKind {
+    auto keyword = [text](std::string_view spelling, JSTokenKind kind) {
+        return text == spelling ? kind : JSTokenKind::Identifier;
+    };
+    switch (text.length()) {
+    case 2:
+        switch (text[0]) {
+        case 'd':
+            return keyword("do", JSTokenKind::Do);
+        case 'i':
+            return text[1] == 'f'   ? JSTokenKind::If
+                   : text[1] == 'n' ? JSTokenKind::In
+                                    : JSTokenKind::Identifier;
+        case 'o':
+            return keyword("of", JSTokenKind::Of);
+        }
+        break;
+    case 3:
+        switch (text[0]) {
+        case 'f':
+            return keyword("for", JSTokenKind::For);
+        case 'l':
+            return keyword("let", JSTokenKind::Let);
+        case 'n':
+            return keyword("new", JSTokenKind::New);
+        case 't':
+            return keyword("try", JSTokenKind::Try);
+        case 'v':
+            return keyword("var", JSTokenKind::Var);
+        }
+        break;
+    case 4:
+        switch (text[0]) {
+        case 'c':
+            return keyword("case", JSTokenKind::Case);
+        case 'e':
+            return keyword("else", JSTokenKind::Else);
+        case 'n':
+            return keyword("null", JSTokenKind::Null);
+        case 't':
+            return text[1] == 'h' ? keyword("this", JSTokenKind::This)
+                                  : keyword("true", JSTokenKind::True);
+        case 'v':
+            return keyword("void", JSTokenKind::Void);
+        }
+        break;
+    case 5:
+        switch (text[0]) {
+        case 'b':
+            return keyword("break", JSTokenKind::Break);
+        case 'c':
+            return text[1] == 'a'   ? keyword("catch", JSTokenKind::Catch)
+                   : text[1] == 'l' ? keyword("class", JSTokenKind::Class)
+                                    : keyword("const", JSTokenKind::Const);
+        case 'f':
+            return keyword("false", JSTokenKind::False);
+        case 's':
+            return keyword("super", JSTokenKind::Super);
+        case 't':
+            return keyword("throw", JSTokenKind::Throw);
+        case 'w':
+            return keyword("while", JSTokenKind::While);
+        }
+        break;
+    case 6:
+        switch (text[0]) {
+        case 'd':
+            return keyword("delete", JSTokenKind::Delete);
+        case 'e':
+            return keyword("export", JSTokenKind::Export);
+        case 'i':
+            return keyword("import", JSTokenKind::Import);
+        case 'r':
+            return keyword("return", JSTokenKind::Return);
+        case 's':
+            return keyword("switch", JSTokenKind::Switch);
+        case 't':
+            return keyword("typeof", JSTokenKind::TypeOf);
+        }
+        break;
+    case 7:
+        switch (text[0]) {
+        case 'd':
+            return keyword("default", JSTokenKind::Default);
+        case 'e':
+            return keyword("extends", JSTokenKind::Extends);
+        }
+        break;
+    case 8:
+        switch (text[0]) {
+        case 'c':
+            return keyword("continue", JSTokenKind::Continue);
+        case 'f':
+            return keyword("function", JSTokenKind::Function);
+        }
+        break;
+    case 9:
+        return keyword("undefined", JSTokenKind::Undefined);
+    case 10:
+        return keyword("instanceof", JSTokenKind::InstanceOf);
+    }
+    return JSTokenKind::Identifier;
+}
+
 // Check if character is alphabet or underscore.
 auto isAlpha(char chr) -> bool {
     return (chr >= 'a' && chr <= 'z') || (chr >= 'A' && chr <= 'Z') ||
@@ -10,6 +10,7 @@
 #include <iterator>
 #include <memory>
 #include <stdexcept>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -18,15 +19,25 @@ namespace minijsc {
 /// Maximum number of arguments supported for functions.
 static constexpr int kMaxArgs = 255;
 
-auto JSParser::parse() -> std::vector<std::shared_ptr<JSStmt>> {
-    std::vector<std::shared_ptr<JSStmt>> statements;
+// The program takes the arena, the parser starts a new one.
+auto JSParser::parse() -> JSProgram {
+    std::vector<JSStmt*> statements;
+    std::vector<std::string_view> sources;
     while (!isAtEnd()) {
+        const auto* start = peek().getLexeme().data();
         statements.emplace_back(parseDecl());
-    }
-    return statements;
+        auto last = previous().getLexeme();
+        sources.emplace_back(
+            start, static_cast<size_t>(last.data() + last.size() - start));
+    }
+    auto program =
+        JSProgram(std::exchange(ownedArena, std::make_unique<ASTArena>()),
+                  std::move(statements), std::move(sources));
+    arena = ownedArena.get();
+    return program;
 }
 
-auto JSParser::parseStmt() -> std::shared_ptr<JSStmt> {
+auto JSParser::parseStmt() -> JSStmt* {
     if (match(JSTokenKind::Function)) {
         return parseFuncDecl();
     }
@@ -42,24 +53,30 @@ auto JSParser::parseStmt() -> std::shared_ptr<JSStmt> {
     if (match(JSTokenKind::Return)) {
         return parseReturnStmt();
     }
+    if (match(JSTokenKind::Break)) {
+        return parseBreakStmt();
+    }
+    if (match(JSTokenKind::Continue)) {
+        return parseContinueStmt();
+    }
     if (match(JSTokenKind::LBrace)) {
         return parseBlockStmt();
     }
     return parseExprStmt();
 }
 
-auto JSParser::parseBlockStmt() -> std::shared_ptr<JSBlockStmt> {
-    std::vector<std::shared_ptr<JSStmt>> statements;
+auto JSParser::parseBlockStmt() -> JSBlockStmt* {
+    std::vector<JSStmt*> statements;
 
     while (!check(JSTokenKind::RBrace) && !isAtEnd()) {
         statements.emplace_back(parseDecl());
     }
 
     consume(JSTokenKind::RBrace, "Expected '}' after block.");
-    return std::make_shared<JSBlockStmt>(statements);
+    return arena->make<JSBlockStmt>(arena->copy(statements));
 }
 
-auto JSParser::parseIfStmt() -> std::shared_ptr<JSIfStmt> {
+auto JSParser::parseIfStmt() -> JSIfStmt* {
     // Consume opening parenthesis for the condition block.
     consume(JSTokenKind::LParen, "Expected '(' after if.");
     // Parse conditional expression.
@@ -70,13 +87,13 @@ auto JSParser::parseIfStmt() -> std::shared_ptr<JSIfStmt> {
     auto thenBranch = parseStmt();
     if (match(JSTokenKind::Else)) {
         auto elseBranch = parseStmt();
-        return std::make_shared<JSIfStmt>(condition, thenBranch, elseBranch);
+        return arena->make<JSIfStmt>(condition, thenBranch, elseBranch);
     }
     // If there's no else branch we set the else branch statement to nullptr.
-    return std::make_shared<JSIfStmt>(condition, thenBranch, nullptr);
+    return arena->make<JSIfStmt>(condition, thenBranch, nullptr);
 }
 
-auto JSParser::parseWhileStmt() -> std::shared_ptr<JSWhileStmt> {
+auto JSParser::parseWhileStmt() -> JSWhileStmt* {
     // Consume opening parenthesis for the condition block.
     consume(JSTokenKind::LParen, "Expected '(' after while.");
     // Parse conditional expression.
@@ -84,16 +101,18 @@ auto JSParser::parseWhileStmt() -> std::shared_ptr<JSWhileStmt> {
     // Consume closing parenthesis for the condition block.
     consume(JSTokenKind::RParen, "Expected ')' after expression.");
     // Parse statement body.
+    loopDepth++;
     auto body = parseStmt();
+    loopDepth--;
     // Create AST node for while statement.
-    return std::make_shared<JSWhileStmt>(condition, body);
+    return arena->make<JSWhileStmt>(condition, body);
 }
 
-auto JSParser::parseForStmt() -> std::shared_ptr<JSForStmt> {
+auto JSParser::parseForStmt() -> JSForStmt* {
     // Consume opening parenthesis for the condition block.
     consume(JSTokenKind::LParen, "Expected '(' after for.");
     // Parse the initializer.
-    std::shared_ptr<JSStmt> initializer;
+    JSStmt* initializer = nullptr;
     if (match(JSTokenKind::Semicolon)) {
         initializer = nullptr;
     } else if (match(JSTokenKind::Var)) {
@@ -102,57 +121,79 @@ auto JSParser::parseForStmt() -> std::shared_ptr<JSForStmt> {
         initializer = parseExprStmt();
     }
     // Parse the condition.
-    std::shared_ptr<JSExpr> condition;
+    JSExpr* condition = nullptr;
     if (!check(JSTokenKind::Semicolon)) {
         condition = parseExpr();
     }
     consume(JSTokenKind::Semicolon, "Expected ';' after condition.");
     // Parse the step.
-    std::shared_ptr<JSExpr> step;
+    JSExpr* step = nullptr;
     if (!check(JSTokenKind::RParen)) {
         step = parseExpr();
     }
     consume(JSTokenKind::RParen, "Expected ')' after for clause.");
     // Parse the loop body.
+    loopDepth++;
     auto body = parseStmt();
+    loopDepth--;
 
-    return std::make_shared<JSForStmt>(initializer, condition, step, body);
+    return arena->make<JSForStmt>(initializer, condition, step, body);
 }
 
-auto JSParser::parseReturnStmt() -> std::shared_ptr<JSReturnStmt> {
+auto JSParser::parseReturnStmt() -> JSReturnStmt* {
     // Return keyword.
     JSToken keyword = previous();
     // Returned value.
-    std::shared_ptr<JSExpr> value = nullptr;
+    JSExpr* value = nullptr;
     if (!check(JSTokenKind::Semicolon)) {
         value = parseExpr();
     }
     consume(JSTokenKind::Semicolon, "Expected ';' after return.\n");
-    return std::make_shared<JSReturnStmt>(keyword, value);
+    return arena->make<JSReturnStmt>(keyword, value);
+}
+
+auto JSParser::parseBreakStmt() -> JSBreakStmt* {
+    JSToken keyword = previous();
+    if (loopDepth == 0) {
+        throw std::runtime_error("Illegal break statement.");
+    }
+    consume(JSTokenKind::Semicolon, "Expected ';' after break.\n");
+    return arena->make<JSBreakStmt>(keyword);
+}
+
+auto JSParser::parseContinueStmt() -> JSContinueStmt* {
+    JSToken keyword = previous();
+    if (loopDepth == 0) {
+        throw std::runtime_error("Illegal continue statement.");
+    }
+    consume(JSTokenKind::Semicolon, "Expected ';' after continue.\n");
+    return arena->make<JSContinueStmt>(keyword);
 }
 
-auto JSParser::parseDecl() -> std::shared_ptr<JSStmt> {
+auto JSParser::parseDecl() -> JSStmt* {
     if (match(JSTokenKind::Var) || match(JSTokenKind::Let)) {
+#ifdef DEBUG_TRACE_EXECUTION
         fmt::print("JSParser::parseVarDecl\n");
+#endif
         return parseVarDecl();
     }
     return parseStmt();
 }
 
-auto JSParser::parseVarDecl() -> std::shared_ptr<JSStmt> {
+auto JSParser::parseVarDecl() -> JSStmt* {
     auto name =
         consume(JSTokenKind::Identifier, "Expected identifier after var");
     if (match(JSTokenKind::Equal)) {
         auto initializer = parseExpr();
         consume(JSTokenKind::Semicolon,
                 "Expected ; after variable declaration");
-        return std::make_shared<JSVarDecl>(name, initializer);
+        return arena->make<JSVarDecl>(name, initializer);
     }
     consume(JSTokenKind::Semicolon, "Expected ; after variable declaration");
-    return std::make_shared<JSVarDecl>(name);
+    return arena->make<JSVarDecl>(name);
 }
 
-auto JSParser::parseFuncDecl() -> std::shared_ptr<JSStmt> {
+auto JSParser::parseFuncDecl() -> JSStmt* {
     // Consume the token name.
     auto name = consume(JSTokenKind::Identifier,
                         "Expected identifier after function declaration.");
@@ -171,209 +212,198 @@ auto JSParser::parseFuncDecl() -> std::shared_ptr<JSStmt> {
     }
     // Skip the closed parenthesis.
     consume(JSTokenKind::RParen, "Expected ')' after argument list.");
-    // Parse the function's body.
+    // Parse the function's body, loops outside the function don't enclose
+    // its body.
     consume(JSTokenKind::LBrace, "Expected '{' after function declaration.");
-    auto body = parseBlockStmt();
-    return std::make_shared<JSFuncDecl>(name, params, body);
+    std::vector<std::string_view> paramNames;
+    paramNames.reserve(params.size());
+    for (const auto& param : params) {
+        paramNames.push_back(param.getLexeme());
+    }
+    if (lazyFunctions) {
+        auto bodySource = preParseBody();
+        return arena->make<JSFuncDecl>(name, arena->copy(params),
+                                       arena->copy(paramNames), bodySource,
+                                       arena);
+    }
+    auto enclosingLoopDepth = loopDepth;
+    loopDepth               = 0;
+    auto body               = parseBlockStmt();
+    loopDepth               = enclosingLoopDepth;
+    return arena->make<JSFuncDecl>(name, arena->copy(params),
+                                   arena->copy(paramNames), body);
+}
+
+// Pre-parsing only matches brackets, no node is allocated for the body.
+auto JSParser::preParseBody() -> std::string_view {
+    const auto* start = previous().getLexeme().data();
+    openBrackets.clear();
+    while (true) {
+        if (isAtEnd()) {
+            throw std::invalid_argument("Expected '}' after function body.");
+        }
+        const auto& token = advance();
+        switch (token.getKind()) {
+        case JSTokenKind::LBrace:
+            openBrackets.push_back(JSTokenKind::RBrace);
+            break;
+        case JSTokenKind::LParen:
+            openBrackets.push_back(JSTokenKind::RParen);
+            break;
+        case JSTokenKind::LBracket:
+            openBrackets.push_back(JSTokenKind::RBracket);
+            break;
+        case JSTokenKind::RBrace:
+        case JSTokenKind::RParen:
+        case JSTokenKind::RBracket: {
+            if (openBrackets.empty() &&
+                token.getKind() == JSTokenKind::RBrace) {
+                auto lexeme = token.getLexeme();
+                return {start, static_cast<size_t>(
+                                   lexeme.data() + lexeme.size() - start)};
+            }
+            if (openBrackets.empty() ||
+                openBrackets.back() != token.getKind()) {
+                throw std::invalid_argument(
+                    "Unbalanced brackets in function body.");
+            }
+            openBrackets.pop_back();
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+auto JSParser::parseFunctionBody(std::string_view bodySource,
+                                 ASTArena& arena, bool lazy) -> JSBlockStmt* {
+    auto lexer  = JSLexer(bodySource);
+    auto parser = JSParser(lexer, arena);
+    parser.setLazyFunctions(lazy);
+    parser.consume(JSTokenKind::LBrace, "Expected '{' before function body.");
+    return parser.parseBlockStmt();
 }
 
-auto JSParser::parseExprStmt() -> std::shared_ptr<JSStmt> {
+// Bodies are parsed lazily too, so functions nested in a body are only
+// parsed when they are needed.
+auto JSFuncDecl::parseBody() -> void {
+    body = JSParser::parseFunctionBody(bodySource, *arena, true);
+}
+
+auto JSParser::parseExprStmt() -> JSStmt* {
     auto expr = parseExpr();
     if (expr == nullptr) {
-        fmt::print("Null expression wut");
-        return std::make_shared<JSExprStmt>(expr);
+        return arena->make<JSExprStmt>(expr);
     }
+#ifdef DEBUG_TRACE_EXECUTION
     fmt::print("parseExprStmt::\n");
     fmt::print("Node Kind : {}\n", astNodeKindToString(expr->getKind()));
-    fmt::print("Current Token: {}\n", tokens[current].toString());
-    fmt::print("Peek Token: {}\n", tokens[current + 1].toString());
+    fmt::print("Current Token: {}\n", tokens.peek().toString());
+    fmt::print("Peek Token: {}\n", tokens.peek(1).toString());
+#endif
     consume(JSTokenKind::Semicolon, "Expected ';' after expression");
-    return std::make_shared<JSExprStmt>(expr);
+    return arena->make<JSExprStmt>(expr);
 }
 
-auto JSParser::parseExpr() -> std::shared_ptr<JSExpr> {
-    fmt::print("JSParser::parseExpr\n");
-    return parseAssignmentExpr();
+auto JSParser::parseExpr() -> JSExpr* {
+    return parsePrecedenceExpr(Precedence::Assignment);
 }
 
-auto JSParser::parseAssignmentExpr() -> std::shared_ptr<JSExpr> {
-    auto expr = parseOrExpr();
-
-    if (match(JSTokenKind::Equal)) {
-        auto equals = previous();
-        auto value  = parseAssignmentExpr();
-
-        // We could use some form of RTTI to decide
-        // the right handside which could be a variable
-        // expression or a function expression.
-        // But since our AST node encode their node kind
-        // we can simply check the node kind.
-        if (expr->getKind() == ASTNodeKind::VarExpr) {
-            fmt::print("JSParaser::parseAssignment::IsVarExpr\n");
-            auto name = std::static_pointer_cast<JSVarExpr>(expr)->getName();
-            return std::make_shared<JSAssignExpr>(name, value);
+// Each iteration folds the operand parsed so far into the next operator as
+// long as it binds tighter than the operator the expression belongs to, a
+// literal is parsed without going through a level per precedence.
+auto JSParser::parsePrecedenceExpr(Precedence minPrec) -> JSExpr* {
+    auto expr = parsePrefixExpr();
+    while (true) {
+        auto prec = getInfixPrecedence(peek().getKind());
+        if (prec == Precedence::None || prec < minPrec) {
+            return expr;
         }
-
-        throw std::runtime_error("Invalid assignment target.");
+        advance();
+        expr = parseInfixExpr(expr, prec);
     }
-
-    return expr;
 }
 
-auto JSParser::parsePrimaryExpr() -> std::shared_ptr<JSExpr> {
-    fmt::print("JSParser::parsePrimaryExpr\n");
-    if (match(JSTokenKind::False)) {
-        return std::make_shared<JSLiteralExpr>(
-            std::make_shared<JSBasicValue>(false));
-    }
-    if (match(JSTokenKind::True)) {
-        return std::make_shared<JSLiteralExpr>(
-            std::make_shared<JSBasicValue>(true));
-    }
-    if (match(JSTokenKind::Null)) {
-        return std::make_shared<JSLiteralExpr>(
-            std::make_shared<JSBasicValue>(nullptr));
-    }
-    if (match({JSTokenKind::Numeric, JSTokenKind::String,
-               JSTokenKind::Undefined, JSTokenKind::Null})) {
-        auto literal = previous().getLiteral();
-        return std::make_shared<JSLiteralExpr>(
-            std::make_shared<JSBasicValue>(literal));
-    }
-    if (match(JSTokenKind::Identifier)) {
-        fmt::print("JSParse::match(Identifier)");
-        return std::make_shared<JSVarExpr>(previous());
+auto JSParser::parsePrefixExpr() -> JSExpr* {
+    auto kind = peek().getKind();
+    if (kind == JSTokenKind::Bang || kind == JSTokenKind::Minus) {
+        auto unaryOp = advance();
+        auto right   = parsePrecedenceExpr(Precedence::Unary);
+        return arena->make<JSUnaryExpr>(unaryOp, right);
     }
+    return parsePrimaryExpr();
+}
 
-    if (match(JSTokenKind::LParen)) {
-        fmt::print("JSParser::match(LParen)\n");
+auto JSParser::parsePrimaryExpr() -> JSExpr* {
+    switch (peek().getKind()) {
+    case JSTokenKind::False:
+        advance();
+        return arena->make<JSLiteralExpr>(JSBasicValue(false));
+    case JSTokenKind::True:
+        advance();
+        return arena->make<JSLiteralExpr>(JSBasicValue(true));
+    case JSTokenKind::Null:
+        advance();
+        return arena->make<JSLiteralExpr>(JSBasicValue(nullptr));
+    case JSTokenKind::Numeric:
+    case JSTokenKind::String:
+    case JSTokenKind::Undefined:
+        return arena->make<JSLiteralExpr>(advance().getLiteral());
+    case JSTokenKind::Identifier:
+        return arena->make<JSVarExpr>(advance());
+    case JSTokenKind::LParen: {
+        advance();
         auto expr = parseExpr();
         consume(JSTokenKind::RParen, "Expected ')' after expression");
-        fmt::print("JSParser::match(RParen)\n");
-        return std::make_shared<JSGroupingExpr>(expr);
+        return arena->make<JSGroupingExpr>(expr);
     }
-
-    return nullptr;
-}
-
-auto JSParser::parseComparisonExpr() -> std::shared_ptr<JSExpr> {
-    fmt::print("JSParser::parseComparisonExpr\n");
-    auto expr = parseTermExpr();
-
-    while (match({JSTokenKind::Greater, JSTokenKind::GreaterEqual,
-                  JSTokenKind::Less, JSTokenKind::LessEqual})) {
-        auto binOp = previous();
-        auto right = parseTermExpr();
-        expr       = std::make_shared<JSBinExpr>(expr, binOp, right);
+    default:
+        return nullptr;
     }
-    return expr;
-}
-
-auto JSParser::parseTermExpr() -> std::shared_ptr<JSExpr> {
-    fmt::print("JSParser::parseTermExpr\n");
-    auto expr = parseFactorExpr();
-
-    while (match({JSTokenKind::Minus, JSTokenKind::Plus})) {
-        auto binOp = previous();
-        auto right = parseFactorExpr();
-        expr       = std::make_shared<JSBinExpr>(expr, binOp, right);
-    }
-
-    return expr;
 }
 
-auto JSParser::parseFactorExpr() -> std::shared_ptr<JSExpr> {
-    fmt::print("JSParser::parseFactorExpr\n");
-    auto expr = parseUnaryExpr();
-
-    while (match({JSTokenKind::Slash, JSTokenKind::Star})) {
-        auto binOp = previous();
-        auto right = parseUnaryExpr();
-        expr       = std::make_shared<JSBinExpr>(expr, binOp, right);
+// Binary and logical operators are left associative, their right operand
+// only takes operators binding tighter than them. Assignments are right
+// associative and their target must be a variable.
+auto JSParser::parseInfixExpr(JSExpr* left, Precedence prec) -> JSExpr* {
+    auto infixOp = previous();
+    switch (prec) {
+    case Precedence::Assignment: {
+        auto value = parsePrecedenceExpr(Precedence::Assignment);
+        if (left == nullptr || left->getKind() != ASTNodeKind::VarExpr) {
+            throw std::runtime_error("Invalid assignment target.");
+        }
+        auto name = static_cast<JSVarExpr*>(left)->getName();
+        return arena->make<JSAssignExpr>(name, value);
     }
-
-    return expr;
-}
-
-auto JSParser::parseUnaryExpr()  // NOLINT
-    -> std::shared_ptr<JSExpr> { // NOLINT
-    fmt::print("JSParser::parseUnaryExpr\n");
-    if (match({JSTokenKind::Bang, JSTokenKind::Minus})) {
-        fmt::print("JSParser::match(Bang, Minus)\n");
-        auto unaryOp = previous();
-        assert(unaryOp.getKind() == JSTokenKind::Bang ||
-               unaryOp.getKind() == JSTokenKind::Minus);
-        fmt::print("Token : {}\n", unaryOp.getLexeme());
-        auto right = parseUnaryExpr();
-        fmt::print("Right : {}\n",
-                   right->getKind() == ASTNodeKind::LiteralExpr);
-        return std::make_shared<JSUnaryExpr>(unaryOp, right);
+    case Precedence::Call:
+        return parseCallArgs(left);
+    case Precedence::Or:
+    case Precedence::And: {
+        auto right = parsePrecedenceExpr(nextPrecedence(prec));
+        return arena->make<JSLogicalExpr>(infixOp, left, right);
     }
-
-    return parseCallExpr();
-}
-
-auto JSParser::parseOrExpr() -> std::shared_ptr<JSExpr> {
-    auto expr = parseAndExpr();
-
-    while (match(JSTokenKind::Or)) {
-        auto logicalOp = previous();
-        auto right     = parseAndExpr();
-        expr = std::make_shared<JSLogicalExpr>(logicalOp, expr, right);
+    default: {
+        auto right = parsePrecedenceExpr(nextPrecedence(prec));
+        return arena->make<JSBinExpr>(left, infixOp, right);
     }
-
-    return expr;
-}
-
-auto JSParser::parseAndExpr() -> std::shared_ptr<JSExpr> {
-    auto expr = parseEqualityExpr();
-
-    while (match(JSTokenKind::And)) {
-        auto logicalOp = previous();
-        auto right     = parseEqualityExpr();
-        expr = std::make_shared<JSLogicalExpr>(logicalOp, expr, right);
     }
-
-    return expr;
 }
 
-auto JSParser::parseCallExpr() -> std::shared_ptr<JSExpr> {
-    fmt::print("JSParser::parseCallExpr\n");
-    auto expr = parsePrimaryExpr();
-
-    while (true) {
-        if (match(JSTokenKind::LParen)) {
-            std::vector<std::shared_ptr<JSExpr>> args;
-            if (!check(JSTokenKind::RParen)) {
-                do {
-                    if (args.size() >= kMaxArgs) {
-                        throw std::runtime_error(
-                            "Can't have more than 255 arguments.\n");
-                    }
-                    args.emplace_back(parseExpr());
-                } while (match(JSTokenKind::Comma));
+auto JSParser::parseCallArgs(JSExpr* callee) -> JSExpr* {
+    std::vector<JSExpr*> args;
+    if (!check(JSTokenKind::RParen)) {
+        do {
+            if (args.size() >= kMaxArgs) {
+                throw std::runtime_error(
+                    "Can't have more than 255 arguments.\n");
             }
-            auto paren =
-                consume(JSTokenKind::RParen, "Expected ')' after arguments.\n");
-
-            expr = std::make_shared<JSCallExpr>(expr, paren, args);
-        } else {
-            break;
-        }
-    }
-    return expr;
-}
-
-auto JSParser::parseEqualityExpr() -> std::shared_ptr<JSExpr> {
-    fmt::print("JSParser::parseEqualityExpr\n");
-    auto expr = parseComparisonExpr();
-
-    while (match({JSTokenKind::BangEqual, JSTokenKind::EqualEqual})) {
-        auto binOp = previous();
-        auto right = parseComparisonExpr();
-        expr       = std::make_shared<JSBinExpr>(expr, binOp, right);
+            args.emplace_back(parseExpr());
+        } while (match(JSTokenKind::Comma));
     }
-
-    return expr;
+    auto paren =
+        consume(JSTokenKind::RParen, "Expected ')' after arguments.\n");
+    return arena->make<JSCallExpr>(callee, paren, arena->copy(args));
 }
 } // namespace minijsc
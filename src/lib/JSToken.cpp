@@ -1,4 +1,7 @@
 #include "JSToken.h"
+#include "JSValue.h"
+
+#include <cstdlib>
 #include <string>
 
 namespace minijsc {
@@ -123,11 +126,12 @@ auto JSToken::toString() const -> std::string {
     case JSTokenKind::Export:
         return "EXPORT";
     case JSTokenKind::String:
-        return "STRING(" + literal.getValue<JSString>() + ")";
+        return "STRING(" + getLiteral().getValue<JSString>() + ")";
     case JSTokenKind::Identifier:
-        return "IDENTIFIER(" + literal.getValue<JSString>() + ")";
+        return "IDENTIFIER(" + std::string(getLexeme()) + ")";
     case JSTokenKind::Numeric:
-        return "NUMERIC(" + std::to_string(literal.getValue<JSNumber>()) + ")";
+        return "NUMERIC(" + std::to_string(getLiteral().getValue<JSNumber>()) +
+               ")";
     case JSTokenKind::Eof:
         return "EOF";
     }
@@ -135,4 +139,19 @@ auto JSToken::toString() const -> std::string {
     return "UNKNOWN TOKEN";
 }
 
+// Decode the literal value from the lexeme.
+auto JSToken::getLiteral() const -> JSBasicValue {
+    switch (kind) {
+    case JSTokenKind::Numeric:
+        // Numeric lexemes only hold digits and a dot, they are short enough
+        // for the copy to stay in the small string buffer.
+        return std::strtod(std::string(getLexeme()).c_str(), nullptr);
+    case JSTokenKind::String:
+        // Strip the quotes, the lexer only emits terminated strings.
+        return JSString(getLexeme().substr(1, length - 2));
+    default:
+        return JSString(getLexeme());
+    }
+}
+
 }; // namespace minijsc
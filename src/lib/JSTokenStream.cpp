@@ -0,0 +1,43 @@
+#include "JSTokenStream.h"
+#include "JSLexer.h"
+#include "JSToken.h"
+
+#include <cassert>
+#include <cstddef>
+
+namespace minijsc {
+
+// Fetch tokens until the one we peek at is in the window.
+auto JSTokenStream::peek(size_t ahead) -> const JSToken& {
+    assert(ahead <= kMaxLookahead && "lookahead past the token window");
+    while (fetched <= current + ahead) {
+        fetch();
+    }
+    return window[(current + ahead) % kTokenWindow];
+}
+
+// The previous token is kept in the window until the stream advances.
+auto JSTokenStream::previous() -> const JSToken& {
+    assert(current > 0 && "no token was consumed");
+    return window[(current - 1) % kTokenWindow];
+}
+
+// Make sure the current token was fetched before moving past it.
+auto JSTokenStream::advance() -> void {
+    peek();
+    current++;
+}
+
+// Once the source is exhausted, both the lexer and the vector keep yielding
+// the `Eof` token.
+auto JSTokenStream::fetch() -> void {
+    auto& slot = window[fetched % kTokenWindow];
+    if (lexer != nullptr) {
+        slot = lexer->next();
+    } else if (next < tokens.size()) {
+        slot = tokens[next < tokens.size() - 1 ? next++ : next];
+    }
+    fetched++;
+}
+
+} // namespace minijsc
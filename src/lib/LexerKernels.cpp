@@ -0,0 +1,243 @@
+//===----------------------------------------------------------------------===//
+// LexerKernels.cpp: This file implements the lexer's scanning kernels. The
+// vector kernels compute, for a block of characters, a bit mask of the
+// characters ending the run and stop at its lowest set bit. The characters
+// left after the last full block are scanned by the scalar kernel.
+//===----------------------------------------------------------------------===//
+#include "LexerKernels.h"
+
+#include <cstdint>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MINIJSC_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace minijsc {
+
+namespace {
+
+/// Check if a character ends a run of blanks.
+inline auto isBlankStop(char chr) -> bool {
+    return chr != ' ' && chr != '\t' && chr != '\r';
+}
+
+/// Check if a character ends an identifier.
+inline auto isIdentifierStop(char chr) -> bool {
+    return !((chr >= 'a' && chr <= 'z') || (chr >= 'A' && chr <= 'Z') ||
+             (chr >= '0' && chr <= '9') || chr == '_');
+}
+
+/// Check if a character ends a run of digits.
+inline auto isDigitStop(char chr) -> bool { return chr < '0' || chr > '9'; }
+
+/// Check if a character ends a run of string contents.
+inline auto isStringStop(char chr) -> bool { return chr == '"' || chr == '\n'; }
+
+template <bool (*Stop)(char)>
+auto scanScalar(const char* first, const char* last) -> const char* {
+    while (first != last && !Stop(*first)) {
+        first++;
+    }
+    return first;
+}
+
+const ScanKernels kScalarKernels = {
+    scanScalar<isBlankStop>,
+    scanScalar<isIdentifierStop>,
+    scanScalar<isDigitStop>,
+    scanScalar<isStringStop>,
+};
+
+#ifdef MINIJSC_SCAN_X86
+
+// SSE2 is part of x86-64 so the SSE2 kernels need no target attribute.
+
+/// Mask of the bytes equal to `chr`.
+inline auto equalSse2(__m128i chars, char chr) -> __m128i {
+    return _mm_cmpeq_epi8(chars, _mm_set1_epi8(chr));
+}
+
+/// Mask of the bytes in [low, high], bytes are compared as signed so
+/// non-ASCII bytes are never in range.
+inline auto rangeSse2(__m128i chars, char low, char high) -> __m128i {
+    return _mm_and_si128(
+        _mm_cmpgt_epi8(chars, _mm_set1_epi8(static_cast<char>(low - 1))),
+        _mm_cmplt_epi8(chars, _mm_set1_epi8(static_cast<char>(high + 1))));
+}
+
+/// Bit mask of the bytes not in the class.
+inline auto invertSse2(__m128i inClass) -> uint32_t {
+    return ~static_cast<uint32_t>(_mm_movemask_epi8(inClass)) & 0xFFFFU;
+}
+
+inline auto blankStopSse2(__m128i chars) -> uint32_t {
+    return invertSse2(_mm_or_si128(
+        equalSse2(chars, ' '),
+        _mm_or_si128(equalSse2(chars, '\t'), equalSse2(chars, '\r'))));
+}
+
+inline auto identifierStopSse2(__m128i chars) -> uint32_t {
+    // Setting bit 5 maps upper case letters to lower case ones.
+    auto lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    return invertSse2(
+        _mm_or_si128(rangeSse2(lower, 'a', 'z'),
+                     _mm_or_si128(rangeSse2(chars, '0', '9'),
+                                  equalSse2(chars, '_'))));
+}
+
+inline auto digitStopSse2(__m128i chars) -> uint32_t {
+    return invertSse2(rangeSse2(chars, '0', '9'));
+}
+
+inline auto stringStopSse2(__m128i chars) -> uint32_t {
+    return static_cast<uint32_t>(_mm_movemask_epi8(
+        _mm_or_si128(equalSse2(chars, '"'), equalSse2(chars, '\n'))));
+}
+
+template <uint32_t (*StopMask)(__m128i), bool (*Stop)(char)>
+auto scanSse2(const char* first, const char* last) -> const char* {
+    // Runs are often empty, e.g. after a single space.
+    if (first == last || Stop(*first)) {
+        return first;
+    }
+    while (last - first >= 16) {
+        auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        if (auto mask = StopMask(chars); mask != 0) {
+            return first + __builtin_ctz(mask);
+        }
+        first += 16;
+    }
+    return scanScalar<Stop>(first, last);
+}
+
+const ScanKernels kSse2Kernels = {
+    scanSse2<blankStopSse2, isBlankStop>,
+    scanSse2<identifierStopSse2, isIdentifierStop>,
+    scanSse2<digitStopSse2, isDigitStop>,
+    scanSse2<stringStopSse2, isStringStop>,
+};
+
+// The AVX2 kernels are compiled for AVX2 whatever the target of the build
+// and are only called after checking the CPU supports it.
+#define MINIJSC_TARGET_AVX2 __attribute__((target("avx2")))
+
+MINIJSC_TARGET_AVX2 inline auto equalAvx2(__m256i chars, char chr)
+    -> __m256i {
+    return _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(chr));
+}
+
+MINIJSC_TARGET_AVX2 inline auto rangeAvx2(__m256i chars, char low, char high)
+    -> __m256i {
+    return _mm256_and_si256(
+        _mm256_cmpgt_epi8(chars,
+                          _mm256_set1_epi8(static_cast<char>(low - 1))),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(high + 1)),
+                          chars));
+}
+
+MINIJSC_TARGET_AVX2 inline auto invertAvx2(__m256i inClass) -> uint32_t {
+    return ~static_cast<uint32_t>(_mm256_movemask_epi8(inClass));
+}
+
+MINIJSC_TARGET_AVX2 inline auto blankStopAvx2(__m256i chars) -> uint32_t {
+    return invertAvx2(_mm256_or_si256(
+        equalAvx2(chars, ' '),
+        _mm256_or_si256(equalAvx2(chars, '\t'), equalAvx2(chars, '\r'))));
+}
+
+MINIJSC_TARGET_AVX2 inline auto identifierStopAvx2(__m256i chars)
+    -> uint32_t {
+    auto lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+    return invertAvx2(
+        _mm256_or_si256(rangeAvx2(lower, 'a', 'z'),
+                        _mm256_or_si256(rangeAvx2(chars, '0', '9'),
+                                        equalAvx2(chars, '_'))));
+}
+
+MINIJSC_TARGET_AVX2 inline auto digitStopAvx2(__m256i chars) -> uint32_t {
+    return invertAvx2(rangeAvx2(chars, '0', '9'));
+}
+
+MINIJSC_TARGET_AVX2 inline auto stringStopAvx2(__m256i chars) -> uint32_t {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_or_si256(equalAvx2(chars, '"'), equalAvx2(chars, '\n'))));
+}
+
+template <uint32_t (*StopMask)(__m256i), bool (*Stop)(char)>
+MINIJSC_TARGET_AVX2 auto scanAvx2(const char* first, const char* last)
+    -> const char* {
+    // Runs are often empty, e.g. after a single space.
+    if (first == last || Stop(*first)) {
+        return first;
+    }
+    while (last - first >= 32) {
+        auto chars =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+        if (auto mask = StopMask(chars); mask != 0) {
+            return first + __builtin_ctz(mask);
+        }
+        first += 32;
+    }
+    return scanScalar<Stop>(first, last);
+}
+
+const ScanKernels kAvx2Kernels = {
+    scanAvx2<blankStopAvx2, isBlankStop>,
+    scanAvx2<identifierStopAvx2, isIdentifierStop>,
+    scanAvx2<digitStopAvx2, isDigitStop>,
+    scanAvx2<stringStopAvx2, isStringStop>,
+};
+
+#endif
+
+} // namespace
+
+auto isScanIsaSupported(ScanIsa isa) -> bool {
+    switch (isa) {
+    case ScanIsa::Scalar:
+        return true;
+#ifdef MINIJSC_SCAN_X86
+    case ScanIsa::SSE2:
+        return true;
+    case ScanIsa::AVX2:
+        return __builtin_cpu_supports("avx2") != 0;
+#else
+    case ScanIsa::SSE2:
+    case ScanIsa::AVX2:
+        return false;
+#endif
+    }
+    return false;
+}
+
+auto getNativeScanIsa() -> ScanIsa {
+    static const auto native = [] {
+        for (auto isa : {ScanIsa::AVX2, ScanIsa::SSE2}) {
+            if (isScanIsaSupported(isa)) {
+                return isa;
+            }
+        }
+        return ScanIsa::Scalar;
+    }();
+    return native;
+}
+
+auto getScanKernels(ScanIsa isa) -> const ScanKernels& {
+    if (!isScanIsaSupported(isa)) {
+        return kScalarKernels;
+    }
+    switch (isa) {
+#ifdef MINIJSC_SCAN_X86
+    case ScanIsa::SSE2:
+        return kSse2Kernels;
+    case ScanIsa::AVX2:
+        return kAvx2Kernels;
+#endif
+    default:
+        return kScalarKernels;
+    }
+}
+
+} // namespace minijsc
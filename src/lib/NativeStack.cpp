@@ -0,0 +1,63 @@
+//===----------------------------------------------------------------------===//
+// NativeStack.cpp: This file implements the native stack guard, the bounds
+// of the thread's stack are queried once per thread.
+//===----------------------------------------------------------------------===//
+#include "NativeStack.h"
+
+#include <cstdint>
+#include <stdexcept>
+
+#if defined(__linux__) || defined(__APPLE__)
+#define MINIJSC_HAS_STACK_BOUNDS 1
+#include <pthread.h>
+#endif
+
+namespace minijsc {
+
+namespace {
+
+/// Return the address of the current stack position, stacks grow down on
+/// the targets we support.
+[[gnu::noinline]] auto getStackPosition() -> uintptr_t {
+    volatile char marker = 0;
+    return reinterpret_cast<uintptr_t>(&marker);
+}
+
+/// Return the lowest usable address of the current thread's stack. When
+/// the bounds can't be queried the stack is assumed to extend
+/// `kDefaultNativeStackSize` bytes below the first checked position.
+auto getStackLimit() -> uintptr_t {
+#ifdef MINIJSC_HAS_STACK_BOUNDS
+#ifdef __APPLE__
+    auto* self = pthread_self();
+    auto top   = reinterpret_cast<uintptr_t>(pthread_get_stackaddr_np(self));
+    return top - pthread_get_stacksize_np(self);
+#else
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        void* addr  = nullptr;
+        size_t size = 0;
+        auto status = pthread_attr_getstack(&attr, &addr, &size);
+        pthread_attr_destroy(&attr);
+        if (status == 0) {
+            return reinterpret_cast<uintptr_t>(addr);
+        }
+    }
+#endif
+#endif
+    auto position = getStackPosition();
+    return position > kDefaultNativeStackSize
+               ? position - kDefaultNativeStackSize
+               : 0;
+}
+
+} // namespace
+
+auto checkNativeStack() -> void {
+    thread_local const uintptr_t limit = getStackLimit() + kNativeStackReserve;
+    if (getStackPosition() < limit) {
+        throw std::runtime_error("Maximum call stack size exceeded.");
+    }
+}
+
+} // namespace minijsc
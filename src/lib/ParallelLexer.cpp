@@ -0,0 +1,85 @@
+//===----------------------------------------------------------------------===//
+// ParallelLexer.cpp: This file implements parallel lexing, the split is
+// computed on the calling thread in a single pass counting quotes and each
+// chunk is lexed on its own thread.
+//===----------------------------------------------------------------------===//
+#include "ParallelLexer.h"
+#include "JSLexer.h"
+#include "JSToken.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace minijsc {
+
+// Each chunk ends at the first newline past its target size preceded by an
+// even number of quotes. The quotes are counted once, from the end of the
+// previous candidate newline.
+auto splitSource(std::string_view source, size_t chunks, size_t minChunk)
+    -> std::vector<std::string_view> {
+    std::vector<std::string_view> result;
+    auto target = std::max(source.length() / std::max<size_t>(chunks, 1),
+                           std::max<size_t>(minChunk, 1));
+    size_t start   = 0;
+    size_t scanned = 0;
+    size_t quotes  = 0;
+    while (result.size() + 1 < chunks && source.length() - start > target) {
+        auto pos = start + target;
+        auto end = std::string_view::npos;
+        while ((pos = source.find('\n', pos)) != std::string_view::npos) {
+            quotes += std::count(source.begin() + scanned,
+                                 source.begin() + pos, '"');
+            scanned = pos;
+            pos++;
+            if (quotes % 2 == 0) {
+                end = pos;
+                break;
+            }
+        }
+        if (end == std::string_view::npos || end == source.length()) {
+            break;
+        }
+        result.push_back(source.substr(start, end - start));
+        start = end;
+    }
+    result.push_back(source.substr(start));
+    return result;
+}
+
+// Chunks are lexed without their end of file token except for the last
+// one, whose end of file token is the one of the source.
+auto lexParallel(std::string_view source, size_t workers, size_t minChunk,
+                 ScanIsa isa) -> std::vector<JSToken> {
+    auto chunks = splitSource(source, workers, minChunk);
+    if (chunks.size() == 1) {
+        return JSLexer(source, isa).scanTokens();
+    }
+    std::vector<std::vector<JSToken>> chunkTokens(chunks.size());
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(chunks.size() - 1);
+        for (size_t idx = 1; idx < chunks.size(); idx++) {
+            threads.emplace_back([&, idx] {
+                chunkTokens[idx] = JSLexer(chunks[idx], isa).scanTokens();
+            });
+        }
+        chunkTokens[0] = JSLexer(chunks[0], isa).scanTokens();
+    }
+
+    size_t count = 0;
+    for (const auto& tokens : chunkTokens) {
+        count += tokens.size() - 1;
+    }
+    std::vector<JSToken> tokens;
+    tokens.reserve(count + 1);
+    for (const auto& chunk : chunkTokens) {
+        tokens.insert(tokens.end(), chunk.begin(), chunk.end() - 1);
+    }
+    tokens.push_back(chunkTokens.back().back());
+    return tokens;
+}
+
+} // namespace minijsc
@@ -0,0 +1,101 @@
+//===----------------------------------------------------------------------===//
+// ParallelParser.cpp: This file implements parallel parsing, the program is
+// pre-parsed on the calling thread and the top level function bodies are
+// parsed on worker threads.
+//===----------------------------------------------------------------------===//
+#include "ParallelParser.h"
+#include "AST.h"
+#include "ASTArena.h"
+#include "JSLexer.h"
+#include "JSParser.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace minijsc {
+
+namespace {
+
+/// Parse the bodies of a group of functions into `arena`.
+auto parseBodies(std::span<JSFuncDecl* const> decls, ASTArena& arena)
+    -> void {
+    for (auto* decl : decls) {
+        decl->setBody(
+            JSParser::parseFunctionBody(decl->getBodySource(), arena, false));
+    }
+}
+
+} // namespace
+
+// Groups end at the first function past their target size. Errors are
+// rethrown once every worker is done, the first one in source order wins
+// as it would when parsing on a single thread.
+auto parseParallel(std::string_view source, size_t workers, size_t minChunk)
+    -> JSProgram {
+    auto lexer  = JSLexer(source);
+    auto parser = JSParser(lexer);
+    parser.setLazyFunctions(true);
+    auto program = parser.parse();
+
+    std::vector<JSFuncDecl*> decls;
+    size_t total = 0;
+    for (auto* stmt : program) {
+        if (stmt->getKind() == ASTNodeKind::FuncDecl) {
+            auto* decl = static_cast<JSFuncDecl*>(stmt);
+            decls.push_back(decl);
+            total += decl->getBodySource().size();
+        }
+    }
+    auto target = std::max(total / std::max<size_t>(workers, 1),
+                           std::max<size_t>(minChunk, 1));
+    std::vector<std::span<JSFuncDecl* const>> groups;
+    size_t start = 0;
+    size_t size  = 0;
+    for (size_t idx = 0; idx < decls.size(); idx++) {
+        size += decls[idx]->getBodySource().size();
+        if (size >= target && groups.size() + 1 < workers) {
+            groups.emplace_back(decls.data() + start, idx + 1 - start);
+            start = idx + 1;
+            size  = 0;
+        }
+    }
+    if (start < decls.size() || groups.empty()) {
+        groups.emplace_back(decls.data() + start, decls.size() - start);
+    }
+
+    std::vector<std::unique_ptr<ASTArena>> arenas(groups.size());
+    std::vector<std::exception_ptr> errors(groups.size());
+    auto parseGroup = [&](size_t idx) {
+        arenas[idx] = std::make_unique<ASTArena>();
+        try {
+            parseBodies(groups[idx], *arenas[idx]);
+        } catch (...) {
+            errors[idx] = std::current_exception();
+        }
+    };
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(groups.size() - 1);
+        for (size_t idx = 1; idx < groups.size(); idx++) {
+            threads.emplace_back(parseGroup, idx);
+        }
+        parseGroup(0);
+    }
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    for (auto& arena : arenas) {
+        program.adoptArena(std::move(arena));
+    }
+    return program;
+}
+
+} // namespace minijsc
@@ -0,0 +1,321 @@
+//===----------------------------------------------------------------------===//
+// PurityAnalyzer.cpp: This file implements the purity analysis, the analysis
+// visits the program once collecting the non-local dependencies of each top
+// level function then computes the pure functions as a fixed point.
+//===----------------------------------------------------------------------===//
+#include "PurityAnalyzer.h"
+#include "AST.h"
+#include "JSValue.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace minijsc {
+
+namespace {
+
+/// Check if a function body starts with the memoization directive.
+auto hasMemoDirective(JSFuncDecl* decl) -> bool {
+    const auto& stmts = decl->getBody()->getStmts();
+    if (stmts.empty() || stmts.front()->getKind() != ASTNodeKind::ExprStmt) {
+        return false;
+    }
+    auto expr = static_cast<JSExprStmt*>(stmts.front())->getExpr();
+    if (expr->getKind() != ASTNodeKind::LiteralExpr) {
+        return false;
+    }
+    const auto& value = static_cast<JSLiteralExpr*>(expr)->getValue();
+    return value.isString() && value.getValue<JSString>() == kMemoDirective;
+}
+
+} // namespace
+
+/// Analyzing a program starts by collecting the top level function
+/// declarations, functions declared more than once are not candidates.
+/// Pre-parsed functions are visited once referenced, those never referenced
+/// are left unparsed and marked impure since nothing is known about them.
+/// After visiting the program, functions depending on an impure or unknown
+/// function are marked impure until no more functions change.
+auto PurityAnalyzer::analyze(std::span<JSStmt* const> stmts)
+    -> void {
+    std::unordered_set<std::string_view> redeclared;
+    for (const auto& stmt : stmts) {
+        if (stmt->getKind() != ASTNodeKind::FuncDecl) {
+            continue;
+        }
+        auto* decl = static_cast<JSFuncDecl*>(stmt);
+        auto name  = decl->getName().getLexeme();
+        if (!functions.try_emplace(name, FunctionInfo{decl}).second) {
+            redeclared.insert(name);
+        }
+    }
+    for (const auto& stmt : stmts) {
+        if (stmt->getKind() == ASTNodeKind::FuncDecl &&
+            !static_cast<JSFuncDecl*>(stmt)->isBodyParsed()) {
+            auto* decl = static_cast<JSFuncDecl*>(stmt);
+            deferred[decl->getName().getLexeme()].push_back(decl);
+            continue;
+        }
+        analyze(stmt);
+    }
+    while (!pending.empty()) {
+        auto* decl = pending.back();
+        pending.pop_back();
+        analyze(decl);
+    }
+    for (const auto& [name, decls] : deferred) {
+        functions.at(name).pure = false;
+    }
+    deferred.clear();
+    for (auto& [name, info] : functions) {
+        if (redeclared.contains(name) || shadowed.contains(name)) {
+            info.pure = false;
+        }
+    }
+
+    auto changed = true;
+    while (changed) {
+        changed = false;
+        for (auto& [name, info] : functions) {
+            if (!info.pure) {
+                continue;
+            }
+            for (const auto& callee : info.callees) {
+                auto iter = functions.find(callee);
+                if (iter == functions.end() || !iter->second.pure) {
+                    info.pure = false;
+                    changed   = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (auto& [name, info] : functions) {
+        info.decl->setPure(info.pure);
+        info.decl->setMemoized(info.pure && hasMemoDirective(info.decl));
+    }
+}
+
+/// Callees of a pure function are pure, the dependencies are collected with
+/// a worklist over the callee names.
+auto PurityAnalyzer::getDependencies(JSFuncDecl* decl) const
+    -> std::vector<JSFuncDecl*> {
+    std::vector<JSFuncDecl*> deps;
+    if (!decl->isPure()) {
+        return deps;
+    }
+    std::vector<std::string_view> worklist{decl->getName().getLexeme()};
+    std::unordered_set<std::string_view> visited{worklist.front()};
+    while (!worklist.empty()) {
+        auto iter = functions.find(worklist.back());
+        worklist.pop_back();
+        if (iter == functions.end()) {
+            continue;
+        }
+        deps.push_back(iter->second.decl);
+        for (const auto& callee : iter->second.callees) {
+            if (visited.insert(callee).second) {
+                worklist.push_back(callee);
+            }
+        }
+    }
+    return deps;
+}
+
+// Names are keyed by their first occurrence, a declaration's name is the
+// key of its entry.
+auto PurityAnalyzer::references(std::string_view source) const -> bool {
+    for (const auto& [name, info] : functions) {
+        if (isWithin(name, source)) {
+            return true;
+        }
+        for (const auto& callee : info.callees) {
+            if (isWithin(callee, source)) {
+                return true;
+            }
+        }
+    }
+    for (const auto& name : shadowed) {
+        if (isWithin(name, source)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+auto PurityAnalyzer::analyze(JSExpr* expr) -> void {
+    if (expr != nullptr) {
+        expr->accept(this);
+    }
+}
+
+auto PurityAnalyzer::analyze(JSStmt* stmt) -> void {
+    if (stmt != nullptr) {
+        stmt->accept(this);
+    }
+}
+
+auto PurityAnalyzer::isLocal(std::string_view name) -> bool {
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); scope++) {
+        if (scope->contains(name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+auto PurityAnalyzer::declare(std::string_view name) -> void {
+    shadowed.insert(name);
+    if (!scopes.empty()) {
+        scopes.back().insert(name);
+    }
+}
+
+auto PurityAnalyzer::markImpure() -> void {
+    if (current != nullptr) {
+        current->pure = false;
+    }
+}
+
+auto PurityAnalyzer::reference(std::string_view name) -> void {
+    auto iter = deferred.find(name);
+    if (iter != deferred.end()) {
+        pending.insert(pending.end(), iter->second.begin(), iter->second.end());
+        deferred.erase(iter);
+    }
+}
+
+auto PurityAnalyzer::visitLiteralExpr(JSLiteralExpr* /*expr*/) -> void {}
+
+auto PurityAnalyzer::visitBinaryExpr(JSBinExpr* expr) -> void {
+    analyze(expr->getLeft());
+    analyze(expr->getRight());
+}
+
+auto PurityAnalyzer::visitUnaryExpr(JSUnaryExpr* expr) -> void {
+    analyze(expr->getRight());
+}
+
+auto PurityAnalyzer::visitLogicalExpr(JSLogicalExpr* expr) -> void {
+    analyze(expr->getLeft());
+    analyze(expr->getRight());
+}
+
+auto PurityAnalyzer::visitGroupingExpr(JSGroupingExpr* expr) -> void {
+    analyze(expr->getExpr());
+}
+
+/// Reading a non-local binding is only allowed for top level functions,
+/// which become dependencies of the analyzed function. Any reference to a
+/// pre-parsed function, even a shadowed one, queues it for analysis.
+auto PurityAnalyzer::visitVarExpr(JSVarExpr* expr) -> void {
+    const auto& name = expr->getName().getLexeme();
+    reference(name);
+    if (current == nullptr || isLocal(name)) {
+        return;
+    }
+    if (functions.contains(name)) {
+        current->callees.insert(name);
+        return;
+    }
+    markImpure();
+}
+
+/// Writing a non-local binding is a side effect.
+auto PurityAnalyzer::visitAssignExpr(JSAssignExpr* expr) -> void {
+    analyze(expr->getValue());
+    const auto& name = expr->getName().getLexeme();
+    if (current == nullptr || !isLocal(name)) {
+        shadowed.insert(name);
+        markImpure();
+    }
+}
+
+/// Calls are only allowed when the callee is a top level function.
+auto PurityAnalyzer::visitCallExpr(JSCallExpr* expr) -> void {
+    const auto& callee = expr->getCallee();
+    if (callee->getKind() != ASTNodeKind::VarExpr ||
+        isLocal(static_cast<JSVarExpr*>(callee)->getName().getLexeme())) {
+        markImpure();
+    }
+    analyze(callee);
+    for (const auto& arg : expr->getArgs()) {
+        analyze(arg);
+    }
+}
+
+auto PurityAnalyzer::visitBlockStmt(JSBlockStmt* block) -> void {
+    scopes.emplace_back();
+    for (const auto& stmt : block->getStmts()) {
+        analyze(stmt);
+    }
+    scopes.pop_back();
+}
+
+auto PurityAnalyzer::visitExprStmt(JSExprStmt* stmt) -> void {
+    analyze(stmt->getExpr());
+}
+
+auto PurityAnalyzer::visitIfStmt(JSIfStmt* stmt) -> void {
+    analyze(stmt->getCondition());
+    analyze(stmt->getThenBranch());
+    analyze(stmt->getElseBranch());
+}
+
+auto PurityAnalyzer::visitWhileStmt(JSWhileStmt* stmt) -> void {
+    analyze(stmt->getCondition());
+    analyze(stmt->getBody());
+}
+
+auto PurityAnalyzer::visitForStmt(JSForStmt* stmt) -> void {
+    analyze(stmt->getInitializer());
+    analyze(stmt->getCondition());
+    analyze(stmt->getStep());
+    analyze(stmt->getBody());
+}
+
+auto PurityAnalyzer::visitVarDecl(JSVarDecl* stmt) -> void {
+    analyze(stmt->getInitializer());
+    declare(stmt->getName());
+}
+
+/// Top level functions are analyzed in their own scope, nested functions
+/// are analyzed as part of the enclosing function which is conservatively
+/// marked impure since the nested function may outlive the call.
+auto PurityAnalyzer::visitFuncDecl(JSFuncDecl* stmt) -> void {
+    auto* enclosing = current;
+    auto  iter      = functions.end();
+    if (enclosing == nullptr && scopes.empty()) {
+        iter = functions.find(stmt->getName().getLexeme());
+    }
+    if (iter != functions.end()) {
+        current = iter->second.decl == stmt ? &iter->second : nullptr;
+    } else {
+        // Nested functions and functions declared in the body of a top
+        // level statement aren't candidates for purity.
+        declare(stmt->getName().getLexeme());
+        markImpure();
+        current = nullptr;
+    }
+    scopes.emplace_back();
+    for (const auto& param : stmt->getParamNames()) {
+        declare(param);
+    }
+    for (const auto& bodyStmt : stmt->getBody()->getStmts()) {
+        analyze(bodyStmt);
+    }
+    scopes.pop_back();
+    current = enclosing;
+}
+
+auto PurityAnalyzer::visitReturnStmt(JSReturnStmt* stmt) -> void {
+    analyze(stmt->getValue());
+}
+
+auto PurityAnalyzer::visitBreakStmt(JSBreakStmt* /*stmt*/) -> void {}
+
+auto PurityAnalyzer::visitContinueStmt(JSContinueStmt* /*stmt*/) -> void {}
+
+} // namespace minijsc
@@ -0,0 +1,146 @@
+//===----------------------------------------------------------------------===//
+// Session.cpp: This file implements sessions, sources are parsed lazily and
+// run by the session's execution manager.
+//===----------------------------------------------------------------------===//
+#include "Session.h"
+#include "AST.h"
+#include "JSLexer.h"
+#include "JSParser.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <list>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace minijsc {
+
+// The document only grows once the source is parsed, a syntax error leaves the
+// session unchanged.
+auto Session::eval(std::string source) -> EditStats {
+    auto begin = document.size();
+    document.append(source);
+    std::vector<Unit> parsed;
+    try {
+        parsed = parse(begin, document.size());
+    } catch (...) {
+        document.resize(begin);
+        throw;
+    }
+    units.insert(units.end(), parsed.begin(), parsed.end());
+    run(parsed);
+    return {units.size() - parsed.size(), parsed.size()};
+}
+
+// A statement is reused when it ends strictly before the edited range, a
+// statement ending right where the edit starts may be continued by it (an
+// `if` gaining an `else`). Likewise for statements after the edited range.
+auto Session::update(std::string source) -> EditStats {
+    auto oldSize = document.size();
+    auto newSize = source.size();
+    auto prefix  = static_cast<size_t>(
+        std::ranges::mismatch(document, source).in1 - document.begin());
+    size_t suffix = 0;
+    while (suffix < std::min(oldSize, newSize) - prefix &&
+           document[oldSize - suffix - 1] == source[newSize - suffix - 1]) {
+        suffix++;
+    }
+
+    size_t first = 0;
+    while (first < units.size() && units[first].end < prefix) {
+        first++;
+    }
+    auto last = units.size();
+    while (last > first && units[last - 1].begin > oldSize - suffix) {
+        last--;
+    }
+    auto begin = first > 0 ? units[first - 1].end : 0;
+    auto end = last < units.size() ? units[last].begin + newSize - oldSize
+                                   : newSize;
+
+    auto previous = std::exchange(document, std::move(source));
+    std::vector<Unit> parsed;
+    try {
+        parsed = parse(begin, end);
+    } catch (...) {
+        document = std::move(previous);
+        throw;
+    }
+    for (auto idx = last; idx < units.size(); idx++) {
+        units[idx].begin += newSize - oldSize;
+        units[idx].end += newSize - oldSize;
+    }
+    EditStats stats{first + units.size() - last, parsed.size()};
+    units.erase(units.begin() + static_cast<std::ptrdiff_t>(first),
+                units.begin() + static_cast<std::ptrdiff_t>(last));
+    units.insert(units.begin() + static_cast<std::ptrdiff_t>(first),
+                 parsed.begin(), parsed.end());
+    run(parsed);
+    release();
+    return stats;
+}
+
+auto Session::getStmts() const -> std::vector<JSStmt*> {
+    std::vector<JSStmt*> stmts;
+    stmts.reserve(units.size());
+    for (const auto& unit : units) {
+        stmts.push_back(unit.stmt);
+    }
+    return stmts;
+}
+
+// Only the parsed range is copied, the copy is what the tokens point into
+// since the document changes with every edit.
+auto Session::parse(size_t begin, size_t end) -> std::vector<Unit> {
+    auto& source = sources.emplace_back(
+        Source{document.substr(begin, end - begin), std::nullopt});
+    const auto& text = source.text;
+    try {
+        auto lexer  = JSLexer(text);
+        auto parser = JSParser(lexer);
+        parser.setLazyFunctions(true);
+        source.program.emplace(parser.parse());
+    } catch (...) {
+        sources.pop_back();
+        throw;
+    }
+    const auto& program = *source.program;
+    std::vector<Unit> parsed;
+    parsed.reserve(program.size());
+    for (size_t idx = 0; idx < program.size(); idx++) {
+        auto stmtText = program.getSources()[idx];
+        auto offset =
+            begin + static_cast<size_t>(stmtText.data() - text.data());
+        parsed.push_back(
+            {program[idx], &source, offset, offset + stmtText.size()});
+    }
+    return parsed;
+}
+
+auto Session::run(std::span<const Unit> parsed) -> void {
+    std::vector<JSStmt*> stmts;
+    stmts.reserve(parsed.size());
+    for (const auto& unit : parsed) {
+        stmts.push_back(unit.stmt);
+    }
+    manager.run(stmts);
+}
+
+// Only edits drop statements, the sources of the dropped statements are
+// released once the statements replacing them ran.
+auto Session::release() -> void {
+    std::unordered_set<const Source*> live;
+    for (const auto& unit : units) {
+        live.insert(unit.source);
+    }
+    std::erase_if(sources, [&](const Source& source) {
+        return !live.contains(&source) && !manager.references(source.text);
+    });
+}
+
+} // namespace minijsc
@@ -0,0 +1,126 @@
+//===----------------------------------------------------------------------===//
+// SourceBuffer.cpp: This file implements the source buffer, files are mapped
+// with mmap on POSIX systems and read into an owned string elsewhere.
+//===----------------------------------------------------------------------===//
+#include "SourceBuffer.h"
+#include "fmt/core.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if __has_include(<sys/mman.h>)
+#define MINIJSC_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#endif
+
+namespace minijsc {
+
+#ifdef MINIJSC_HAS_MMAP
+
+// The descriptor is closed as soon as the file is mapped, the mapping keeps
+// the file alive. Empty files can't be mapped and get an empty buffer.
+auto SourceBuffer::mapFile(const std::string& path) -> SourceBuffer {
+    auto fail = [&path](const char* what) {
+        return std::runtime_error(fmt::format("{} '{}': {}", what, path,
+                                              std::strerror(errno)));
+    };
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw fail("cannot open");
+    }
+    struct stat info {};
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw fail("cannot stat");
+    }
+    SourceBuffer buffer;
+    auto length = static_cast<size_t>(info.st_size);
+    if (length == 0) {
+        ::close(fd);
+        return buffer;
+    }
+    auto* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw fail("cannot map");
+    }
+    // The lexer reads the source front to back exactly once.
+    ::madvise(mapping, length, MADV_SEQUENTIAL);
+    buffer.mapping       = mapping;
+    buffer.mappingLength = length;
+    buffer.text          = {static_cast<const char*>(mapping), length};
+    return buffer;
+}
+
+auto SourceBuffer::release() -> void {
+    if (mapping != nullptr) {
+        ::munmap(mapping, mappingLength);
+        mapping       = nullptr;
+        mappingLength = 0;
+    }
+}
+
+#else
+
+// Without mmap the file is read once into an owned string.
+auto SourceBuffer::mapFile(const std::string& path) -> SourceBuffer {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("cannot open '" + path + "'");
+    }
+    return fromString(std::string(std::istreambuf_iterator<char>(file),
+                                  std::istreambuf_iterator<char>()));
+}
+
+auto SourceBuffer::release() -> void {}
+
+#endif
+
+auto SourceBuffer::fromString(std::string text) -> SourceBuffer {
+    SourceBuffer buffer;
+    buffer.owned = std::move(text);
+    buffer.text  = buffer.owned;
+    return buffer;
+}
+
+auto SourceBuffer::borrow(std::string_view text) -> SourceBuffer {
+    SourceBuffer buffer;
+    buffer.text = text;
+    return buffer;
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer&& other) noexcept {
+    *this = std::move(other);
+}
+
+// Moving a short owned string moves its characters, the view is rebuilt
+// from the moved string.
+auto SourceBuffer::operator=(SourceBuffer&& other) noexcept -> SourceBuffer& {
+    if (this == &other) {
+        return *this;
+    }
+    release();
+    auto ownsText =
+        !other.owned.empty() && other.text.data() == other.owned.data();
+    owned         = std::move(other.owned);
+    text          = ownsText ? std::string_view(owned) : other.text;
+    mapping       = std::exchange(other.mapping, nullptr);
+    mappingLength = std::exchange(other.mappingLength, 0);
+    other.text    = {};
+    other.owned.clear();
+    return *this;
+}
+
+SourceBuffer::~SourceBuffer() { release(); }
+
+} // namespace minijsc
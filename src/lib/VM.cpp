@@ -4,14 +4,17 @@
 #include "JSValue.h"
 #include "fmt/core.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <stdexcept>
 #include <string>
 
 namespace minijsc {
 
 /// Run the virtual machine, executing the bytecode loaded.
 auto VM::run() -> VMResult {
-    while (ip < code.size()) {
+    while (ip < activeCode->size()) {
         auto inst = fetch();
         // Since ip is incremented in fetch() we need to substract
         // 1 to grab the proper offset.
@@ -21,14 +24,29 @@ auto VM::run() -> VMResult {
         // fmt::print("Executing instruction : {}\n", (uint8_t)inst);
         switch (inst) {
         case OPCode::Return: {
-            return VMResult::Ok;
+            // Returning from the top level code stops the execution.
+            if (frames.empty()) {
+                return VMResult::Ok;
+            }
+            // Pop the function's frame including the callee slot and push
+            // the returned value for the caller.
+            auto result = pop();
+            stack.resize(base - 1);
+            push(result);
+            auto& frame = frames.back();
+            activeCode  = frame.code;
+            activeCtx   = frame.ctx;
+            ip          = frame.ip;
+            base        = frame.base;
+            frames.pop_back();
+            break;
         }
         case OPCode::Constant: {
             // Next opcode after OPConstant is the byte offset
             // in the constants pool.
             auto offset = fetch();
-            assert(ctx != nullptr);
-            JSBasicValue value = ctx->loadConstant((size_t)offset);
+            assert(activeCtx != nullptr);
+            JSBasicValue value = activeCtx->loadConstant((size_t)offset);
             push(value);
             break;
         }
@@ -60,6 +78,12 @@ auto VM::run() -> VMResult {
         case OPCode::Add: {
             JSBasicValue rhs = pop();
             JSBasicValue lhs = pop();
+            // Strings are concatenated following the interpreter's
+            // overloading of the plus operator.
+            if (lhs.isString() || rhs.isString()) {
+                push(lhs.toString() + rhs.toString());
+                break;
+            }
             JSBasicValue sum =
                 lhs.getValue<JSNumber>() + rhs.getValue<JSNumber>();
             push(sum);
@@ -103,50 +127,112 @@ auto VM::run() -> VMResult {
             push(res);
             break;
         }
-        case OPCode::GreaterEqual:
-        case OPCode::Greater: {
+        case OPCode::GreaterEqual: {
             JSBasicValue rhs = pop();
             JSBasicValue lhs = pop();
             JSBasicValue res = lhs.greaterOrEqual(rhs);
             push(res);
             break;
         }
-        case OPCode::LesserEqual:
-        case OPCode::Lesser: {
+        case OPCode::Greater: {
+            JSBasicValue rhs = pop();
+            JSBasicValue lhs = pop();
+            JSBasicValue res =
+                lhs.greaterOrEqual(rhs) && !lhs.lesserOrEqual(rhs);
+            push(res);
+            break;
+        }
+        case OPCode::LesserEqual: {
             JSBasicValue rhs = pop();
             JSBasicValue lhs = pop();
             JSBasicValue res = lhs.lesserOrEqual(rhs);
             push(res);
             break;
         }
+        case OPCode::Lesser: {
+            JSBasicValue rhs = pop();
+            JSBasicValue lhs = pop();
+            JSBasicValue res =
+                lhs.lesserOrEqual(rhs) && !lhs.greaterOrEqual(rhs);
+            push(res);
+            break;
+        }
+        case OPCode::Pop: {
+            pop();
+            break;
+        }
+        case OPCode::Dup: {
+            push(stack.back());
+            break;
+        }
         case OPCode::SetGlobal: {
             // fetch global constant offset
             auto offset = fetch();
             // load variable name from constants table
-            JSBasicValue name = ctx->loadConstant((size_t)offset);
+            JSBasicValue name = activeCtx->loadConstant((size_t)offset);
             // load value on top of the stack that's assigned
             // to the variable
             auto value = pop();
             auto ident = name.getValue<JSString>();
-            fmt::print("Name : {}\n", ident);
-            fmt::print("Value : {}\n", value.getValue<JSNumber>());
+#ifdef DEBUG_TRACE_EXECUTION
+            fmt::print("SetGlobal {} = {}\n", ident, value.toString());
+#endif
             globals[ident] = value;
             break;
         }
         case OPCode::GetGlobal: {
-            fmt::print("OPCode::GetGlobal");
             // fetch constant offset
             auto offset = fetch();
             // load variable value from constant table
-            JSBasicValue name = ctx->loadConstant((size_t)offset);
+            JSBasicValue name = activeCtx->loadConstant((size_t)offset);
             auto ident        = name.getValue<JSString>();
             auto value        = globals[ident];
-            fmt::print("GetGlobal=>Name : {}\n", ident);
-            fmt::print("GetGlobal=>Value : {}\n", value.getValue<JSNumber>());
-            fmt::print("Pushing value to the stack.");
+#ifdef DEBUG_TRACE_EXECUTION
+            fmt::print("GetGlobal {} = {}\n", ident, value.toString());
+#endif
             push(value);
             break;
         }
+        case OPCode::GetLocal: {
+            // Locals are addressed relative to the frame base.
+            auto slot = (size_t)fetch();
+            push(stack[base + slot]);
+            break;
+        }
+        case OPCode::SetLocal: {
+            // Assignments are expressions, the value is left on the stack.
+            auto slot          = (size_t)fetch();
+            stack[base + slot] = stack.back();
+            break;
+        }
+        case OPCode::Jump: {
+            auto offset = fetchOffset();
+            ip += offset;
+            break;
+        }
+        case OPCode::JumpIfFalse: {
+            auto offset = fetchOffset();
+            if (!isTruthy(pop())) {
+                ip += offset;
+            }
+            break;
+        }
+        case OPCode::Loop: {
+            auto offset = fetchOffset();
+            ip -= offset;
+            backEdges++;
+            break;
+        }
+        case OPCode::Call: {
+            call((size_t)fetch());
+            calls++;
+            break;
+        }
+        case OPCode::TailCall: {
+            tailCall((size_t)fetch());
+            calls++;
+            break;
+        }
         default:
             fmt::print("Unexpected instruction {} ", (uint8_t)inst);
             break;
@@ -156,6 +242,86 @@ auto VM::run() -> VMResult {
     return VMResult::Ok;
 }
 
+/// Calls push a frame saving the caller's state, the callee's frame starts
+/// at its first argument and the callee itself stays in the slot below it.
+/// Missing arguments are undefined and extra arguments are dropped.
+auto VM::call(size_t argc) -> void {
+    auto calleeIdx = stack.size() - argc - 1;
+    auto& callee   = stack[calleeIdx];
+    if (callee.getKind() != JSValueKind::Function) {
+        throw std::runtime_error(fmt::format(
+            "Uncaught type error {} is not a function", callee.toString()));
+    }
+    if (stack.size() >= kMaxStackSize) {
+        throw std::runtime_error("Maximum call stack size exceeded.");
+    }
+    auto func = callee.getValue<JSObjectRef>();
+    auto* fn  = static_cast<JSBytecodeFunction*>(func.get());
+    stack.resize(calleeIdx + 1 + fn->getArity());
+    frames.push_back(CallFrame{func, activeCode, activeCtx, ip, base});
+    activeCode = &fn->getCode();
+    activeCtx  = fn->getContext();
+    ip         = 0;
+    base       = calleeIdx + 1;
+}
+
+/// Tail calls move the callee and its arguments over the executing
+/// function's frame and restart execution at the callee's first instruction,
+/// the caller's saved state is left untouched so the callee returns directly
+/// to it. The stack depth stays constant for any chain of tail calls.
+auto VM::tailCall(size_t argc) -> void {
+    if (frames.empty()) {
+        call(argc);
+        return;
+    }
+    auto calleeIdx = stack.size() - argc - 1;
+    auto& callee   = stack[calleeIdx];
+    if (callee.getKind() != JSValueKind::Function) {
+        throw std::runtime_error(fmt::format(
+            "Uncaught type error {} is not a function", callee.toString()));
+    }
+    auto func = callee.getValue<JSObjectRef>();
+    auto* fn  = static_cast<JSBytecodeFunction*>(func.get());
+    std::move(stack.begin() + static_cast<std::ptrdiff_t>(calleeIdx),
+              stack.end(),
+              stack.begin() + static_cast<std::ptrdiff_t>(base - 1));
+    stack.resize(base + argc);
+    stack.resize(base + fn->getArity());
+    frames.back().func = std::move(func);
+    activeCode         = &fn->getCode();
+    activeCtx          = fn->getContext();
+    ip                 = 0;
+}
+
+/// Host calls are made once the top level code ran to completion, the call
+/// saves an instruction pointer past the end of the top level code so the
+/// execution loop stops when the callee returns to it. A runtime error drops
+/// the frames and values of the call so the VM can be invoked again.
+auto VM::invoke(const JSBasicValue& callee,
+                const std::vector<JSBasicValue>& args) -> JSBasicValue {
+    activeCode = &code;
+    activeCtx  = ctx.get();
+    ip         = static_cast<uint32_t>(code.size());
+    auto depth     = frames.size();
+    auto top       = stack.size();
+    auto savedBase = base;
+    push(callee);
+    for (const auto& arg : args) {
+        push(arg);
+    }
+    try {
+        call(args.size());
+        run();
+    } catch (...) {
+        frames.erase(frames.begin() + static_cast<std::ptrdiff_t>(depth),
+                     frames.end());
+        stack.resize(top);
+        base = savedBase;
+        throw;
+    }
+    return pop();
+}
+
 /// Display the contents of stack.
 auto VM::displayStack() -> void {
     fmt::print("        ");
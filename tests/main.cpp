@@ -1,8 +1,14 @@
 #include "AST.h"
 #include "ASTOptimizer.h"
+#include "ASTSerializer.h"
 #include "BytecodeCompiler.h"
+#include "ClosureCompiler.h"
+#include "ExecutionManager.h"
 #include "Interpreter.h"
+#include "JSCallable.h"
 #include "JSParser.h"
+#include "PurityAnalyzer.h"
+#include "Session.h"
 #include <memory>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
@@ -13,7 +19,11 @@
 #include "JSLexer.h"
 #include "JSParser.h"
 #include "JSToken.h"
+#include "JSTokenStream.h"
+#include "SourceBuffer.h"
 #include "JSValue.h"
+#include "ParallelLexer.h"
+#include "ParallelParser.h"
 
 #include "Bytecode.h"
 #include "Jit.h"
@@ -24,6 +34,8 @@
 #include <cstdio>
 
 #include <algorithm>
+#include <filesystem>
+#include <fstream>
 #include <optional>
 #include <string>
 #include <variant>
@@ -50,6 +62,16 @@ TEST_CASE("check that all JavaScript keywords are handled") {
         INFO("Checking keyword: ", keyword);
         CHECK(iter != jsKeywords.end());
     }
+
+    for (const auto& [keyword, kind] : jsKeywords) {
+        INFO("Looking up keyword: ", keyword);
+        CHECK(lookupKeyword(keyword) == kind);
+    }
+    for (const auto* name : {"d", "doo", "iff", "thus", "tru", "constant",
+                             "functions", "Function", "instanceOf"}) {
+        INFO("Looking up identifier: ", name);
+        CHECK(lookupKeyword(name) == JSTokenKind::Identifier);
+    }
 }
 
 TEST_CASE("testing the lexing of single character tokens") {
@@ -148,6 +170,62 @@ TEST_CASE("testing the lexing of multicharacter tokens") {
     }
 }
 
+TEST_CASE("testing the lexing of token spans") {
+    std::string source = "var s = \"hi\" + 2.5;";
+    auto lexer         = JSLexer(source);
+    auto tokens        = lexer.scanTokens();
+
+    CHECK(sizeof(JSToken) == 16);
+    REQUIRE(tokens.size() == 8);
+    CHECK(tokens[1].getLexeme() == "s");
+    CHECK(tokens[1].getLexeme().data() == source.data() + 4);
+    CHECK(tokens[3].getLexeme() == "\"hi\"");
+    CHECK(tokens[3].getLiteral().getValue<JSString>() == "hi");
+    CHECK(tokens[4].getLexeme() == "+");
+    CHECK(tokens[5].getLiteral().getValue<JSNumber>() == 2.5);
+    CHECK(tokens[7].getLexeme().empty());
+}
+
+TEST_CASE("testing the lexing with each scanning kernel") {
+    // Runs longer than a vector block, runs ending at every offset of a
+    // block and a source ending in the middle of runs.
+    std::string source = "var identifier_spanning_more_than_32_chars = "
+                         "\"a string longer than a 32 bytes block\n"
+                         "spanning two lines\";\n"
+                         "x  \t\r      \t                         = "
+                         "12345678901234567890123456789012345.5;\n";
+    for (size_t len = 1; len < 40; len++) {
+        source += std::string(len, 'a') + std::string(len, ' ') +
+                  std::string(len, '7') + " \"" + std::string(len, 's') +
+                  "\" ";
+    }
+    source += "tail_identifier 42";
+
+    auto scalar   = JSLexer(source, ScanIsa::Scalar).scanTokens();
+    auto expected = std::vector<std::string_view>{};
+    for (const auto& token : scalar) {
+        expected.push_back(token.getLexeme());
+    }
+    CHECK(scalar.size() == 129);
+    CHECK(expected[1] == "identifier_spanning_more_than_32_chars");
+    CHECK(expected[3].size() == 58);
+    CHECK(expected[7] == "12345678901234567890123456789012345.5");
+
+    for (auto isa : {ScanIsa::SSE2, ScanIsa::AVX2}) {
+        if (!isScanIsaSupported(isa)) {
+            continue;
+        }
+        INFO("Scanning with ISA ", static_cast<int>(isa));
+        auto lexer  = JSLexer(source, isa);
+        auto tokens = lexer.scanTokens();
+        REQUIRE(tokens.size() == scalar.size());
+        for (size_t idx = 0; idx < tokens.size(); idx++) {
+            CHECK(tokens[idx].getKind() == scalar[idx].getKind());
+            CHECK(tokens[idx].getLexeme() == expected[idx]);
+        }
+    }
+}
+
 TEST_CASE("testing the lexing of statements and expressions") {
     SUBCASE("statement to assign an expression to a variable") {
         auto source = "var a = 3.14 + 7.86;";
@@ -266,6 +344,130 @@ TEST_CASE("testing the lexing of statements and expressions") {
     }
 }
 
+TEST_CASE("testing parallel lexing") {
+    // Strings spanning lines must not be split.
+    std::string source;
+    for (size_t idx = 0; idx < 200; idx++) {
+        source += "var v" + std::to_string(idx) + " = \"first line\n" +
+                  std::string(idx % 7, ' ') +
+                  "second line\" + " + std::to_string(idx) + ";\n";
+    }
+
+    SUBCASE("chunks end after newlines outside of strings") {
+        auto chunks = splitSource(source, 8, 64);
+        CHECK(chunks.size() == 8);
+        size_t length = 0;
+        for (const auto& chunk : chunks) {
+            CHECK(chunk.data() == source.data() + length);
+            length += chunk.length();
+            CHECK(chunk.ends_with(";\n"));
+        }
+        CHECK(length == source.size());
+    }
+    SUBCASE("small sources are a single chunk") {
+        CHECK(splitSource(source, 8).size() == 1);
+        CHECK(splitSource("x;\ny;\n", 4, 1).size() == 2);
+    }
+    SUBCASE("parallel lexing yields the sequential tokens") {
+        auto sequential = JSLexer(source).scanTokens();
+        auto parallel   = lexParallel(source, 8, 64);
+        REQUIRE(parallel.size() == sequential.size());
+        for (size_t idx = 0; idx < parallel.size(); idx++) {
+            CHECK(parallel[idx].getKind() == sequential[idx].getKind());
+            CHECK(parallel[idx].getLexeme().data() ==
+                  sequential[idx].getLexeme().data());
+            CHECK(parallel[idx].getLexeme().size() ==
+                  sequential[idx].getLexeme().size());
+        }
+    }
+}
+
+TEST_CASE("testing source buffers") {
+    SUBCASE("mapping a file") {
+        auto path = std::filesystem::temp_directory_path() /
+                    "minijsc_source_buffer.js";
+        {
+            std::ofstream file(path);
+            file << "var x = 42;\n";
+        }
+        auto buffer = SourceBuffer::mapFile(path.string());
+        std::filesystem::remove(path);
+        CHECK(buffer.getText() == "var x = 42;\n");
+        auto tokens = JSLexer(buffer).scanTokens();
+        REQUIRE(tokens.size() == 6);
+        CHECK(tokens[1].getLexeme().data() == buffer.getText().data() + 4);
+        CHECK(tokens[3].getLiteral().getValue<JSNumber>() == 42.);
+    }
+    SUBCASE("mapping a missing file throws") {
+        CHECK_THROWS_AS(SourceBuffer::mapFile("/nonexistent/minijsc.js"),
+                        std::runtime_error);
+    }
+    SUBCASE("owned and borrowed text survive moves") {
+        auto owned = SourceBuffer::fromString("x;");
+        auto moved = std::move(owned);
+        CHECK(moved.getText() == "x;");
+        CHECK(owned.getText().empty());
+
+        const std::string text = "let y;";
+        auto borrowed          = SourceBuffer::borrow(text);
+        auto other             = std::move(borrowed);
+        CHECK(other.getText().data() == text.data());
+        CHECK_FALSE(other.isMapped());
+    }
+}
+
+TEST_CASE("testing the token stream") {
+    std::string source = "var x = 1;\nfunction f(a, b) { return a + b; }\n"
+                         "while (x < 10) { x = f(x, 2); }\n";
+    auto batch    = JSLexer(source).scanTokens();
+
+    SUBCASE("pulling tokens from the lexer yields the batch tokens") {
+        auto lexer  = JSLexer(source);
+        auto stream = JSTokenStream(lexer);
+        for (const auto& token : batch) {
+            CHECK(stream.peek().getKind() == token.getKind());
+            CHECK(stream.peek().getLexeme() == token.getLexeme());
+            stream.advance();
+            CHECK(stream.previous().getLexeme() == token.getLexeme());
+        }
+        CHECK(stream.peek().getKind() == JSTokenKind::Eof);
+        CHECK(lexer.getTokens().size() <= 1);
+    }
+    SUBCASE("peeking ahead within the window") {
+        auto lexer  = JSLexer(source);
+        auto stream = JSTokenStream(lexer);
+        CHECK(stream.peek(kMaxLookahead).getLexeme() == "=");
+        CHECK(stream.peek(1).getLexeme() == "x");
+        stream.advance();
+        stream.advance();
+        CHECK(stream.previous().getLexeme() == "x");
+        CHECK(stream.peek(kMaxLookahead).getLexeme() == ";");
+    }
+    SUBCASE("reading past the end yields Eof") {
+        auto stream = JSTokenStream(JSLexer("x").scanTokens());
+        stream.advance();
+        for (size_t idx = 0; idx < 2 * kTokenWindow; idx++) {
+            CHECK(stream.peek().getKind() == JSTokenKind::Eof);
+            stream.advance();
+        }
+    }
+    SUBCASE("parsing from a lexer and from tokens build the same program") {
+        auto lexer    = JSLexer(source);
+        auto streamed = JSParser(lexer).parse();
+        auto parsed   = JSParser(batch).parse();
+        REQUIRE(streamed.size() == parsed.size());
+        for (size_t idx = 0; idx < parsed.size(); idx++) {
+            CHECK(streamed[idx]->getKind() == parsed[idx]->getKind());
+        }
+
+        auto interpreter = Interpreter();
+        interpreter.run(streamed);
+        auto* value = interpreter.getEnvironment().resolveBinding("x");
+        REQUIRE(value != nullptr);
+        CHECK(value->getValue<JSNumber>() == 11.);
+    }
+}
+
 TEST_CASE("testing the JSBasicValue class") {
     JSBasicValue var(3.14);
 
@@ -280,6 +482,44 @@ TEST_CASE("testing the JSBasicValue class") {
     CHECK(undefined.isUndefined() == true);
 }
 
+TEST_CASE("testing the runtime environment") {
+    Environment env;
+    env.defineBinding("a", JSBasicValue(1.));
+    env.pushFrame();
+    env.defineBinding("b", JSBasicValue(2.));
+    CHECK(env.getDepth() == 2);
+    CHECK(env.resolveBinding("a")->getValue<JSNumber>() == 1.);
+    CHECK(env.resolveLocal("a") == nullptr);
+    CHECK(env.assign("a", JSBasicValue(3.)) == true);
+    env.popFrame();
+    CHECK(env.getDepth() == 1);
+    CHECK(env.resolveBinding("b") == nullptr);
+    CHECK(env.resolveBinding("a")->getValue<JSNumber>() == 3.);
+    CHECK(env.assign("b", JSBasicValue(4.)) == false);
+
+    SUBCASE("testing global bindings lookup") {
+        std::vector<std::string> names;
+        for (auto i = 0; i < 1000; i++) {
+            names.push_back(fmt::format("g{}", i));
+        }
+        for (auto i = 0; i < 1000; i++) {
+            env.defineBinding(names[i], JSBasicValue(double(i)));
+        }
+        env.defineBinding("g500", JSBasicValue(-1.));
+        env.pushFrame();
+        env.defineBinding("g7", JSBasicValue(7.5));
+        CHECK(env.resolveBinding("g7")->getValue<JSNumber>() == 7.5);
+        CHECK(env.resolveBinding("g999")->getValue<JSNumber>() == 999.);
+        CHECK(env.assign("g42", JSBasicValue(0.)) == true);
+        env.popFrame();
+        CHECK(env.getTop() == 1001);
+        CHECK(env.resolveBinding("g7")->getValue<JSNumber>() == 7.);
+        CHECK(env.resolveBinding("g42")->getValue<JSNumber>() == 0.);
+        CHECK(env.resolveBinding("g500")->getValue<JSNumber>() == -1.);
+        CHECK(env.resolveBinding("g1000") == nullptr);
+    }
+}
+
 TEST_CASE("testing the parser") {
     SUBCASE("testing the parser match") {
         auto source = R"(
@@ -303,7 +543,7 @@ TEST_CASE("testing the parser") {
         auto tokens = lexer.scanTokens();
         auto parser = JSParser(tokens);
         auto expr   = parser.parsePrimaryExpr();
-        CHECK(expr.get()->getKind() == ASTNodeKind::LiteralExpr);
+        CHECK(expr->getKind() == ASTNodeKind::LiteralExpr);
     }
     SUBCASE("test parsing expressions/comparison(not equal)") {
         auto source = "1 != 2;";
@@ -311,7 +551,7 @@ TEST_CASE("testing the parser") {
         auto tokens = lexer.scanTokens();
         auto parser = JSParser(std::move(tokens));
         auto expr   = parser.parseExpr();
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test parsing expressions/comparison(equal)") {
         auto source = "2 == 2;";
@@ -319,7 +559,7 @@ TEST_CASE("testing the parser") {
         auto tokens = lexer.scanTokens();
         auto parser = JSParser(std::move(tokens));
         auto expr   = parser.parseExpr();
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test parsing expressions/term(plus)") {
         auto source = "1 + 2;";
@@ -327,7 +567,7 @@ TEST_CASE("testing the parser") {
         auto tokens = lexer.scanTokens();
         auto parser = JSParser(std::move(tokens));
         auto expr   = parser.parseExpr();
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test parsing expressions/factor(star)") {
         auto source = "1 + 2 * 3;";
@@ -335,7 +575,7 @@ TEST_CASE("testing the parser") {
         auto tokens = lexer.scanTokens();
         auto parser = JSParser(std::move(tokens));
         auto expr   = parser.parseExpr();
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test parsing expressions/grouping(comparison)") {
         auto source = "(4 == 2);";
@@ -343,7 +583,7 @@ TEST_CASE("testing the parser") {
         auto tokens = lexer.scanTokens();
         auto parser = JSParser(std::move(tokens));
         auto expr   = parser.parseExpr();
-        CHECK(expr.get()->getKind() == ASTNodeKind::GroupingExpr);
+        CHECK(expr->getKind() == ASTNodeKind::GroupingExpr);
     }
     SUBCASE("test parsing expressions/comparison(grouping)") {
         auto source = "3 == (1 + 2);";
@@ -361,7 +601,237 @@ TEST_CASE("testing the parser") {
         }
         auto parser = JSParser(std::move(tokens));
         auto expr   = parser.parseExpr();
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
+    }
+    SUBCASE("test parsing expressions/precedence and associativity") {
+        auto parser = JSParser(JSLexer("1 - 2 * 3 - -f(4)(5);").scanTokens());
+        auto* expr  = parser.parseExpr();
+        REQUIRE(expr->getKind() == ASTNodeKind::BinaryExpr);
+        // ((1 - (2 * 3)) - (-(f(4)(5))))
+        auto* outer = static_cast<JSBinExpr*>(expr);
+        REQUIRE(outer->getLeft()->getKind() == ASTNodeKind::BinaryExpr);
+        auto* inner = static_cast<JSBinExpr*>(outer->getLeft());
+        CHECK(inner->getLeft()->getKind() == ASTNodeKind::LiteralExpr);
+        CHECK(inner->getRight()->getKind() == ASTNodeKind::BinaryExpr);
+        REQUIRE(outer->getRight()->getKind() == ASTNodeKind::UnaryExpr);
+        auto* negated = static_cast<JSUnaryExpr*>(outer->getRight());
+        REQUIRE(negated->getRight()->getKind() == ASTNodeKind::CallExpr);
+        auto* call = static_cast<JSCallExpr*>(negated->getRight());
+        CHECK(call->getCallee()->getKind() == ASTNodeKind::CallExpr);
+    }
+    SUBCASE("test parsing expressions/logical and assignment") {
+        auto parser = JSParser(JSLexer("a = b = c || d && e;").scanTokens());
+        auto* expr  = parser.parseExpr();
+        REQUIRE(expr->getKind() == ASTNodeKind::AssignExpr);
+        auto* assign = static_cast<JSAssignExpr*>(expr);
+        CHECK(assign->getName().getLexeme() == "a");
+        REQUIRE(assign->getValue()->getKind() == ASTNodeKind::AssignExpr);
+        auto* value =
+            static_cast<JSAssignExpr*>(assign->getValue())->getValue();
+        REQUIRE(value->getKind() == ASTNodeKind::LogicalExpr);
+        auto* logical = static_cast<JSLogicalExpr*>(value);
+        CHECK(logical->getOperator().getKind() == JSTokenKind::Or);
+        CHECK(logical->getRight()->getKind() == ASTNodeKind::LogicalExpr);
+    }
+    SUBCASE("test parsing expressions/invalid assignment target") {
+        auto parser = JSParser(JSLexer("a + b = c;").scanTokens());
+        CHECK_THROWS(parser.parseExpr());
+    }
+    SUBCASE("test parsing expressions/binding power table") {
+        CHECK(getInfixPrecedence(JSTokenKind::Star) >
+              getInfixPrecedence(JSTokenKind::Plus));
+        CHECK(getInfixPrecedence(JSTokenKind::And) >
+              getInfixPrecedence(JSTokenKind::Or));
+        CHECK(getInfixPrecedence(JSTokenKind::Semicolon) == Precedence::None);
+        CHECK(getInfixPrecedence(JSTokenKind::Bang) == Precedence::None);
+    }
+    SUBCASE("test parsing statements/break(outside loop)") {
+        auto source = "function f() { break; }";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        CHECK_THROWS(parser.parse());
+    }
+}
+
+TEST_CASE("testing the syntax tree arena") {
+    SUBCASE("arena nodes are destroyed with the arena") {
+        static auto destroyed = 0;
+        struct Tracked {
+            ~Tracked() { destroyed++; }
+        };
+        {
+            auto arena = ASTArena();
+            arena.make<Tracked>();
+            arena.make<Tracked>();
+            arena.make<int>(42);
+            CHECK(arena.getNodeCount() == 3);
+            CHECK(destroyed == 0);
+        }
+        CHECK(destroyed == 2);
+    }
+    SUBCASE("large arrays get a chunk of their own") {
+        auto arena  = ASTArena();
+        auto values = std::vector<uint64_t>(kArenaChunkSize, 7);
+        auto copied = arena.copy(values);
+        REQUIRE(copied.size() == values.size());
+        CHECK(std::equal(copied.begin(), copied.end(), values.begin()));
+        CHECK(arena.getReservedBytes() >= values.size() * sizeof(uint64_t));
+    }
+    SUBCASE("programs own the arena of their syntax tree") {
+        auto parser = JSParser(
+            JSLexer("function add(a, b) { return a + b; } add(1, 2);")
+                .scanTokens());
+        auto program = parser.parse();
+        CHECK(parser.getArena().getNodeCount() == 0);
+        CHECK(program.getArena().getNodeCount() > 0);
+        REQUIRE(program.size() == 2);
+        auto* add = static_cast<JSFuncDecl*>(program[0]);
+        REQUIRE(add->getParamNames().size() == 2);
+        CHECK(add->getParamNames()[1] == "b");
+
+        auto interpreter = Interpreter();
+        interpreter.run(program);
+    }
+}
+
+TEST_CASE("testing lazy function parsing") {
+    auto source = R"(
+        function unused(a) { var x = ; return a(x[0]); }
+        function square(n) { return n * n; }
+        function fib(n) {
+            if (n < 2) { return n; }
+            return fib(n - 1) + fib(n - 2);
+        }
+        var result = square(fib(10));
+    )";
+    SUBCASE("bodies are only parsed when needed") {
+        auto lexer  = JSLexer(source);
+        auto parser = JSParser(lexer);
+        parser.setLazyFunctions(true);
+        auto program = parser.parse();
+        REQUIRE(program.size() == 4);
+        auto* unused = static_cast<JSFuncDecl*>(program[0]);
+        auto* square = static_cast<JSFuncDecl*>(program[1]);
+        auto* fib    = static_cast<JSFuncDecl*>(program[2]);
+        CHECK_FALSE(unused->isBodyParsed());
+        CHECK_FALSE(square->isBodyParsed());
+        CHECK(square->getBodySource() == "{ return n * n; }");
+
+        auto interpreter = Interpreter();
+        interpreter.run(program);
+        auto* value = interpreter.getEnvironment().resolveBinding("result");
+        REQUIRE(value != nullptr);
+        CHECK(value->getValue<JSNumber>() == 3025.);
+        CHECK_FALSE(unused->isBodyParsed());
+        CHECK(square->isBodyParsed());
+        CHECK(fib->isPure());
+        CHECK_FALSE(unused->isPure());
+    }
+    SUBCASE("pre-parsing rejects unbalanced bodies") {
+        auto lexer  = JSLexer("function f() { return (1; } var x = 1;");
+        auto parser = JSParser(lexer);
+        parser.setLazyFunctions(true);
+        CHECK_THROWS(parser.parse());
+    }
+}
+
+TEST_CASE("testing parallel parsing") {
+    std::string source;
+    for (size_t idx = 0; idx < 16; idx++) {
+        source += fmt::format("function f{0}(n) {{\n"
+                              "    function g(m) {{ return m + {0}; }}\n"
+                              "    if (n > 0) {{ return g(n); }}\n"
+                              "    return {0};\n"
+                              "}}\n",
+                              idx);
+    }
+    source += "var total = f3(1) + f15(0);\n";
+    SUBCASE("bodies are parsed in the program's order") {
+        auto program = parseParallel(source, 4, 1);
+        auto eager   = JSParser(JSLexer(source).scanTokens()).parse();
+        REQUIRE(program.size() == eager.size());
+        for (size_t idx = 0; idx < program.size(); idx++) {
+            REQUIRE(program[idx]->getKind() == eager[idx]->getKind());
+            if (program[idx]->getKind() != ASTNodeKind::FuncDecl) {
+                continue;
+            }
+            auto* decl = static_cast<JSFuncDecl*>(program[idx]);
+            REQUIRE(decl->isBodyParsed());
+            auto* eagerDecl = static_cast<JSFuncDecl*>(eager[idx]);
+            CHECK(decl->getName().getLexeme() ==
+                  eagerDecl->getName().getLexeme());
+            CHECK(decl->getBody()->getStmts().size() ==
+                  eagerDecl->getBody()->getStmts().size());
+        }
+
+        auto interpreter = Interpreter();
+        interpreter.run(program);
+        auto* value = interpreter.getEnvironment().resolveBinding("total");
+        REQUIRE(value != nullptr);
+        CHECK(value->getValue<JSNumber>() == 19.);
+    }
+    SUBCASE("small programs are parsed on the calling thread") {
+        auto program = parseParallel(source, 4);
+        for (auto* stmt : program) {
+            if (stmt->getKind() == ASTNodeKind::FuncDecl) {
+                CHECK(static_cast<JSFuncDecl*>(stmt)->isBodyParsed());
+            }
+        }
+    }
+    SUBCASE("errors in bodies are reported") {
+        auto invalid = source + "function h() { var = 1; }\n";
+        CHECK_THROWS(parseParallel(invalid, 4, 1));
+    }
+}
+
+TEST_CASE("testing syntax tree serialization") {
+    auto source = std::string(R"(
+        function fib(n) {
+            if (n < 2) { return n; }
+            return fib(n - 1) + fib(n - 2);
+        }
+        var label = "fib";
+        var result = 0;
+        for (var i = 0; i < 10; i = i + 1) {
+            if (i == 8) { break; }
+            if (!(i > 2) || i == 5) { continue; }
+            result = result + fib(i) * -1.5;
+        }
+        while (false) {}
+        var done = null;
+    )");
+    auto serialized = ASTSerializer().serialize(
+        JSParser(JSLexer(source).scanTokens()).parse());
+    REQUIRE(isSerializedAST(serialized));
+    SUBCASE("deserialized programs serialize back to the same bytes") {
+        auto program = ASTDeserializer(serialized).deserialize();
+        CHECK(ASTSerializer().serialize(program) == serialized);
+    }
+    SUBCASE("deserialized programs don't depend on the source") {
+        auto data    = serialized;
+        auto program = ASTDeserializer(data).deserialize();
+        source.assign(source.size(), ' ');
+        data.assign(data.size(), '\0');
+
+        auto interpreter = Interpreter();
+        interpreter.run(program);
+        auto* result = interpreter.getEnvironment().resolveBinding("result");
+        REQUIRE(result != nullptr);
+        CHECK(result->getValue<JSNumber>() == -39.);
+        auto* label = interpreter.getEnvironment().resolveBinding("label");
+        REQUIRE(label != nullptr);
+        CHECK(label->getValue<JSString>() == "fib");
+    }
+    SUBCASE("malformed data is rejected") {
+        CHECK_THROWS_AS(ASTDeserializer("").deserialize(), std::runtime_error);
+        CHECK_THROWS_AS(ASTDeserializer("MJSA\x7f").deserialize(),
+                        std::runtime_error);
+        for (size_t length = 0; length < serialized.size(); length++) {
+            auto truncated = std::string_view(serialized).substr(0, length);
+            CHECK_THROWS_AS(ASTDeserializer(truncated).deserialize(),
+                            std::runtime_error);
+        }
     }
 }
 
@@ -373,10 +843,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value = (JSBasicValue*)interpreter.evaluate(expr.get()).get();
-        CHECK(value->isBoolean() == true);
-        CHECK(value->getValue<JSBoolean>() == JSBoolean(true));
-        CHECK(expr.get()->getKind() == ASTNodeKind::LiteralExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isBoolean() == true);
+        CHECK(value.getValue<JSBoolean>() == JSBoolean(true));
+        CHECK(expr->getKind() == ASTNodeKind::LiteralExpr);
     }
     SUBCASE("test interpreting boolean literal(false)") {
         auto source      = "false;";
@@ -385,10 +855,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value = (JSBasicValue*)interpreter.evaluate(expr.get()).get();
-        CHECK(value->isBoolean() == true);
-        CHECK(value->getValue<JSBoolean>() == JSBoolean(false));
-        CHECK(expr.get()->getKind() == ASTNodeKind::LiteralExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isBoolean() == true);
+        CHECK(value.getValue<JSBoolean>() == JSBoolean(false));
+        CHECK(expr->getKind() == ASTNodeKind::LiteralExpr);
     }
     SUBCASE("test interpreting unary expressions (-1)") {
         auto source      = "-1;";
@@ -397,12 +867,11 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        fmt::print("test/ {}\n", value->toString());
-        CHECK(value->isNumber() == true);
-        CHECK(value->getValue<JSNumber>() == JSNumber(-1));
-        CHECK(expr.get()->getKind() == ASTNodeKind::UnaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        fmt::print("test/ {}\n", value.toString());
+        CHECK(value.isNumber() == true);
+        CHECK(value.getValue<JSNumber>() == JSNumber(-1));
+        CHECK(expr->getKind() == ASTNodeKind::UnaryExpr);
     }
     SUBCASE("test interpreting unary expressions (truthy/undefined)") {
         auto source      = "!undefined;";
@@ -411,11 +880,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isBoolean() == true);
-        CHECK(value->getValue<JSBoolean>() == JSBoolean(true));
-        CHECK(expr.get()->getKind() == ASTNodeKind::UnaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isBoolean() == true);
+        CHECK(value.getValue<JSBoolean>() == JSBoolean(true));
+        CHECK(expr->getKind() == ASTNodeKind::UnaryExpr);
     }
     SUBCASE("test interpreting unary expressions (truthy/null)") {
         auto source      = "!null;";
@@ -424,11 +892,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isBoolean() == true);
-        CHECK(value->getValue<JSBoolean>() == JSBoolean(true));
-        CHECK(expr.get()->getKind() == ASTNodeKind::UnaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isBoolean() == true);
+        CHECK(value.getValue<JSBoolean>() == JSBoolean(true));
+        CHECK(expr->getKind() == ASTNodeKind::UnaryExpr);
     }
     SUBCASE("test interpreting binary expressions (add)") {
         auto source      = "1 + 3;";
@@ -437,11 +904,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isNumber() == true);
-        CHECK(value->getValue<JSNumber>() == JSNumber(4));
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isNumber() == true);
+        CHECK(value.getValue<JSNumber>() == JSNumber(4));
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test interpreting grouped expressions (add/mul)") {
         auto source      = "(1 + 3) * 5;";
@@ -450,11 +916,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isNumber() == true);
-        CHECK(value->getValue<JSNumber>() == JSNumber(20));
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isNumber() == true);
+        CHECK(value.getValue<JSNumber>() == JSNumber(20));
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test interpreting grouped expressions (mul/add)") {
         auto source      = "(3 * 5) + 1;";
@@ -463,11 +928,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isNumber() == true);
-        CHECK(value->getValue<JSNumber>() == JSNumber(16));
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isNumber() == true);
+        CHECK(value.getValue<JSNumber>() == JSNumber(16));
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test interpreting unary expressions (!false)") {
         auto source      = "!false;";
@@ -476,11 +940,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isBoolean() == true);
-        CHECK(value->getValue<JSBoolean>() == JSBoolean(true));
-        CHECK(expr.get()->getKind() == ASTNodeKind::UnaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isBoolean() == true);
+        CHECK(value.getValue<JSBoolean>() == JSBoolean(true));
+        CHECK(expr->getKind() == ASTNodeKind::UnaryExpr);
     }
     SUBCASE("test interpreting binary expressions (add)") {
         auto source      = "1 + 3;";
@@ -489,11 +952,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isNumber() == true);
-        CHECK(value->getValue<JSNumber>() == JSNumber(4));
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isNumber() == true);
+        CHECK(value.getValue<JSNumber>() == JSNumber(4));
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test interpreting grouped expressions (add/mul)") {
         auto source      = "(1 + 3) * 5;";
@@ -502,11 +964,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isNumber() == true);
-        CHECK(value->getValue<JSNumber>() == JSNumber(20));
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isNumber() == true);
+        CHECK(value.getValue<JSNumber>() == JSNumber(20));
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test interpreting grouped expressions (mul/add)") {
         auto source      = "(3 * 5) + 1;";
@@ -515,11 +976,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isNumber() == true);
-        CHECK(value->getValue<JSNumber>() == JSNumber(16));
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isNumber() == true);
+        CHECK(value.getValue<JSNumber>() == JSNumber(16));
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test interpreting grouped expressions (add/mul) no parenthesis") {
         auto source      = "1 + 3 * 5;";
@@ -528,11 +988,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isNumber() == true);
-        CHECK(value->getValue<JSNumber>() == JSNumber(16));
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isNumber() == true);
+        CHECK(value.getValue<JSNumber>() == JSNumber(16));
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test interpreting binary expressions (comparison/greater_equal)") {
         auto source      = "5 >= 5;";
@@ -541,11 +1000,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isBoolean() == true);
-        CHECK(value->getValue<JSBoolean>() == true);
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isBoolean() == true);
+        CHECK(value.getValue<JSBoolean>() == true);
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test interpreting binary expressions (comparison/greater)") {
         auto source      = "5 > 4;";
@@ -554,11 +1012,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isBoolean() == true);
-        CHECK(value->getValue<JSBoolean>() == true);
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isBoolean() == true);
+        CHECK(value.getValue<JSBoolean>() == true);
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test interpreting binary expressions (comparison/lesser_equal)") {
         auto source      = "4 <= 4;";
@@ -567,11 +1024,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isBoolean() == true);
-        CHECK(value->getValue<JSBoolean>() == true);
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isBoolean() == true);
+        CHECK(value.getValue<JSBoolean>() == true);
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test interpreting binary expressions (comparison/lesser)") {
         auto source      = "3 < 4;";
@@ -580,11 +1036,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isBoolean() == true);
-        CHECK(value->getValue<JSBoolean>() == true);
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isBoolean() == true);
+        CHECK(value.getValue<JSBoolean>() == true);
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test interpreting binary expressions (comparison/unequal") {
         auto source      = "3 != 4;";
@@ -593,11 +1048,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isBoolean() == true);
-        CHECK(value->getValue<JSBoolean>() == true);
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isBoolean() == true);
+        CHECK(value.getValue<JSBoolean>() == true);
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
     SUBCASE("test interpreting binary expressions (comparison/equal_equal)") {
         auto source      = "3 == 4;";
@@ -606,11 +1060,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto expr        = parser.parseExpr();
         auto interpreter = Interpreter();
-        auto value       = std::static_pointer_cast<JSBasicValue>(
-            interpreter.evaluate(expr.get()));
-        CHECK(value->isBoolean() == true);
-        CHECK(value->getValue<JSBoolean>() == false);
-        CHECK(expr.get()->getKind() == ASTNodeKind::BinaryExpr);
+        auto value       = interpreter.evaluate(expr);
+        CHECK(value.isBoolean() == true);
+        CHECK(value.getValue<JSBoolean>() == false);
+        CHECK(expr->getKind() == ASTNodeKind::BinaryExpr);
     }
 
     SUBCASE("test interpreting variable declaration") {
@@ -620,10 +1073,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto stmt        = parser.parseDecl();
         auto interpreter = Interpreter();
-        interpreter.execute(stmt.get());
-        auto result = std::static_pointer_cast<JSBasicValue>(
-            interpreter.getEnv(JSToken(JSTokenKind::Identifier, "a", 0.)));
-        REQUIRE(result != nullptr);
+        interpreter.execute(stmt);
+        auto result =
+            interpreter.getEnv(JSToken(JSTokenKind::Identifier, "a"));
+        REQUIRE(result.has_value());
         CHECK((*result).getValue<JSNumber>() == 5.);
     }
     SUBCASE("test interpreting variable declaration/let") {
@@ -633,10 +1086,10 @@ TEST_CASE("testing interpreter evaluate") {
         auto parser      = JSParser(std::move(tokens));
         auto stmt        = parser.parseDecl();
         auto interpreter = Interpreter();
-        interpreter.execute(stmt.get());
-        auto result = std::static_pointer_cast<JSBasicValue>(
-            interpreter.getEnv(JSToken(JSTokenKind::Identifier, "a", 0.)));
-        REQUIRE(result != nullptr);
+        interpreter.execute(stmt);
+        auto result =
+            interpreter.getEnv(JSToken(JSTokenKind::Identifier, "a"));
+        REQUIRE(result.has_value());
         CHECK((*result).getValue<JSNumber>() == 5.);
     }
     SUBCASE("test interpreting variable declarations with binary expression") {
@@ -647,9 +1100,9 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         interpreter.run(stmts);
-        auto result = std::static_pointer_cast<JSBasicValue>(
-            interpreter.getEnv(JSToken(JSTokenKind::Identifier, "c", 0.)));
-        REQUIRE(result != nullptr);
+        auto result =
+            interpreter.getEnv(JSToken(JSTokenKind::Identifier, "c"));
+        REQUIRE(result.has_value());
         CHECK((*result).getValue<JSNumber>() == 42.);
     }
     SUBCASE("test interpreting variable assignment") {
@@ -660,9 +1113,9 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         interpreter.run(stmts);
-        auto result = std::static_pointer_cast<JSBasicValue>(
-            interpreter.getEnv(JSToken(JSTokenKind::Identifier, "a", 0.)));
-        REQUIRE(result != nullptr);
+        auto result =
+            interpreter.getEnv(JSToken(JSTokenKind::Identifier, "a"));
+        REQUIRE(result.has_value());
         CHECK((*result).getValue<JSNumber>() == 39.);
     }
     SUBCASE("test interpreting block statements") {
@@ -685,15 +1138,15 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         interpreter.run(stmts);
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "a", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "a"))
                   .getValue<JSNumber>() == -55.);
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "c", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "c"))
                   .getValue<JSNumber>() == 42.);
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "d", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "d"))
                   .getValue<JSBoolean>() == false);
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "f", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "f"))
                   .getValue<JSBoolean>() == true);
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "g", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "g"))
                   .getValue<JSNumber>() == -13.);
     }
     SUBCASE("test interpreting expression (plus operator overload)") {
@@ -706,11 +1159,11 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         interpreter.run(stmts);
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "f", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "f"))
                   .getValue<JSString>() == "helloBob");
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "g", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "g"))
                   .getValue<JSString>() == "hellofalse");
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "h", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "h"))
                   .getValue<JSString>() == "hellotrue");
     }
     SUBCASE("test interpreting expression with outer and inner scope") {
@@ -721,7 +1174,7 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "a", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "a"))
                   .getValue<JSNumber>() == 1.);
     }
     SUBCASE("test interpreting logical expressions") {
@@ -732,7 +1185,7 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "a", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "a"))
                   .getValue<JSBoolean>() == true);
     }
     SUBCASE(
@@ -744,7 +1197,7 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "a", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "a"))
                   .getValue<JSNumber>() == 1.);
     }
     SUBCASE("test interpreting conditional expressions") {
@@ -755,7 +1208,7 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "a", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "a"))
                   .getValue<JSNumber>() == 2.);
     }
     SUBCASE("test interpreting conditional expressions with else branch") {
@@ -766,7 +1219,7 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "a", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "a"))
                   .getValue<JSNumber>() == 3.);
     }
     SUBCASE("test interpreting while loop") {
@@ -778,7 +1231,7 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts  = parser.parse();
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "sum", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "sum"))
                   .getValue<JSNumber>() == 10.);
     }
     SUBCASE("test interpreting for loop with variable declaration") {
@@ -790,7 +1243,7 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts  = parser.parse();
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "sum", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "sum"))
                   .getValue<JSNumber>() == 10.);
     }
     SUBCASE("test interpreting for loop with pre-variable declaration") {
@@ -803,7 +1256,7 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "sum", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "sum"))
                   .getValue<JSNumber>() == 10.);
     }
     SUBCASE("test interpreting for loop with in-loop step") {
@@ -815,7 +1268,7 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "sum", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "sum"))
                   .getValue<JSNumber>() == 10.);
     }
     SUBCASE("test interpreting function calls") {
@@ -837,7 +1290,7 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "d", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "d"))
                   .getValue<JSNumber>() == 3.);
     }
     SUBCASE("test interpreting function with conditional and logical branch") {
@@ -849,7 +1302,7 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts  = parser.parse();
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "b", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "b"))
                   .getValue<JSBoolean>() == true);
     }
     SUBCASE("test interpreting recursive function calls/factorial(5)") {
@@ -862,7 +1315,7 @@ TEST_CASE("testing interpreter evaluate") {
         auto stmts       = parser.parse();
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
-        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "res", 0.))
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "res"))
                   .getValue<JSNumber>() == 120.);
     }
     SUBCASE("test interpreting function calls with nested callstack") {
@@ -879,9 +1332,342 @@ TEST_CASE("testing interpreter evaluate") {
         auto interpreter = Interpreter();
         REQUIRE_NOTHROW(interpreter.run(stmts));
         CHECK(
-            interpreter.getValue(JSToken(JSTokenKind::Identifier, "result", 0.))
+            interpreter.getValue(JSToken(JSTokenKind::Identifier, "result"))
                 .getValue<JSNumber>() == 4.);
     }
+    SUBCASE("test interpreting recursive function calls/fibonacci(20)") {
+        auto source      = "function fib(n) { if (n < 2) { return n; } "
+                           "return fib(n - 1) + fib(n - 2);}\n "
+                           "var res = fib(20);";
+        auto lexer       = JSLexer(source);
+        auto tokens      = lexer.scanTokens();
+        auto parser      = JSParser(std::move(tokens));
+        auto stmts       = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "res"))
+                  .getValue<JSNumber>() == 6765.);
+    }
+    SUBCASE("test interpreting deep recursion/call depth limit") {
+        auto source      = "function depth(n) { if (n == 0) { return 0; } "
+                           "return 1 + depth(n - 1);}\n "
+                           "var res = depth(2000);\n var deep = depth(100000);";
+        auto lexer       = JSLexer(source);
+        auto tokens      = lexer.scanTokens();
+        auto parser      = JSParser(std::move(tokens));
+        auto stmts       = parser.parse();
+        auto interpreter = Interpreter();
+        CHECK_THROWS_WITH_AS(interpreter.run(stmts),
+                             "Maximum call stack size exceeded.",
+                             std::runtime_error);
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "res"))
+                  .getValue<JSNumber>() == 2000.);
+    }
+    SUBCASE("test interpreting function calls with missing/extra arguments") {
+        auto source      = "function second(a, b) { return b; }\n var r = "
+                           "second(1);\n var s = second(1, 2, 3);";
+        auto lexer       = JSLexer(source);
+        auto tokens      = lexer.scanTokens();
+        auto parser      = JSParser(std::move(tokens));
+        auto stmts       = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "r"))
+                  .isUndefined());
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "s"))
+                  .getValue<JSNumber>() == 2.);
+    }
+    SUBCASE("test interpreting tail recursive function calls") {
+        auto source = "function count(n, acc) { if (n == 0) { return acc; } "
+                      "return count(n - 1, acc + 1);}\n "
+                      "var res = count(100000, 0);";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        auto stmts  = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "res"))
+                  .getValue<JSNumber>() == 100000.);
+    }
+    SUBCASE("test interpreting mutually tail recursive function calls") {
+        auto source =
+            "function isEven(n) { if (n == 0) { return true; } return "
+            "isOdd(n - 1);}\nfunction isOdd(n) { if (n == 0) { return false; "
+            "} return isEven(n - 1);}\n var res = isEven(70001);";
+        auto lexer       = JSLexer(source);
+        auto tokens      = lexer.scanTokens();
+        auto parser      = JSParser(std::move(tokens));
+        auto stmts       = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "res"))
+                  .getValue<JSBoolean>() == false);
+    }
+    SUBCASE("test interpreting impure tail recursive function calls") {
+        auto source = "var count = 0;\nfunction down(n) { count = count + 1; "
+                      "if (n == 0) { return 0; } return down(n - 1); }\n"
+                      "var res = down(5000);";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        auto stmts  = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(
+            interpreter.getValue(JSToken(JSTokenKind::Identifier, "count"))
+                .getValue<JSNumber>() == 5001.);
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "res"))
+                  .getValue<JSNumber>() == 0.);
+        CHECK(interpreter.getEnvironment().getDepth() == 1);
+    }
+    SUBCASE("test interpreting tail calls reading the caller's scope") {
+        auto source = "var n = 10;\nfunction lp(k) { return n * k; }\n"
+                      "function caller() { var n = 3; return lp(2); }\n"
+                      "var res = caller();";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        auto stmts  = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "res"))
+                  .getValue<JSNumber>() == 6.);
+    }
+    SUBCASE("test interpreting tail calls to nested functions") {
+        auto source =
+            "function outer(n) { function fact(k) { if (k == 0) { return 1; "
+            "} return k * fact(k - 1); } return fact(n); }\n"
+            "var res = outer(5);";
+        auto lexer       = JSLexer(source);
+        auto tokens      = lexer.scanTokens();
+        auto parser      = JSParser(std::move(tokens));
+        auto stmts       = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "res"))
+                  .getValue<JSNumber>() == 120.);
+    }
+    SUBCASE("test interpreting while loop with break") {
+        auto source = "var i = 0;\nwhile (i < 10) { if (i == 5) { break; } "
+                      "i = i + 1; }";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        auto stmts  = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "i"))
+                  .getValue<JSNumber>() == 5.);
+    }
+    SUBCASE("test interpreting for loop with continue") {
+        auto source = "var sum = 0;\nfor (var i = 0;i < 10;i = i + 1) { if "
+                      "(i < 5) { continue; } sum = sum + 1; }\n";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        auto stmts  = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "sum"))
+                  .getValue<JSNumber>() == 5.);
+    }
+    SUBCASE("test interpreting call statements inside a block") {
+        auto source = "function one() { return 1; }\nvar sum = 0;\n"
+                      "{ one(); sum = sum + one(); sum = sum + 1; }";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        auto stmts  = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "sum"))
+                  .getValue<JSNumber>() == 2.);
+    }
+    SUBCASE("test interpreting return from within a loop") {
+        auto source = "function find(n) { var i = 0; while (true) { if (i == "
+                      "n) { return i; } i = i + 1; } }\n var res = find(7);";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        auto stmts  = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "res"))
+                  .getValue<JSNumber>() == 7.);
+    }
+}
+
+TEST_CASE("testing purity analysis") {
+    SUBCASE("test pure and impure functions are detected") {
+        auto source = "var g = 1;\nfunction add(a, b) { var c = a + b; return "
+                      "c; }\nfunction twice(a) { return add(a, a); }\n"
+                      "function read(a) { return a + g; }\nfunction write(a) "
+                      "{ g = a; return a; }\nfunction indirect(a) { return "
+                      "read(a); }";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        auto stmts  = parser.parse();
+        PurityAnalyzer analyzer;
+        analyzer.analyze(stmts);
+        auto isPure = [&](size_t idx) {
+            return static_cast<JSFuncDecl*>(stmts[idx])->isPure();
+        };
+        CHECK(isPure(1) == true);
+        CHECK(isPure(2) == true);
+        CHECK(isPure(3) == false);
+        CHECK(isPure(4) == false);
+        CHECK(isPure(5) == false);
+    }
+    SUBCASE("test functions declared by top level statements are impure") {
+        auto source = "var c = true;\nif (c) function f(n) { return n; }";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        auto stmts  = parser.parse();
+        PurityAnalyzer analyzer;
+        REQUIRE_NOTHROW(analyzer.analyze(stmts));
+        auto* branch = static_cast<JSIfStmt*>(stmts[1])->getThenBranch();
+        CHECK(static_cast<JSFuncDecl*>(branch)->isPure() == false);
+    }
+    SUBCASE("test interpreting memoized function calls") {
+        auto source = "function fib(n) { \"use memo\"; if (n < 2) { return "
+                      "n; } return fib(n - 1) + fib(n - 2); }\nvar res = "
+                      "fib(60);";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        auto stmts  = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, "res"))
+                  .getValue<JSNumber>() == 1548008755920.);
+        auto* fib = static_cast<JSFunction*>(
+            interpreter.getValue(JSToken(JSTokenKind::Identifier, "fib"))
+                .getObject());
+        REQUIRE(fib->getMemoTable() != nullptr);
+        CHECK(fib->getMemoTable()->size() == 61);
+        CHECK(fib->getMemoTable()->getHits() == 58);
+    }
+    SUBCASE("test memoized functions called in tail position") {
+        auto source = "function sq(n) { \"use memo\"; return n * n; }\n"
+                      "function viaTail(n) { return sq(n); }\n"
+                      "var a = viaTail(7);\nvar b = viaTail(7);\n"
+                      "var c = sq(7);";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        auto stmts  = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        for (const auto* name : {"a", "b", "c"}) {
+            CHECK(interpreter.getValue(JSToken(JSTokenKind::Identifier, name))
+                      .getValue<JSNumber>() == 49.);
+        }
+        auto* sq = static_cast<JSFunction*>(
+            interpreter.getValue(JSToken(JSTokenKind::Identifier, "sq"))
+                .getObject());
+        REQUIRE(sq->getMemoTable() != nullptr);
+        CHECK(sq->getMemoTable()->size() == 1);
+        CHECK(sq->getMemoTable()->getHits() == 2);
+    }
+    SUBCASE("test impure functions are not memoized") {
+        auto source = "var count = 0;\nfunction inc(n) { \"use memo\"; count "
+                      "= count + 1; return n; }\ninc(1);\ninc(1);";
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        auto stmts  = parser.parse();
+        auto interpreter = Interpreter();
+        REQUIRE_NOTHROW(interpreter.run(stmts));
+        CHECK(
+            interpreter.getValue(JSToken(JSTokenKind::Identifier, "count"))
+                .getValue<JSNumber>() == 2.);
+    }
+    SUBCASE("test memo table evicts the least recently used result") {
+        MemoTable memo(2);
+        memo.insert({JSBasicValue(1.)}, JSBasicValue(10.));
+        memo.insert({JSBasicValue(2.)}, JSBasicValue(20.));
+        REQUIRE(memo.lookup({JSBasicValue(1.)}) != nullptr);
+        memo.insert({JSBasicValue(3.)}, JSBasicValue(30.));
+        CHECK(memo.size() == 2);
+        CHECK(memo.lookup({JSBasicValue(2.)}) == nullptr);
+        CHECK(memo.lookup({JSBasicValue(1.)})->getValue<JSNumber>() == 10.);
+        CHECK(memo.lookup({JSBasicValue(0.)}) == nullptr);
+        memo.insert({JSBasicValue(-0.)}, JSBasicValue(0.));
+        CHECK(memo.lookup({JSBasicValue(0.)}) == nullptr);
+    }
+}
+
+TEST_CASE("testing closure compiler") {
+    SUBCASE("test compiling grouped expressions (add/mul)") {
+        auto source   = "(1 + 2) * 3 - 4 / 2;";
+        auto lexer    = JSLexer(source);
+        auto tokens   = lexer.scanTokens();
+        auto parser   = JSParser(std::move(tokens));
+        auto expr     = parser.parseExpr();
+        auto compiler = ClosureCompiler();
+        auto value    = compiler.evaluate(expr);
+        CHECK(value.isNumber() == true);
+        CHECK(value.getValue<JSNumber>() == 7.);
+    }
+    SUBCASE("test compiling loops with break and continue") {
+        auto source = "var sum = 0;\nfor (var i = 0;i < 10;i = i + 1) { if "
+                      "(i < 2) { continue; } if (i == 8) { break; } sum = sum "
+                      "+ i; }\n";
+        auto lexer    = JSLexer(source);
+        auto tokens   = lexer.scanTokens();
+        auto parser   = JSParser(std::move(tokens));
+        auto stmts    = parser.parse();
+        auto compiler = ClosureCompiler();
+        REQUIRE_NOTHROW(compiler.run(stmts));
+        auto sum = compiler.getGlobal("sum");
+        REQUIRE(sum.has_value());
+        CHECK(sum->getValue<JSNumber>() == 27.);
+    }
+    SUBCASE("test compiling deep recursion/call depth limit") {
+        auto source   = "function depth(n) { if (n == 0) { return 0; } "
+                        "return 1 + depth(n - 1);}\n "
+                        "var res = depth(2000);\n var deep = depth(1000000);";
+        auto lexer    = JSLexer(source);
+        auto tokens   = lexer.scanTokens();
+        auto parser   = JSParser(std::move(tokens));
+        auto stmts    = parser.parse();
+        auto compiler = ClosureCompiler();
+        CHECK_THROWS_WITH_AS(compiler.run(stmts),
+                             "Maximum call stack size exceeded.",
+                             std::runtime_error);
+        auto res = compiler.getGlobal("res");
+        REQUIRE(res.has_value());
+        CHECK(res->getValue<JSNumber>() == 2000.);
+        CHECK(compiler.getContext().depth == 0);
+    }
+    SUBCASE("test compiling recursive function calls/fibonacci(20)") {
+        auto source   = "function fib(n) { if (n < 2) { return n; } "
+                        "return fib(n - 1) + fib(n - 2);}\n "
+                        "var res = fib(20);";
+        auto lexer    = JSLexer(source);
+        auto tokens   = lexer.scanTokens();
+        auto parser   = JSParser(std::move(tokens));
+        auto stmts    = parser.parse();
+        auto compiler = ClosureCompiler();
+        REQUIRE_NOTHROW(compiler.run(stmts));
+        auto res = compiler.getGlobal("res");
+        REQUIRE(res.has_value());
+        CHECK(res->getValue<JSNumber>() == 6765.);
+        CHECK(compiler.getContext().stack.empty());
+    }
+    SUBCASE("test compiling block scoped variables") {
+        auto source   = "var a = 1;\n{ var a = 2; var b = a; }\nb;";
+        auto lexer    = JSLexer(source);
+        auto tokens   = lexer.scanTokens();
+        auto parser   = JSParser(std::move(tokens));
+        auto stmts    = parser.parse();
+        auto compiler = ClosureCompiler();
+        CHECK_THROWS(compiler.run(stmts));
+        CHECK(compiler.getGlobal("a")->getValue<JSNumber>() == 1.);
+    }
 }
 
 TEST_CASE("testing AST optimizer") {
@@ -892,7 +1678,7 @@ TEST_CASE("testing AST optimizer") {
         auto parser = JSParser(std::move(tokens));
         auto expr   = parser.parseExpr();
         fmt::print("expr::Kind : {}\n", astNodeKindToString(expr->getKind()));
-        auto optimizer = ASTOptimizer();
+        auto optimizer = ASTOptimizer(parser.getArena());
         REQUIRE(expr != nullptr);
         expr->accept(&optimizer);
         expr = optimizer.rewriteAST(expr);
@@ -906,13 +1692,392 @@ TEST_CASE("testing AST optimizer") {
         auto parser = JSParser(std::move(tokens));
         auto expr   = parser.parseExpr();
         fmt::print("expr::Kind : {}\n", astNodeKindToString(expr->getKind()));
-        auto optimizer = ASTOptimizer();
+        auto optimizer = ASTOptimizer(parser.getArena());
         REQUIRE(expr != nullptr);
         expr->accept(&optimizer);
         expr = optimizer.rewriteAST(expr);
         REQUIRE(expr != nullptr);
         fmt::print("Node kind: {}\n", astNodeKindToString(expr->getKind()));
     }
+    SUBCASE("testing constant folding of nested expressions") {
+        auto fold = [](const char* source) -> JSBasicValue {
+            auto lexer     = JSLexer(source);
+            auto parser    = JSParser(lexer);
+            auto* expr     = parser.parseExpr();
+            auto optimizer = ASTOptimizer(parser.getArena());
+            expr           = optimizer.rewriteAST(expr);
+            REQUIRE(expr->getKind() == ASTNodeKind::LiteralExpr);
+            return static_cast<JSLiteralExpr*>(expr)->getValue();
+        };
+        CHECK(fold("(1 + 2) * 3 - 8 / 4").getValue<JSNumber>() == 7.);
+        CHECK(fold("-(2 * 3)").getValue<JSNumber>() == -6.);
+        CHECK(fold("1 + 2 < 4").getValue<JSBoolean>());
+        CHECK(fold("2 * 2 == 4").getValue<JSBoolean>());
+        CHECK_FALSE(fold("1 != 1").getValue<JSBoolean>());
+        CHECK(fold("!(1 >= 2)").getValue<JSBoolean>());
+        CHECK(fold("!null").getValue<JSBoolean>());
+        CHECK(fold("\"mini\" + \"js\" + \"c\"").getValue<JSString>() ==
+              "minijsc");
+        CHECK(fold("0 || 3").getValue<JSNumber>() == 3.);
+        CHECK(fold("1 && 0").getValue<JSNumber>() == 0.);
+        CHECK(fold("false && 1").getValue<JSBoolean>() == false);
+    }
+    SUBCASE("testing expressions left to the runtime") {
+        auto lexer     = JSLexer("1 + a * 2; true - 1; !\"a\"; 0 || f();");
+        auto parser    = JSParser(lexer);
+        auto program   = parser.parse();
+        auto optimizer = ASTOptimizer(program.getArena());
+        optimizer.rewrite(program);
+        auto exprOf = [&](size_t idx) {
+            return static_cast<JSExprStmt*>(program[idx])->getExpr();
+        };
+        CHECK(exprOf(0)->getKind() == ASTNodeKind::BinaryExpr);
+        CHECK(exprOf(1)->getKind() == ASTNodeKind::BinaryExpr);
+        CHECK(exprOf(2)->getKind() == ASTNodeKind::UnaryExpr);
+        // The constant left operand of `||` is dropped.
+        CHECK(exprOf(3)->getKind() == ASTNodeKind::CallExpr);
+    }
+    SUBCASE("testing constant folding through statements") {
+        auto source = R"(
+            function area(r) { return 3 * (2 + 1) * r * r; }
+            var total = 0;
+            for (var i = 0; i < 10 * 10; i = i + (3 - 2)) {
+                if (2 > 1) { total = total + area(1) * (1 + 1); }
+            }
+            var label = "total: " + (40 + 2);
+        )";
+        auto lexer   = JSLexer(source);
+        auto parser  = JSParser(lexer);
+        auto program = parser.parse();
+        auto before  = program.getArena().getNodeCount();
+        ASTOptimizer(program.getArena()).rewrite(program);
+        CHECK(program.getArena().getNodeCount() > before);
+
+        auto* area = static_cast<JSFuncDecl*>(program[0]);
+        auto* ret  = static_cast<JSReturnStmt*>(area->getBody()->getStmts()[0]);
+        // `3 * (2 + 1) * r` only folds its constant prefix.
+        auto* mul = static_cast<JSBinExpr*>(ret->getValue());
+        auto* lhs = static_cast<JSBinExpr*>(mul->getLeft());
+        REQUIRE(lhs->getLeft()->getKind() == ASTNodeKind::LiteralExpr);
+        CHECK(static_cast<JSLiteralExpr*>(lhs->getLeft())
+                  ->getValue()
+                  .getValue<JSNumber>() == 9.);
+
+        auto* loop = static_cast<JSForStmt*>(program[2]);
+        auto* cond = static_cast<JSBinExpr*>(loop->getCondition());
+        CHECK(cond->getRight()->getKind() == ASTNodeKind::LiteralExpr);
+        auto* step = static_cast<JSAssignExpr*>(loop->getStep());
+        auto* inc  = static_cast<JSBinExpr*>(step->getValue());
+        CHECK(inc->getRight()->getKind() == ASTNodeKind::LiteralExpr);
+        auto* body   = static_cast<JSBlockStmt*>(loop->getBody());
+        auto* branch = static_cast<JSIfStmt*>(body->getStmts()[0]);
+        CHECK(branch->getCondition()->getKind() == ASTNodeKind::LiteralExpr);
+
+        auto interpreter = Interpreter();
+        interpreter.run(program);
+        auto* total = interpreter.getEnvironment().resolveBinding("total");
+        REQUIRE(total != nullptr);
+        CHECK(total->getValue<JSNumber>() == 1800.);
+        auto* label = interpreter.getEnvironment().resolveBinding("label");
+        REQUIRE(label != nullptr);
+        CHECK(label->getValue<JSString>() ==
+              "total: " + JSBasicValue(42.).toString());
+    }
+    SUBCASE("testing optimizing programs with missing operands") {
+        // The parser leaves missing operands null, optimized programs must
+        // behave as the original ones when the operand is evaluated.
+        auto sources = {
+            "var x = 1 + ;\nvar y = 1 + ;",
+            "var x = - ;\nvar y = !(1 && );",
+            "function f(a) { return a * ; }\nvar y = f(1);",
+            "function g(a) { return a; }\nvar y = g(1 < );",
+            "var i = 0;\nwhile (i < 3) { var t = i - ; i = i + 1; }",
+            "var c = 2;\nc = c + ;\nvar d = c + ;",
+        };
+        auto fails = [](JSProgram& program) {
+            try {
+                Interpreter().run(program);
+            } catch (const std::runtime_error& /*error*/) {
+                return true;
+            }
+            return false;
+        };
+        for (const auto* source : sources) {
+            CAPTURE(source);
+            auto parse = [&]() {
+                auto lexer = JSLexer(source);
+                return JSParser(lexer).parse();
+            };
+            auto program   = parse();
+            auto optimized = parse();
+            REQUIRE_NOTHROW(optimize(optimized));
+            CHECK(fails(optimized) == fails(program));
+        }
+    }
+}
+
+TEST_CASE("testing constant propagation") {
+    SUBCASE("testing feature flags are removed") {
+        auto source = R"(
+            var DEBUG = false;
+            var SCALE = 2 * 5;
+            var calls = 0;
+            function trace(msg) { calls = calls + 100; }
+            function scale(n) {
+                if (DEBUG) { trace(n); }
+                calls = calls + 1;
+                return n * SCALE;
+                calls = calls + 1000;
+            }
+            var total = 0;
+            while (DEBUG) { total = total - 1; }
+            for (var i = 0; i < 3; i = i + 1) { total = total + scale(i); }
+            for (var j = 0; DEBUG; j = j + 1) { total = 0; }
+            var unused = "unused";
+            function unusedFn() { return 1; }
+        )";
+        auto lexer   = JSLexer(source);
+        auto parser  = JSParser(lexer);
+        auto program = parser.parse();
+        ConstantPropagator(program.getArena()).run(program);
+
+        // Only `calls`, `scale`, `total` and the live loop are left.
+        REQUIRE(program.size() == 4);
+        CHECK(program[0]->getKind() == ASTNodeKind::VarDecl);
+        CHECK(program[1]->getKind() == ASTNodeKind::FuncDecl);
+        CHECK(program[2]->getKind() == ASTNodeKind::VarDecl);
+        CHECK(program[3]->getKind() == ASTNodeKind::ForStmt);
+        auto* scale = static_cast<JSFuncDecl*>(program[1]);
+        auto body   = scale->getBody()->getStmts();
+        REQUIRE(body.size() == 2);
+        auto* ret = static_cast<JSReturnStmt*>(body[1]);
+        auto* mul = static_cast<JSBinExpr*>(ret->getValue());
+        REQUIRE(mul->getRight()->getKind() == ASTNodeKind::LiteralExpr);
+        CHECK(static_cast<JSLiteralExpr*>(mul->getRight())
+                  ->getValue()
+                  .getValue<JSNumber>() == 10.);
+
+        auto interpreter = Interpreter();
+        interpreter.run(program);
+        auto* total = interpreter.getEnvironment().resolveBinding("total");
+        REQUIRE(total != nullptr);
+        CHECK(total->getValue<JSNumber>() == 30.);
+        auto* calls = interpreter.getEnvironment().resolveBinding("calls");
+        REQUIRE(calls != nullptr);
+        CHECK(calls->getValue<JSNumber>() == 3.);
+    }
+    SUBCASE("testing variables which aren't constant are kept") {
+        auto source = R"(
+            function limit() { return LIMIT; }
+            var early = limit();
+            var LIMIT = 3;
+            var late = LIMIT + 1;
+            var n = 1;
+            n = 2;
+            var m = n;
+            print(early, late, m);
+        )";
+        auto lexer   = JSLexer(source);
+        auto parser  = JSParser(lexer);
+        auto program = parser.parse();
+        ConstantPropagator(program.getArena()).run(program);
+        // `late` is folded to a constant, propagated and removed.
+        REQUIRE(program.size() == 7);
+
+        // `limit` is called before `LIMIT` is declared.
+        auto* limit = static_cast<JSFuncDecl*>(program[0]);
+        auto* ret = static_cast<JSReturnStmt*>(limit->getBody()->getStmts()[0]);
+        CHECK(ret->getValue()->getKind() == ASTNodeKind::VarExpr);
+        // `n` is assigned twice.
+        auto* copy = static_cast<JSVarDecl*>(program[5]);
+        CHECK(copy->getInitializer()->getKind() == ASTNodeKind::VarExpr);
+        auto* print = static_cast<JSExprStmt*>(program[6])->getExpr();
+        auto args   = static_cast<JSCallExpr*>(print)->getArgs();
+        REQUIRE(args.size() == 3);
+        CHECK(args[0]->getKind() == ASTNodeKind::VarExpr);
+        REQUIRE(args[1]->getKind() == ASTNodeKind::LiteralExpr);
+        CHECK(static_cast<JSLiteralExpr*>(args[1])
+                  ->getValue()
+                  .getValue<JSNumber>() == 4.);
+    }
+}
+
+TEST_CASE("testing function inlining") {
+    auto source = R"(
+        function square(n) { return n * n; }
+        function scaled(x, k) { return x * k + OFFSET; }
+        function bump(v) { total = total + v; return v; }
+        function loop(n) { return loop(n); }
+        function moved(a) { return a + 1; }
+        var OFFSET = 1;
+        var total = 0;
+        var last = 0;
+        for (var i = 0; i < 5; i = i + 1) {
+            total = total + square(i);
+            last = scaled(bump(i), 2);
+        }
+        var sq = square(3);
+        var m = moved(1);
+        moved = 0;
+    )";
+    auto run = [](JSProgram& program, const char* name) -> JSNumber {
+        auto interpreter = Interpreter();
+        interpreter.run(program);
+        auto* value = interpreter.getEnvironment().resolveBinding(name);
+        REQUIRE(value != nullptr);
+        return value->getValue<JSNumber>();
+    };
+    SUBCASE("testing calls to small functions are inlined") {
+        auto lexer   = JSLexer(source);
+        auto parser  = JSParser(lexer);
+        auto program = parser.parse();
+        auto inliner = FunctionInliner(program.getArena());
+        inliner.run(program);
+        // `square` twice and `scaled`, `bump` assigns, `loop` calls and
+        // `moved` is reassigned.
+        CHECK(inliner.getInlinedCalls() == 3);
+
+        auto* loop = static_cast<JSForStmt*>(program[8]);
+        auto body  = static_cast<JSBlockStmt*>(loop->getBody())->getStmts();
+        // The argument of `scaled` is bound to a fresh local.
+        REQUIRE(body.size() == 3);
+        auto* local = static_cast<JSVarDecl*>(body[1]);
+        CHECK(local->getName().starts_with("$"));
+        CHECK(local->getInitializer()->getKind() == ASTNodeKind::CallExpr);
+        auto* sq = static_cast<JSVarDecl*>(program[9]);
+        REQUIRE(sq->getInitializer()->getKind() == ASTNodeKind::LiteralExpr);
+        CHECK(static_cast<JSLiteralExpr*>(sq->getInitializer())
+                  ->getValue()
+                  .getValue<JSNumber>() == 9.);
+        auto* m = static_cast<JSVarDecl*>(program[10]);
+        CHECK(m->getInitializer()->getKind() == ASTNodeKind::CallExpr);
+
+        CHECK(run(program, "total") == 40.);
+        CHECK(run(program, "last") == 9.);
+    }
+    SUBCASE("testing the optimization pipeline") {
+        auto lexer   = JSLexer(source);
+        auto parser  = JSParser(lexer);
+        auto program = parser.parse();
+        optimize(program);
+        // `square` and `scaled` aren't referenced anymore, `loop` calls
+        // itself.
+        for (auto* stmt : program) {
+            if (stmt->getKind() == ASTNodeKind::FuncDecl) {
+                auto name = static_cast<JSFuncDecl*>(stmt)->getName();
+                CHECK((name.getLexeme() == "bump" ||
+                       name.getLexeme() == "loop" ||
+                       name.getLexeme() == "moved"));
+            }
+        }
+        CHECK(run(program, "total") == 40.);
+        CHECK(run(program, "last") == 9.);
+    }
+}
+
+TEST_CASE("testing loop invariant code motion") {
+    auto source = R"(
+        function shrink() { factor = factor - 1; }
+        var limit = 10;
+        var factor = 3;
+        var sum = 0;
+        var i = 0;
+        while (i < limit * factor) {
+            sum = sum + i * (factor - 1);
+            i = i + 1;
+        }
+        for (var j = 0; j < limit; j = j + 1) {
+            var k = j * (limit / 2);
+            sum = sum - (limit - k);
+        }
+        var n = 0;
+        while (n < limit * factor) {
+            shrink();
+            n = n + 1;
+        }
+    )";
+    auto lexer   = JSLexer(source);
+    auto parser  = JSParser(lexer);
+    auto program = parser.parse();
+    auto licm    = LoopInvariantMotion(program.getArena());
+    licm.run(program);
+    // `limit * factor` and `(factor - 1)` out of the first loop and
+    // `(limit / 2)` out of the second, `limit - k` reads a local of the
+    // loop and `shrink` assigns `factor`.
+    CHECK(licm.getHoistedCount() == 3);
+    REQUIRE(program.size() == 12);
+    for (auto idx : {5, 6, 8}) {
+        REQUIRE(program[idx]->getKind() == ASTNodeKind::VarDecl);
+        CHECK(static_cast<JSVarDecl*>(program[idx])
+                  ->getName()
+                  .starts_with("$"));
+    }
+    CHECK(program[7]->getKind() == ASTNodeKind::WhileStmt);
+    CHECK(program[9]->getKind() == ASTNodeKind::ForStmt);
+
+    auto interpreter = Interpreter();
+    interpreter.run(program);
+    auto& env = interpreter.getEnvironment();
+    CHECK(env.resolveBinding("sum")->getValue<JSNumber>() == 995.);
+    CHECK(env.resolveBinding("n")->getValue<JSNumber>() == 3.);
+}
+
+TEST_CASE("testing value numbering") {
+    auto source = R"(
+        function bump() { b = b + 1; }
+        var a = 3;
+        var b = 4;
+        var c = 0;
+        var x = a * b + a * b;
+        var y = (b * a) - c;
+        c = a * b;
+        var z = a * b - c;
+        a = 5;
+        var w = a * b;
+        bump();
+        var v = a * b;
+        if (v > 0) {
+            var k = a * b;
+            c = k + a * b;
+        }
+    )";
+    auto run = [](JSProgram& program) -> std::vector<JSNumber> {
+        auto interpreter = Interpreter();
+        interpreter.run(program);
+        std::vector<JSNumber> results;
+        for (const auto* name : {"x", "y", "z", "w", "v", "c"}) {
+            auto* value = interpreter.getEnvironment().resolveBinding(name);
+            REQUIRE(value != nullptr);
+            results.push_back(value->getValue<JSNumber>());
+        }
+        return results;
+    };
+    auto expected = std::vector<JSNumber>{24., 12., 0., 20., 25., 50.};
+    SUBCASE("testing repeated expressions are computed once") {
+        auto lexer     = JSLexer(source);
+        auto parser    = JSParser(lexer);
+        auto program   = parser.parse();
+        auto numbering = ValueNumbering(program.getArena());
+        numbering.run(program);
+        // `a * b` is computed five times before `a` is assigned, `b * a`
+        // included, then three times after `bump` may assign `b`.
+        CHECK(numbering.getEliminatedCount() == 6);
+        REQUIRE(program.size() == 15);
+        for (auto idx : {4, 12}) {
+            REQUIRE(program[idx]->getKind() == ASTNodeKind::VarDecl);
+            CHECK(static_cast<JSVarDecl*>(program[idx])
+                      ->getName()
+                      .starts_with("$"));
+        }
+        CHECK(run(program) == expected);
+    }
+    SUBCASE("testing the optimization pipeline") {
+        auto lexer   = JSLexer(source);
+        auto parser  = JSParser(lexer);
+        auto program = parser.parse();
+        optimize(program);
+        CHECK(run(program) == expected);
+    }
 }
 
 #define DEBUG_TRACE_EXECUTION
@@ -957,7 +2122,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -979,7 +2144,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1001,7 +2166,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1023,7 +2188,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1045,7 +2210,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1067,7 +2232,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1089,7 +2254,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1111,7 +2276,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1133,7 +2298,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1155,7 +2320,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1177,7 +2342,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1192,7 +2357,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1207,7 +2372,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1222,12 +2387,12 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseExpr();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->compile(expr.get());
+        compiler->compile(expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
         vm.run();
-        CHECK(vm.pop().getValue<JSBoolean>() == false);
+        CHECK(vm.pop().getValue<JSBoolean>() == true);
     }
     SUBCASE("testing compilation of variable declarations") {
         auto source   = "var a = 42;";
@@ -1237,7 +2402,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseDecl();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->visitVarDecl((JSVarDecl*)expr.get());
+        compiler->visitVarDecl((JSVarDecl*)expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1253,7 +2418,7 @@ TEST_CASE("testing bytecode compiler") {
         auto expr     = parser.parseDecl();
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
-        compiler->visitVarDecl((JSVarDecl*)expr.get());
+        compiler->visitVarDecl((JSVarDecl*)expr);
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
         auto vm   = VM(bc, pool);
@@ -1270,7 +2435,7 @@ TEST_CASE("testing bytecode compiler") {
         auto compiler = std::make_shared<BytecodeCompiler>();
         // expr->accept(compiler.get());
         for (auto& stmt : stmts) {
-            compiler->compile(stmt.get());
+            compiler->compile(stmt);
         }
         auto bc   = compiler->getBytecode();
         auto pool = compiler->getConstantsPool();
@@ -1279,6 +2444,234 @@ TEST_CASE("testing bytecode compiler") {
         CHECK(vm.resolveGlobal("a").getValue<JSNumber>() == 42);
         CHECK(vm.resolveGlobal("b").getValue<JSNumber>() == 42);
     }
+    SUBCASE("testing compilation of recursive functions with VM run") {
+        auto source   = "function fib(n) { if (n < 2) { return n; } "
+                        "return fib(n - 1) + fib(n - 2);}\n "
+                        "var res = fib(10);";
+        auto lexer    = JSLexer(source);
+        auto tokens   = lexer.scanTokens();
+        auto parser   = JSParser(std::move(tokens));
+        auto stmts    = parser.parse();
+        auto compiler = std::make_shared<BytecodeCompiler>();
+        for (auto& stmt : stmts) {
+            compiler->compile(stmt);
+        }
+        auto bc   = compiler->getBytecode();
+        auto pool = compiler->getConstantsPool();
+        auto vm   = VM(bc, pool);
+        vm.run();
+        CHECK(vm.resolveGlobal("res").getValue<JSNumber>() == 55.);
+    }
+    SUBCASE("testing compilation of tail calls with VM run") {
+        auto source = "function count(n, acc) { while (true) { if (n == 0) { "
+                      "return acc; } break; } return count(n - 1, acc + 1);}"
+                      "\n var res = count(30000, 0);";
+        auto lexer    = JSLexer(source);
+        auto tokens   = lexer.scanTokens();
+        auto parser   = JSParser(std::move(tokens));
+        auto stmts    = parser.parse();
+        auto compiler = std::make_shared<BytecodeCompiler>();
+        for (auto& stmt : stmts) {
+            compiler->compile(stmt);
+        }
+        auto bc   = compiler->getBytecode();
+        auto pool = compiler->getConstantsPool();
+        auto vm   = VM(bc, pool);
+        REQUIRE_NOTHROW(vm.run());
+        CHECK(vm.resolveGlobal("res").getValue<JSNumber>() == 30000.);
+        CHECK(vm.getCallDepth() == 0);
+    }
+    SUBCASE("testing compilation of nested functions is rejected") {
+        auto source =
+            "function outer(n) { function fact(k) { if (k == 0) { return 1; "
+            "} return k * fact(k - 1); } return fact(n); }";
+        auto lexer    = JSLexer(source);
+        auto tokens   = lexer.scanTokens();
+        auto parser   = JSParser(std::move(tokens));
+        auto stmts    = parser.parse();
+        auto compiler = std::make_shared<BytecodeCompiler>();
+        CHECK_THROWS_WITH_AS(compiler->compile(stmts[0]),
+                             "Nested function fact is not supported.\n",
+                             std::runtime_error);
+    }
+    SUBCASE("testing compilation of short circuiting logical expressions") {
+        auto source = "function loop(n) { return loop(n); }\n var a = 0 || "
+                      "5;\n var b = false && loop(1);";
+        auto lexer    = JSLexer(source);
+        auto tokens   = lexer.scanTokens();
+        auto parser   = JSParser(std::move(tokens));
+        auto stmts    = parser.parse();
+        auto compiler = std::make_shared<BytecodeCompiler>();
+        for (auto& stmt : stmts) {
+            compiler->compile(stmt);
+        }
+        auto bc   = compiler->getBytecode();
+        auto pool = compiler->getConstantsPool();
+        auto vm   = VM(bc, pool);
+        REQUIRE_NOTHROW(vm.run());
+        CHECK(vm.resolveGlobal("a").getValue<JSNumber>() == 5.);
+        CHECK(vm.resolveGlobal("b").getValue<JSBoolean>() == false);
+    }
+}
+
+TEST_CASE("testing tiered execution") {
+    auto parse = [](const char* source) {
+        auto lexer  = JSLexer(source);
+        auto tokens = lexer.scanTokens();
+        auto parser = JSParser(std::move(tokens));
+        return parser.parse();
+    };
+    auto valueOf = [](ExecutionManager& manager, const std::string& name) {
+        return manager.getInterpreter().getValue(
+            JSToken(JSTokenKind::Identifier, name));
+    };
+    SUBCASE("test hot functions are promoted through the tiers") {
+        auto stmts = parse(
+            "function fib(n) { if (n < 2) { return n; } return fib(n - 1) + "
+            "fib(n - 2);}\n var res = 0;\n for (var i = 0; i < 8; i = i + 1) "
+            "{ res = res + fib(10); }");
+        auto manager = ExecutionManager(TierConfig{2, 1000, 5, 100000});
+        REQUIRE_NOTHROW(manager.run(stmts));
+        CHECK(valueOf(manager, "res").getValue<JSNumber>() == 440.);
+        auto* fib = static_cast<JSFuncDecl*>(stmts[0]);
+        CHECK(manager.getTier(fib) == Tier::Native);
+        // The first call is interpreted, its recursive calls promote fib
+        // and run fib(9) in the VM then the remaining calls as native code.
+        const auto& stats = manager.getStats();
+        CHECK(stats.bytecodePromotions == 1);
+        CHECK(stats.nativePromotions == 1);
+        CHECK(stats.failedPromotions == 0);
+        CHECK(stats.interpretedCalls == 1);
+        CHECK(stats.bytecodeCalls == 1);
+        CHECK(stats.nativeCalls == 8);
+    }
+    SUBCASE("test hot loops promote their function") {
+        auto stmts   = parse("function sum(n) { var s = 0; var i = 0; while (i "
+                               "< n) { s = s + i; i = i + 1; } return s; }\n "
+                               "var a = sum(100);\n var b = sum(10);");
+        auto manager = ExecutionManager(TierConfig{1000, 50, 1000, 100000});
+        REQUIRE_NOTHROW(manager.run(stmts));
+        CHECK(valueOf(manager, "a").getValue<JSNumber>() == 4950.);
+        CHECK(valueOf(manager, "b").getValue<JSNumber>() == 45.);
+        auto* sum = static_cast<JSFuncDecl*>(stmts[0]);
+        CHECK(manager.getTier(sum) == Tier::Bytecode);
+        CHECK(manager.getStats().bytecodeCalls == 1);
+    }
+    SUBCASE("test impure functions stay in the interpreter") {
+        auto stmts   = parse("var count = 0;\n function inc(n) { count = count "
+                               "+ n; return count; }\n for (var i = 0; i < 10; "
+                               "i = i + 1) { inc(1); }");
+        auto manager = ExecutionManager(TierConfig{1, 1, 1, 1});
+        REQUIRE_NOTHROW(manager.run(stmts));
+        CHECK(valueOf(manager, "count").getValue<JSNumber>() == 10.);
+        auto* inc = static_cast<JSFuncDecl*>(stmts[1]);
+        CHECK(manager.getTier(inc) == Tier::Interpreter);
+        CHECK(manager.getStats().interpretedCalls == 10);
+    }
+}
+
+TEST_CASE("testing sessions") {
+    auto session = Session();
+    auto value   = [&session](const char* name) {
+        auto& env     = session.getManager().getInterpreter().getEnvironment();
+        auto* binding = env.resolveBinding(name);
+        REQUIRE(binding != nullptr);
+        return binding->getValue<JSNumber>();
+    };
+    SUBCASE("evaluated sources share their state") {
+        session.eval("var x = 1;\n");
+        auto stats = session.eval("x = x + 1;\n");
+        CHECK(stats.reused == 1);
+        CHECK(stats.parsed == 1);
+        CHECK(value("x") == 2.);
+
+        CHECK_THROWS(session.eval("var = ;\n"));
+        session.eval("function inc(n) { return n + 1; } x = inc(x);\n");
+        CHECK(session.getStmts().size() == 4);
+        CHECK(value("x") == 3.);
+    }
+    SUBCASE("edits only parse and run the edited statements") {
+        std::string document = "function f(n) { return n + 1; }\n"
+                               "var a = f(1);\n"
+                               "var b = 10;\n";
+        auto stats = session.update(document);
+        CHECK(stats.reused == 0);
+        CHECK(stats.parsed == 3);
+        auto before = session.getStmts();
+
+        document.replace(document.find("10"), 2, "20");
+        stats = session.update(document);
+        CHECK(stats.reused == 2);
+        CHECK(stats.parsed == 1);
+        auto after = session.getStmts();
+        REQUIRE(after.size() == 3);
+        CHECK(after[0] == before[0]);
+        CHECK(after[1] == before[1]);
+        CHECK(after[2] != before[2]);
+        CHECK(value("a") == 2.);
+        CHECK(value("b") == 20.);
+
+        document.replace(document.find("n + 1"), 5, "n * 3");
+        stats = session.update(document);
+        CHECK(stats.reused == 2);
+        CHECK(stats.parsed == 1);
+        CHECK(session.getStmts()[1] == before[1]);
+        CHECK(value("a") == 2.);
+        session.eval("var c = f(2);\n");
+        CHECK(value("c") == 6.);
+    }
+    SUBCASE("runtime errors leave the session usable") {
+        session.eval("var g = 1;\n"
+                     "function fail(n) { var local = n; if (n > 0) { "
+                     "var inner = n; return local + missing; } return 0; }\n");
+        CHECK_THROWS(session.eval("g = fail(2);\n"));
+        auto& interpreter = session.getManager().getInterpreter();
+        auto& env         = interpreter.getEnvironment();
+        CHECK(env.getDepth() == 1);
+        CHECK(env.resolveBinding("local") == nullptr);
+        CHECK(env.resolveBinding("inner") == nullptr);
+        CHECK(interpreter.callDepth == 0);
+        CHECK(interpreter.activeFunction == nullptr);
+
+        session.eval("var h = g + 1;\n");
+        CHECK(env.resolveLocal("h") != nullptr);
+        CHECK(value("h") == 2.);
+        session.eval("g = fail(0);\n");
+        CHECK(value("g") == 0.);
+    }
+    SUBCASE("statements continued by an edit are parsed again") {
+        session.update("var d = 0;\nif (d == 1) { d = 1; }");
+        auto stats = session.update(
+            "var d = 0;\nif (d == 1) { d = 1; } else { d = 2; }");
+        CHECK(stats.reused == 1);
+        CHECK(stats.parsed == 1);
+        CHECK(value("d") == 2.);
+    }
+    SUBCASE("sources of edited statements are released") {
+        std::string document = "function f(n) { return n + 1; }\n"
+                               "var a = f(1);\n"
+                               "var b = 0;\n";
+        session.update(document);
+        for (auto i = 1; i <= 100; i++) {
+            auto begin = document.find("b = ") + 4;
+            document.replace(begin, document.find(';', begin) - begin,
+                             std::to_string(i));
+            session.update(document);
+        }
+        CHECK(session.getSourceCount() == 2);
+        CHECK(value("b") == 100.);
+
+        for (auto i = 1; i <= 100; i++) {
+            auto begin = document.find("return ") + 7;
+            document.replace(begin, document.find(';', begin) - begin,
+                             fmt::format("n * {}", i));
+            session.update(document);
+        }
+        CHECK(session.getSourceCount() <= 3);
+        session.eval("var c = f(2);\n");
+        CHECK(value("c") == 200.);
+        CHECK(value("a") == 2.);
+    }
 }
 
 TEST_CASE("testing bytecode virtual machine") {